@@ -7,6 +7,8 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
         util/QCameraCmdThread.cpp \
         util/QCameraQueue.cpp \
+        util/QCameraBufIndexMap.cpp \
+        util/QCameraThumbScaler.cpp \
         QCamera2Hal.cpp \
         QCamera2Factory.cpp
 
@@ -18,7 +20,9 @@ LOCAL_SRC_FILES += \
         HAL3/QCamera3Channel.cpp \
         HAL3/QCamera3VendorTags.cpp \
         HAL3/QCamera3PostProc.cpp \
-        HAL3/QCamera3CropRegionMapper.cpp
+        HAL3/QCamera3CropRegionMapper.cpp \
+        HAL3/QCamera3ResultBuilder.cpp \
+        HAL3/QCamera3RawUnpacker.cpp
 
 #HAL 1.0 source
 LOCAL_SRC_FILES += \
@@ -1141,6 +1141,8 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
 
     memset(m_channels, 0, sizeof(m_channels));
     memset(&mExifParams, 0, sizeof(mm_jpeg_exif_params_t));
+    memset(&mExifDebugParams, 0, sizeof(mm_jpeg_debug_exif_params_t));
+    mExifParams.debug_params = &mExifDebugParams;
 
     memset(m_BackendFileName, 0, QCAMERA_MAX_FILEPATH_LENGTH);
 
@@ -2275,6 +2277,7 @@ int QCamera2HardwareInterface::startPreview()
     ATRACE_CALL();
     int32_t rc = NO_ERROR;
     CDBG_HIGH("%s: E", __func__);
+    prefetchPreviewBufs();
     // start preview stream
     if (mParameters.isZSLMode() && mParameters.getRecordingHintValue() != true) {
         rc = startChannel(QCAMERA_CH_TYPE_ZSL);
@@ -2369,6 +2372,7 @@ int QCamera2HardwareInterface::startRecording()
         mParameters.updateRecordingHintValue(TRUE);
         rc = preparePreview();
         if (rc == NO_ERROR) {
+            prefetchPreviewBufs();
             rc = startChannel(QCAMERA_CH_TYPE_PREVIEW);
         }
     }
@@ -4198,6 +4202,8 @@ int QCamera2HardwareInterface::dump(int fd)
     dprintf(fd, "StoreMetaDataInFrame: %d \n", mStoreMetaDataInFrame);
     dprintf(fd, "\n Configuration: %s", mParameters.dump().string());
     dprintf(fd, "\n State Information: %s", m_stateMachine.dump().string());
+    dprintf(fd, "\n Memory Pool: %s", m_memoryPool.dump().string());
+    mm_camera_trace_dump(fd);
     dprintf(fd, "\n Camera HAL information End \n");
 
     /* send UPDATE_DEBUG_LEVEL to the backend so that they can read the
@@ -6266,6 +6272,33 @@ int32_t QCamera2HardwareInterface::preparePreview()
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : prefetchPreviewBufs
+ *
+ * DESCRIPTION: start allocating the buffers of all channels prepared for
+ *              preview in parallel, before the first of them starts. Called
+ *              once the preview window is known, preview buffers come from
+ *              it. Live snapshot channel is left out, it only starts on
+ *              takePicture and its buffers would be held through preview.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::prefetchPreviewBufs()
+{
+    const qcamera_ch_type_enum_t prefetchChannels[] = {
+        QCAMERA_CH_TYPE_ZSL, QCAMERA_CH_TYPE_PREVIEW, QCAMERA_CH_TYPE_VIDEO
+    };
+
+    for (size_t i = 0;
+            i < sizeof(prefetchChannels) / sizeof(prefetchChannels[0]); i++) {
+        if (m_channels[prefetchChannels[i]] != NULL) {
+            m_channels[prefetchChannels[i]]->prefetchBufs();
+        }
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : unpreparePreview
  *
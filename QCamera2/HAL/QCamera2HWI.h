@@ -418,6 +418,7 @@ private:
                                void *userData);
     int32_t preparePreview();
     void unpreparePreview();
+    void prefetchPreviewBufs();
     int32_t prepareRawStream(QCameraChannel *pChannel);
     QCameraChannel *getChannelByHandle(uint32_t channelHandle);
     mm_camera_buf_def_t *getSnapshotFrame(mm_camera_super_buf_t *recvd_frame);
@@ -568,6 +569,7 @@ private:
     uint32_t mDumpFrmCnt;  // frame dump count
     uint32_t mDumpSkipCnt; // frame skip count
     mm_jpeg_exif_params_t mExifParams;
+    mm_jpeg_debug_exif_params_t mExifDebugParams;
     qcamera_thermal_level_enum_t mThermalLevel;
     bool mCancelAutoFocus;
     bool m_HDRSceneEnabled;
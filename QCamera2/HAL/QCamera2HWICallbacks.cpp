@@ -1767,32 +1767,32 @@ void QCamera2HardwareInterface::metadata_stream_cb_routine(mm_camera_super_buf_t
 
     IF_META_AVAILABLE(cam_ae_exif_debug_t, ae_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_AE, pMetaData) {
-        pme->mExifParams.ae_debug_params = *ae_exif_debug_params;
-        pme->mExifParams.ae_debug_params_valid = TRUE;
+        pme->mExifDebugParams.ae_debug_params = *ae_exif_debug_params;
+        pme->mExifDebugParams.ae_debug_params_valid = TRUE;
     }
 
     IF_META_AVAILABLE(cam_awb_exif_debug_t, awb_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_AWB, pMetaData) {
-        pme->mExifParams.awb_debug_params = *awb_exif_debug_params;
-        pme->mExifParams.awb_debug_params_valid = TRUE;
+        pme->mExifDebugParams.awb_debug_params = *awb_exif_debug_params;
+        pme->mExifDebugParams.awb_debug_params_valid = TRUE;
     }
 
     IF_META_AVAILABLE(cam_af_exif_debug_t, af_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_AF, pMetaData) {
-        pme->mExifParams.af_debug_params = *af_exif_debug_params;
-        pme->mExifParams.af_debug_params_valid = TRUE;
+        pme->mExifDebugParams.af_debug_params = *af_exif_debug_params;
+        pme->mExifDebugParams.af_debug_params_valid = TRUE;
     }
 
     IF_META_AVAILABLE(cam_asd_exif_debug_t, asd_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_ASD, pMetaData) {
-        pme->mExifParams.asd_debug_params = *asd_exif_debug_params;
-        pme->mExifParams.asd_debug_params_valid = TRUE;
+        pme->mExifDebugParams.asd_debug_params = *asd_exif_debug_params;
+        pme->mExifDebugParams.asd_debug_params_valid = TRUE;
     }
 
     IF_META_AVAILABLE(cam_stats_buffer_exif_debug_t, stats_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_STATS, pMetaData) {
-        pme->mExifParams.stats_debug_params = *stats_exif_debug_params;
-        pme->mExifParams.stats_debug_params_valid = TRUE;
+        pme->mExifDebugParams.stats_debug_params = *stats_exif_debug_params;
+        pme->mExifDebugParams.stats_debug_params_valid = TRUE;
     }
 
     IF_META_AVAILABLE(uint32_t, led_mode, CAM_INTF_META_LED_MODE_OVERRIDE, pMetaData) {
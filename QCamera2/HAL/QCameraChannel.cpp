@@ -274,6 +274,33 @@ int32_t QCameraChannel::linkStream(QCameraChannel *ch, QCameraStream *stream)
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : prefetchBufs
+ *
+ * DESCRIPTION: start allocating the initial buffers of all streams of this
+ *              channel in the background. Called for every channel of a
+ *              session before the first one starts, so that allocations of
+ *              different channels overlap too. Streams pick the buffers up
+ *              in getBufs when their channel starts.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraChannel::prefetchBufs()
+{
+    if (m_bIsActive) {
+        // running streams already own their buffers
+        return;
+    }
+    for (size_t i = 0; i < mStreams.size(); i++) {
+        if ((mStreams[i] != NULL) &&
+                (m_handle == mStreams[i]->getChannelHandle())) {
+            mStreams[i]->prefetchBufs();
+        }
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : start
  *
@@ -327,6 +354,9 @@ int32_t QCameraChannel::start()
         if ((mStreams[i] != NULL) &&
                 (m_handle == mStreams[i]->getChannelHandle())) {
             mStreams[i]->start();
+            // no-op if already prefetched with the session, mm-camera-interface
+            // picks the buffers up stream by stream while starting the channel
+            mStreams[i]->prefetchBufs();
         }
     }
     rc = m_camOps->start_channel(m_camHandle, m_handle);
@@ -62,6 +62,7 @@ public:
     virtual int32_t processZoomDone(preview_stream_ops_t *previewWindow,
                                     cam_crop_data_t &crop_info);
     int32_t config();
+    void prefetchBufs();
     QCameraStream *getStreamByHandle(uint32_t streamHandle);
     uint32_t getMyHandle() const {return m_handle;};
     uint32_t getNumOfStreams() const {return (uint32_t) mStreams.size();};
@@ -33,6 +33,8 @@
 #include <string.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <stdlib.h>
+#include <cutils/properties.h>
 #include <utils/Errors.h>
 #include <utils/Trace.h>
 #include <utils/Log.h>
@@ -210,6 +212,7 @@ void QCameraMemory::reset()
         mMemInfo[i].fd = -1;
         mMemInfo[i].main_ion_fd = -1;
     }
+    mBufIndex.clear();
 
     return;
 }
@@ -412,13 +415,11 @@ int QCameraMemory::alloc(int count, size_t size, unsigned int heap_id,
                                              heap_id,
                                              size,
                                              m_bCached,
-                                             mStreamType,
                                              secure_mode);
             if (rc < 0) {
                 ALOGE("%s: Memory pool allocation failed", __func__);
                 for (int j = i-1; j >= 0; j--)
-                    mMemoryPool->releaseBuffer(mMemInfo[j],
-                                               mStreamType);
+                    mMemoryPool->releaseBuffer(mMemInfo[j]);
                 break;
             }
         }
@@ -443,7 +444,7 @@ void QCameraMemory::dealloc()
         if ( NULL == mMemoryPool ) {
             deallocOneBuffer(mMemInfo[i]);
         } else {
-            mMemoryPool->releaseBuffer(mMemInfo[i], mStreamType);
+            mMemoryPool->releaseBuffer(mMemInfo[i]);
         }
     }
 }
@@ -515,6 +516,7 @@ int QCameraMemory::allocOneBuffer(QCameraMemInfo &memInfo,
     memInfo.size = alloc.len;
     memInfo.cached = cached;
     memInfo.heap_id = heap_id;
+    memInfo.secure = secure_mode;
 
     ALOGD("%s : ION buffer %lx with size %d allocated",
             __func__, (unsigned long)memInfo.handle, alloc.len);
@@ -570,7 +572,15 @@ void QCameraMemory::deallocOneBuffer(QCameraMemInfo &memInfo)
  * RETURN     : None
  *==========================================================================*/
 QCameraMemoryPool::QCameraMemoryPool()
+    : mReleaseSeq(0)
 {
+    char value[PROPERTY_VALUE_MAX];
+
+    // byte budget of buffers kept for reuse, in MB
+    property_get("persist.camera.mem.pool.budget", value, "96");
+    int budget = atoi(value);
+    mBudget = (budget > 0) ? (size_t)budget * 1024U * 1024U : 0;
+    memset(&mStats, 0, sizeof(mStats));
     pthread_mutex_init(&mLock, NULL);
 }
 
@@ -590,65 +600,148 @@ QCameraMemoryPool::~QCameraMemoryPool()
     pthread_mutex_destroy(&mLock);
 }
 
+/*===========================================================================
+ * FUNCTION   : getSizeClass
+ *
+ * DESCRIPTION: get size class bucket of a buffer size
+ *
+ * PARAMETERS :
+ *   @size    : size of the buffer
+ *
+ * RETURN     : index of size class, smallest power of 2 not below size
+ *==========================================================================*/
+uint32_t QCameraMemoryPool::getSizeClass(size_t size)
+{
+    uint32_t cls = 0;
+
+    while ((cls < NUM_SIZE_CLASSES - 1) &&
+            (((size_t)1 << (MIN_SIZE_CLASS_SHIFT + cls)) < size)) {
+        cls++;
+    }
+    return cls;
+}
+
 /*===========================================================================
  * FUNCTION   : releaseBuffer
  *
- * DESCRIPTION: release one cached buffers
+ * DESCRIPTION: release one cached buffers, least recently released buffers
+ *              are freed once the pool goes over its byte budget
  *
  * PARAMETERS :
  *   @memInfo : reference to struct that stores additional memory allocation info
- *   @streamType: Type of stream the buffers belongs to
  *
  * RETURN     : none
  *==========================================================================*/
 void QCameraMemoryPool::releaseBuffer(
-        struct QCameraMemory::QCameraMemInfo &memInfo,
-        cam_stream_type_t streamType)
+        struct QCameraMemory::QCameraMemInfo &memInfo)
 {
+    PoolEntry entry;
+
     pthread_mutex_lock(&mLock);
 
-    mPools[streamType].push_back(memInfo);
+    entry.memInfo = memInfo;
+    entry.seq = mReleaseSeq++;
+    mBuckets[getSizeClass(memInfo.size)].push_back(entry);
+    mStats.bufsHeld++;
+    mStats.bytesHeld += memInfo.size;
+    trimLocked(mBudget);
 
     pthread_mutex_unlock(&mLock);
 }
 
 /*===========================================================================
- * FUNCTION   : clear
+ * FUNCTION   : trimLocked
  *
- * DESCRIPTION: clears all cached buffers
+ * DESCRIPTION: free least recently released buffers until the pool holds
+ *              no more than budget bytes. Each bucket is in release order,
+ *              so the LRU buffer is the oldest bucket front.
  *
- * PARAMETERS : none
+ * PARAMETERS :
+ *   @budget  : bytes allowed to be kept
  *
  * RETURN     : none
  *==========================================================================*/
-void QCameraMemoryPool::clear()
+void QCameraMemoryPool::trimLocked(size_t budget)
 {
-    pthread_mutex_lock(&mLock);
-
-    for (int i = CAM_STREAM_TYPE_DEFAULT; i < CAM_STREAM_TYPE_MAX; i++ ) {
-        List<struct QCameraMemory::QCameraMemInfo>::iterator it;
-        it = mPools[i].begin();
-        for( ; it != mPools[i].end() ; it++) {
-            QCameraMemory::deallocOneBuffer(*it);
+    while (mStats.bytesHeld > budget) {
+        int lru = -1;
+        for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
+            if (!mBuckets[i].empty() && ((lru < 0) ||
+                    ((*mBuckets[i].begin()).seq < (*mBuckets[lru].begin()).seq))) {
+                lru = i;
+            }
+        }
+        if (lru < 0) {
+            break;
         }
 
-        mPools[i].clear();
+        List<PoolEntry>::iterator it = mBuckets[lru].begin();
+        mStats.bufsHeld--;
+        mStats.bytesHeld -= (*it).memInfo.size;
+        mStats.evictions++;
+        QCameraMemory::deallocOneBuffer((*it).memInfo);
+        mBuckets[lru].erase(it);
     }
+}
 
+/*===========================================================================
+ * FUNCTION   : trim
+ *
+ * DESCRIPTION: free cached buffers over the given byte budget
+ *
+ * PARAMETERS :
+ *   @budget  : bytes allowed to be kept
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trim(size_t budget)
+{
+    pthread_mutex_lock(&mLock);
+    trimLocked(budget);
     pthread_mutex_unlock(&mLock);
 }
 
+/*===========================================================================
+ * FUNCTION   : trim
+ *
+ * DESCRIPTION: free cached buffers over the configured byte budget
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::trim()
+{
+    trim(mBudget);
+}
+
+/*===========================================================================
+ * FUNCTION   : clear
+ *
+ * DESCRIPTION: clears all cached buffers
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraMemoryPool::clear()
+{
+    trim(0);
+}
+
 /*===========================================================================
  * FUNCTION   : findBufferLocked
  *
- * DESCRIPTION: search for a appropriate cached buffer
+ * DESCRIPTION: search for a appropriate cached buffer. Best fit is taken
+ *              from the size class of the request or the next one up, and
+ *              never more than twice the requested size is handed out.
  *
  * PARAMETERS :
  *   @memInfo : reference to struct that stores additional memory allocation info
  *   @heap_id : type of heap
  *   @size    : size of the buffer
  *   @cached  : whether the buffer should be cached
- *   @streaType: type of stream this buffer belongs to
+ *   @is_secure : whether the buffer should be secure
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
@@ -656,28 +749,34 @@ void QCameraMemoryPool::clear()
  *==========================================================================*/
 int QCameraMemoryPool::findBufferLocked(
         struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
-        size_t size, bool cached, cam_stream_type_t streamType)
+        size_t size, bool cached, uint32_t is_secure)
 {
-    int rc = NAME_NOT_FOUND;
-
-    if (mPools[streamType].empty()) {
-        return NAME_NOT_FOUND;
-    }
-
-    List<struct QCameraMemory::QCameraMemInfo>::iterator it;
-    it = mPools[streamType].begin();
-    for ( ; it != mPools[streamType].end() ; it++) {
-        if ( ((*it).size >= size) &&
-            ((*it).heap_id == heap_id) &&
-            ((*it).cached == cached) ) {
-            memInfo = *it;
-            mPools[streamType].erase(it);
-            rc = NO_ERROR;
-            break;
+    uint32_t cls = getSizeClass(size);
+
+    for (uint32_t c = cls; (c <= cls + 1) && (c < NUM_SIZE_CLASSES); c++) {
+        List<PoolEntry>::iterator best = mBuckets[c].end();
+        List<PoolEntry>::iterator it = mBuckets[c].begin();
+        for ( ; it != mBuckets[c].end() ; it++) {
+            if ( ((*it).memInfo.size >= size) &&
+                ((*it).memInfo.size - size <= size) &&
+                ((*it).memInfo.heap_id == heap_id) &&
+                ((*it).memInfo.cached == cached) &&
+                ((*it).memInfo.secure == is_secure) &&
+                ((best == mBuckets[c].end()) ||
+                ((*it).memInfo.size < (*best).memInfo.size)) ) {
+                best = it;
+            }
+        }
+        if (best != mBuckets[c].end()) {
+            memInfo = (*best).memInfo;
+            mBuckets[c].erase(best);
+            mStats.bufsHeld--;
+            mStats.bytesHeld -= memInfo.size;
+            return NO_ERROR;
         }
     }
 
-    return rc;
+    return NAME_NOT_FOUND;
 }
 
 /*===========================================================================
@@ -691,7 +790,7 @@ int QCameraMemoryPool::findBufferLocked(
  *   @heap_id : type of heap
  *   @size    : size of the buffer
  *   @cached  : whether the buffer should be cached
- *   @streaType: type of stream this buffer belongs to
+ *   @secure_mode : whether the buffer should be secure
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
@@ -699,23 +798,76 @@ int QCameraMemoryPool::findBufferLocked(
  *==========================================================================*/
 int QCameraMemoryPool::allocateBuffer(
         struct QCameraMemory::QCameraMemInfo &memInfo, unsigned int heap_id,
-        size_t size, bool cached, cam_stream_type_t streamType,
-        uint32_t secure_mode)
+        size_t size, bool cached, uint32_t secure_mode)
 {
     int rc = NO_ERROR;
 
     pthread_mutex_lock(&mLock);
+    rc = findBufferLocked(memInfo, heap_id, size, cached, secure_mode);
+    if (NO_ERROR == rc) {
+        mStats.hits++;
+    } else {
+        mStats.misses++;
+    }
+    pthread_mutex_unlock(&mLock);
 
-    rc = findBufferLocked(memInfo, heap_id, size, cached, streamType);
-    if (NAME_NOT_FOUND == rc ) {
+    if (NAME_NOT_FOUND == rc) {
         CDBG_HIGH("%s : Buffer not found!", __func__);
+        // ion allocation is done outside of the pool lock so that
+        // concurrent stream allocations are not serialized on it
+        nsecs_t start = systemTime();
         rc = QCameraMemory::allocOneBuffer(memInfo, heap_id, size, cached,
                  secure_mode);
+        nsecs_t elapsed = systemTime() - start;
+
+        pthread_mutex_lock(&mLock);
+        mStats.allocCnt++;
+        mStats.allocTimeNs += elapsed;
+        if (elapsed > mStats.maxAllocTimeNs) {
+            mStats.maxAllocTimeNs = elapsed;
+        }
+        pthread_mutex_unlock(&mLock);
     }
 
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: dump memory pool statistics
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : string with pool statistics
+ *==========================================================================*/
+String8 QCameraMemoryPool::dump()
+{
+    String8 str("\n");
+    char s[128];
+
+    pthread_mutex_lock(&mLock);
+    snprintf(s, 128, "Pool hits: %u misses: %u evictions: %u\n",
+            mStats.hits, mStats.misses, mStats.evictions);
+    str += s;
+    snprintf(s, 128, "Pool held: %u bufs %zu bytes (budget %zu)\n",
+            mStats.bufsHeld, mStats.bytesHeld, mBudget);
+    str += s;
+    snprintf(s, 128, "Ion allocs: %u total %lld us max %lld us\n",
+            mStats.allocCnt, (long long)(mStats.allocTimeNs / 1000),
+            (long long)(mStats.maxAllocTimeNs / 1000));
+    str += s;
+    for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
+        if (!mBuckets[i].empty()) {
+            snprintf(s, 128, "  class %zu KB: %zu bufs\n",
+                    ((size_t)1 << (MIN_SIZE_CLASS_SHIFT + i)) / 1024U,
+                    mBuckets[i].size());
+            str += s;
+        }
+    }
     pthread_mutex_unlock(&mLock);
 
-    return rc;
+    return str;
 }
 
 /*===========================================================================
@@ -812,6 +964,9 @@ int QCameraHeapMemory::allocate(uint8_t count, size_t size, uint32_t isSecure)
         }
     }
     if (rc == 0) {
+        for (int i = 0; i < count; i++) {
+            mBufIndex.add(mPtr[i], i);
+        }
         mBufferCount = count;
     }
     traceLogAllocEnd((size * count));
@@ -856,6 +1011,9 @@ int QCameraHeapMemory::allocateMore(uint8_t count, size_t size)
             mPtr[i] = vaddr;
         }
     }
+    for (int i = mBufferCount; i < count + mBufferCount; i++) {
+        mBufIndex.add(mPtr[i], i);
+    }
     mBufferCount = (uint8_t)(mBufferCount + count);
     traceLogAllocEnd((size * count));
     return OK;
@@ -876,6 +1034,7 @@ void QCameraHeapMemory::deallocate()
         munmap(mPtr[i], mMemInfo[i].size);
         mPtr[i] = NULL;
     }
+    mBufIndex.clear();
     dealloc();
     mBufferCount = 0;
 }
@@ -949,17 +1108,10 @@ camera_memory_t *QCameraHeapMemory::getMemory(uint32_t /*index*/, bool /*metadat
 int QCameraHeapMemory::getMatchBufIndex(const void *opaque,
                                         bool metadata) const
 {
-    int index = -1;
     if (metadata) {
         return -1;
     }
-    for (int i = 0; i < mBufferCount; i++) {
-        if (mPtr[i] == opaque) {
-            index = i;
-            break;
-        }
-    }
-    return index;
+    return mBufIndex.find(opaque);
 }
 
 /*===========================================================================
@@ -1024,6 +1176,9 @@ int QCameraStreamMemory::allocate(uint8_t count, size_t size, uint32_t isSecure)
             mCameraMemory[i] = 0;
         } else {
             mCameraMemory[i] = mGetMemory(mMemInfo[i].fd, mMemInfo[i].size, 1, this);
+            if (mCameraMemory[i]) {
+                mBufIndex.add(mCameraMemory[i]->data, i);
+            }
         }
     }
     mBufferCount = count;
@@ -1054,6 +1209,9 @@ int QCameraStreamMemory::allocateMore(uint8_t count, size_t size)
 
     for (int i = mBufferCount; i < mBufferCount + count; i++) {
         mCameraMemory[i] = mGetMemory(mMemInfo[i].fd, mMemInfo[i].size, 1, this);
+        if (mCameraMemory[i]) {
+            mBufIndex.add(mCameraMemory[i]->data, i);
+        }
     }
     mBufferCount = (uint8_t)(mBufferCount + count);
     traceLogAllocEnd((size * count));
@@ -1076,6 +1234,7 @@ void QCameraStreamMemory::deallocate()
             mCameraMemory[i]->release(mCameraMemory[i]);
         mCameraMemory[i] = NULL;
     }
+    mBufIndex.clear();
     dealloc();
     mBufferCount = 0;
 }
@@ -1154,17 +1313,10 @@ camera_memory_t *QCameraStreamMemory::getMemory(uint32_t index,
 int QCameraStreamMemory::getMatchBufIndex(const void *opaque,
                                           bool metadata) const
 {
-    int index = -1;
     if (metadata) {
         return -1;
     }
-    for (int i = 0; i < mBufferCount; i++) {
-        if (mCameraMemory[i]->data == opaque) {
-            index = i;
-            break;
-        }
-    }
-    return index;
+    return mBufIndex.find(opaque);
 }
 
 /*===========================================================================
@@ -1300,13 +1452,16 @@ int QCameraVideoMemory::allocateMore(uint8_t count, size_t size)
             if (!mMetadata[i]) {
                 ALOGE("allocation of video metadata failed.");
                 for (int j = mBufferCount; j <= i-1; j ++) {
+                    mMetaIndex.remove(mMetadata[j]->data);
                     mMetadata[j]->release(mMetadata[j]);
+                    mBufIndex.remove(mCameraMemory[j]->data);
                     mCameraMemory[j]->release(mCameraMemory[j]);
                     mCameraMemory[j] = NULL;
                     deallocOneBuffer(mMemInfo[j]);;
                 }
                 return NO_MEMORY;
             }
+            mMetaIndex.add(mMetadata[i]->data, i);
             struct encoder_media_buffer_type * packet =
                     (struct encoder_media_buffer_type *)mMetadata[i]->data;
              //1     fd, 1 offset, 1 size, 1 color transform, 1 Timestamp  1 format
@@ -1353,10 +1508,12 @@ int QCameraVideoMemory::allocateMeta(uint8_t buf_cnt)
         if (!mMetadata[i]) {
             ALOGE("allocation of video metadata failed.");
             for (int j = (i - 1); j >= 0; j--) {
+                mMetaIndex.remove(mMetadata[j]->data);
                 mMetadata[j]->release(mMetadata[j]);
             }
             return NO_MEMORY;
         }
+        mMetaIndex.add(mMetadata[i]->data, i);
     }
     mMetaBufCount = buf_cnt;
     return rc;
@@ -1377,6 +1534,7 @@ void QCameraVideoMemory::deallocateMeta()
         mMetadata[i]->release(mMetadata[i]);
         mMetadata[i] = NULL;
     }
+    mMetaIndex.clear();
     mMetaBufCount = 0;
 }
 
@@ -1457,24 +1615,10 @@ camera_memory_t *QCameraVideoMemory::getMemory(uint32_t index,
 int QCameraVideoMemory::getMatchBufIndex(const void *opaque,
                                          bool metadata) const
 {
-    int index = -1;
-
     if (metadata) {
-        for (int i = 0; i < mMetaBufCount; i++) {
-            if (mMetadata[i]->data == opaque) {
-                index = i;
-                break;
-            }
-        }
-    } else {
-        for (int i = 0; i < mBufferCount; i++) {
-            if (mCameraMemory[i]->data == opaque) {
-                index = i;
-                break;
-            }
-        }
+        return mMetaIndex.find(opaque);
     }
-    return index;
+    return mBufIndex.find(opaque);
 }
 
 /*===========================================================================
@@ -1759,6 +1903,9 @@ int QCameraGrallocMemory::allocate(uint8_t count, size_t /*size*/,
                     (size_t)mPrivateHandle[cnt]->size,
                     1,
                     (void *)this);
+        if (mCameraMemory[cnt]) {
+            mBufIndex.add(mCameraMemory[cnt]->data, cnt);
+        }
         CDBG_HIGH("%s: idx = %d, fd = %d, size = %d, offset = %d",
               __func__, cnt, mPrivateHandle[cnt]->fd,
               mPrivateHandle[cnt]->size,
@@ -1835,6 +1982,7 @@ void QCameraGrallocMemory::deallocate()
         mLocalFlag[cnt] = BUFFER_NOT_OWNED;
         CDBG_HIGH("put buffer %d successfully", cnt);
     }
+    mBufIndex.clear();
     mBufferCount = 0;
     CDBG(" %s : X ",__FUNCTION__);
 }
@@ -1916,17 +2064,10 @@ camera_memory_t *QCameraGrallocMemory::getMemory(uint32_t index,
 int QCameraGrallocMemory::getMatchBufIndex(const void *opaque,
                                            bool metadata) const
 {
-    int index = -1;
     if (metadata) {
         return -1;
     }
-    for (int i = 0; i < mBufferCount; i++) {
-        if (mCameraMemory[i]->data == opaque) {
-            index = i;
-            break;
-        }
-    }
-    return index;
+    return mBufIndex.find(opaque);
 }
 
 /*===========================================================================
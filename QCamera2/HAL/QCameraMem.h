@@ -33,6 +33,8 @@
 #include <hardware/camera.h>
 #include <utils/Mutex.h>
 #include <utils/List.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
 #ifndef CAM_MSM8974
 #include <qdMetaData.h>
 #endif
@@ -42,6 +44,7 @@ extern "C" {
 #include <linux/msm_ion.h>
 #include <mm_camera_interface.h>
 }
+#include "QCameraBufIndexMap.h"
 
 namespace qcamera {
 
@@ -106,6 +109,7 @@ protected:
         size_t size;
         bool cached;
         unsigned int heap_id;
+        uint32_t secure;
     };
 
     int alloc(int count, size_t size, unsigned int heap_id,
@@ -122,6 +126,8 @@ protected:
     QCameraMemoryPool *mMemoryPool;
     cam_stream_type_t mStreamType;
     cam_stream_buf_type mBufType;
+    // opaque ptr handed out for each buffer -> buffer index
+    QCameraBufIndexMap mBufIndex;
 };
 
 class QCameraMemoryPool {
@@ -133,18 +139,49 @@ public:
 
     int allocateBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
             unsigned int heap_id, size_t size, bool cached,
-            cam_stream_type_t streamType, uint32_t is_secure);
-    void releaseBuffer(struct QCameraMemory::QCameraMemInfo &memInfo,
-            cam_stream_type_t streamType);
+            uint32_t is_secure);
+    void releaseBuffer(struct QCameraMemory::QCameraMemInfo &memInfo);
     void clear();
+    void trim();
+    void trim(size_t budget);
+    android::String8 dump();
 
 protected:
 
+    // Buffers are bucketed by power of 2 size class, starting at one page.
+    // Buckets are shared by all stream types, a buffer is reused for any
+    // request with the same heap/cached/secure attributes.
+    enum {
+        MIN_SIZE_CLASS_SHIFT = 12,
+        NUM_SIZE_CLASSES = 20,
+    };
+
+    struct PoolEntry {
+        QCameraMemory::QCameraMemInfo memInfo;
+        uint64_t seq; // release order, for LRU trimming
+    };
+
+    struct PoolStats {
+        uint32_t hits;
+        uint32_t misses;
+        uint32_t evictions;
+        uint32_t bufsHeld;
+        size_t bytesHeld;
+        uint32_t allocCnt;
+        nsecs_t allocTimeNs;
+        nsecs_t maxAllocTimeNs;
+    };
+
+    static uint32_t getSizeClass(size_t size);
     int findBufferLocked(struct QCameraMemory::QCameraMemInfo &memInfo,
             unsigned int heap_id, size_t size, bool cached,
-            cam_stream_type_t streamType);
+            uint32_t is_secure);
+    void trimLocked(size_t budget);
 
-    android::List<QCameraMemory::QCameraMemInfo> mPools[CAM_STREAM_TYPE_MAX];
+    android::List<PoolEntry> mBuckets[NUM_SIZE_CLASSES];
+    uint64_t mReleaseSeq;
+    size_t mBudget;
+    PoolStats mStats;
     pthread_mutex_t mLock;
 };
 
@@ -212,6 +249,7 @@ public:
 private:
     camera_memory_t *mMetadata[MM_CAMERA_MAX_NUM_FRAMES];
     uint8_t mMetaBufCount;
+    QCameraBufIndexMap mMetaIndex;
 };
 
 
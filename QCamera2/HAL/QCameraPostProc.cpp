@@ -83,11 +83,15 @@ QCameraPostProcessor::QCameraPostProcessor(QCamera2HardwareInterface *cam_ctrl)
       m_JpegOutputMemCount(0),
       mNewJpegSessionNeeded(true),
       m_bufCountPPQ(0),
-      m_PPindex(0)
+      m_PPindex(0),
+      mUseThumbScaler(false),
+      m_pThumbMem(NULL)
 {
     memset(&mJpegHandle, 0, sizeof(mJpegHandle));
     memset(&m_pJpegOutputMem, 0, sizeof(m_pJpegOutputMem));
     memset(mPPChannels, 0, sizeof(mPPChannels));
+    memset(&m_thumbDim, 0, sizeof(m_thumbDim));
+    memset(&m_thumbOffset, 0, sizeof(m_thumbOffset));
     m_DataMem = NULL;
 }
 
@@ -107,6 +111,7 @@ QCameraPostProcessor::~QCameraPostProcessor()
         delete m_pJpegExifObj;
         m_pJpegExifObj = NULL;
     }
+    releaseThumbMem();
     for (int8_t i = 0; i < mTotalNumReproc; i++) {
         QCameraChannel *pChannel = mPPChannels[i];
         if ( pChannel != NULL ) {
@@ -157,8 +162,25 @@ int32_t QCameraPostProcessor::init(jpeg_encode_callback_t jpeg_cb, void *user_da
     }
 
     m_dataProcTh.launch(dataProcessRoutine, this);
+    m_saveProcTh.setDrainMode(true);
     m_saveProcTh.launch(dataSaveRoutine, this);
 
+    // thumbnails without a postview stream are scaled from the main frame,
+    // unless the encoder takes them from the main image regardless
+    char prop[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.thumb.swscale", prop, "1");
+    mUseThumbScaler = (atoi(prop) > 0);
+    if (mUseThumbScaler && (mJpegHandle.thumb_from_main != NULL) &&
+            mJpegHandle.thumb_from_main()) {
+        CDBG_HIGH("%s: encoder thumbnails come from the main image, "
+                "not scaling them", __func__);
+        mUseThumbScaler = false;
+    }
+    if (mUseThumbScaler) {
+        property_get("persist.camera.thumb.scale.threads", prop, "4");
+        mThumbScaler.init((uint32_t)atoi(prop));
+    }
+
     m_parent->mParameters.setReprocCount();
     m_bInited = TRUE;
     return NO_ERROR;
@@ -180,6 +202,8 @@ int32_t QCameraPostProcessor::deinit()
     if (m_bInited == TRUE) {
         m_dataProcTh.exit();
         m_saveProcTh.exit();
+        mThumbScaler.deinit();
+        releaseThumbMem();
 
         if(mJpegClientHandle > 0) {
             int rc = mJpegHandle.close(mJpegClientHandle);
@@ -509,6 +533,7 @@ int32_t QCameraPostProcessor::getJpegEncodingConfig(mm_jpeg_encode_params_t& enc
         }
     }
 
+    releaseThumbMem();
     if (m_bThumbnailNeeded == TRUE) {
         bool need_thumb_rotate = true;
         uint32_t jpeg_rotation = m_parent->mParameters.getJpegRotation();
@@ -562,6 +587,36 @@ int32_t QCameraPostProcessor::getJpegEncodingConfig(mm_jpeg_encode_params_t& enc
             encode_parm.thumb_dim.dst_dim.height = tmp_dim.width;
         }
         encode_parm.thumb_dim.crop = crop;
+
+        // scale the thumbnail of every main buffer into a buffer of its own
+        // instead of having the encoder shrink the whole frame. The main
+        // buffers stay registered behind the scaled ones, so a frame the
+        // scaler fails on still gets its thumbnail from the encoder.
+        if ((thumb_stream == main_stream) && mUseThumbScaler &&
+                (CAM_FORMAT_YUV_420_NV21 == img_fmt_thumb ||
+                CAM_FORMAT_YUV_420_NV12 == img_fmt_thumb) &&
+                (encode_parm.num_tmb_bufs == encode_parm.num_src_bufs) &&
+                (2 * encode_parm.num_src_bufs <= MM_JPEG_MAX_BUF) &&
+                (allocateThumbMem(encode_parm.thumb_dim.dst_dim,
+                encode_parm.num_src_bufs) == NO_ERROR)) {
+            for (uint32_t i = 0; i < encode_parm.num_src_bufs; i++) {
+                uint32_t j = encode_parm.num_src_bufs + i;
+                encode_parm.src_thumb_buf[j] = encode_parm.src_thumb_buf[i];
+                encode_parm.src_thumb_buf[j].index = j;
+                encode_parm.src_thumb_buf[i].index = i;
+                encode_parm.src_thumb_buf[i].buf_size = m_thumbOffset.frame_len;
+                encode_parm.src_thumb_buf[i].buf_vaddr =
+                        (uint8_t *)m_pThumbMem->getPtr(i);
+                encode_parm.src_thumb_buf[i].fd = m_pThumbMem->getFd(i);
+                encode_parm.src_thumb_buf[i].format = MM_JPEG_FMT_YUV;
+                encode_parm.src_thumb_buf[i].offset = m_thumbOffset;
+            }
+            encode_parm.num_tmb_bufs = 2 * encode_parm.num_src_bufs;
+            encode_parm.thumb_dim.src_dim = m_thumbDim;
+            memset(&encode_parm.thumb_dim.crop, 0, sizeof(cam_rect_t));
+            encode_parm.thumb_dim.crop.width = m_thumbDim.width;
+            encode_parm.thumb_dim.crop.height = m_thumbDim.height;
+        }
     }
 
     encode_parm.num_dst_bufs = 1;
@@ -609,11 +664,124 @@ int32_t QCameraPostProcessor::getJpegEncodingConfig(mm_jpeg_encode_params_t& enc
 
 on_error:
     FREE_JPEG_OUTPUT_BUFFER(m_pJpegOutputMem, m_JpegOutputMemCount);
+    releaseThumbMem();
 
     CDBG("%s : X with error %d", __func__, ret);
     return ret;
 }
 
+/*===========================================================================
+ * FUNCTION   : allocateThumbMem
+ *
+ * DESCRIPTION: allocate the buffers thumbnails are scaled into
+ *
+ * PARAMETERS :
+ *   @dim     : thumbnail dimension, before jpeg rotation
+ *   @count   : number of buffers, one per main stream buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraPostProcessor::allocateThumbMem(const cam_dimension_t &dim,
+        uint32_t count)
+{
+    if ((dim.width <= 0) || (dim.height <= 0) || (count == 0) ||
+            (count > MM_JPEG_MAX_BUF)) {
+        return BAD_VALUE;
+    }
+
+    cam_frame_len_offset_t offset;
+    QCameraThumbScaler::getFrameOffset(dim, offset);
+    m_pThumbMem = new QCameraHeapMemory(QCAMERA_ION_USE_CACHE);
+    if (m_pThumbMem == NULL) {
+        ALOGE("%s: Unable to allocate thumbnail memory object", __func__);
+        return NO_MEMORY;
+    }
+    int rc = m_pThumbMem->allocate((uint8_t)count, offset.frame_len,
+            NON_SECURE);
+    if (rc < 0) {
+        ALOGE("%s: Failed to allocate %u thumbnail buffers", __func__, count);
+        delete m_pThumbMem;
+        m_pThumbMem = NULL;
+        return NO_MEMORY;
+    }
+    m_thumbDim = dim;
+    m_thumbOffset = offset;
+    CDBG_HIGH("%s: %u thumbnail buffers of %dx%d", __func__, count,
+            dim.width, dim.height);
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseThumbMem
+ *
+ * DESCRIPTION: free the scaled thumbnail buffers
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPostProcessor::releaseThumbMem()
+{
+    if (m_pThumbMem != NULL) {
+        m_pThumbMem->deallocate();
+        delete m_pThumbMem;
+        m_pThumbMem = NULL;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : scaleThumbnail
+ *
+ * DESCRIPTION: scale the thumbnail of a main frame into the thumbnail
+ *              buffer of the same index
+ *
+ * PARAMETERS :
+ *   @main_stream : main stream
+ *   @main_frame  : main frame
+ *   @crop        : crop of the main frame
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraPostProcessor::scaleThumbnail(QCameraStream *main_stream,
+        mm_camera_buf_def_t *main_frame, const cam_rect_t &crop)
+{
+    ATRACE_CALL();
+    if ((m_pThumbMem == NULL) ||
+            (main_frame->buf_idx >= m_pThumbMem->getCnt())) {
+        ALOGE("%s: No thumbnail buffer for frame %u", __func__,
+                main_frame->buf_idx);
+        return BAD_VALUE;
+    }
+
+    cam_dimension_t main_dim;
+    cam_frame_len_offset_t main_offset;
+    memset(&main_dim, 0, sizeof(cam_dimension_t));
+    memset(&main_offset, 0, sizeof(cam_frame_len_offset_t));
+    main_stream->getFrameDimension(main_dim);
+    main_stream->getFrameOffset(main_offset);
+
+    QCameraMemory *memObj = (QCameraMemory *)main_frame->mem_info;
+    if (memObj != NULL) {
+        memObj->cleanInvalidateCache(main_frame->buf_idx);
+    }
+
+    thumb_scale_image_t src, dst;
+    QCameraThumbScaler::mapImage((uint8_t *)main_frame->buffer, main_dim,
+            main_offset, src);
+    QCameraThumbScaler::mapImage(
+            (uint8_t *)m_pThumbMem->getPtr(main_frame->buf_idx), m_thumbDim,
+            m_thumbOffset, dst);
+    int32_t rc = mThumbScaler.scale(src, &crop, dst, 0);
+    if (rc == NO_ERROR) {
+        m_pThumbMem->cleanCache(main_frame->buf_idx);
+    }
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : sendEvtNotify
  *
@@ -2037,6 +2205,23 @@ int32_t QCameraPostProcessor::encodeData(qcamera_jpeg_data_t *jpeg_job_data,
         thumb_stream->getFrameDimension(src_dim);
         jpg_job.encode_job.thumb_dim.src_dim = src_dim;
 
+        uint32_t thumb_base = 0;
+        if ((m_pThumbMem != NULL) && (thumb_frame == main_frame)) {
+            // the session takes thumbnails from the scaled buffers, or has
+            // the encoder shrink the main buffer registered after them
+            if (scaleThumbnail(main_stream, main_frame, crop) == NO_ERROR) {
+                jpg_job.encode_job.thumb_dim.src_dim = m_thumbDim;
+                crop.left = 0;
+                crop.top = 0;
+                crop.width = m_thumbDim.width;
+                crop.height = m_thumbDim.height;
+            } else {
+                ALOGE("%s: error scaling thumbnail, encoder scales it instead",
+                        __func__);
+                thumb_base = m_pThumbMem->getCnt();
+            }
+        }
+
         // crop is the same if frame is the same
         if (thumb_frame != main_frame) {
             crop.left = 0;
@@ -2057,7 +2242,7 @@ int32_t QCameraPostProcessor::encodeData(qcamera_jpeg_data_t *jpeg_job_data,
 
         jpg_job.encode_job.thumb_dim.crop = crop;
         if (thumb_frame != NULL) {
-            jpg_job.encode_job.thumb_index = thumb_frame->buf_idx;
+            jpg_job.encode_job.thumb_index = thumb_base + thumb_frame->buf_idx;
         }
         CDBG_HIGH("%s, thumbnail src w/h (%dx%d), dst w/h (%dx%d)", __func__,
             jpg_job.encode_job.thumb_dim.src_dim.width,
@@ -2093,37 +2278,41 @@ int32_t QCameraPostProcessor::encodeData(qcamera_jpeg_data_t *jpeg_job_data,
                 jpg_job.encode_job.cam_exif_params.cam_3a_params;
        }
 
-       /* Save a copy of 3A debug params */
-        jpg_job.encode_job.p_metadata->is_statsdebug_ae_params_valid =
-            jpg_job.encode_job.cam_exif_params.ae_debug_params_valid;
-        jpg_job.encode_job.p_metadata->is_statsdebug_awb_params_valid =
-            jpg_job.encode_job.cam_exif_params.awb_debug_params_valid;
-        jpg_job.encode_job.p_metadata->is_statsdebug_af_params_valid =
-            jpg_job.encode_job.cam_exif_params.af_debug_params_valid;
-        jpg_job.encode_job.p_metadata->is_statsdebug_asd_params_valid =
-            jpg_job.encode_job.cam_exif_params.asd_debug_params_valid;
-        jpg_job.encode_job.p_metadata->is_statsdebug_stats_params_valid =
-            jpg_job.encode_job.cam_exif_params.stats_debug_params_valid;
-
-        if (jpg_job.encode_job.cam_exif_params.ae_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_ae_data =
-                jpg_job.encode_job.cam_exif_params.ae_debug_params;
-        }
-        if (jpg_job.encode_job.cam_exif_params.awb_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_awb_data =
-                jpg_job.encode_job.cam_exif_params.awb_debug_params;
-        }
-        if (jpg_job.encode_job.cam_exif_params.af_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_af_data =
-                jpg_job.encode_job.cam_exif_params.af_debug_params;
-        }
-        if (jpg_job.encode_job.cam_exif_params.asd_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_asd_data =
-                jpg_job.encode_job.cam_exif_params.asd_debug_params;
-        }
-        if (jpg_job.encode_job.cam_exif_params.stats_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_stats_buffer_data =
-                jpg_job.encode_job.cam_exif_params.stats_debug_params;
+        /* Save a copy of 3A debug params */
+        mm_jpeg_debug_exif_params_t *debug_params =
+            jpg_job.encode_job.cam_exif_params.debug_params;
+        if (NULL != debug_params) {
+            jpg_job.encode_job.p_metadata->is_statsdebug_ae_params_valid =
+                debug_params->ae_debug_params_valid;
+            jpg_job.encode_job.p_metadata->is_statsdebug_awb_params_valid =
+                debug_params->awb_debug_params_valid;
+            jpg_job.encode_job.p_metadata->is_statsdebug_af_params_valid =
+                debug_params->af_debug_params_valid;
+            jpg_job.encode_job.p_metadata->is_statsdebug_asd_params_valid =
+                debug_params->asd_debug_params_valid;
+            jpg_job.encode_job.p_metadata->is_statsdebug_stats_params_valid =
+                debug_params->stats_debug_params_valid;
+
+            if (debug_params->ae_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_ae_data =
+                    debug_params->ae_debug_params;
+            }
+            if (debug_params->awb_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_awb_data =
+                    debug_params->awb_debug_params;
+            }
+            if (debug_params->af_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_af_data =
+                    debug_params->af_debug_params;
+            }
+            if (debug_params->asd_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_asd_data =
+                    debug_params->asd_debug_params;
+            }
+            if (debug_params->stats_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_stats_buffer_data =
+                    debug_params->stats_debug_params;
+            }
         }
     }
 
@@ -2343,69 +2532,74 @@ void *QCameraPostProcessor::dataSaveRoutine(void *data)
             {
                 CDBG_HIGH("%s: Do next job, active is %d", __func__, is_active);
 
+                // drain mode: one wakeup handles every queued jpeg
                 qcamera_jpeg_evt_payload_t *job_data = (qcamera_jpeg_evt_payload_t *) pme->m_inputSaveQ.dequeue();
                 if (job_data == NULL) {
-                    ALOGE("%s: Invalid jpeg event data", __func__);
+                    // already handled by the previous drain
+                    CDBG("%s: No pending jpeg event data", __func__);
                     continue;
                 }
 
-                pme->m_ongoingJpegQ.flushNodes(matchJobId, (void*)&job_data->jobId);
-
-                CDBG_HIGH("[KPI Perf] %s : jpeg job %d", __func__, job_data->jobId);
+                while (NULL != job_data) {
+                    pme->m_ongoingJpegQ.flushNodes(matchJobId, (void*)&job_data->jobId);
+
+                    CDBG_HIGH("[KPI Perf] %s : jpeg job %d", __func__, job_data->jobId);
+
+                    if (is_active == TRUE) {
+                        memset(saveName, '\0', sizeof(saveName));
+                        snprintf(saveName,
+                                 sizeof(saveName),
+                                 QCameraPostProcessor::STORE_LOCATION,
+                                 pme->mSaveFrmCnt);
+
+                        int file_fd = open(saveName, O_RDWR | O_CREAT, 0655);
+                        if (file_fd >= 0) {
+                            ssize_t written_len = write(file_fd, job_data->out_data.buf_vaddr,
+                                    job_data->out_data.buf_filled_len);
+                            if ((ssize_t)job_data->out_data.buf_filled_len != written_len) {
+                                ALOGE("%s: Failed save complete data %d bytes "
+                                      "written instead of %d bytes!",
+                                      __func__, written_len,
+                                      job_data->out_data.buf_filled_len);
+                            } else {
+                                CDBG_HIGH("%s: written number of bytes %d\n",
+                                    __func__, written_len);
+                            }
 
-                if (is_active == TRUE) {
-                    memset(saveName, '\0', sizeof(saveName));
-                    snprintf(saveName,
-                             sizeof(saveName),
-                             QCameraPostProcessor::STORE_LOCATION,
-                             pme->mSaveFrmCnt);
-
-                    int file_fd = open(saveName, O_RDWR | O_CREAT, 0655);
-                    if (file_fd >= 0) {
-                        ssize_t written_len = write(file_fd, job_data->out_data.buf_vaddr,
-                                job_data->out_data.buf_filled_len);
-                        if ((ssize_t)job_data->out_data.buf_filled_len != written_len) {
-                            ALOGE("%s: Failed save complete data %d bytes "
-                                  "written instead of %d bytes!",
-                                  __func__, written_len,
-                                  job_data->out_data.buf_filled_len);
+                            close(file_fd);
                         } else {
-                            CDBG_HIGH("%s: written number of bytes %d\n",
-                                __func__, written_len);
+                            ALOGE("%s: fail t open file for saving", __func__);
                         }
+                        pme->mSaveFrmCnt++;
 
-                        close(file_fd);
-                    } else {
-                        ALOGE("%s: fail t open file for saving", __func__);
-                    }
-                    pme->mSaveFrmCnt++;
-
-                    camera_memory_t* jpeg_mem = pme->m_parent->mGetMemory(-1,
-                                                         strlen(saveName),
-                                                         1,
-                                                         pme->m_parent->mCallbackCookie);
-                    if (NULL == jpeg_mem) {
-                        ret = NO_MEMORY;
-                        ALOGE("%s : getMemory for jpeg, ret = NO_MEMORY", __func__);
-                        goto end;
+                        camera_memory_t* jpeg_mem = pme->m_parent->mGetMemory(-1,
+                                                             strlen(saveName),
+                                                             1,
+                                                             pme->m_parent->mCallbackCookie);
+                        if (NULL == jpeg_mem) {
+                            ret = NO_MEMORY;
+                            ALOGE("%s : getMemory for jpeg, ret = NO_MEMORY", __func__);
+                            goto end;
+                        }
+                        memcpy(jpeg_mem->data, saveName, strlen(saveName));
+
+                        CDBG_HIGH("%s : Calling upperlayer callback to store JPEG image", __func__);
+                        qcamera_release_data_t release_data;
+                        memset(&release_data, 0, sizeof(qcamera_release_data_t));
+                        release_data.data = jpeg_mem;
+                        release_data.unlinkFile = true;
+                        CDBG_HIGH("[KPI Perf] %s: PROFILE_JPEG_CB ",__func__);
+                        ret = pme->sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
+                                            jpeg_mem,
+                                            0,
+                                            NULL,
+                                            &release_data);
                     }
-                    memcpy(jpeg_mem->data, saveName, strlen(saveName));
-
-                    CDBG_HIGH("%s : Calling upperlayer callback to store JPEG image", __func__);
-                    qcamera_release_data_t release_data;
-                    memset(&release_data, 0, sizeof(qcamera_release_data_t));
-                    release_data.data = jpeg_mem;
-                    release_data.unlinkFile = true;
-                    CDBG_HIGH("[KPI Perf] %s: PROFILE_JPEG_CB ",__func__);
-                    ret = pme->sendDataNotify(CAMERA_MSG_COMPRESSED_IMAGE,
-                                        jpeg_mem,
-                                        0,
-                                        NULL,
-                                        &release_data);
-                }
 
 end:
-                free(job_data);
+                    free(job_data);
+                    job_data = (qcamera_jpeg_evt_payload_t *) pme->m_inputSaveQ.dequeue();
+                }
             }
             break;
         case CAMERA_CMD_TYPE_EXIT:
@@ -2501,6 +2695,7 @@ void *QCameraPostProcessor::dataProcessRoutine(void *data)
                 // free jpeg out buf and exif obj
                 FREE_JPEG_OUTPUT_BUFFER(pme->m_pJpegOutputMem,
                     pme->m_JpegOutputMemCount);
+                pme->releaseThumbMem();
 
                 if (pme->m_pJpegExifObj != NULL) {
                     delete pme->m_pJpegExifObj;
@@ -35,6 +35,7 @@ extern "C" {
 #include <mm_jpeg_interface.h>
 }
 #include "QCamera2HWI.h"
+#include "QCameraThumbScaler.h"
 
 #define MAX_JPEG_BURST 2
 #define CAM_PP_CHANNEL_MAX 8
@@ -181,6 +182,11 @@ private:
     int32_t doReprocess();
     int32_t stopCapture();
 
+    int32_t allocateThumbMem(const cam_dimension_t &dim, uint32_t count);
+    void releaseThumbMem();
+    int32_t scaleThumbnail(QCameraStream *main_stream,
+            mm_camera_buf_def_t *main_frame, const cam_rect_t &crop);
+
 private:
     QCamera2HardwareInterface *m_parent;
     jpeg_encode_callback_t     mJpegCB;
@@ -219,6 +225,13 @@ private:
     Vector<mm_camera_buf_def_t *> m_InputMetadata; // store input metadata buffers for AOST cases
     size_t m_PPindex;                   // counter for each incoming AOST buffer
 
+    QCameraThumbScaler mThumbScaler;    // scales thumbnails from main frames
+    bool mUseThumbScaler;
+    QCameraHeapMemory *m_pThumbMem;     // scaled thumbnails, one per main buffer,
+                                        // registered ahead of the main buffers
+    cam_dimension_t m_thumbDim;
+    cam_frame_len_offset_t m_thumbOffset;
+
 public:
     cam_dimension_t m_dst_dim;
 };
@@ -400,8 +400,8 @@ int32_t QCameraStateMachine::procEvtPreviewStoppedState(qcamera_sm_evt_enum_t ev
             bool needRestart = false;
             rc = m_parent->updateParameters((char*)payload, needRestart);
             if (needRestart) {
-                // Clear memory pools
-                m_parent->m_memoryPool.clear();
+                // Trim memory pools, buffers within budget are reused on restart
+                m_parent->m_memoryPool.trim();
             }
             if (rc == NO_ERROR) {
                 rc = m_parent->commitParameterChanges();
@@ -745,8 +745,8 @@ int32_t QCameraStateMachine::procEvtPreviewReadyState(qcamera_sm_evt_enum_t evt,
                 if (needRestart) {
                     // need restart preview for parameters to take effect
                     m_parent->unpreparePreview();
-                    // Clear memory pools
-                    m_parent->m_memoryPool.clear();
+                    // Trim memory pools, buffers within budget are reused on restart
+                    m_parent->m_memoryPool.trim();
                     // commit parameter changes to server
                     m_parent->commitParameterChanges();
                     // prepare preview again
@@ -1069,8 +1069,8 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
                     // need restart preview for parameters to take effect
                     // stop preview
                     m_parent->stopPreview();
-                    // Clear memory pools
-                    m_parent->m_memoryPool.clear();
+                    // Trim memory pools, buffers within budget are reused on restart
+                    m_parent->m_memoryPool.trim();
                     // commit parameter changes to server
                     m_parent->commitParameterChanges();
                     // start preview again
@@ -1287,8 +1287,8 @@ int32_t QCameraStateMachine::procEvtPreviewingState(qcamera_sm_evt_enum_t evt,
             if (CAMERA_CMD_LONGSHOT_ON == cmd_payload->cmd) {
                 if (QCAMERA_SM_EVT_RESTART_PERVIEW == cmd_payload->arg1) {
                     m_parent->stopPreview();
-                    // Clear memory pools
-                    m_parent->m_memoryPool.clear();
+                    // Trim memory pools, buffers within budget are reused on restart
+                    m_parent->m_memoryPool.trim();
                     // start preview again
                     rc = m_parent->preparePreview();
                     if (rc == NO_ERROR) {
@@ -2816,8 +2816,8 @@ int32_t QCameraStateMachine::procEvtPreviewPicTakingState(qcamera_sm_evt_enum_t
                     // need restart preview for parameters to take effect
                     // stop preview
                     m_parent->stopPreview();
-                    // Clear memory pools
-                    m_parent->m_memoryPool.clear();
+                    // Trim memory pools, buffers within budget are reused on restart
+                    m_parent->m_memoryPool.trim();
                     // commit parameter changes to server
                     m_parent->commitParameterChanges();
                     // start preview again
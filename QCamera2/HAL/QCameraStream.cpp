@@ -35,9 +35,14 @@
 #include "QCameraStream.h"
 
 #define CAMERA_MIN_ALLOCATED_BUFFERS     3
+#define CAMERA_DEFAULT_ALLOC_WORKERS     3
 
 namespace qcamera {
 
+pthread_mutex_t QCameraStream::sAllocLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t QCameraStream::sAllocCond = PTHREAD_COND_INITIALIZER;
+uint32_t QCameraStream::sAllocActive = 0;
+
 /*===========================================================================
  * FUNCTION   : get_bufs
  *
@@ -298,6 +303,10 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
         m_bActive(false),
         mDynBufAlloc(false),
         mBufAllocPid(0),
+        mBufPrefetchPid(0),
+        mPrefetchBufs(NULL),
+        mPrefetchReqCnt(0),
+        mPrefetchCnt(0),
         mDefferedAllocation(deffered),
         wait_for_cond(false)
 {
@@ -312,6 +321,7 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
     mMemVtbl.invalidate_buf = invalidate_buf;
     mMemVtbl.clean_invalidate_buf = clean_invalidate_buf;
     memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
+    memset(&mPrefetchOffset, 0, sizeof(mPrefetchOffset));
     memcpy(&mPaddingInfo, paddingInfo, sizeof(cam_padding_info_t));
     memset(&mCropInfo, 0, sizeof(cam_rect_t));
     memset(&m_MemOpsTbl, 0, sizeof(mm_camera_map_unmap_ops_tbl_t));
@@ -332,6 +342,7 @@ QCameraStream::QCameraStream(QCameraAllocator &allocator,
  *==========================================================================*/
 QCameraStream::~QCameraStream()
 {
+    releasePrefetchedBufs();
     pthread_mutex_destroy(&mCropLock);
     pthread_mutex_destroy(&mParameterLock);
 
@@ -750,6 +761,7 @@ int32_t QCameraStream::start()
 {
     int32_t rc = 0;
     mDataQ.init();
+    mProcTh.setDrainMode(true);
     rc = mProcTh.launch(dataProcRoutine, this);
     if (rc == NO_ERROR) {
         m_bActive = true;
@@ -775,6 +787,8 @@ int32_t QCameraStream::stop()
     int32_t rc = 0;
     m_bActive = false;
     rc = mProcTh.exit();
+    // drop buffers prefetched for a start that did not reach getBufs
+    releasePrefetchedBufs();
     return rc;
 }
 
@@ -918,6 +932,7 @@ void QCameraStream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         stream->bufDone(recvd_frame->bufs[0]->buf_idx);
         return;
     }
+    mm_camera_trace_frame(MM_CAMERA_TRACE_HAL_NOTIFY, recvd_frame->bufs[0]);
     *frame = *recvd_frame;
     stream->processDataNotify(frame);
     return;
@@ -958,9 +973,11 @@ void *QCameraStream::dataProcRoutine(void *data)
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
             {
                 CDBG_HIGH("%s: Do next job", __func__);
+                // drain mode: one wakeup handles every queued frame
                 mm_camera_super_buf_t *frame =
                     (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
-                if (NULL != frame) {
+                while (NULL != frame) {
+                    mm_camera_trace_frame(MM_CAMERA_TRACE_HAL_CB, frame->bufs[0]);
                     if (pme->mDataCB != NULL) {
                         pme->mDataCB(frame, pme, pme->mUserData);
                     } else {
@@ -968,6 +985,7 @@ void *QCameraStream::dataProcRoutine(void *data)
                         pme->bufDone(frame->bufs[0]->buf_idx);
                         free(frame);
                     }
+                    frame = (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
                 }
             }
             break;
@@ -1127,11 +1145,15 @@ int32_t QCameraStream::getBufs(cam_frame_len_offset_t *offset,
             mNumBufsNeedAlloc = (uint8_t)(mNumBufs - numBufAlloc);
         }
     }
+    uint8_t numBufReq = numBufAlloc;
 
-    //Allocate stream buffer
-    mStreamBufs = mAllocator.allocateStreamBuf(mStreamInfo->stream_type,
-            mFrameLenOffset.frame_len, mFrameLenOffset.mp[0].stride,
-            mFrameLenOffset.mp[0].scanline, numBufAlloc);
+    //Allocate stream buffer, unless already prefetched at channel start
+    mStreamBufs = takePrefetchedBufs(mFrameLenOffset, numBufReq, numBufAlloc);
+    if (!mStreamBufs) {
+        mStreamBufs = mAllocator.allocateStreamBuf(mStreamInfo->stream_type,
+                mFrameLenOffset.frame_len, mFrameLenOffset.mp[0].stride,
+                mFrameLenOffset.mp[0].scanline, numBufAlloc);
+    }
     if (!mStreamBufs) {
         ALOGE("%s: Failed to allocate stream buffers", __func__);
         return NO_MEMORY;
@@ -1611,6 +1633,190 @@ int32_t QCameraStream::releaseBatchBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
 
 }
 
+/*===========================================================================
+ * FUNCTION   : getMinAllocCnt
+ *
+ * DESCRIPTION: number of buffers to be allocated before stream on. With
+ *              dynamic allocation the rest is allocated after stream on.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : number of buffers
+ *==========================================================================*/
+uint8_t QCameraStream::getMinAllocCnt()
+{
+    if (mDynBufAlloc && (CAMERA_MIN_ALLOCATED_BUFFERS <= mNumBufs)) {
+        return CAMERA_MIN_ALLOCATED_BUFFERS;
+    }
+    return mNumBufs;
+}
+
+/*===========================================================================
+ * FUNCTION   : prefetchBufs
+ *
+ * DESCRIPTION: start allocating the buffers needed before stream on in the
+ *              background, so that all streams of a channel allocate in
+ *              parallel while mm-camera-interface starts them one by one.
+ *              getBufs picks the buffers up once its stream is started.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraStream::prefetchBufs()
+{
+    if ((mStreamInfo == NULL) || mDefferedAllocation ||
+            (mStreamInfo->streaming_mode == CAM_STREAMING_MODE_BATCH) ||
+            (mBufPrefetchPid != 0)) {
+        // buffers are allocated by other means, or already on the way
+        return NO_ERROR;
+    }
+
+    mPrefetchOffset = mStreamInfo->buf_planes.plane_info;
+    mPrefetchReqCnt = getMinAllocCnt();
+    mPrefetchCnt = mPrefetchReqCnt;
+    mPrefetchBufs = NULL;
+    if (pthread_create(&mBufPrefetchPid, NULL, BufPrefetchRoutine, this) != 0) {
+        ALOGE("%s: cannot start buffer prefetch", __func__);
+        mBufPrefetchPid = 0;
+        return UNKNOWN_ERROR;
+    }
+    pthread_setname_np(mBufPrefetchPid, "CAM_strmBufPre");
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : BufPrefetchRoutine
+ *
+ * DESCRIPTION: function to allocate the initial stream buffers ahead of
+ *              getBufs
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void *QCameraStream::BufPrefetchRoutine(void *data)
+{
+    QCameraStream *pme = (QCameraStream *)data;
+
+    CDBG_HIGH("%s: E stream type %d, %d bufs", __func__,
+            pme->mStreamInfo->stream_type, pme->mPrefetchReqCnt);
+    acquireAllocWorker();
+    pme->mPrefetchBufs = pme->mAllocator.allocateStreamBuf(
+            pme->mStreamInfo->stream_type,
+            pme->mPrefetchOffset.frame_len, pme->mPrefetchOffset.mp[0].stride,
+            pme->mPrefetchOffset.mp[0].scanline, pme->mPrefetchCnt);
+    releaseAllocWorker();
+    CDBG_HIGH("%s: X", __func__);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : takePrefetchedBufs
+ *
+ * DESCRIPTION: wait for the buffer prefetch and hand its buffers over if
+ *              they match what getBufs needs
+ *
+ * PARAMETERS :
+ *   @offset  : offset info of stream buffers
+ *   @reqCnt  : number of buffers getBufs needs
+ *   @bufCnt  : [out] number of buffers allocated
+ *
+ * RETURN     : ptr to prefetched memory obj, NULL if none usable
+ *==========================================================================*/
+QCameraMemory *QCameraStream::takePrefetchedBufs(
+        cam_frame_len_offset_t &offset, uint8_t reqCnt, uint8_t &bufCnt)
+{
+    QCameraMemory *bufs = NULL;
+
+    if (mBufPrefetchPid == 0) {
+        return NULL;
+    }
+    pthread_join(mBufPrefetchPid, NULL);
+    mBufPrefetchPid = 0;
+
+    if ((mPrefetchBufs != NULL) && (mPrefetchReqCnt == reqCnt) &&
+            (mPrefetchOffset.frame_len == offset.frame_len) &&
+            (mPrefetchOffset.mp[0].stride == offset.mp[0].stride) &&
+            (mPrefetchOffset.mp[0].scanline == offset.mp[0].scanline)) {
+        bufs = mPrefetchBufs;
+        bufCnt = mPrefetchCnt;
+        mPrefetchBufs = NULL;
+    } else {
+        releasePrefetchedBufs();
+    }
+    return bufs;
+}
+
+/*===========================================================================
+ * FUNCTION   : releasePrefetchedBufs
+ *
+ * DESCRIPTION: free prefetched buffers which were not taken by getBufs
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStream::releasePrefetchedBufs()
+{
+    if (mBufPrefetchPid != 0) {
+        pthread_join(mBufPrefetchPid, NULL);
+        mBufPrefetchPid = 0;
+    }
+    if (mPrefetchBufs != NULL) {
+        mPrefetchBufs->deallocate();
+        delete mPrefetchBufs;
+        mPrefetchBufs = NULL;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : acquireAllocWorker
+ *
+ * DESCRIPTION: wait for a free buffer allocation slot. Number of slots is
+ *              read from persist.camera.mem.alloc_workers.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStream::acquireAllocWorker()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.mem.alloc_workers", value, "3");
+    int workers = atoi(value);
+    if (workers <= 0) {
+        workers = CAMERA_DEFAULT_ALLOC_WORKERS;
+    }
+
+    pthread_mutex_lock(&sAllocLock);
+    while (sAllocActive >= (uint32_t)workers) {
+        pthread_cond_wait(&sAllocCond, &sAllocLock);
+    }
+    sAllocActive++;
+    pthread_mutex_unlock(&sAllocLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseAllocWorker
+ *
+ * DESCRIPTION: give back a buffer allocation slot
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCameraStream::releaseAllocWorker()
+{
+    pthread_mutex_lock(&sAllocLock);
+    sAllocActive--;
+    pthread_cond_signal(&sAllocCond);
+    pthread_mutex_unlock(&sAllocLock);
+}
+
 /*===========================================================================
  * FUNCTION   : BufAllocRoutine
  *
@@ -72,9 +72,14 @@ public:
     virtual int32_t allocateBuffers();
     virtual int32_t releaseBuffs();
 
+    /* Used for parallel allocation of buffers at channel start */
+    int32_t prefetchBufs();
+    void releasePrefetchedBufs();
+
     static void dataNotifyCB(mm_camera_super_buf_t *recvd_frame, void *userdata);
     static void *dataProcRoutine(void *data);
     static void *BufAllocRoutine(void *data);
+    static void *BufPrefetchRoutine(void *data);
     uint32_t getMyHandle() const {return mHandle;}
     bool isTypeOf(cam_stream_type_t type);
     bool isOrignalTypeOf(cam_stream_type_t type);
@@ -152,6 +157,11 @@ private:
     bool m_bActive; // if stream mProcTh is active
     bool mDynBufAlloc; // allow buf allocation in 2 steps
     pthread_t mBufAllocPid;
+    pthread_t mBufPrefetchPid;
+    QCameraMemory *mPrefetchBufs; // minimum set allocated ahead of getBufs
+    cam_frame_len_offset_t mPrefetchOffset;
+    uint8_t mPrefetchReqCnt; // buffers requested for prefetch
+    uint8_t mPrefetchCnt;    // buffers actually allocated by prefetch
     mm_camera_map_unmap_ops_tbl_t m_MemOpsTbl;
     cam_stream_parm_buffer_t m_OutputCrop;
     cam_stream_parm_buffer_t m_ImgProp;
@@ -183,6 +193,12 @@ private:
     static int32_t invalidate_buf(uint32_t index, void *user_data);
     static int32_t clean_invalidate_buf(uint32_t index, void *user_data);
 
+    uint8_t getMinAllocCnt();
+    QCameraMemory *takePrefetchedBufs(cam_frame_len_offset_t &offset,
+            uint8_t reqCnt, uint8_t &bufCnt);
+    static void acquireAllocWorker();
+    static void releaseAllocWorker();
+
     int32_t getBufs(cam_frame_len_offset_t *offset,
                      uint8_t *num_bufs,
                      uint8_t **initial_reg_flag,
@@ -214,6 +230,11 @@ private:
     pthread_mutex_t m_lock;
     pthread_cond_t m_cond;
 
+    // limit of concurrent buffer prefetches across all streams
+    static pthread_mutex_t sAllocLock;
+    static pthread_cond_t sAllocCond;
+    static uint32_t sAllocActive;
+
 };
 
 }; // namespace qcamera
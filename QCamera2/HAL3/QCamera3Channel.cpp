@@ -102,6 +102,7 @@ QCamera3Channel::QCamera3Channel(uint32_t cam_handle,
     mYUVDump = (uint8_t) atoi(prop);
     mIsType = IS_TYPE_NONE;
     mNumBuffers = numBuffers;
+    memset(&mBatchInfo, 0, sizeof(mBatchInfo));
 }
 
 /*===========================================================================
@@ -129,6 +130,7 @@ QCamera3Channel::QCamera3Channel()
     mPaddingInfo = NULL;
 
     mPostProcMask = 0;
+    memset(&mBatchInfo, 0, sizeof(mBatchInfo));
 }
 
 /*===========================================================================
@@ -141,6 +143,22 @@ QCamera3Channel::QCamera3Channel()
  * RETURN     : none
  *==========================================================================*/
 QCamera3Channel::~QCamera3Channel()
+{
+    destroyStreams();
+}
+
+/*===========================================================================
+ * FUNCTION   : destroyStreams
+ *
+ * DESCRIPTION: stop the channel and release its streams and backend channel.
+ *              The channel object stays usable, the next initialize adds
+ *              the streams again.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Channel::destroyStreams()
 {
     if (m_bIsActive)
         stop();
@@ -234,7 +252,9 @@ int32_t QCamera3Channel::addStream(cam_stream_type_t streamType,
     }
 
     rc = pStream->init(streamType, streamFormat, streamDim, NULL, minStreamBufNum,
-                       postprocessMask, isType, streamCbRoutine, this);
+                       postprocessMask, isType,
+                       (mBatchInfo.frame_buf_cnt > 1) ? &mBatchInfo : NULL,
+                       streamCbRoutine, this);
     if (rc == 0) {
         mStreams[m_numStreams] = pStream;
         m_numStreams++;
@@ -412,6 +432,65 @@ QCamera3Stream *QCamera3Channel::getStreamByHandle(uint32_t streamHandle)
     return NULL;
 }
 
+/*===========================================================================
+ * FUNCTION   : setBatchSize
+ *
+ * DESCRIPTION: set the number of frames the kernel fills per buffer for the
+ *              streams of this channel. Has to be called before the streams
+ *              are added.
+ *
+ * PARAMETERS :
+ *   @batchSize : frames per kernel buffer, 0 or 1 to disable batching
+ *   @fps       : sensor frame rate the batch is captured at
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Channel::setBatchSize(uint8_t batchSize, uint32_t fps)
+{
+    if (m_numStreams > 0) {
+        ALOGE("%s: Streams already added", __func__);
+        return INVALID_OPERATION;
+    }
+    if ((batchSize > MSM_CAMERA_MAX_USER_BUFF_CNT) ||
+            ((batchSize > 1) && ((fps == 0) || (mNumBuffers < batchSize)))) {
+        ALOGE("%s: Invalid batch size %d at %d fps", __func__, batchSize, fps);
+        return BAD_VALUE;
+    }
+
+    memset(&mBatchInfo, 0, sizeof(mBatchInfo));
+    if (batchSize > 1) {
+        mBatchInfo.frame_buf_cnt = batchSize;
+        mBatchInfo.frameInterval = 1000 / fps;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : flushBatch
+ *
+ * DESCRIPTION: queue the partially filled batch of every stream of this
+ *              channel to the kernel
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Channel::flushBatch()
+{
+    int32_t rc = NO_ERROR;
+
+    for (uint32_t i = 0; i < m_numStreams; i++) {
+        if ((mStreams[i] != NULL) && (mStreams[i]->flushBatch() != NO_ERROR)) {
+            rc = UNKNOWN_ERROR;
+        }
+    }
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : getStreamByIndex
  *
@@ -999,10 +1078,17 @@ QCamera3RawChannel::QCamera3RawChannel(uint32_t cam_handle,
     char prop[PROPERTY_VALUE_MAX];
     property_get("persist.camera.raw.debug.dump", prop, "0");
     mRawDump = atoi(prop);
+
+    if (mIsRaw16) {
+        // threads converting a frame, the callback thread included
+        property_get("persist.camera.raw.unpack.threads", prop, "4");
+        mUnpacker.init((uint32_t)atoi(prop));
+    }
 }
 
 QCamera3RawChannel::~QCamera3RawChannel()
 {
+    mUnpacker.deinit();
 }
 
 void QCamera3RawChannel::streamCbRoutine(
@@ -1077,25 +1163,15 @@ void QCamera3RawChannel::convertLegacyToRaw16(mm_camera_buf_def_t *frame)
       stream->getFrameOffset(offset);
 
       uint32_t raw16_stride = ((uint32_t)dim.width + 15U) & ~15U;
-      uint16_t* raw16_buffer = (uint16_t *)frame->buffer;
 
       // In-place format conversion.
       // Raw16 format always occupy more memory than opaque raw10.
-      // Convert to Raw16 by iterating through all pixels from bottom-right
-      // to top-left of the image.
       // One special notes:
       // 1. Cross-platform raw16's stride is 16 pixels.
       // 2. Opaque raw10's stride is 6 pixels, and aligned to 16 bytes.
-      for (int32_t ys = dim.height - 1; ys >= 0; ys--) {
-          uint32_t y = (uint32_t)ys;
-          uint64_t* row_start = (uint64_t *)frame->buffer +
-                  y * (uint32_t)offset.mp[0].stride_in_bytes / 8;
-          for (int32_t xs = dim.width - 1; xs >= 0; xs--) {
-              uint32_t x = (uint32_t)xs;
-              uint16_t raw16_pixel = 0x3FF & (row_start[x/6] >> (10*(x%6)));
-              raw16_buffer[y*raw16_stride+x] = raw16_pixel;
-          }
-      }
+      mUnpacker.unpack(RAW_UNPACK_LEGACY10, frame->buffer,
+              (uint32_t)dim.width, (uint32_t)dim.height,
+              (uint32_t)offset.mp[0].stride_in_bytes, raw16_stride);
   } else {
       ALOGE("%s: Could not find stream", __func__);
   }
@@ -1120,29 +1196,15 @@ void QCamera3RawChannel::convertMipiToRaw16(mm_camera_buf_def_t *frame)
         stream->getFrameOffset(offset);
 
         uint32_t raw16_stride = ((uint32_t)dim.width + 15U) & ~15U;
-        uint16_t* raw16_buffer = (uint16_t *)frame->buffer;
 
         // In-place format conversion.
         // Raw16 format always occupy more memory than opaque raw10.
-        // Convert to Raw16 by iterating through all pixels from bottom-right
-        // to top-left of the image.
         // One special notes:
         // 1. Cross-platform raw16's stride is 16 pixels.
         // 2. mipi raw10's stride is 4 pixels, and aligned to 16 bytes.
-        for (int32_t ys = dim.height - 1; ys >= 0; ys--) {
-            uint32_t y = (uint32_t)ys;
-            uint8_t* row_start = (uint8_t *)frame->buffer +
-                    y * (uint32_t)offset.mp[0].stride_in_bytes;
-            for (int32_t xs = dim.width - 1; xs >= 0; xs--) {
-                uint32_t x = (uint32_t)xs;
-                uint8_t upper_8bit = row_start[5*(x/4)+x%4];
-                uint8_t lower_2bit = ((row_start[5*(x/4)+4] >> (x%4)) & 0x3);
-                uint16_t raw16_pixel =
-                        (uint16_t)(((uint16_t)upper_8bit)<<2 | 
-                        (uint16_t)lower_2bit);
-                raw16_buffer[y*raw16_stride+x] = raw16_pixel;
-            }
-        }
+        mUnpacker.unpack(RAW_UNPACK_MIPI10, frame->buffer,
+                (uint32_t)dim.width, (uint32_t)dim.height,
+                (uint32_t)offset.mp[0].stride_in_bytes, raw16_stride);
     } else {
         ALOGE("%s: Could not find stream", __func__);
     }
@@ -1521,11 +1583,8 @@ void QCamera3PicChannel::jpegEvtHandle(jpeg_job_status_t status,
                     (uint32_t)resultFrameNumber,
                     obj->mUserData);
 
-            // release internal data for jpeg job
-            if ((NULL != job->fwk_frame) || (NULL != job->fwk_src_buffer)) {
-                obj->mOfflineMetaMemory.deallocate();
-                obj->mOfflineMemory.unregisterBuffers();
-            }
+            // release internal data for jpeg job, framework inputs give
+            // their offline slot back in releaseJpegJobData
             obj->m_postprocessor.releaseOfflineBuffers();
             obj->m_postprocessor.releaseJpegJobData(job);
             free(job);
@@ -1597,10 +1656,63 @@ int32_t QCamera3PicChannel::stop()
 
     m_postprocessor.stop();
     mPostProcStarted = false;
+    resetOfflineSlots();
     rc |= QCamera3Channel::stop();
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : releaseOfflineInput
+ *
+ * DESCRIPTION: give back the offline slot of a framework input once its
+ *              reprocess and encoding are done or dropped
+ *
+ * PARAMETERS :
+ *   @frame : framework input frame
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3PicChannel::releaseOfflineInput(qcamera_fwk_input_pp_data_t *frame)
+{
+    if ((NULL == frame) || !frame->offline_slot) {
+        return;
+    }
+
+    int32_t rc = mOfflineMemory.unregisterBuffer(frame->input_buffer.buf_idx);
+    if (NO_ERROR != rc) {
+        ALOGE("%s: Error %d unregistering input buffer %d",
+                __func__, rc, frame->input_buffer.buf_idx);
+    }
+    frame->offline_slot = false;
+
+    Mutex::Autolock lock(mFreeBuffersLock);
+    mFreeOfflineMetaList.push_back(frame->metadata_buffer.buf_idx);
+}
+
+/*===========================================================================
+ * FUNCTION   : resetOfflineSlots
+ *
+ * DESCRIPTION: drop all framework input registrations and free every
+ *              offline metadata buffer. Only valid with the postprocessor
+ *              stopped, when no offline job is left.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3PicChannel::resetOfflineSlots()
+{
+    if (0 < mOfflineMemory.getCnt()) {
+        mOfflineMemory.unregisterBuffers();
+    }
+
+    Mutex::Autolock lock(mFreeBuffersLock);
+    mFreeOfflineMetaList.clear();
+    for (uint32_t i = 0; i < mOfflineMetaMemory.getCnt(); i++) {
+        mFreeOfflineMetaList.push_back(i);
+    }
+}
+
 QCamera3PicChannel::~QCamera3PicChannel()
 {
    stop();
@@ -1759,40 +1871,68 @@ int32_t QCamera3PicChannel::request(buffer_handle_t *buffer,
             rc = NOT_ENOUGH_DATA;
         }
     } else {
-        if (0 < mOfflineMetaMemory.getCnt()) {
-            mOfflineMetaMemory.deallocate();
-        }
-        if (0 < mOfflineMemory.getCnt()) {
-            mOfflineMemory.unregisterBuffers();
-        }
-
-        int input_index = mOfflineMemory.getMatchBufIndex((void*)pInputBuffer->buffer);
-        if(input_index < 0) {
-            rc = mOfflineMemory.registerBuffer(pInputBuffer->buffer, mStreamType);
+        // Every input in flight keeps its registration and a metadata
+        // buffer of the pool until its JPEG is done, so the next input is
+        // mapped while earlier ones are still reprocessed or encoded.
+        if (0 == mOfflineMetaMemory.getCnt()) {
+            rc = mOfflineMetaMemory.allocate(mNumBuffers,
+                    sizeof(metadata_buffer_t), false);
             if (NO_ERROR != rc) {
-                ALOGE("%s: On-the-fly input buffer registration failed %d",
-                        __func__, rc);
+                ALOGE("%s: Couldn't allocate offline metadata buffers!", __func__);
                 return rc;
             }
+            resetOfflineSlots();
+        }
 
-            input_index = mOfflineMemory.getMatchBufIndex((void*)pInputBuffer->buffer);
-            if (input_index < 0) {
-                ALOGE("%s: Could not find object among registered buffers",__func__);
-                return DEAD_OBJECT;
+        uint32_t meta_index;
+        {
+            Mutex::Autolock lock(mFreeBuffersLock);
+            if (mFreeOfflineMetaList.empty()) {
+                ALOGE("%s: No offline metadata buffers available!", __func__);
+                return NOT_ENOUGH_DATA;
             }
+            List<uint32_t>::iterator it = mFreeOfflineMetaList.begin();
+            meta_index = *it;
+            mFreeOfflineMetaList.erase(it);
         }
+
         qcamera_fwk_input_pp_data_t *src_frame = NULL;
         src_frame = (qcamera_fwk_input_pp_data_t *)malloc(
                 sizeof(qcamera_fwk_input_pp_data_t));
         if (src_frame == NULL) {
             ALOGE("%s: No memory for src frame", __func__);
+            Mutex::Autolock lock(mFreeBuffersLock);
+            mFreeOfflineMetaList.push_back(meta_index);
             return NO_MEMORY;
         }
         memset(src_frame, 0, sizeof(qcamera_fwk_input_pp_data_t));
         src_frame->src_frame = *pInputBuffer;
+        src_frame->metadata_buffer.buf_idx = meta_index;
+
+        rc = mOfflineMemory.registerBuffer(pInputBuffer->buffer, mStreamType);
+        if ((NO_ERROR != rc) && (ALREADY_EXISTS != rc)) {
+            ALOGE("%s: On-the-fly input buffer registration failed %d",
+                    __func__, rc);
+            Mutex::Autolock lock(mFreeBuffersLock);
+            mFreeOfflineMetaList.push_back(meta_index);
+            free(src_frame);
+            return rc;
+        }
+        int input_index = mOfflineMemory.getMatchBufIndex((void*)pInputBuffer->buffer);
+        if (input_index < 0) {
+            ALOGE("%s: Could not find object among registered buffers",__func__);
+            Mutex::Autolock lock(mFreeBuffersLock);
+            mFreeOfflineMetaList.push_back(meta_index);
+            free(src_frame);
+            return DEAD_OBJECT;
+        }
+        src_frame->input_buffer.buf_idx = (uint32_t)input_index;
+        src_frame->offline_slot = true;
+
         rc = mOfflineMemory.getBufDef(reproc_cfg.input_stream_plane_info.plane_info,
                 src_frame->input_buffer, (uint32_t)input_index);
         if (rc != 0) {
+            releaseOfflineInput(src_frame);
             free(src_frame);
             return rc;
         }
@@ -1805,31 +1945,32 @@ int32_t QCamera3PicChannel::request(buffer_handle_t *buffer,
         rc = mm_stream_calc_offset_metadata(&dim, mPaddingInfo, &meta_planes);
         if (rc != 0) {
             ALOGE("%s: Metadata stream plane info calculation failed!", __func__);
+            releaseOfflineInput(src_frame);
             free(src_frame);
             return rc;
         }
 
-        rc = mOfflineMetaMemory.allocate(1, sizeof(metadata_buffer_t), false);
-        if (NO_ERROR != rc) {
-            ALOGE("%s: Couldn't allocate offline metadata buffer!", __func__);
-            free(src_frame);
-            return rc;
-        }
         mm_camera_buf_def_t meta_buf;
         cam_frame_len_offset_t offset = meta_planes.plane_info;
-        rc = mOfflineMetaMemory.getBufDef(offset, meta_buf, 0);
+        rc = mOfflineMetaMemory.getBufDef(offset, meta_buf, meta_index);
         if (NO_ERROR != rc) {
+            releaseOfflineInput(src_frame);
             free(src_frame);
             return rc;
         }
-        memcpy(meta_buf.buffer, metadata, sizeof(metadata_buffer_t));
+        mm_camera_copy_metadata((metadata_buffer_t *)meta_buf.buffer,
+                metadata);
         src_frame->metadata_buffer = meta_buf;
         src_frame->reproc_config = reproc_cfg;
 
         CDBG_HIGH("%s: Post-process started", __func__);
         CDBG_HIGH("%s: Issue call to reprocess", __func__);
 
-        m_postprocessor.processData(src_frame);
+        rc = m_postprocessor.processData(src_frame);
+        if (NO_ERROR != rc) {
+            releaseOfflineInput(src_frame);
+            free(src_frame);
+        }
     }
     return rc;
 }
@@ -3006,6 +3147,21 @@ int32_t QCamera3ReprocessChannel::unmapOfflineBuffers(bool all)
            mOfflineMetaBuffers.clear();
         }
     }
+
+    if (all && !mOfflineMetaPool.isEmpty() && (0 < m_numStreams) &&
+            (NULL != mStreams[0])) {
+        for (size_t i = 0; i < mOfflineMetaPool.size(); i++) {
+            rc = mStreams[0]->unmapBuf(CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF,
+                    mOfflineMetaPool.keyAt(i), -1);
+            if (NO_ERROR != rc) {
+                ALOGE("%s: Error during offline buffer unmap %d",
+                      __func__, rc);
+            }
+        }
+    }
+    if (all) {
+        mOfflineMetaPool.clear();
+    }
     return rc;
 }
 
@@ -3240,23 +3396,49 @@ int32_t QCamera3ReprocessChannel::extractCrop(qcamera_fwk_input_pp_data_t *frame
         CDBG("%s: Mapped buffer with index %d", __func__, mOfflineBuffersIndex);
     }
 
-    max_idx = (int32_t) ((mNumBuffers * 2) - 1);
-    //loop back the indices if max burst count reached
-    if (mOfflineMetaIndex == max_idx) {
-       mOfflineMetaIndex = (int32_t) (mNumBuffers - 1);
-    }
-    uint32_t meta_buf_idx = (uint32_t)(mOfflineMetaIndex + 1);
-    rc |= pStream->mapBuf(
-            CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF,
-            meta_buf_idx, -1,
-            frame->metadata_buffer.fd, frame->metadata_buffer.frame_len);
-    if (NO_ERROR == rc) {
-        mappedBuffer.index = meta_buf_idx;
-        mappedBuffer.stream = pStream;
-        mappedBuffer.type = CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF;
-        mOfflineMetaBuffers.push_back(mappedBuffer);
-        mOfflineMetaIndex = (int32_t)meta_buf_idx;
-        CDBG("%s: Mapped meta buffer with index %d", __func__, mOfflineMetaIndex);
+    uint32_t meta_buf_idx;
+    if (frame->offline_slot) {
+        // metadata pool of the picture channel, mapped on first use
+        meta_buf_idx = mNumBuffers + frame->metadata_buffer.buf_idx;
+        ssize_t pool_idx = mOfflineMetaPool.indexOfKey(meta_buf_idx);
+        if ((pool_idx >= 0) &&
+                (mOfflineMetaPool.valueAt((size_t)pool_idx) !=
+                frame->metadata_buffer.fd)) {
+            pStream->unmapBuf(CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF,
+                    meta_buf_idx, -1);
+            mOfflineMetaPool.removeItemsAt((size_t)pool_idx);
+            pool_idx = NAME_NOT_FOUND;
+        }
+        if (pool_idx < 0) {
+            rc |= pStream->mapBuf(
+                    CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF,
+                    meta_buf_idx, -1,
+                    frame->metadata_buffer.fd, frame->metadata_buffer.frame_len);
+            if (NO_ERROR == rc) {
+                mOfflineMetaPool.add(meta_buf_idx, frame->metadata_buffer.fd);
+                CDBG("%s: Mapped pool meta buffer with index %d", __func__,
+                        meta_buf_idx);
+            }
+        }
+    } else {
+        max_idx = (int32_t) ((mNumBuffers * 2) - 1);
+        //loop back the indices if max burst count reached
+        if (mOfflineMetaIndex == max_idx) {
+           mOfflineMetaIndex = (int32_t) (mNumBuffers - 1);
+        }
+        meta_buf_idx = (uint32_t)(mOfflineMetaIndex + 1);
+        rc |= pStream->mapBuf(
+                CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF,
+                meta_buf_idx, -1,
+                frame->metadata_buffer.fd, frame->metadata_buffer.frame_len);
+        if (NO_ERROR == rc) {
+            mappedBuffer.index = meta_buf_idx;
+            mappedBuffer.stream = pStream;
+            mappedBuffer.type = CAM_MAPPING_BUF_TYPE_OFFLINE_META_BUF;
+            mOfflineMetaBuffers.push_back(mappedBuffer);
+            mOfflineMetaIndex = (int32_t)meta_buf_idx;
+            CDBG("%s: Mapped meta buffer with index %d", __func__, mOfflineMetaIndex);
+        }
     }
 
     if (rc == NO_ERROR) {
@@ -3393,6 +3575,7 @@ int32_t QCamera3ReprocessChannel::addReprocStreamsFromSource(cam_pp_feature_conf
             (uint8_t)mNumBuffers,
             reprocess_config.pp_feature_config.feature_mask,
             is_type,
+            NULL,
             QCamera3Channel::streamCbRoutine, this);
 
     if (rc == 0) {
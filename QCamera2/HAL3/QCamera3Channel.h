@@ -35,8 +35,10 @@
 #include "QCamera3Mem.h"
 #include "QCamera3PostProc.h"
 #include "QCamera3HALHeader.h"
+#include "QCamera3RawUnpacker.h"
 #include "utils/Vector.h"
 #include <utils/List.h>
+#include <utils/KeyedVector.h>
 
 extern "C" {
 #include <mm_camera_interface.h>
@@ -71,6 +73,7 @@ public:
                       cam_is_type_t isType);
     virtual int32_t start();
     virtual int32_t stop();
+    void destroyStreams();
     int32_t bufDone(mm_camera_super_buf_t *recvd_frame);
 
     uint32_t getStreamTypeMask();
@@ -94,6 +97,8 @@ public:
     uint32_t getNumOfStreams() const {return m_numStreams;};
     uint32_t getNumBuffers() const {return mNumBuffers;};
     QCamera3Stream *getStreamByIndex(uint32_t index);
+    int32_t setBatchSize(uint8_t batchSize, uint32_t fps);
+    int32_t flushBatch();
 
     static void streamCbRoutine(mm_camera_super_buf_t *super_frame,
                 QCamera3Stream *stream, void *userdata);
@@ -127,6 +132,8 @@ protected:
     uint8_t mYUVDump;
     cam_is_type_t mIsType;
     uint32_t mNumBuffers;
+    /* frames per kernel buffer for streams added from here on */
+    cam_stream_user_buf_info_t mBatchInfo;
 };
 
 /* QCamera3RegularChannel is used to handle all streams that are directly
@@ -231,6 +238,7 @@ public:
 private:
     bool mRawDump;
     bool mIsRaw16;
+    QCamera3RawUnpacker mUnpacker;
 
     void dumpRawSnapshot(mm_camera_buf_def_t *frame);
     void convertLegacyToRaw16(mm_camera_buf_def_t *frame);
@@ -314,9 +322,11 @@ public:
     virtual int32_t registerBuffer(buffer_handle_t *buffer, cam_is_type_t isType);
     int32_t queueReprocMetadata(mm_camera_super_buf_t *metadata);
     int32_t getStreamSize(cam_dimension_t &dim);
+    void releaseOfflineInput(qcamera_fwk_input_pp_data_t *frame);
 
 private:
     int32_t queueJpegSetting(uint32_t out_buf_index, metadata_buffer_t *metadata);
+    void resetOfflineSlots();
 
 public:
     QCamera3PostProcessor m_postprocessor; // post processor
@@ -339,12 +349,15 @@ private:
     QCamera3HeapMemory *mYuvMemory;
     QCamera3Channel *m_pMetaChannel;
     mm_camera_super_buf_t *mMetaFrame;
+    // Framework inputs in flight for offline reprocess, each holds its
+    // registered input and one buffer of the metadata pool until encoded
     QCamera3GrallocMemory mOfflineMemory;
     QCamera3HeapMemory mOfflineMetaMemory;
 
     // Keep a list of free buffers
     Mutex mFreeBuffersLock;
     List<uint32_t> mFreeBufferList;
+    List<uint32_t> mFreeOfflineMetaList;
 };
 
 // reprocess channel class
@@ -397,6 +410,8 @@ private:
 
     android::List<OfflineBuffer> mOfflineBuffers;
     android::List<OfflineBuffer> mOfflineMetaBuffers;
+    // picture channel metadata pool, map index -> fd, mapped until stop
+    android::KeyedVector<uint32_t, int> mOfflineMetaPool;
     int32_t mOfflineBuffersIndex;
     int32_t mOfflineMetaIndex;
     uint32_t mSrcStreamHandles[MAX_STREAM_NUM_IN_BUNDLE];
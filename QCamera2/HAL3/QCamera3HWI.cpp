@@ -61,6 +61,9 @@ namespace qcamera {
 #define PARTIAL_RESULT_COUNT 2
 #define FRAME_SKIP_DELAY     0
 #define CAM_MAX_SYNC_LATENCY 4
+// frame interval below which the in-flight window may open past
+// MIN_INFLIGHT_REQUESTS, i.e. faster than 45fps
+#define INFLIGHT_GROW_INTERVAL ((nsecs_t)NSEC_PER_SEC / 45)
 
 #define MAX_VALUE_8BIT ((1<<8)-1)
 #define MAX_VALUE_10BIT ((1<<10)-1)
@@ -262,6 +265,71 @@ const QCamera3HardwareInterface::QCameraMap<
     { ANDROID_SENSOR_REFERENCE_ILLUMINANT1_WHITE_FLUORESCENT, CAM_AWB_COLD_FLO},
 };
 
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_control_effect_mode_t,
+        cam_effect_mode_type> QCamera3HardwareInterface::EFFECT_MODES_INDEX(
+        EFFECT_MODES_MAP, METADATA_MAP_SIZE(EFFECT_MODES_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_control_awb_mode_t,
+        cam_wb_mode_type> QCamera3HardwareInterface::WHITE_BALANCE_MODES_INDEX(
+        WHITE_BALANCE_MODES_MAP, METADATA_MAP_SIZE(WHITE_BALANCE_MODES_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_control_scene_mode_t,
+        cam_scene_mode_type> QCamera3HardwareInterface::SCENE_MODES_INDEX(
+        SCENE_MODES_MAP, METADATA_MAP_SIZE(SCENE_MODES_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_control_af_mode_t,
+        cam_focus_mode_type> QCamera3HardwareInterface::FOCUS_MODES_INDEX(
+        FOCUS_MODES_MAP, METADATA_MAP_SIZE(FOCUS_MODES_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_color_correction_aberration_mode_t,
+        cam_aberration_mode_t> QCamera3HardwareInterface::COLOR_ABERRATION_INDEX(
+        COLOR_ABERRATION_MAP, METADATA_MAP_SIZE(COLOR_ABERRATION_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_control_ae_antibanding_mode_t,
+        cam_antibanding_mode_type> QCamera3HardwareInterface::ANTIBANDING_MODES_INDEX(
+        ANTIBANDING_MODES_MAP, METADATA_MAP_SIZE(ANTIBANDING_MODES_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_lens_state_t,
+        cam_af_lens_state_t> QCamera3HardwareInterface::LENS_STATE_INDEX(
+        LENS_STATE_MAP, METADATA_MAP_SIZE(LENS_STATE_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_control_ae_mode_t,
+        cam_flash_mode_t> QCamera3HardwareInterface::AE_FLASH_MODE_INDEX(
+        AE_FLASH_MODE_MAP, METADATA_MAP_SIZE(AE_FLASH_MODE_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_flash_mode_t,
+        cam_flash_mode_t> QCamera3HardwareInterface::FLASH_MODES_INDEX(
+        FLASH_MODES_MAP, METADATA_MAP_SIZE(FLASH_MODES_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_statistics_face_detect_mode_t,
+        cam_face_detect_mode_t> QCamera3HardwareInterface::FACEDETECT_MODES_INDEX(
+        FACEDETECT_MODES_MAP, METADATA_MAP_SIZE(FACEDETECT_MODES_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_lens_info_focus_distance_calibration_t,
+        cam_focus_calibration_t> QCamera3HardwareInterface::FOCUS_CALIBRATION_INDEX(
+        FOCUS_CALIBRATION_MAP, METADATA_MAP_SIZE(FOCUS_CALIBRATION_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_sensor_test_pattern_mode_t,
+        cam_test_pattern_mode_t> QCamera3HardwareInterface::TEST_PATTERN_INDEX(
+        TEST_PATTERN_MAP, METADATA_MAP_SIZE(TEST_PATTERN_MAP));
+
+const QCamera3HardwareInterface::QCameraMapIndex<
+        camera_metadata_enum_android_sensor_reference_illuminant1_t,
+        cam_illuminat_t> QCamera3HardwareInterface::REFERENCE_ILLUMINANT_INDEX(
+        REFERENCE_ILLUMINANT_MAP, METADATA_MAP_SIZE(REFERENCE_ILLUMINANT_MAP));
+
 camera3_device_ops_t QCamera3HardwareInterface::mCameraOps = {
     initialize:                         QCamera3HardwareInterface::initialize,
     configure_streams:                  QCamera3HardwareInterface::configure_streams,
@@ -304,6 +372,11 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
       mParamHeap(NULL),
       mParameters(NULL),
       mPrevParameters(NULL),
+      mCachedParameters(NULL),
+      mCachedSettings(NULL),
+      mCachedSnapshotStreamId(0),
+      mSettingsCacheHits(0),
+      mSettingsCacheMisses(0),
       m_bIsVideo(false),
       m_bIs4KVideo(false),
       m_bEisSupportedSize(false),
@@ -316,7 +389,15 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
       mMetaFrameCount(0U),
       mUpdateDebugLevel(false),
       mCallbacks(callbacks),
-      mCaptureIntent(0)
+      mCaptureIntent(0),
+      mBatchCapable(false),
+      mBatchSize(0),
+      mHFRVideoFps(0),
+      mBatchFrameCount(0),
+      mFirstFrameNumberInBatch(0),
+      mBatchStartTime(0),
+      mBatchFlushThreadActive(false),
+      mBatchFlushExit(false)
 {
     getLogLevel();
     mCameraDevice.common.tag = HARDWARE_DEVICE_TAG;
@@ -330,7 +411,17 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
     gCamCapability[cameraId]->min_num_pp_bufs = 3;
 
     pthread_cond_init(&mRequestCond, NULL);
+    pthread_cond_init(&mBatchCond, NULL);
     mPendingRequest = 0;
+    for (size_t i = 0; i < PENDING_REQUEST_RING_SIZE; i++) {
+        mPendingRequestRing[i].valid = false;
+    }
+    mPendingRequestUnindexed = 0;
+    resetInflightWindow();
+    memset(&mFlushStats, 0, sizeof(mFlushStats));
+    memset(&mExifParams, 0, sizeof(mExifParams));
+    memset(&mExifDebugParams, 0, sizeof(mExifDebugParams));
+    mExifParams.debug_params = &mExifDebugParams;
     mCurrentRequestId = -1;
     pthread_mutex_init(&mMutex, NULL);
 
@@ -373,6 +464,15 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
 QCamera3HardwareInterface::~QCamera3HardwareInterface()
 {
     CDBG("%s: E", __func__);
+    if (mBatchFlushThreadActive) {
+        pthread_mutex_lock(&mMutex);
+        mBatchFlushExit = true;
+        pthread_cond_signal(&mBatchCond);
+        pthread_mutex_unlock(&mMutex);
+        pthread_join(mBatchFlushThread, NULL);
+        mBatchFlushThreadActive = false;
+    }
+
     /* We need to stop all streams before deleting any stream */
 
 
@@ -458,6 +558,7 @@ QCamera3HardwareInterface::~QCamera3HardwareInterface()
             free_camera_metadata(mDefaultMetadata[i]);
 
     pthread_cond_destroy(&mRequestCond);
+    pthread_cond_destroy(&mBatchCond);
 
     pthread_mutex_destroy(&mMutex);
     CDBG("%s: X", __func__);
@@ -481,9 +582,81 @@ QCamera3HardwareInterface::pendingRequestIterator
         free(i->input_buffer);
         i->input_buffer = NULL;
     }
+
+    PendingRequestSlot &slot =
+            mPendingRequestRing[i->frame_number & (PENDING_REQUEST_RING_SIZE - 1)];
+    if (slot.valid && (slot.request == i)) {
+        slot.valid = false;
+    } else if (mPendingRequestUnindexed > 0) {
+        mPendingRequestUnindexed--;
+    }
     return mPendingRequestsList.erase(i);
 }
 
+/*===========================================================================
+ * FUNCTION   : addPendingRequest
+ *
+ * DESCRIPTION: append a request to the pending request list and index it by
+ *              frame number. If its ring slot is still held by an older
+ *              request the new one stays unindexed and findPendingRequest
+ *              falls back to walking the list until it retires.
+ *
+ * PARAMETERS :
+ *   @request : pending request to be added
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3HardwareInterface::addPendingRequest(
+        const PendingRequestInfo &request)
+{
+    mPendingRequestsList.push_back(request);
+    pendingRequestIterator last = mPendingRequestsList.end();
+    --last;
+
+    PendingRequestSlot &slot =
+            mPendingRequestRing[request.frame_number & (PENDING_REQUEST_RING_SIZE - 1)];
+    if (slot.valid) {
+        CDBG_HIGH("%s: ring slot of frame %u still held by frame %u",
+                __func__, request.frame_number, slot.frame_number);
+        mPendingRequestUnindexed++;
+    } else {
+        slot.valid = true;
+        slot.frame_number = request.frame_number;
+        slot.request = last;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : findPendingRequest
+ *
+ * DESCRIPTION: look up a pending request by frame number
+ *
+ * PARAMETERS :
+ *   @frame_number : frame number of the request
+ *
+ * RETURN     : iterator pointing to the request,
+ *              mPendingRequestsList.end() if not pending
+ *==========================================================================*/
+QCamera3HardwareInterface::pendingRequestIterator
+        QCamera3HardwareInterface::findPendingRequest(uint32_t frame_number)
+{
+    PendingRequestSlot &slot =
+            mPendingRequestRing[frame_number & (PENDING_REQUEST_RING_SIZE - 1)];
+    if (slot.valid && (slot.frame_number == frame_number)) {
+        return slot.request;
+    }
+
+    if (mPendingRequestUnindexed > 0) {
+        for (pendingRequestIterator i = mPendingRequestsList.begin();
+                i != mPendingRequestsList.end(); i++) {
+            if (i->frame_number == frame_number) {
+                return i;
+            }
+        }
+    }
+    return mPendingRequestsList.end();
+}
+
 /*===========================================================================
  * FUNCTION   : camEvtHandle
  *
@@ -916,6 +1089,7 @@ int QCamera3HardwareInterface::configureStreams(
     ATRACE_CALL();
     int rc = 0;
     bool bWasVideo = m_bIsVideo;
+    bool bWasBatchCapable = mBatchCapable;
 
     // Sanity check stream_list
     if (streamList == NULL) {
@@ -1141,6 +1315,25 @@ int QCamera3HardwareInterface::configureStreams(
         return rc;
     }
 
+    /* HFR batching needs every output frame straight from the ISP, so no
+     * snapshot, raw or reprocess streams. Regular streams then get enough
+     * buffers to keep a few batches in flight. */
+    char batch_prop[PROPERTY_VALUE_MAX];
+    memset(batch_prop, 0, sizeof(batch_prop));
+    property_get("persist.camera.hfr.batch", batch_prop, "0");
+    mBatchCapable = (atoi(batch_prop) > 0) && (stallStreamCnt == 0) &&
+            (rawStreamCnt == 0) && !isZsl;
+
+    /* Channels of streams that come back unchanged are kept, along with
+     * their backend channel and stream objects. Batched streams are sized
+     * per session, so HFR always rebuilds. */
+    char reuse_prop[PROPERTY_VALUE_MAX];
+    memset(reuse_prop, 0, sizeof(reuse_prop));
+    property_get("persist.camera.hal3.reuse", reuse_prop, "1");
+    bool reuseChannels = (atoi(reuse_prop) > 0) && !mBatchCapable &&
+            !bWasBatchCapable;
+    uint32_t reusedCnt = 0;
+
     camera3_stream_t *inputStream = NULL;
     camera3_stream_t *jpegStream = NULL;
     for (size_t i = 0; i < streamList->num_streams; i++) {
@@ -1153,13 +1346,17 @@ int QCamera3HardwareInterface::configureStreams(
         for (List<stream_info_t*>::iterator it=mStreamInfo.begin();
                 it != mStreamInfo.end(); it++) {
             if ((*it)->stream == newStream) {
-                QCamera3Channel *channel =
-                    (QCamera3Channel*)(*it)->stream->priv;
+                // otherwise the channel is kept or rebuilt once the new
+                // stream parameters are known
+                if (!reuseChannels) {
+                    QCamera3Channel *channel =
+                        (QCamera3Channel*)(*it)->stream->priv;
+                    delete channel;
+                    (*it)->stream->priv = NULL;
+                    (*it)->channel = NULL;
+                }
                 stream_exists = true;
-                delete channel;
                 (*it)->status = VALID;
-                (*it)->stream->priv = NULL;
-                (*it)->channel = NULL;
             }
         }
         if (!stream_exists) {
@@ -1172,6 +1369,7 @@ int QCamera3HardwareInterface::configureStreams(
                pthread_mutex_unlock(&mMutex);
                return rc;
             }
+            memset(stream_info, 0, sizeof(stream_info_t));
             stream_info->stream = newStream;
             stream_info->status = VALID;
             stream_info->channel = NULL;
@@ -1193,7 +1391,7 @@ int QCamera3HardwareInterface::configureStreams(
     mInputStream = inputStream;
 
     cleanAndSortStreamInfo();
-    if (mMetadataChannel) {
+    if (mMetadataChannel && !reuseChannels) {
         delete mMetadataChannel;
         mMetadataChannel = NULL;
     }
@@ -1207,23 +1405,26 @@ int QCamera3HardwareInterface::configureStreams(
         mAnalysisChannel = NULL;
     }
 
-    //Create metadata channel and initialize it
-    mMetadataChannel = new QCamera3MetadataChannel(mCameraHandle->camera_handle,
-                    mCameraHandle->ops, captureResultCb,
-                    &gCamCapability[mCameraId]->padding_info, CAM_QCOM_FEATURE_NONE, this);
+    //Create metadata channel and initialize it, its stream does not depend
+    //on the configuration so an existing one is kept
     if (mMetadataChannel == NULL) {
-        ALOGE("%s: failed to allocate metadata channel", __func__);
-        rc = -ENOMEM;
-        pthread_mutex_unlock(&mMutex);
-        return rc;
-    }
-    rc = mMetadataChannel->initialize(IS_TYPE_NONE);
-    if (rc < 0) {
-        ALOGE("%s: metadata channel initialization failed", __func__);
-        delete mMetadataChannel;
-        mMetadataChannel = NULL;
-        pthread_mutex_unlock(&mMutex);
-        return rc;
+        mMetadataChannel = new QCamera3MetadataChannel(mCameraHandle->camera_handle,
+                        mCameraHandle->ops, captureResultCb,
+                        &gCamCapability[mCameraId]->padding_info, CAM_QCOM_FEATURE_NONE, this);
+        if (mMetadataChannel == NULL) {
+            ALOGE("%s: failed to allocate metadata channel", __func__);
+            rc = -ENOMEM;
+            pthread_mutex_unlock(&mMutex);
+            return rc;
+        }
+        rc = mMetadataChannel->initialize(IS_TYPE_NONE);
+        if (rc < 0) {
+            ALOGE("%s: metadata channel initialization failed", __func__);
+            delete mMetadataChannel;
+            mMetadataChannel = NULL;
+            pthread_mutex_unlock(&mMutex);
+            return rc;
+        }
     }
 
     // Create analysis stream all the time, even when h/w support is not available
@@ -1339,32 +1540,75 @@ int QCamera3HardwareInterface::configureStreams(
                 break;
             }
         }
-        if (newStream->priv == NULL) {
-            //New stream, construct channel
-            switch (newStream->stream_type) {
-            case CAMERA3_STREAM_INPUT:
-                newStream->usage = GRALLOC_USAGE_HW_CAMERA_READ;
-                break;
-            case CAMERA3_STREAM_BIDIRECTIONAL:
-                newStream->usage = GRALLOC_USAGE_HW_CAMERA_READ |
-                    GRALLOC_USAGE_HW_CAMERA_WRITE;
-                break;
-            case CAMERA3_STREAM_OUTPUT:
-                /* For video encoding stream, set read/write rarely
-                 * flag so that they may be set to un-cached */
-                if (newStream->usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)
-                    newStream->usage =
-                         (GRALLOC_USAGE_SW_READ_RARELY |
-                         GRALLOC_USAGE_SW_WRITE_RARELY |
-                         GRALLOC_USAGE_HW_CAMERA_WRITE);
-                else
-                    newStream->usage = GRALLOC_USAGE_HW_CAMERA_WRITE;
-                break;
-            default:
-                ALOGE("%s: Invalid stream_type %d", __func__, newStream->stream_type);
+
+        stream_info_t *stream_info = NULL;
+        for (List<stream_info_t*>::iterator it=mStreamInfo.begin();
+                it != mStreamInfo.end(); it++) {
+            if ((*it)->stream == newStream) {
+                stream_info = *it;
                 break;
             }
+        }
+        if (stream_info == NULL) {
+            ALOGE("%s: stream %p missing from stream info", __func__, newStream);
+            pthread_mutex_unlock(&mMutex);
+            return -EINVAL;
+        }
+
+        channel_config_t config;
+        memset(&config, 0, sizeof(channel_config_t));
+        config.stream_type = newStream->stream_type;
+        config.format = newStream->format;
+        config.width = newStream->width;
+        config.height = newStream->height;
+        config.type = mStreamConfigInfo.type[i];
+        config.postprocess_mask = mStreamConfigInfo.postprocess_mask[i];
+        config.dim = mStreamConfigInfo.stream_sizes[i];
+        if (newStream->format == HAL_PIXEL_FORMAT_BLOB) {
+            config.num_buffers = m_bIsVideo ? 1 : MAX_INFLIGHT_REQUESTS;
+            config.is_4k_video = m_bIs4KVideo;
+        } else {
+            config.num_buffers = mBatchCapable ? MAX_INFLIGHT_HFR_REQUESTS :
+                    MAX_INFLIGHT_REQUESTS;
+        }
+        if (newStream->priv != NULL) {
+            if (!memcmp(&stream_info->config, &config,
+                    sizeof(channel_config_t))) {
+                reusedCnt++;
+            } else {
+                delete (QCamera3Channel *)newStream->priv;
+                newStream->priv = NULL;
+                stream_info->channel = NULL;
+            }
+        }
+        stream_info->config = config;
 
+        switch (newStream->stream_type) {
+        case CAMERA3_STREAM_INPUT:
+            newStream->usage = GRALLOC_USAGE_HW_CAMERA_READ;
+            break;
+        case CAMERA3_STREAM_BIDIRECTIONAL:
+            newStream->usage = GRALLOC_USAGE_HW_CAMERA_READ |
+                GRALLOC_USAGE_HW_CAMERA_WRITE;
+            break;
+        case CAMERA3_STREAM_OUTPUT:
+            /* For video encoding stream, set read/write rarely
+             * flag so that they may be set to un-cached */
+            if (newStream->usage & GRALLOC_USAGE_HW_VIDEO_ENCODER)
+                newStream->usage =
+                     (GRALLOC_USAGE_SW_READ_RARELY |
+                     GRALLOC_USAGE_SW_WRITE_RARELY |
+                     GRALLOC_USAGE_HW_CAMERA_WRITE);
+            else
+                newStream->usage = GRALLOC_USAGE_HW_CAMERA_WRITE;
+            break;
+        default:
+            ALOGE("%s: Invalid stream_type %d", __func__, newStream->stream_type);
+            break;
+        }
+
+        if (newStream->priv == NULL) {
+            //New stream, construct channel
             if (newStream->format == HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED &&
                     newStream->stream_type == CAMERA3_STREAM_BIDIRECTIONAL &&
                     jpegStream) {
@@ -1395,7 +1639,9 @@ int QCamera3HardwareInterface::configureStreams(
                             this,
                             newStream,
                             (cam_stream_type_t) mStreamConfigInfo.type[i],
-                            mStreamConfigInfo.postprocess_mask[i]);
+                            mStreamConfigInfo.postprocess_mask[i],
+                            (mBatchCapable ? MAX_INFLIGHT_HFR_REQUESTS :
+                                    MAX_INFLIGHT_REQUESTS));
                     if (channel == NULL) {
                         ALOGE("%s: allocation of channel failed", __func__);
                         pthread_mutex_unlock(&mMutex);
@@ -1446,18 +1692,17 @@ int QCamera3HardwareInterface::configureStreams(
                 }
             }
 
-            for (List<stream_info_t*>::iterator it=mStreamInfo.begin();
-                    it != mStreamInfo.end(); it++) {
-                if ((*it)->stream == newStream) {
-                    (*it)->channel = (QCamera3Channel*) newStream->priv;
-                    break;
-                }
-            }
+            stream_info->channel = (QCamera3Channel*) newStream->priv;
+            stream_info->is_type = IS_TYPE_NONE;
         } else {
-            // Channel already exists for this stream
-            // Do nothing for now
+            // Channel kept from the previous configuration, the framework
+            // resets max_buffers along with usage on every configuration
+            newStream->max_buffers =
+                    ((QCamera3Channel *)newStream->priv)->getNumBuffers();
         }
     }
+    CDBG_HIGH("%s: %u of %u channels kept from previous configuration",
+            __func__, reusedCnt, streamList->num_streams);
 
     if (mPictureChannel && m_bIs4KVideo) {
         mPictureChannel->overrideYuvSize(videoWidth, videoHeight);
@@ -1528,8 +1773,15 @@ int QCamera3HardwareInterface::configureStreams(
     mPendingReprocessResultList.clear();
 
     mFirstRequest = true;
+    mBatchSize = 0;
+    mHFRVideoFps = 0;
+    mBatchFrameCount = 0;
+    mPendingBatchMap.clear();
     //Get min frame duration for this streams configuration
     deriveMinFrameDuration();
+    resetInflightWindow();
+    mResultBuilder.reset();
+    invalidateSettingsCache();
 
     /* Turn on video hint only if video stream is configured */
     updatePowerHint(bWasVideo, m_bIsVideo);
@@ -1780,28 +2032,24 @@ int32_t QCamera3HardwareInterface::handlePendingReprocResults(uint32_t frame_num
             CDBG("%s: Delayed reprocess notify %d", __func__,
                     frame_number);
 
-            for (pendingRequestIterator k = mPendingRequestsList.begin();
-                    k != mPendingRequestsList.end(); k++) {
-
-                if (k->frame_number == j->frame_number) {
-                    CDBG("%s: Found reprocess frame number %d in pending reprocess List "
-                            "Take it out!!", __func__,
-                            k->frame_number);
-
-                    camera3_capture_result result;
-                    memset(&result, 0, sizeof(camera3_capture_result));
-                    result.frame_number = frame_number;
-                    result.num_output_buffers = 1;
-                    result.output_buffers =  &j->buffer;
-                    result.input_buffer = k->input_buffer;
-                    result.result = k->settings;
-                    result.partial_result = PARTIAL_RESULT_COUNT;
-                    mCallbackOps->process_capture_result(mCallbackOps, &result);
-
-                    erasePendingRequest(k);
-                    mPendingRequest--;
-                    break;
-                }
+            pendingRequestIterator k = findPendingRequest(j->frame_number);
+            if (k != mPendingRequestsList.end()) {
+                CDBG("%s: Found reprocess frame number %d in pending reprocess List "
+                        "Take it out!!", __func__,
+                        k->frame_number);
+
+                camera3_capture_result result;
+                memset(&result, 0, sizeof(camera3_capture_result));
+                result.frame_number = frame_number;
+                result.num_output_buffers = 1;
+                result.output_buffers =  &j->buffer;
+                result.input_buffer = k->input_buffer;
+                result.result = k->settings;
+                result.partial_result = PARTIAL_RESULT_COUNT;
+                mCallbackOps->process_capture_result(mCallbackOps, &result);
+
+                erasePendingRequest(k);
+                mPendingRequest--;
             }
             mPendingReprocessResultList.erase(j);
             break;
@@ -1816,12 +2064,14 @@ int32_t QCamera3HardwareInterface::handlePendingReprocResults(uint32_t frame_num
  * DESCRIPTION: Handles metadata buffer callback with mMutex lock held.
  *
  * PARAMETERS : @metadata_buf: metadata buffer
+ *              @free_and_bufdone_meta_buf: return the metadata buffer once
+ *                  done. False while a batch is still fanned out of it.
  *
  * RETURN     :
  *
  *==========================================================================*/
 void QCamera3HardwareInterface::handleMetadataWithLock(
-    mm_camera_super_buf_t *metadata_buf)
+    mm_camera_super_buf_t *metadata_buf, bool free_and_bufdone_meta_buf)
 {
     ATRACE_CALL();
     metadata_buffer_t *metadata = (metadata_buffer_t *)metadata_buf->bufs[0]->buffer;
@@ -1846,8 +2096,10 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
     if ((NULL == p_frame_number_valid) || (NULL == p_frame_number) || (NULL == p_capture_time) ||
             (NULL == p_urgent_frame_number_valid) || (NULL == p_urgent_frame_number)) {
         ALOGE("%s: Invalid metadata", __func__);
-        mMetadataChannel->bufDone(metadata_buf);
-        free(metadata_buf);
+        if (free_and_bufdone_meta_buf) {
+            mMetadataChannel->bufDone(metadata_buf);
+            free(metadata_buf);
+        }
         goto done_metadata;
     } else {
         frame_number_valid = *p_frame_number_valid;
@@ -1862,48 +2114,46 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
           __func__, urgent_frame_number, capture_time);
 
         //Recieved an urgent Frame Number, handle it
-        //using partial results
-        for (pendingRequestIterator i =
-                mPendingRequestsList.begin(); i != mPendingRequestsList.end(); i++) {
-            CDBG("%s: Iterator Frame = %d urgent frame = %d",
-                __func__, i->frame_number, urgent_frame_number);
-
-            if (i->frame_number < urgent_frame_number &&
-                i->partial_result_cnt == 0) {
+        //using partial results. Pending requests are kept in frame
+        //number order, so only the head can have missed theirs.
+        for (pendingRequestIterator i = mPendingRequestsList.begin();
+                i != mPendingRequestsList.end() &&
+                i->frame_number < urgent_frame_number; i++) {
+            if (i->partial_result_cnt == 0) {
                 ALOGE("%s: Error: HAL missed urgent metadata for frame number %d",
                     __func__, i->frame_number);
             }
+        }
 
-            if (i->frame_number == urgent_frame_number &&
-                     i->bUrgentReceived == 0) {
-
-                camera3_capture_result_t result;
-                memset(&result, 0, sizeof(camera3_capture_result_t));
+        pendingRequestIterator i = findPendingRequest(urgent_frame_number);
+        if (i != mPendingRequestsList.end() && i->bUrgentReceived == 0) {
+            camera3_capture_result_t result;
+            memset(&result, 0, sizeof(camera3_capture_result_t));
 
-                i->partial_result_cnt++;
-                i->bUrgentReceived = 1;
-                // Extract 3A metadata
-                result.result =
-                    translateCbUrgentMetadataToResultMetadata(metadata);
-                // Populate metadata result
-                result.frame_number = urgent_frame_number;
-                result.num_output_buffers = 0;
-                result.output_buffers = NULL;
-                result.partial_result = i->partial_result_cnt;
+            i->partial_result_cnt++;
+            i->bUrgentReceived = 1;
+            // Extract 3A metadata
+            result.result =
+                translateCbUrgentMetadataToResultMetadata(metadata);
+            // Populate metadata result
+            result.frame_number = urgent_frame_number;
+            result.num_output_buffers = 0;
+            result.output_buffers = NULL;
+            result.partial_result = i->partial_result_cnt;
 
-                mCallbackOps->process_capture_result(mCallbackOps, &result);
-                CDBG("%s: urgent frame_number = %u, capture_time = %lld",
-                     __func__, result.frame_number, capture_time);
-                free_camera_metadata((camera_metadata_t *)result.result);
-                break;
-            }
+            mCallbackOps->process_capture_result(mCallbackOps, &result);
+            CDBG("%s: urgent frame_number = %u, capture_time = %lld",
+                 __func__, result.frame_number, capture_time);
+            free_camera_metadata((camera_metadata_t *)result.result);
         }
     }
 
     if (!frame_number_valid) {
         CDBG("%s: Not a valid normal frame number, used as SOF only", __func__);
-        mMetadataChannel->bufDone(metadata_buf);
-        free(metadata_buf);
+        if (free_and_bufdone_meta_buf) {
+            mMetadataChannel->bufDone(metadata_buf);
+            free(metadata_buf);
+        }
         goto done_metadata;
     }
     CDBG("%s: valid frame_number = %u, capture_time = %lld", __func__,
@@ -1913,6 +2163,7 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
             i != mPendingRequestsList.end() && i->frame_number <= frame_number;) {
         camera3_capture_result_t result;
         memset(&result, 0, sizeof(camera3_capture_result_t));
+        bool resultFromBuilder = false;
 
         CDBG("%s: frame_number in the list is %u", __func__, i->frame_number);
         i->partial_result_cnt++;
@@ -1990,10 +2241,12 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
             mCallbackOps->notify(mCallbackOps, &notify_msg);
 
             i->timestamp = capture_time;
+            updateInflightWindow(frame_number, capture_time);
 
             result.result = translateFromHalMetadata(metadata,
                     i->timestamp, i->request_id, i->jpegMetadata, i->pipeline_depth,
                     i->capture_intent);
+            resultFromBuilder = true;
 
             saveExifParams(metadata);
 
@@ -2015,7 +2268,7 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
 
 
                 mPictureChannel->queueReprocMetadata(metadata_buf);
-            } else {
+            } else if (free_and_bufdone_meta_buf) {
                 // Return metadata buffer
                 mMetadataChannel->bufDone(metadata_buf);
                 free(metadata_buf);
@@ -2080,13 +2333,21 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
             mCallbackOps->process_capture_result(mCallbackOps, &result);
             CDBG("%s: meta frame_number = %u, capture_time = %lld",
                     __func__, result.frame_number, i->timestamp);
-            free_camera_metadata((camera_metadata_t *)result.result);
+            if (resultFromBuilder) {
+                mResultBuilder.release(result.result);
+            } else {
+                free_camera_metadata((camera_metadata_t *)result.result);
+            }
             delete[] result_buffers;
         } else {
             mCallbackOps->process_capture_result(mCallbackOps, &result);
             CDBG("%s: meta frame_number = %u, capture_time = %lld",
                         __func__, result.frame_number, i->timestamp);
-            free_camera_metadata((camera_metadata_t *)result.result);
+            if (resultFromBuilder) {
+                mResultBuilder.release(result.result);
+            } else {
+                free_camera_metadata((camera_metadata_t *)result.result);
+            }
         }
         // erase the element from the list
         i = erasePendingRequest(i);
@@ -2105,6 +2366,92 @@ done_metadata:
 
 }
 
+/*===========================================================================
+ * FUNCTION   : handleBatchMetadata
+ *
+ * DESCRIPTION: Handles the metadata of a HFR batch with mMutex lock held.
+ *              The backend reports one metadata per batch for the frame
+ *              number of its last frame; every frame of the batch gets its
+ *              own result, with the timestamp spread back at sensor rate.
+ *
+ * PARAMETERS : @metadata_buf: metadata buffer
+ *
+ * RETURN     :
+ *
+ *==========================================================================*/
+void QCamera3HardwareInterface::handleBatchMetadata(
+        mm_camera_super_buf_t *metadata_buf)
+{
+    ATRACE_CALL();
+    metadata_buffer_t *metadata = (metadata_buffer_t *)metadata_buf->bufs[0]->buffer;
+    int32_t *p_frame_number_valid =
+            POINTER_OF_META(CAM_INTF_META_FRAME_NUMBER_VALID, metadata);
+    uint32_t *p_frame_number = POINTER_OF_META(CAM_INTF_META_FRAME_NUMBER, metadata);
+    int64_t *p_capture_time = POINTER_OF_META(CAM_INTF_META_SENSOR_TIMESTAMP, metadata);
+    int32_t *p_urgent_frame_number_valid =
+            POINTER_OF_META(CAM_INTF_META_URGENT_FRAME_NUMBER_VALID, metadata);
+    uint32_t *p_urgent_frame_number =
+            POINTER_OF_META(CAM_INTF_META_URGENT_FRAME_NUMBER, metadata);
+
+    if ((NULL == p_frame_number_valid) || (NULL == p_frame_number) ||
+            (NULL == p_capture_time) || (NULL == p_urgent_frame_number_valid) ||
+            (NULL == p_urgent_frame_number) || (mHFRVideoFps == 0)) {
+        handleMetadataWithLock(metadata_buf, true);
+        return;
+    }
+
+    uint32_t last_frame_number = *p_frame_number;
+    uint32_t first_frame_number = last_frame_number;
+    uint32_t last_urgent_frame_number = *p_urgent_frame_number;
+    uint32_t first_urgent_frame_number = last_urgent_frame_number;
+    int64_t last_capture_time = *p_capture_time;
+    uint32_t frame_count = 1;
+
+    if (*p_urgent_frame_number_valid) {
+        ssize_t idx = mPendingBatchMap.indexOfKey(last_urgent_frame_number);
+        if (idx >= 0) {
+            first_urgent_frame_number = mPendingBatchMap.valueAt(idx);
+        }
+        frame_count = last_urgent_frame_number - first_urgent_frame_number + 1;
+    }
+    if (*p_frame_number_valid) {
+        ssize_t idx = mPendingBatchMap.indexOfKey(last_frame_number);
+        if (idx >= 0) {
+            first_frame_number = mPendingBatchMap.valueAt(idx);
+            mPendingBatchMap.removeItemsAt(idx);
+        } else {
+            ALOGE("%s: No batch pending for frame %u", __func__,
+                    last_frame_number);
+        }
+        if (last_frame_number - first_frame_number + 1 > frame_count) {
+            frame_count = last_frame_number - first_frame_number + 1;
+        }
+    }
+    CDBG("%s: batch of %u, frames %u-%u, urgent %u-%u", __func__, frame_count,
+            first_frame_number, last_frame_number,
+            first_urgent_frame_number, last_urgent_frame_number);
+
+    for (uint32_t i = 0; i < frame_count; i++) {
+        if (*p_urgent_frame_number_valid) {
+            *p_urgent_frame_number =
+                    MIN(first_urgent_frame_number + i, last_urgent_frame_number);
+        }
+        if (*p_frame_number_valid) {
+            *p_frame_number = MIN(first_frame_number + i, last_frame_number);
+            *p_capture_time = last_capture_time -
+                    (int64_t)((last_frame_number - *p_frame_number) *
+                    NSEC_PER_SEC / mHFRVideoFps);
+        }
+        handleMetadataWithLock(metadata_buf, (i == frame_count - 1));
+    }
+
+    // Nothing else is left in the backend, a partial batch would only
+    // wait for the timeout
+    if (mPendingBatchMap.isEmpty() && (mBatchFrameCount > 0)) {
+        flushPendingBatch();
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : handleBufferWithLock
  *
@@ -2123,18 +2470,15 @@ void QCamera3HardwareInterface::handleBufferWithLock(
     // If the frame number doesn't exist in the pending request list,
     // directly send the buffer to the frameworks, and update pending buffers map
     // Otherwise, book-keep the buffer.
-    pendingRequestIterator i = mPendingRequestsList.begin();
-    while (i != mPendingRequestsList.end() && i->frame_number != frame_number){
-        i++;
-    }
+    pendingRequestIterator i = findPendingRequest(frame_number);
     if (i == mPendingRequestsList.end()) {
-        // Verify all pending requests frame_numbers are greater
-        for (pendingRequestIterator j = mPendingRequestsList.begin();
-                j != mPendingRequestsList.end(); j++) {
-            if (j->frame_number < frame_number) {
-                ALOGE("%s: Error: pending frame number %d is smaller than %d",
-                        __func__, j->frame_number, frame_number);
-            }
+        // Verify all pending requests frame_numbers are greater; the list
+        // is in frame number order so checking the oldest one is enough
+        if (!mPendingRequestsList.empty() &&
+                mPendingRequestsList.begin()->frame_number < frame_number) {
+            ALOGE("%s: Error: pending frame number %d is smaller than %d",
+                    __func__, mPendingRequestsList.begin()->frame_number,
+                    frame_number);
         }
         camera3_capture_result_t result;
         memset(&result, 0, sizeof(camera3_capture_result_t));
@@ -2217,14 +2561,9 @@ void QCamera3HardwareInterface::handleBufferWithLock(
             CDBG("%s: mPendingBuffersMap.num_buffers = %d",
                 __func__, mPendingBuffersMap.num_buffers);
 
-            bool notifyNow = true;
-            for (pendingRequestIterator j = mPendingRequestsList.begin();
-                    j != mPendingRequestsList.end(); j++) {
-                if (j->frame_number < frame_number) {
-                    notifyNow = false;
-                    break;
-                }
-            }
+            // Only notify once all older requests are retired
+            bool notifyNow =
+                    (mPendingRequestsList.begin()->frame_number >= frame_number);
 
             if (notifyNow) {
                 camera3_capture_result result;
@@ -2287,6 +2626,123 @@ void QCamera3HardwareInterface::unblockRequestIfNecessary()
    pthread_cond_signal(&mRequestCond);
 }
 
+/*===========================================================================
+ * FUNCTION   : resetInflightWindow
+ *
+ * DESCRIPTION: Reset the in-flight request window for a new stream
+ *              configuration. The upper bound is the smallest buffer count
+ *              negotiated for a non-blob output stream, since the framework
+ *              can't queue more requests than that stream has buffers. Note
+ *              that mMutex is held when this function is called.
+ *
+ * PARAMETERS :
+ *
+ * RETURN     :
+ *
+ *==========================================================================*/
+void QCamera3HardwareInterface::resetInflightWindow()
+{
+    uint32_t max = mBatchCapable ? MAX_INFLIGHT_HFR_REQUESTS :
+            MAX_INFLIGHT_REQUESTS;
+
+    for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+        camera3_stream_t *stream = (*it)->stream;
+        // Blob requests are sparse, a single jpeg buffer must not
+        // throttle every other request
+        if ((stream->stream_type == CAMERA3_STREAM_INPUT) ||
+                (stream->format == HAL_PIXEL_FORMAT_BLOB) ||
+                (stream->max_buffers == 0)) {
+            continue;
+        }
+        if (stream->max_buffers < max) {
+            max = stream->max_buffers;
+        }
+    }
+    if (max < MIN_INFLIGHT_REQUESTS) {
+        max = MIN_INFLIGHT_REQUESTS;
+    }
+
+    memset(&mInflight, 0, sizeof(mInflight));
+    mInflight.window = MIN_INFLIGHT_REQUESTS;
+    mInflight.max = max;
+    mInflight.interval = mMinProcessedFrameDuration;
+    CDBG("%s: in-flight window %u, max %u", __func__,
+            mInflight.window, mInflight.max);
+}
+
+/*===========================================================================
+ * FUNCTION   : updateInflightWindow
+ *
+ * DESCRIPTION: Fold the result of one request into the sensor-to-result
+ *              latency and frame interval estimates and resize the in-flight
+ *              window. At 45fps and below the window stays at
+ *              MIN_INFLIGHT_REQUESTS, which already covers the pipeline.
+ *              Faster sessions get the frames still in post processing plus
+ *              the request being prepared. Neither estimate depends on how
+ *              long requests wait in the HAL, so the window does not feed
+ *              back into itself. Note that mMutex is held when this function
+ *              is called.
+ *
+ * PARAMETERS :
+ *   @frame_number : frame number of the result
+ *   @capture_time : sensor timestamp of the result, CLOCK_MONOTONIC
+ *
+ * RETURN     :
+ *
+ *==========================================================================*/
+void QCamera3HardwareInterface::updateInflightWindow(uint32_t frame_number,
+        nsecs_t capture_time)
+{
+    if (mBatchSize > 0) {
+        // requests arrive and complete a batch at a time, the window stays
+        // fully open
+        return;
+    }
+
+    nsecs_t now = systemTime(CLOCK_MONOTONIC);
+
+    // Timestamps from another clock or a stale frame would make the
+    // estimate meaningless, ignore anything older than a second
+    if ((capture_time > 0) && (now > capture_time) &&
+            (now - capture_time < (nsecs_t)NSEC_PER_SEC)) {
+        nsecs_t latency = now - capture_time;
+        mInflight.latency = (mInflight.latency == 0) ? latency :
+                (mInflight.latency * 7 + latency) / 8;
+    }
+
+    if ((mInflight.last_capture_time > 0) &&
+            (frame_number > mInflight.last_frame_number) &&
+            (capture_time > mInflight.last_capture_time)) {
+        nsecs_t interval = (capture_time - mInflight.last_capture_time) /
+                (nsecs_t)(frame_number - mInflight.last_frame_number);
+        mInflight.interval = (mInflight.interval == 0) ? interval :
+                (mInflight.interval * 7 + interval) / 8;
+    }
+    mInflight.last_frame_number = frame_number;
+    mInflight.last_capture_time = capture_time;
+
+    if ((mInflight.latency <= 0) || (mInflight.interval <= 0)) {
+        return;
+    }
+
+    uint32_t window = MIN_INFLIGHT_REQUESTS;
+    if (mInflight.interval < INFLIGHT_GROW_INTERVAL) {
+        nsecs_t depth = (mInflight.latency + mInflight.interval - 1) /
+                mInflight.interval + 1;
+        if (depth > (nsecs_t)window) {
+            window = (depth > (nsecs_t)mInflight.max) ?
+                    mInflight.max : (uint32_t)depth;
+        }
+    }
+    if (window != mInflight.window) {
+        CDBG("%s: in-flight window %u -> %u, latency %lld ns, interval %lld ns",
+                __func__, mInflight.window, window,
+                (long long)mInflight.latency, (long long)mInflight.interval);
+        mInflight.window = window;
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : processCaptureRequest
  *
@@ -2415,6 +2871,16 @@ int QCamera3HardwareInterface::processCaptureRequest(
         mCameraHandle->ops->set_parms(mCameraHandle->camera_handle,
                     mParameters);
 
+        // Streams are added on buffer registration, batch size goes first
+        if (mBatchCapable) {
+            rc = setBatchMode(meta);
+            if (rc != NO_ERROR) {
+                ALOGE("%s: setBatchMode failed", __func__);
+                pthread_mutex_unlock(&mMutex);
+                return rc;
+            }
+        }
+
         cam_dimension_t sensor_dim;
         memset(&sensor_dim, 0, sizeof(sensor_dim));
         rc = getSensorOutputSize(sensor_dim);
@@ -2428,6 +2894,21 @@ int QCamera3HardwareInterface::processCaptureRequest(
                 gCamCapability[mCameraId]->active_array_size.height,
                 sensor_dim.width, sensor_dim.height);
 
+        // Channels kept from the previous configuration still have their
+        // streams, rebuild the ones added with a different IS type
+        for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+            QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
+            cam_is_type_t streamIsType = is_type;
+            if (setEis && (*it)->stream->format == HAL_PIXEL_FORMAT_BLOB) {
+                streamIsType = IS_TYPE_DIS;
+            }
+            if ((channel != NULL) && ((*it)->is_type != streamIsType)) {
+                channel->destroyStreams();
+            }
+            (*it)->is_type = streamIsType;
+        }
+
         for (size_t i = 0; i < request->num_output_buffers; i++) {
             const camera3_stream_buffer_t& output = request->output_buffers[i];
             QCamera3Channel *channel = (QCamera3Channel *)output.stream->priv;
@@ -2618,6 +3099,11 @@ int QCamera3HardwareInterface::processCaptureRequest(
     }
 
     if(request->input_buffer == NULL) {
+       // New settings apply to the next batch, the backend takes the
+       // settings of a batch from its last frame
+       if ((mBatchSize > 0) && (request->settings != NULL)) {
+           flushPendingBatch();
+       }
        rc = setFrameParameters(request, streamID, blob_request, snapshotStreamId);
         if (rc < 0) {
             ALOGE("%s: fail to set frame parameters", __func__);
@@ -2685,7 +3171,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
     CDBG("%s: mPendingBuffersMap.num_buffers = %d",
           __func__, mPendingBuffersMap.num_buffers);
 
-    mPendingRequestsList.push_back(pendingRequest);
+    addPendingRequest(pendingRequest);
 
     if(mFlush) {
         pthread_mutex_unlock(&mMutex);
@@ -2751,8 +3237,22 @@ int QCamera3HardwareInterface::processCaptureRequest(
     }
 
     if(request->input_buffer == NULL) {
-        /*set the parameters to backend*/
-        mCameraHandle->ops->set_parms(mCameraHandle->camera_handle, mParameters);
+        if (mBatchSize > 0) {
+            // The backend takes one request per batch, carrying the
+            // settings and frame number of its last frame
+            if (mBatchFrameCount == 0) {
+                mFirstFrameNumberInBatch = frameNumber;
+                mBatchStartTime = systemTime(CLOCK_MONOTONIC);
+                pthread_cond_signal(&mBatchCond);
+            }
+            mBatchFrameCount++;
+            if (mBatchFrameCount == mBatchSize) {
+                flushPendingBatch();
+            }
+        } else {
+            /*set the parameters to backend*/
+            mCameraHandle->ops->set_parms(mCameraHandle->camera_handle, mParameters);
+        }
     }
 
     mFirstRequest = false;
@@ -2771,7 +3271,12 @@ int QCamera3HardwareInterface::processCaptureRequest(
     //Block on conditional variable
 
     mPendingRequest++;
-    while (mPendingRequest >= MIN_INFLIGHT_REQUESTS) {
+    mInflight.requests++;
+    nsecs_t blockStart = 0;
+    while (mPendingRequest >= (int)mInflight.window) {
+        if (blockStart == 0) {
+            blockStart = systemTime(CLOCK_MONOTONIC);
+        }
         if (!isValidTimeout) {
             CDBG("%s: Blocking on conditional wait", __func__);
             pthread_cond_wait(&mRequestCond, &mMutex);
@@ -2788,10 +3293,18 @@ int QCamera3HardwareInterface::processCaptureRequest(
         CDBG("%s: Unblocked", __func__);
         if (mWokenUpByDaemon) {
             mWokenUpByDaemon = false;
-            if (mPendingRequest < MAX_INFLIGHT_REQUESTS)
+            if (mPendingRequest < (int)mInflight.max)
                 break;
         }
     }
+    if (blockStart != 0) {
+        nsecs_t blocked = systemTime(CLOCK_MONOTONIC) - blockStart;
+        mInflight.blocked++;
+        mInflight.blocked_time += blocked;
+        if (blocked > mInflight.max_blocked_time) {
+            mInflight.max_blocked_time = blocked;
+        }
+    }
     pthread_mutex_unlock(&mMutex);
 
     return rc;
@@ -2849,23 +3362,139 @@ void QCamera3HardwareInterface::dump(int fd)
     }
     dprintf(fd, "-------+-----------\n");
 
+    dprintf(fd, "\nSettings translation cache: hits %u, misses %u\n",
+            mSettingsCacheHits, mSettingsCacheMisses);
+
+    dprintf(fd, "\nIn-flight window: %u (max %u), sensor to result latency "
+            "%lld us, frame interval %lld us\n",
+            mInflight.window, mInflight.max,
+            (long long)(mInflight.latency / 1000),
+            (long long)(mInflight.interval / 1000));
+    dprintf(fd, "Requests %u, blocked %u, blocked time total %lld us "
+            "max %lld us\n",
+            mInflight.requests, mInflight.blocked,
+            (long long)(mInflight.blocked_time / 1000),
+            (long long)(mInflight.max_blocked_time / 1000));
+
+    dprintf(fd, "\nFlush: count %u, over %d ms %u, last stop %lld us, "
+            "error results %lld us, start %lld us, total %lld us, "
+            "max total %lld us\n",
+            mFlushStats.count, FLUSH_TARGET_LATENCY_MS, mFlushStats.over_target,
+            (long long)(mFlushStats.stop_time / 1000),
+            (long long)(mFlushStats.error_time / 1000),
+            (long long)(mFlushStats.start_time / 1000),
+            (long long)(mFlushStats.total_time / 1000),
+            (long long)(mFlushStats.max_total_time / 1000));
+
+    mm_camera_trace_dump(fd);
+
     dprintf(fd, "\n Camera HAL3 information End \n");
 
-    /* use dumpsys media.camera as trigger to send update debug level event */
-    mUpdateDebugLevel = true;
-    pthread_mutex_unlock(&mMutex);
-    return;
+    /* use dumpsys media.camera as trigger to send update debug level event */
+    mUpdateDebugLevel = true;
+    pthread_mutex_unlock(&mMutex);
+    return;
+}
+
+/*===========================================================================
+ * FUNCTION   : collectChannelOps
+ *
+ * DESCRIPTION: list the stream, support, analysis and raw dump channels for
+ *              a concurrent start or stop. The metadata channel is left out,
+ *              it has to start before and stop after the others.
+ *
+ * PARAMETERS :
+ *   @ops   : array to fill
+ *   @max   : size of the array
+ *   @start : true to start the channels, false to stop them
+ *
+ * RETURN     : number of entries filled
+ *==========================================================================*/
+size_t QCamera3HardwareInterface::collectChannelOps(ChannelOp *ops,
+        size_t max, bool start)
+{
+    size_t count = 0;
+    for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+            (it != mStreamInfo.end()) && (count < max); it++) {
+        QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
+        if (channel != NULL) {
+            ops[count].channel = channel;
+            ops[count++].start = start;
+        }
+    }
+    QCamera3Channel *others[] = {mSupportChannel, mAnalysisChannel,
+            mRawDumpChannel};
+    for (size_t i = 0; (i < sizeof(others) / sizeof(others[0])) &&
+            (count < max); i++) {
+        if (others[i] != NULL) {
+            ops[count].channel = others[i];
+            ops[count++].start = start;
+        }
+    }
+    return count;
+}
+
+/*===========================================================================
+ * FUNCTION   : runChannelOps
+ *
+ * DESCRIPTION: run channel starts or stops concurrently, one thread each,
+ *              the last one on the calling thread. An op whose thread
+ *              cannot be created runs inline.
+ *
+ * PARAMETERS :
+ *   @ops   : channel ops, rc is filled in on return
+ *   @count : number of ops
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3HardwareInterface::runChannelOps(ChannelOp *ops, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        ops[i].rc = NO_ERROR;
+        ops[i].spawned = false;
+        if (i + 1 < count) {
+            ops[i].spawned = (pthread_create(&ops[i].thread, NULL,
+                    channelOpRoutine, &ops[i]) == 0);
+        }
+        if (!ops[i].spawned) {
+            channelOpRoutine(&ops[i]);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (ops[i].spawned) {
+            pthread_join(ops[i].thread, NULL);
+        }
+    }
 }
 
 /*===========================================================================
- * FUNCTION   : flush
+ * FUNCTION   : channelOpRoutine
  *
- * DESCRIPTION:
+ * DESCRIPTION: thread body of a single channel start or stop
  *
  * PARAMETERS :
+ *   @data : ChannelOp to run
+ *
+ * RETURN     : NULL
+ *==========================================================================*/
+void *QCamera3HardwareInterface::channelOpRoutine(void *data)
+{
+    ChannelOp *op = (ChannelOp *)data;
+    op->rc = op->start ? op->channel->start() : op->channel->stop();
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : flush
  *
+ * DESCRIPTION: Stop all channels, return every pending request with an
+ *              error and restart the channels. Channels stop and start
+ *              concurrently, bounded by FLUSH_MAX_LATENCY_MS; the timing
+ *              of each phase is kept for dump().
  *
- * RETURN     :
+ * PARAMETERS : none
+ *
+ * RETURN     : 0 on success, error code otherwise
  *==========================================================================*/
 int QCamera3HardwareInterface::flush()
 {
@@ -2874,35 +3503,31 @@ int QCamera3HardwareInterface::flush()
     camera3_capture_result_t result;
     camera3_stream_buffer_t *pStream_Buf = NULL;
     FlushMap flushMap;
+    ChannelOp ops[MAX_NUM_STREAMS + 3];
+    size_t numOps = 0;
+    nsecs_t flushStart = systemTime(CLOCK_MONOTONIC);
 
     CDBG("%s: Unblocking Process Capture Request", __func__);
     pthread_mutex_lock(&mMutex);
     mFlush = true;
+    flushPendingBatch();
     pthread_mutex_unlock(&mMutex);
 
     memset(&result, 0, sizeof(camera3_capture_result_t));
 
-    // Stop the Streams/Channels
+    // Stop the Streams/Channels. Buffers can only go back to the
+    // framework once no channel writes to them anymore.
     for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
         it != mStreamInfo.end(); it++) {
-        QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
-        channel->stop();
         (*it)->status = INVALID;
     }
-
-    if (mSupportChannel) {
-        mSupportChannel->stop();
-    }
-    if (mAnalysisChannel) {
-        mAnalysisChannel->stop();
-    }
-    if (mRawDumpChannel) {
-        mRawDumpChannel->stop();
-    }
+    numOps = collectChannelOps(ops, sizeof(ops) / sizeof(ops[0]), false);
+    runChannelOps(ops, numOps);
     if (mMetadataChannel) {
         /* If content of mStreamInfo is not 0, there is metadata stream */
         mMetadataChannel->stop();
     }
+    nsecs_t stopDone = systemTime(CLOCK_MONOTONIC);
 
     // Mutex Lock
     pthread_mutex_lock(&mMutex);
@@ -3059,11 +3684,15 @@ int QCamera3HardwareInterface::flush()
     mPendingBuffersMap.num_buffers = 0;
     mPendingBuffersMap.mPendingBufferList.clear();
     mPendingReprocessResultList.clear();
+    // a partially collected HFR batch never reached the backend
+    mBatchFrameCount = 0;
+    mPendingBatchMap.clear();
     CDBG("%s: Cleared all the pending buffers ", __func__);
 
     mFlush = false;
+    nsecs_t errorDone = systemTime(CLOCK_MONOTONIC);
 
-    // Start the Streams/Channels
+    // Start the Streams/Channels, metadata first
     int rc = NO_ERROR;
     if (mMetadataChannel) {
         /* If content of mStreamInfo is not 0, there is metadata stream */
@@ -3074,39 +3703,41 @@ int QCamera3HardwareInterface::flush()
             return rc;
         }
     }
-    for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
-        it != mStreamInfo.end(); it++) {
-        QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
-        rc = channel->start();
-        if (rc < 0) {
-            ALOGE("%s: channel start failed", __func__);
-            pthread_mutex_unlock(&mMutex);
-            return rc;
+    numOps = collectChannelOps(ops, sizeof(ops) / sizeof(ops[0]), true);
+    runChannelOps(ops, numOps);
+    for (size_t i = 0; i < numOps; i++) {
+        // analysis stream is best effort
+        if ((ops[i].rc < 0) && (ops[i].channel != mAnalysisChannel)) {
+            ALOGE("%s: channel %p start failed %d", __func__,
+                    ops[i].channel, ops[i].rc);
+            rc = ops[i].rc;
         }
     }
-    if (mAnalysisChannel) {
-        mAnalysisChannel->start();
-    }
-    if (mSupportChannel) {
-        rc = mSupportChannel->start();
-        if (rc < 0) {
-            ALOGE("%s: Support channel start failed", __func__);
-            pthread_mutex_unlock(&mMutex);
-            return rc;
-        }
+
+    nsecs_t flushDone = systemTime(CLOCK_MONOTONIC);
+    mFlushStats.count++;
+    mFlushStats.stop_time = stopDone - flushStart;
+    mFlushStats.error_time = errorDone - stopDone;
+    mFlushStats.start_time = flushDone - errorDone;
+    mFlushStats.total_time = flushDone - flushStart;
+    if (mFlushStats.total_time > mFlushStats.max_total_time) {
+        mFlushStats.max_total_time = mFlushStats.total_time;
     }
-    if (mRawDumpChannel) {
-        rc = mRawDumpChannel->start();
-        if (rc < 0) {
-            ALOGE("%s: RAW dump channel start failed", __func__);
-            pthread_mutex_unlock(&mMutex);
-            return rc;
+    if (mFlushStats.total_time > ms2ns(FLUSH_TARGET_LATENCY_MS)) {
+        mFlushStats.over_target++;
+        if (mFlushStats.total_time > ms2ns(FLUSH_MAX_LATENCY_MS)) {
+            ALOGE("%s: flush took %lld ms: stop %lld ms, errors %lld ms, "
+                    "start %lld ms", __func__,
+                    (long long)ns2ms(mFlushStats.total_time),
+                    (long long)ns2ms(mFlushStats.stop_time),
+                    (long long)ns2ms(mFlushStats.error_time),
+                    (long long)ns2ms(mFlushStats.start_time));
         }
     }
 
     pthread_mutex_unlock(&mMutex);
 
-    return 0;
+    return (rc < 0) ? rc : 0;
 }
 
 /*===========================================================================
@@ -3126,14 +3757,126 @@ void QCamera3HardwareInterface::captureResultCb(mm_camera_super_buf_t *metadata_
                 camera3_stream_buffer_t *buffer, uint32_t frame_number)
 {
     pthread_mutex_lock(&mMutex);
-    if (metadata_buf)
-        handleMetadataWithLock(metadata_buf);
+    if (metadata_buf && (mBatchSize > 0))
+        handleBatchMetadata(metadata_buf);
+    else if (metadata_buf)
+        handleMetadataWithLock(metadata_buf, true);
     else
         handleBufferWithLock(buffer, frame_number);
     pthread_mutex_unlock(&mMutex);
     return;
 }
 
+/*===========================================================================
+ * FUNCTION   : QCameraMapIndex
+ *
+ * DESCRIPTION: constructor of QCameraMapIndex. Records for every key below
+ *              MAX_DENSE_KEYS the first entry of the table carrying it, in
+ *              both directions, so a lookup resolves to the same entry the
+ *              table scan would.
+ *
+ * PARAMETERS :
+ *   @arr     : map between the two enums
+ *   @len     : len of the map
+ *
+ * RETURN     : none
+ *==========================================================================*/
+template <typename fwkType, typename halType>
+QCamera3HardwareInterface::QCameraMapIndex<fwkType, halType>::QCameraMapIndex(
+        const QCameraMap<fwkType, halType> *arr, size_t len)
+    : mArr(arr),
+      mLen(len)
+{
+    memset(mFwkToHal, INVALID_ENTRY, sizeof(mFwkToHal));
+    memset(mHalToFwk, INVALID_ENTRY, sizeof(mHalToFwk));
+
+    // Tables too large for the entry encoding are always scanned
+    if (len >= (size_t)INVALID_ENTRY) {
+        ALOGE("%s: Map of %zu entries not indexed", __func__, len);
+        return;
+    }
+
+    for (size_t i = len; i > 0; i--) {
+        int fwk = (int)arr[i - 1].fwk_name;
+        int hal = (int)arr[i - 1].hal_name;
+        // walk backwards so the earliest duplicate is the one left behind
+        if ((fwk >= 0) && (fwk < MAX_DENSE_KEYS)) {
+            mFwkToHal[fwk] = (uint8_t)(i - 1);
+        }
+        if ((hal >= 0) && (hal < MAX_DENSE_KEYS)) {
+            mHalToFwk[hal] = (uint8_t)(i - 1);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : find
+ *
+ * DESCRIPTION: find the table entry of a key through the dense index, or by
+ *              scanning the table for keys outside of it
+ *
+ * PARAMETERS :
+ *   @dense   : dense index of the lookup direction
+ *   @key     : name to be looked up
+ *   @byHal   : true if key is a hal name, false if a framework name
+ *
+ * RETURN     : index of the first matching entry
+ *              NAME_NOT_FOUND if there is none
+ *==========================================================================*/
+template <typename fwkType, typename halType>
+int QCamera3HardwareInterface::QCameraMapIndex<fwkType, halType>::find(
+        const uint8_t *dense, int key, bool byHal) const
+{
+    if ((key >= 0) && (key < MAX_DENSE_KEYS) && (mLen < (size_t)INVALID_ENTRY)) {
+        return (INVALID_ENTRY == dense[key]) ? NAME_NOT_FOUND : dense[key];
+    }
+
+    for (size_t i = 0; i < mLen; i++) {
+        if (key == (byHal ? (int)mArr[i].hal_name : (int)mArr[i].fwk_name)) {
+            return (int)i;
+        }
+    }
+    return NAME_NOT_FOUND;
+}
+
+/*===========================================================================
+ * FUNCTION   : fwkName
+ *
+ * DESCRIPTION: map a hal enum value to its framework counterpart
+ *
+ * PARAMETERS :
+ *   @hal_name : name of the hal_parm to map
+ *
+ * RETURN     : fwk_name  -- success
+ *              NAME_NOT_FOUND if the value is not in the map
+ *==========================================================================*/
+template <typename fwkType, typename halType>
+int QCamera3HardwareInterface::QCameraMapIndex<fwkType, halType>::fwkName(
+        int hal_name) const
+{
+    int idx = find(mHalToFwk, hal_name, true);
+    return (NAME_NOT_FOUND == idx) ? NAME_NOT_FOUND : (int)mArr[idx].fwk_name;
+}
+
+/*===========================================================================
+ * FUNCTION   : halName
+ *
+ * DESCRIPTION: map a framework enum value to its hal counterpart
+ *
+ * PARAMETERS :
+ *   @fwk_name : name of the framework parm to map
+ *
+ * RETURN     : hal_name  -- success
+ *              NAME_NOT_FOUND if the value is not in the map
+ *==========================================================================*/
+template <typename fwkType, typename halType>
+int QCamera3HardwareInterface::QCameraMapIndex<fwkType, halType>::halName(
+        int fwk_name) const
+{
+    int idx = find(mFwkToHal, fwk_name, false);
+    return (NAME_NOT_FOUND == idx) ? NAME_NOT_FOUND : (int)mArr[idx].hal_name;
+}
+
 /*===========================================================================
  * FUNCTION   : lookupFwkName
  *
@@ -3141,22 +3884,19 @@ void QCamera3HardwareInterface::captureResultCb(mm_camera_super_buf_t *metadata_
  *              make sure the parameter is correctly propogated
  *
  * PARAMETERS  :
- *   @arr      : map between the two enums
- *   @len      : len of the map
+ *   @index    : index of the map between the two enums
  *   @hal_name : name of the hal_parm to map
  *
  * RETURN     : int type of status
  *              fwk_name  -- success
  *              none-zero failure code
  *==========================================================================*/
-template <typename halType, class mapType> int lookupFwkName(const mapType *arr,
-        size_t len, halType hal_name)
+template <typename halType, class indexType> int lookupFwkName(const indexType &index,
+        halType hal_name)
 {
-
-    for (size_t i = 0; i < len; i++) {
-        if (arr[i].hal_name == hal_name) {
-            return arr[i].fwk_name;
-        }
+    int fwk_name = index.fwkName((int)hal_name);
+    if (NAME_NOT_FOUND != fwk_name) {
+        return fwk_name;
     }
 
     /* Not able to find matching framework type is not necessarily
@@ -3173,21 +3913,19 @@ template <typename halType, class mapType> int lookupFwkName(const mapType *arr,
  *              make sure the parameter is correctly propogated
  *
  * PARAMETERS  :
- *   @arr      : map between the two enums
- *   @len      : len of the map
+ *   @index    : index of the map between the two enums
  *   @fwk_name : name of the hal_parm to map
  *
  * RETURN     : int32_t type of status
  *              hal_name  -- success
  *              none-zero failure code
  *==========================================================================*/
-template <typename fwkType, class mapType> int lookupHalName(const mapType *arr,
-        size_t len, fwkType fwk_name)
+template <typename fwkType, class indexType> int lookupHalName(const indexType &index,
+        fwkType fwk_name)
 {
-    for (size_t i = 0; i < len; i++) {
-        if (arr[i].fwk_name == fwk_name) {
-            return arr[i].hal_name;
-        }
+    int hal_name = index.halName((int)fwk_name);
+    if (NAME_NOT_FOUND != hal_name) {
+        return hal_name;
     }
 
     ALOGE("%s: Cannot find matching hal type fwk_name=%d", __func__, fwk_name);
@@ -3231,9 +3969,11 @@ template <class mapType> cam_cds_mode_type_t lookupProp(const mapType *arr,
  *   @jpegMetadata: additional jpeg metadata
  *
  * RETURN     : camera_metadata_t*
- *              metadata in a format specified by fwk
+ *              metadata in a format specified by fwk. The buffer belongs
+ *              to mResultBuilder and must be returned through
+ *              mResultBuilder.release() instead of being freed.
  *==========================================================================*/
-camera_metadata_t*
+const camera_metadata_t*
 QCamera3HardwareInterface::translateFromHalMetadata(
                                  metadata_buffer_t *metadata,
                                  nsecs_t timestamp,
@@ -3242,8 +3982,10 @@ QCamera3HardwareInterface::translateFromHalMetadata(
                                  uint8_t pipeline_depth,
                                  uint8_t capture_intent)
 {
-    CameraMetadata camMetadata;
-    camera_metadata_t *resultMetadata;
+    QCamera3ResultBuilder &camMetadata = mResultBuilder;
+
+    // Entries unchanged since the previous frame are left in place
+    camMetadata.begin();
 
     if (jpegMetadata.entryCount())
         camMetadata.append(jpegMetadata);
@@ -3289,9 +4031,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
             fwkSceneMode = ANDROID_CONTROL_SCENE_MODE_HIGH_SPEED_VIDEO;
         else {
             fwkSceneMode =
-                    (uint8_t)lookupFwkName(SCENE_MODES_MAP,
-                    sizeof(SCENE_MODES_MAP)/
-                    sizeof(SCENE_MODES_MAP[0]), sceneMode);
+                    (uint8_t)lookupFwkName(SCENE_MODES_INDEX, sceneMode);
         }
         camMetadata.update(ANDROID_CONTROL_SCENE_MODE,
                 &fwkSceneMode, 1);
@@ -3388,7 +4128,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
     }
 
     IF_META_AVAILABLE(uint32_t, flashMode, CAM_INTF_META_FLASH_MODE, metadata) {
-        int val = lookupFwkName(FLASH_MODES_MAP, METADATA_MAP_SIZE(FLASH_MODES_MAP), *flashMode);
+        int val = lookupFwkName(FLASH_MODES_INDEX, *flashMode);
         if (NAME_NOT_FOUND != val) {
             uint8_t fwk_flashMode = (uint8_t)val;
             camMetadata.update(ANDROID_FLASH_MODE, &fwk_flashMode, 1);
@@ -3489,8 +4229,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
     }
 
     IF_META_AVAILABLE(uint32_t, faceDetectMode, CAM_INTF_META_STATS_FACEDETECT_MODE, metadata) {
-        int val = lookupFwkName(FACEDETECT_MODES_MAP, METADATA_MAP_SIZE(FACEDETECT_MODES_MAP),
-                *faceDetectMode);
+        int val = lookupFwkName(FACEDETECT_MODES_INDEX, *faceDetectMode);
         if (NAME_NOT_FOUND != val) {
             uint8_t fwk_faceDetectMode = (uint8_t)val;
             camMetadata.update(ANDROID_STATISTICS_FACE_DETECT_MODE, &fwk_faceDetectMode, 1);
@@ -3606,8 +4345,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
     }
 
     IF_META_AVAILABLE(uint32_t, effectMode, CAM_INTF_PARM_EFFECT, metadata) {
-        int val = lookupFwkName(EFFECT_MODES_MAP, METADATA_MAP_SIZE(EFFECT_MODES_MAP),
-                *effectMode);
+        int val = lookupFwkName(EFFECT_MODES_INDEX, *effectMode);
         if (NAME_NOT_FOUND != val) {
             uint8_t fwk_effectMode = (uint8_t)val;
             camMetadata.update(ANDROID_CONTROL_EFFECT_MODE, &fwk_effectMode, 1);
@@ -3616,8 +4354,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
 
     IF_META_AVAILABLE(cam_test_pattern_data_t, testPatternData,
             CAM_INTF_META_TEST_PATTERN_DATA, metadata) {
-        int32_t fwk_testPatternMode = lookupFwkName(TEST_PATTERN_MAP,
-                METADATA_MAP_SIZE(TEST_PATTERN_MAP), testPatternData->mode);
+        int32_t fwk_testPatternMode = lookupFwkName(TEST_PATTERN_INDEX, testPatternData->mode);
         if (NAME_NOT_FOUND != fwk_testPatternMode) {
             camMetadata.update(ANDROID_SENSOR_TEST_PATTERN_MODE, &fwk_testPatternMode, 1);
         }
@@ -3794,8 +4531,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
     }
 
     IF_META_AVAILABLE(uint32_t, hal_ab_mode, CAM_INTF_PARM_ANTIBANDING, metadata) {
-        int val = lookupFwkName(ANTIBANDING_MODES_MAP, METADATA_MAP_SIZE(ANTIBANDING_MODES_MAP),
-                *hal_ab_mode);
+        int val = lookupFwkName(ANTIBANDING_MODES_INDEX, *hal_ab_mode);
         if (NAME_NOT_FOUND != val) {
             uint8_t fwk_ab_mode = (uint8_t)val;
             camMetadata.update(ANDROID_CONTROL_AE_ANTIBANDING_MODE, &fwk_ab_mode, 1);
@@ -3803,8 +4539,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
     }
 
     IF_META_AVAILABLE(uint32_t, bestshotMode, CAM_INTF_PARM_BESTSHOT_MODE, metadata) {
-        int val = lookupFwkName(SCENE_MODES_MAP,
-                METADATA_MAP_SIZE(SCENE_MODES_MAP), *bestshotMode);
+        int val = lookupFwkName(SCENE_MODES_INDEX, *bestshotMode);
         if (NAME_NOT_FOUND != val) {
             uint8_t fwkBestshotMode = (uint8_t)val;
             camMetadata.update(ANDROID_CONTROL_SCENE_MODE, &fwkBestshotMode, 1);
@@ -3930,8 +4665,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
     }
 
     IF_META_AVAILABLE(cam_aberration_mode_t, cacMode, CAM_INTF_PARM_CAC, metadata) {
-        int val = lookupFwkName(COLOR_ABERRATION_MAP, METADATA_MAP_SIZE(COLOR_ABERRATION_MAP),
-                *cacMode);
+        int val = lookupFwkName(COLOR_ABERRATION_INDEX, *cacMode);
         if (NAME_NOT_FOUND != val) {
             uint8_t fwkCacMode = (uint8_t)val;
             camMetadata.update(ANDROID_COLOR_CORRECTION_ABERRATION_MODE, &fwkCacMode, 1);
@@ -3940,8 +4674,7 @@ QCamera3HardwareInterface::translateFromHalMetadata(
         }
     }
 
-    resultMetadata = camMetadata.release();
-    return resultMetadata;
+    return camMetadata.finish();
 }
 
 /*===========================================================================
@@ -3959,28 +4692,28 @@ void QCamera3HardwareInterface::saveExifParams(metadata_buffer_t *metadata)
 {
     IF_META_AVAILABLE(cam_ae_exif_debug_t, ae_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_AE, metadata) {
-        mExifParams.ae_debug_params = *ae_exif_debug_params;
-        mExifParams.ae_debug_params_valid = TRUE;
+        mExifDebugParams.ae_debug_params = *ae_exif_debug_params;
+        mExifDebugParams.ae_debug_params_valid = TRUE;
     }
     IF_META_AVAILABLE(cam_awb_exif_debug_t,awb_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_AWB, metadata) {
-        mExifParams.awb_debug_params = *awb_exif_debug_params;
-        mExifParams.awb_debug_params_valid = TRUE;
+        mExifDebugParams.awb_debug_params = *awb_exif_debug_params;
+        mExifDebugParams.awb_debug_params_valid = TRUE;
     }
     IF_META_AVAILABLE(cam_af_exif_debug_t,af_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_AF, metadata) {
-        mExifParams.af_debug_params = *af_exif_debug_params;
-        mExifParams.af_debug_params_valid = TRUE;
+        mExifDebugParams.af_debug_params = *af_exif_debug_params;
+        mExifDebugParams.af_debug_params_valid = TRUE;
     }
     IF_META_AVAILABLE(cam_asd_exif_debug_t, asd_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_ASD, metadata) {
-        mExifParams.asd_debug_params = *asd_exif_debug_params;
-        mExifParams.asd_debug_params_valid = TRUE;
+        mExifDebugParams.asd_debug_params = *asd_exif_debug_params;
+        mExifDebugParams.asd_debug_params_valid = TRUE;
     }
     IF_META_AVAILABLE(cam_stats_buffer_exif_debug_t,stats_exif_debug_params,
             CAM_INTF_META_EXIF_DEBUG_STATS, metadata) {
-        mExifParams.stats_debug_params = *stats_exif_debug_params;
-        mExifParams.stats_debug_params_valid = TRUE;
+        mExifDebugParams.stats_debug_params = *stats_exif_debug_params;
+        mExifDebugParams.stats_debug_params_valid = TRUE;
     }
 }
 
@@ -4056,7 +4789,7 @@ QCamera3HardwareInterface::translateCbUrgentMetadataToResultMetadata
     }
 
     IF_META_AVAILABLE(uint32_t, focusMode, CAM_INTF_PARM_FOCUS_MODE, metadata) {
-        int val = lookupFwkName(FOCUS_MODES_MAP, METADATA_MAP_SIZE(FOCUS_MODES_MAP), *focusMode);
+        int val = lookupFwkName(FOCUS_MODES_INDEX, *focusMode);
         if (NAME_NOT_FOUND != val) {
             uint8_t fwkAfMode = (uint8_t)val;
             camMetadata.update(ANDROID_CONTROL_AF_MODE, &fwkAfMode, 1);
@@ -4078,8 +4811,7 @@ QCamera3HardwareInterface::translateCbUrgentMetadataToResultMetadata
     }
 
     IF_META_AVAILABLE(int32_t, whiteBalance, CAM_INTF_PARM_WHITE_BALANCE, metadata) {
-        int val = lookupFwkName(WHITE_BALANCE_MODES_MAP,
-                METADATA_MAP_SIZE(WHITE_BALANCE_MODES_MAP), *whiteBalance);
+        int val = lookupFwkName(WHITE_BALANCE_MODES_INDEX, *whiteBalance);
         if (NAME_NOT_FOUND != val) {
             uint8_t fwkWhiteBalanceMode = (uint8_t)val;
             camMetadata.update(ANDROID_CONTROL_AWB_MODE, &fwkWhiteBalanceMode, 1);
@@ -4107,8 +4839,7 @@ QCamera3HardwareInterface::translateCbUrgentMetadataToResultMetadata
         fwk_aeMode = ANDROID_CONTROL_AE_MODE_ON_AUTO_FLASH_REDEYE;
         camMetadata.update(ANDROID_CONTROL_AE_MODE, &fwk_aeMode, 1);
     } else if ((CAM_FLASH_MODE_AUTO == flashMode) || (CAM_FLASH_MODE_ON == flashMode)) {
-        int val = lookupFwkName(AE_FLASH_MODE_MAP, METADATA_MAP_SIZE(AE_FLASH_MODE_MAP),
-                flashMode);
+        int val = lookupFwkName(AE_FLASH_MODE_INDEX, flashMode);
         if (NAME_NOT_FOUND != val) {
             fwk_aeMode = (uint8_t)val;
             camMetadata.update(ANDROID_CONTROL_AE_MODE, &fwk_aeMode, 1);
@@ -4617,6 +5348,7 @@ int QCamera3HardwareInterface::initParameters()
     mParameters = (metadata_buffer_t *) DATA_PTR(mParamHeap,0);
 
     mPrevParameters = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
+    mCachedParameters = (metadata_buffer_t *)malloc(sizeof(metadata_buffer_t));
     return rc;
 }
 
@@ -4642,6 +5374,10 @@ void QCamera3HardwareInterface::deinitParameters()
 
     free(mPrevParameters);
     mPrevParameters = NULL;
+
+    invalidateSettingsCache();
+    free(mCachedParameters);
+    mCachedParameters = NULL;
 }
 
 /*===========================================================================
@@ -5088,8 +5824,7 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
     count = CAM_EFFECT_MODE_MAX;
     count = MIN(gCamCapability[cameraId]->supported_effects_cnt, count);
     for (size_t i = 0; i < count; i++) {
-        int val = lookupFwkName(EFFECT_MODES_MAP, METADATA_MAP_SIZE(EFFECT_MODES_MAP),
-                gCamCapability[cameraId]->supported_effects[i]);
+        int val = lookupFwkName(EFFECT_MODES_INDEX, gCamCapability[cameraId]->supported_effects[i]);
         if (NAME_NOT_FOUND != val) {
             avail_effects[size] = (uint8_t)val;
             size++;
@@ -5107,8 +5842,7 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
     for (size_t i = 0; i < count; i++) {
         if (gCamCapability[cameraId]->supported_scene_modes[i] !=
                 CAM_SCENE_MODE_OFF) {
-            int val = lookupFwkName(SCENE_MODES_MAP,
-                    METADATA_MAP_SIZE(SCENE_MODES_MAP),
+            int val = lookupFwkName(SCENE_MODES_INDEX,
                     gCamCapability[cameraId]->supported_scene_modes[i]);
             if (NAME_NOT_FOUND != val) {
                 avail_scene_modes[supported_scene_modes_cnt] = (uint8_t)val;
@@ -5153,7 +5887,7 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
     count = CAM_ANTIBANDING_MODE_MAX;
     count = MIN(gCamCapability[cameraId]->supported_antibandings_cnt, count);
     for (size_t i = 0; i < count; i++) {
-        int val = lookupFwkName(ANTIBANDING_MODES_MAP, METADATA_MAP_SIZE(ANTIBANDING_MODES_MAP),
+        int val = lookupFwkName(ANTIBANDING_MODES_INDEX,
                 gCamCapability[cameraId]->supported_antibandings[i]);
         if (NAME_NOT_FOUND != val) {
             avail_antibanding_modes[size] = (uint8_t)val;
@@ -5175,7 +5909,7 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
         size++;
     } else {
         for (size_t i = 0; i < count; i++) {
-            int val = lookupFwkName(COLOR_ABERRATION_MAP, METADATA_MAP_SIZE(COLOR_ABERRATION_MAP),
+            int val = lookupFwkName(COLOR_ABERRATION_INDEX,
                     gCamCapability[cameraId]->aberration_modes[i]);
             if (NAME_NOT_FOUND != val) {
                 avail_abberation_modes[size] = (uint8_t)val;
@@ -5197,7 +5931,7 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
     count = CAM_FOCUS_MODE_MAX;
     count = MIN(gCamCapability[cameraId]->supported_focus_modes_cnt, count);
     for (size_t i = 0; i < count; i++) {
-        int val = lookupFwkName(FOCUS_MODES_MAP, METADATA_MAP_SIZE(FOCUS_MODES_MAP),
+        int val = lookupFwkName(FOCUS_MODES_INDEX,
                 gCamCapability[cameraId]->supported_focus_modes[i]);
         if (NAME_NOT_FOUND != val) {
             avail_af_modes[size] = (uint8_t)val;
@@ -5213,8 +5947,7 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
     count = CAM_WB_MODE_MAX;
     count = MIN(gCamCapability[cameraId]->supported_white_balances_cnt, count);
     for (size_t i = 0; i < count; i++) {
-        int val = lookupFwkName(WHITE_BALANCE_MODES_MAP,
-                METADATA_MAP_SIZE(WHITE_BALANCE_MODES_MAP),
+        int val = lookupFwkName(WHITE_BALANCE_MODES_INDEX,
                 gCamCapability[cameraId]->supported_white_balances[i]);
         if (NAME_NOT_FOUND != val) {
             avail_awb_modes[size] = (uint8_t)val;
@@ -5288,7 +6021,7 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
                       &avail_leds, 0);
 
     uint8_t focus_dist_calibrated;
-    int val = lookupFwkName(FOCUS_CALIBRATION_MAP, METADATA_MAP_SIZE(FOCUS_CALIBRATION_MAP),
+    int val = lookupFwkName(FOCUS_CALIBRATION_INDEX,
             gCamCapability[cameraId]->focus_dist_calibrated);
     if (NAME_NOT_FOUND != val) {
         focus_dist_calibrated = (uint8_t)val;
@@ -5301,7 +6034,7 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
     count = MIN(gCamCapability[cameraId]->supported_test_pattern_modes_cnt,
             MAX_TEST_PATTERN_CNT);
     for (size_t i = 0; i < count; i++) {
-        int testpatternMode = lookupFwkName(TEST_PATTERN_MAP, METADATA_MAP_SIZE(TEST_PATTERN_MAP),
+        int testpatternMode = lookupFwkName(TEST_PATTERN_INDEX,
                 gCamCapability[cameraId]->supported_test_pattern_modes[i]);
         if (NAME_NOT_FOUND != testpatternMode) {
             avail_testpattern_modes[size] = testpatternMode;
@@ -5384,14 +6117,14 @@ int QCamera3HardwareInterface::initStaticMetadata(uint32_t cameraId)
             available_hot_pixel_map_modes,
             sizeof(available_hot_pixel_map_modes)/sizeof(available_hot_pixel_map_modes[0]));
 
-    val = lookupFwkName(REFERENCE_ILLUMINANT_MAP, METADATA_MAP_SIZE(REFERENCE_ILLUMINANT_MAP),
+    val = lookupFwkName(REFERENCE_ILLUMINANT_INDEX,
             gCamCapability[cameraId]->reference_illuminant1);
     if (NAME_NOT_FOUND != val) {
         uint8_t fwkReferenceIlluminant = (uint8_t)val;
         staticInfo.update(ANDROID_SENSOR_REFERENCE_ILLUMINANT1, &fwkReferenceIlluminant, 1);
     }
 
-    val = lookupFwkName(REFERENCE_ILLUMINANT_MAP, METADATA_MAP_SIZE(REFERENCE_ILLUMINANT_MAP),
+    val = lookupFwkName(REFERENCE_ILLUMINANT_INDEX,
             gCamCapability[cameraId]->reference_illuminant2);
     if (NAME_NOT_FOUND != val) {
         uint8_t fwkReferenceIlluminant = (uint8_t)val;
@@ -5704,9 +6437,7 @@ void QCamera3HardwareInterface::makeOverridesList(
         size_t index = supported_indexes[i];
         overridesList[j] = gCamCapability[camera_id]->flash_available ?
                 ANDROID_CONTROL_AE_MODE_ON_AUTO_FLASH : ANDROID_CONTROL_AE_MODE_ON;
-        int val = lookupFwkName(WHITE_BALANCE_MODES_MAP,
-                METADATA_MAP_SIZE(WHITE_BALANCE_MODES_MAP),
-                overridesTable[index].awb_mode);
+        int val = lookupFwkName(WHITE_BALANCE_MODES_INDEX, overridesTable[index].awb_mode);
         if (NAME_NOT_FOUND != val) {
             overridesList[j+1] = (uint8_t)val;
         }
@@ -5718,8 +6449,7 @@ void QCamera3HardwareInterface::makeOverridesList(
            }
         }
         if (supt) {
-            val = lookupFwkName(FOCUS_MODES_MAP, METADATA_MAP_SIZE(FOCUS_MODES_MAP),
-                    focus_override);
+            val = lookupFwkName(FOCUS_MODES_INDEX, focus_override);
             if (NAME_NOT_FOUND != val) {
                 overridesList[j+2] = (uint8_t)val;
             }
@@ -6303,7 +7033,26 @@ int QCamera3HardwareInterface::setFrameParameters(
     int rc = 0;
     int32_t hal_version = CAM_HAL_V3;
 
-    clear_metadata_buffer(mParameters);
+    /* Repeating requests usually carry the same settings as the previous
+     * request; reuse their translation instead of walking the settings
+     * again. The per-frame entries below are always added on top. */
+    if ((request->settings != NULL) &&
+            isSettingsCached(request->settings, snapshotStreamId)) {
+        mm_camera_copy_metadata(mParameters, mCachedParameters);
+        mSettingsCacheHits++;
+    } else {
+        clear_metadata_buffer(mParameters);
+        if (request->settings != NULL) {
+            rc = translateToHalMetadata(request, mParameters, snapshotStreamId);
+            if (rc == NO_ERROR) {
+                updateSettingsCache(request->settings, snapshotStreamId);
+            } else {
+                invalidateSettingsCache();
+            }
+            mSettingsCacheMisses++;
+        }
+    }
+
     if (ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_HAL_VERSION, hal_version)) {
         ALOGE("%s: Failed to set hal version in the parameters", __func__);
         return BAD_VALUE;
@@ -6334,15 +7083,107 @@ int QCamera3HardwareInterface::setFrameParameters(
         mUpdateDebugLevel = false;
     }
 
-    if(request->settings != NULL){
-        rc = translateToHalMetadata(request, mParameters, snapshotStreamId);
-        if (blob_request)
-            memcpy(mPrevParameters, mParameters, sizeof(metadata_buffer_t));
+    if ((request->settings != NULL) && blob_request) {
+        mm_camera_copy_metadata(mPrevParameters, mParameters);
     }
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : isSettingsCached
+ *
+ * DESCRIPTION: check whether request settings match the settings whose
+ *              translation is held in mCachedParameters. Settings are
+ *              compared entry by entry, so identical settings in buffers
+ *              of different capacity still match.
+ *
+ * PARAMETERS :
+ *   @settings        : request settings from framework
+ *   @snapshotStreamId: snapshot stream id of the request
+ *
+ * RETURN     : true if mCachedParameters can be used for the request
+ *==========================================================================*/
+bool QCamera3HardwareInterface::isSettingsCached(
+        const camera_metadata_t *settings, uint32_t snapshotStreamId)
+{
+    if ((NULL == mCachedSettings) || (NULL == mCachedParameters) ||
+            (snapshotStreamId != mCachedSnapshotStreamId)) {
+        return false;
+    }
+
+    size_t entryCount = get_camera_metadata_entry_count(settings);
+    if (entryCount != get_camera_metadata_entry_count(mCachedSettings)) {
+        return false;
+    }
+
+    camera_metadata_ro_entry_t entry, cached;
+    for (size_t i = 0; i < entryCount; i++) {
+        if (get_camera_metadata_ro_entry(settings, i, &entry) ||
+                get_camera_metadata_ro_entry(mCachedSettings, i, &cached)) {
+            return false;
+        }
+        if ((entry.tag != cached.tag) || (entry.type != cached.type) ||
+                (entry.count != cached.count) || (entry.type >= NUM_TYPES)) {
+            return false;
+        }
+        if (memcmp(entry.data.u8, cached.data.u8,
+                entry.count * camera_metadata_type_size[entry.type])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : updateSettingsCache
+ *
+ * DESCRIPTION: remember request settings along with their translation,
+ *              which must be the current content of mParameters
+ *
+ * PARAMETERS :
+ *   @settings        : request settings from framework
+ *   @snapshotStreamId: snapshot stream id of the request
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3HardwareInterface::updateSettingsCache(
+        const camera_metadata_t *settings, uint32_t snapshotStreamId)
+{
+    invalidateSettingsCache();
+    if (NULL == mCachedParameters) {
+        return;
+    }
+
+    mCachedSettings = clone_camera_metadata(settings);
+    if (NULL == mCachedSettings) {
+        ALOGE("%s: Failed to copy request settings", __func__);
+        return;
+    }
+    mm_camera_copy_metadata(mCachedParameters, mParameters);
+    mCachedSnapshotStreamId = snapshotStreamId;
+}
+
+/*===========================================================================
+ * FUNCTION   : invalidateSettingsCache
+ *
+ * DESCRIPTION: drop the cached settings translation. Needed whenever the
+ *              translation inputs other than the settings change, e.g. the
+ *              crop region mapping on a new stream configuration.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3HardwareInterface::invalidateSettingsCache()
+{
+    if (mCachedSettings) {
+        free_camera_metadata(mCachedSettings);
+        mCachedSettings = NULL;
+    }
+    mCachedSnapshotStreamId = 0;
+}
+
 /*===========================================================================
  * FUNCTION   : setReprocParameters
  *
@@ -6556,8 +7397,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
             redeye = 0;
         }
 
-        int val = lookupHalName(AE_FLASH_MODE_MAP, METADATA_MAP_SIZE(AE_FLASH_MODE_MAP),
-                fwk_aeMode);
+        int val = lookupHalName(AE_FLASH_MODE_INDEX, fwk_aeMode);
         if (NAME_NOT_FOUND != val) {
             int32_t flashMode = (int32_t)val;
             ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_LED_MODE, flashMode);
@@ -6572,8 +7412,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
 
     if (frame_settings.exists(ANDROID_CONTROL_AWB_MODE)) {
         uint8_t fwk_whiteLevel = frame_settings.find(ANDROID_CONTROL_AWB_MODE).data.u8[0];
-        int val = lookupHalName(WHITE_BALANCE_MODES_MAP, METADATA_MAP_SIZE(WHITE_BALANCE_MODES_MAP),
-                fwk_whiteLevel);
+        int val = lookupHalName(WHITE_BALANCE_MODES_INDEX, fwk_whiteLevel);
         if (NAME_NOT_FOUND != val) {
             uint8_t whiteLevel = (uint8_t)val;
             if (ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_WHITE_BALANCE, whiteLevel)) {
@@ -6586,8 +7425,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
         uint8_t fwk_cacMode =
                 frame_settings.find(
                         ANDROID_COLOR_CORRECTION_ABERRATION_MODE).data.u8[0];
-        int val = lookupHalName(COLOR_ABERRATION_MAP, METADATA_MAP_SIZE(COLOR_ABERRATION_MAP),
-                fwk_cacMode);
+        int val = lookupHalName(COLOR_ABERRATION_INDEX, fwk_cacMode);
         if (NAME_NOT_FOUND != val) {
             cam_aberration_mode_t cacMode = (cam_aberration_mode_t) val;
             if (ADD_SET_PARAM_ENTRY_TO_BATCH(hal_metadata, CAM_INTF_PARM_CAC, cacMode)) {
@@ -6600,8 +7438,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
 
     if (frame_settings.exists(ANDROID_CONTROL_AF_MODE)) {
         uint8_t fwk_focusMode = frame_settings.find(ANDROID_CONTROL_AF_MODE).data.u8[0];
-        int val = lookupHalName(FOCUS_MODES_MAP, METADATA_MAP_SIZE(FOCUS_MODES_MAP),
-                fwk_focusMode);
+        int val = lookupHalName(FOCUS_MODES_INDEX, fwk_focusMode);
         if (NAME_NOT_FOUND != val) {
             uint8_t focusMode = (uint8_t)val;
             if (ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_FOCUS_MODE, focusMode)) {
@@ -6621,8 +7458,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
     if (frame_settings.exists(ANDROID_CONTROL_AE_ANTIBANDING_MODE)) {
         uint8_t fwk_antibandingMode =
                 frame_settings.find(ANDROID_CONTROL_AE_ANTIBANDING_MODE).data.u8[0];
-        int val = lookupHalName(ANTIBANDING_MODES_MAP,
-                METADATA_MAP_SIZE(ANTIBANDING_MODES_MAP), fwk_antibandingMode);
+        int val = lookupHalName(ANTIBANDING_MODES_INDEX, fwk_antibandingMode);
         if (NAME_NOT_FOUND != val) {
             uint32_t hal_antibandingMode = (uint32_t)val;
             if (ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_ANTIBANDING,
@@ -6667,8 +7503,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
 
     if (frame_settings.exists(ANDROID_CONTROL_EFFECT_MODE)) {
         uint8_t fwk_effectMode = frame_settings.find(ANDROID_CONTROL_EFFECT_MODE).data.u8[0];
-        int val = lookupHalName(EFFECT_MODES_MAP, METADATA_MAP_SIZE(EFFECT_MODES_MAP),
-                fwk_effectMode);
+        int val = lookupHalName(EFFECT_MODES_INDEX, fwk_effectMode);
         if (NAME_NOT_FOUND != val) {
             uint8_t effectMode = (uint8_t)val;
             if (ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters, CAM_INTF_PARM_EFFECT, effectMode)) {
@@ -6786,7 +7621,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
             }
         }
         if (respectFlashMode) {
-            int val = lookupHalName(FLASH_MODES_MAP, METADATA_MAP_SIZE(FLASH_MODES_MAP),
+            int val = lookupHalName(FLASH_MODES_INDEX,
                     (int)frame_settings.find(ANDROID_FLASH_MODE).data.u8[0]);
             CDBG_HIGH("%s: flash mode after mapping %d", __func__, val);
             // To check: CAM_INTF_META_FLASH_MODE usage
@@ -6948,8 +7783,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
         fwk_facedetectMode = (m_overrideAppFaceDetection < 0) ?
                                     fwk_facedetectMode : (uint8_t)m_overrideAppFaceDetection;
 
-        int val = lookupHalName(FACEDETECT_MODES_MAP, METADATA_MAP_SIZE(FACEDETECT_MODES_MAP),
-                fwk_facedetectMode);
+        int val = lookupHalName(FACEDETECT_MODES_INDEX, fwk_facedetectMode);
 
         if (NAME_NOT_FOUND != val) {
             uint8_t facedetectMode = (uint8_t)val;
@@ -7116,8 +7950,7 @@ int QCamera3HardwareInterface::translateToHalMetadata
     if (frame_settings.exists(ANDROID_SENSOR_TEST_PATTERN_MODE)) {
         int32_t fwk_testPatternMode =
                 frame_settings.find(ANDROID_SENSOR_TEST_PATTERN_MODE).data.i32[0];
-        int testPatternMode = lookupHalName(TEST_PATTERN_MAP,
-                METADATA_MAP_SIZE(TEST_PATTERN_MAP), fwk_testPatternMode);
+        int testPatternMode = lookupHalName(TEST_PATTERN_INDEX, fwk_testPatternMode);
 
         if (NAME_NOT_FOUND != testPatternMode) {
             cam_test_pattern_data_t testPatternData;
@@ -7511,6 +8344,183 @@ cam_denoise_process_type_t QCamera3HardwareInterface::getWaveletDenoiseProcessPl
 }
 
 
+/*===========================================================================
+ * FUNCTION   : setBatchMode
+ *
+ * DESCRIPTION: Enables HFR batch mode on the regular channels if the first
+ *              request asks for high speed video. Frames per batch follow
+ *              the sensor rate over PREVIEW_FPS_FOR_HFR, bounded by the
+ *              backend limit. Has to run before the streams are added.
+ *
+ * PARAMETERS :
+ *   @settings  : settings of the first capture request
+ *
+ * RETURN     : Success: NO_ERROR
+ *              Failure: error code from the channels
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::setBatchMode(const CameraMetadata &settings)
+{
+    int32_t rc = NO_ERROR;
+
+    mBatchSize = 0;
+    mHFRVideoFps = 0;
+    if (!settings.exists(ANDROID_CONTROL_MODE) ||
+            !settings.exists(ANDROID_CONTROL_SCENE_MODE) ||
+            !settings.exists(ANDROID_CONTROL_AE_TARGET_FPS_RANGE)) {
+        return rc;
+    }
+    uint8_t metaMode = settings.find(ANDROID_CONTROL_MODE).data.u8[0];
+    uint8_t sceneMode = settings.find(ANDROID_CONTROL_SCENE_MODE).data.u8[0];
+    camera_metadata_ro_entry fpsRange =
+            settings.find(ANDROID_CONTROL_AE_TARGET_FPS_RANGE);
+    if ((metaMode != ANDROID_CONTROL_MODE_USE_SCENE_MODE) ||
+            (sceneMode != ANDROID_CONTROL_SCENE_MODE_HIGH_SPEED_VIDEO) ||
+            (fpsRange.data.i32[0] != fpsRange.data.i32[1]) ||
+            (fpsRange.data.i32[1] < 2 * PREVIEW_FPS_FOR_HFR)) {
+        return rc;
+    }
+
+    uint32_t fps = (uint32_t)fpsRange.data.i32[1];
+    uint32_t batchSize = MIN(fps / PREVIEW_FPS_FOR_HFR, MAX_HFR_BATCH_SIZE);
+    if (gCamCapability[mCameraId]->max_batch_bufs_supported > 0) {
+        batchSize = MIN(batchSize,
+                (uint32_t)gCamCapability[mCameraId]->max_batch_bufs_supported);
+    }
+    if (batchSize < 2) {
+        return rc;
+    }
+
+    for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+        QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
+        if (channel == NULL) {
+            continue;
+        }
+        rc = channel->setBatchSize((uint8_t)batchSize, fps);
+        if (rc != NO_ERROR) {
+            ALOGE("%s: Failed to set batch size %u", __func__, batchSize);
+            // leave every channel unbatched
+            for (List<stream_info_t *>::iterator jt = mStreamInfo.begin();
+                    jt != it; jt++) {
+                QCamera3Channel *batched = (QCamera3Channel *)(*jt)->stream->priv;
+                if (batched != NULL) {
+                    batched->setBatchSize(0, 0);
+                }
+            }
+            return rc;
+        }
+    }
+
+    mBatchSize = (uint8_t)batchSize;
+    mHFRVideoFps = fps;
+    mBatchFrameCount = 0;
+    mPendingBatchMap.clear();
+    mInflight.window = mInflight.max;
+    if (!mBatchFlushThreadActive) {
+        mBatchFlushExit = false;
+        mBatchFlushThreadActive = (pthread_create(&mBatchFlushThread, NULL,
+                batchFlushRoutine, this) == 0);
+        if (!mBatchFlushThreadActive) {
+            ALOGE("%s: Failed to start batch timeout thread", __func__);
+        }
+    }
+    CDBG_HIGH("%s: HFR %u fps, batch size %u", __func__, fps, batchSize);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : flushPendingBatch
+ *
+ * DESCRIPTION: Send the HFR batch collected so far to the backend, full or
+ *              not: the staged frames of every batch mode stream are queued
+ *              to the kernel and the settings of the last frame are sent.
+ *              A partial batch is sent when new settings arrive, when no
+ *              request completed it within two batch durations, when the
+ *              backend has nothing else left and on flush, so that its
+ *              requests don't wait for frames that may never come. Note
+ *              that mMutex is held when this function is called.
+ *
+ * PARAMETERS :
+ *
+ * RETURN     : Success: NO_ERROR
+ *              Failure: error code from set_parms
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::flushPendingBatch()
+{
+    if ((mBatchSize == 0) || (mBatchFrameCount == 0)) {
+        return NO_ERROR;
+    }
+
+    // a full batch was queued by the streams with its last frame
+    if (mBatchFrameCount < mBatchSize) {
+        CDBG("%s: partial batch of %u, frames %u-%u", __func__,
+                mBatchFrameCount, mFirstFrameNumberInBatch,
+                mFirstFrameNumberInBatch + mBatchFrameCount - 1);
+        for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+                it != mStreamInfo.end(); it++) {
+            QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
+            if (channel != NULL) {
+                channel->flushBatch();
+            }
+        }
+    }
+
+    // frame numbers of a batch are consecutive, no reprocess in batch mode
+    mPendingBatchMap.add(mFirstFrameNumberInBatch + mBatchFrameCount - 1,
+            mFirstFrameNumberInBatch);
+    mBatchFrameCount = 0;
+    return mCameraHandle->ops->set_parms(mCameraHandle->camera_handle,
+            mParameters);
+}
+
+/*===========================================================================
+ * FUNCTION   : batchFlushRoutine
+ *
+ * DESCRIPTION: Sends an HFR batch left partial for two batch durations, in
+ *              case the framework stops submitting requests mid batch.
+ *
+ * PARAMETERS :
+ *   @data    : QCamera3HardwareInterface
+ *
+ * RETURN     : NULL
+ *==========================================================================*/
+void *QCamera3HardwareInterface::batchFlushRoutine(void *data)
+{
+    QCamera3HardwareInterface *hw = (QCamera3HardwareInterface *)data;
+
+    pthread_mutex_lock(&hw->mMutex);
+    while (!hw->mBatchFlushExit) {
+        if ((hw->mBatchSize == 0) || (hw->mBatchFrameCount == 0) ||
+                (hw->mHFRVideoFps == 0)) {
+            pthread_cond_wait(&hw->mBatchCond, &hw->mMutex);
+            continue;
+        }
+
+        nsecs_t timeout = 2 * (nsecs_t)hw->mBatchSize *
+                (nsecs_t)NSEC_PER_SEC / hw->mHFRVideoFps;
+        nsecs_t left = hw->mBatchStartTime + timeout -
+                systemTime(CLOCK_MONOTONIC);
+        if (left <= 0) {
+            CDBG_HIGH("%s: batch of frame %u timed out with %u frames",
+                    __func__, hw->mFirstFrameNumberInBatch,
+                    hw->mBatchFrameCount);
+            hw->flushPendingBatch();
+            continue;
+        }
+
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        nsecs_t deadline = (nsecs_t)ts.tv_sec * (nsecs_t)NSEC_PER_SEC +
+                ts.tv_nsec + left;
+        ts.tv_sec = (time_t)(deadline / (nsecs_t)NSEC_PER_SEC);
+        ts.tv_nsec = (long)(deadline % (nsecs_t)NSEC_PER_SEC);
+        pthread_cond_timedwait(&hw->mBatchCond, &hw->mMutex, &ts);
+    }
+    pthread_mutex_unlock(&hw->mMutex);
+
+    return NULL;
+}
+
 /*===========================================================================
  * FUNCTION   : extractSceneMode
  *
@@ -7540,9 +8550,7 @@ int32_t QCamera3HardwareInterface::extractSceneMode(
         uint8_t fwk_sceneMode = entry.data.u8[0];
 
         if (fwk_sceneMode != ANDROID_CONTROL_SCENE_MODE_HIGH_SPEED_VIDEO) {
-            sceneMode = lookupHalName(SCENE_MODES_MAP,
-                    sizeof(SCENE_MODES_MAP)/sizeof(SCENE_MODES_MAP[0]),
-                    fwk_sceneMode);
+            sceneMode = lookupHalName(SCENE_MODES_INDEX, fwk_sceneMode);
             hfrMode = CAM_HFR_MODE_OFF;
         } else {
             if (!frame_settings.exists(ANDROID_CONTROL_AE_TARGET_FPS_RANGE)) {
@@ -38,6 +38,7 @@
 #include "QCamera3HALHeader.h"
 #include "QCamera3Channel.h"
 #include "QCamera3CropRegionMapper.h"
+#include "QCamera3ResultBuilder.h"
 
 #include <hardware/power.h>
 
@@ -87,6 +88,24 @@ typedef enum {
 
 #define MODULE_ALL 0
 
+/* Slots of the frame number indexed pending request ring. Must be a power
+ * of 2 and cover the max pipeline depth, HFR batches included; requests
+ * outliving their slot (e.g. reprocess waiting on older frames) fall back
+ * to a list walk */
+#define PENDING_REQUEST_RING_SIZE 64
+
+/* HFR batch mode: frames per kernel buffer are derived from the sensor
+ * rate over the preview rate, up to the container limit */
+#define MAX_HFR_BATCH_SIZE 8
+#define PREVIEW_FPS_FOR_HFR 30
+
+/* camera3.h expects flush() to return within 100ms and never to take more
+ * than 1s. Channels stop and restart in parallel, so flush takes about the
+ * slowest channel stop, plus the error results, plus the metadata start
+ * and the slowest channel start. */
+#define FLUSH_TARGET_LATENCY_MS 100
+#define FLUSH_MAX_LATENCY_MS 1000
+
 
 extern volatile uint32_t gCamHal3LogLevel;
 
@@ -95,12 +114,29 @@ class QCamera3PicChannel;
 class QCamera3HeapMemory;
 class QCamera3Exif;
 
+/* Parameters a channel was built from. A stream that is configured again
+ * with the same ones keeps its channel across configureStreams. */
+typedef struct {
+    int stream_type;
+    int format;
+    uint32_t width;
+    uint32_t height;
+    cam_stream_type_t type;
+    uint32_t postprocess_mask;
+    cam_dimension_t dim;
+    uint32_t num_buffers;
+    bool is_4k_video;
+} channel_config_t;
+
 typedef struct {
     camera3_stream_t *stream;
     camera3_stream_buffer_set_t buffer_set;
     stream_status_t status;
     int registered;
     QCamera3Channel *channel;
+    channel_config_t config;
+    /* IS type the channel streams were added with */
+    cam_is_type_t is_type;
 } stream_info_t;
 
 class QCamera3HardwareInterface {
@@ -169,9 +205,14 @@ public:
             metadata_buffer_t *reprocParam, uint32_t snapshotStreamId);
     int translateToHalMetadata(const camera3_capture_request_t *request,
             metadata_buffer_t *parm, uint32_t snapshotStreamId);
+    bool isSettingsCached(const camera_metadata_t *settings,
+            uint32_t snapshotStreamId);
+    void updateSettingsCache(const camera_metadata_t *settings,
+            uint32_t snapshotStreamId);
+    void invalidateSettingsCache();
     camera_metadata_t* translateCbUrgentMetadataToResultMetadata (
                              metadata_buffer_t *metadata);
-    camera_metadata_t* translateFromHalMetadata(metadata_buffer_t *metadata,
+    const camera_metadata_t* translateFromHalMetadata(metadata_buffer_t *metadata,
                             nsecs_t timestamp, int32_t request_id,
                             const CameraMetadata& jpegMetadata, uint8_t pipeline_depth,
                             uint8_t capture_intent);
@@ -198,6 +239,28 @@ public:
         halType hal_name;
     };
 
+    /* Direct index over a QCameraMap table, built once from it. The enums
+     * involved are small, so each direction is a dense array holding the
+     * first table entry for a key; that keeps the table order deciding
+     * which entry wins for keys listed more than once. */
+    template <typename fwkType, typename halType> class QCameraMapIndex {
+    public:
+        QCameraMapIndex(const QCameraMap<fwkType, halType> *arr, size_t len);
+        int fwkName(int hal_name) const;
+        int halName(int fwk_name) const;
+    private:
+        enum {
+            MAX_DENSE_KEYS = 64,
+            INVALID_ENTRY = 0xFF
+        };
+        int find(const uint8_t *dense, int key, bool byHal) const;
+
+        const QCameraMap<fwkType, halType> *mArr;
+        size_t mLen;
+        uint8_t mFwkToHal[MAX_DENSE_KEYS];
+        uint8_t mHalToFwk[MAX_DENSE_KEYS];
+    };
+
     typedef struct {
         const char *const desc;
         cam_cds_mode_type_t val;
@@ -216,15 +279,32 @@ private:
     void deriveMinFrameDuration();
     int32_t handlePendingReprocResults(uint32_t frame_number);
     int64_t getMinFrameDuration(const camera3_capture_request_t *request);
-    void handleMetadataWithLock(mm_camera_super_buf_t *metadata_buf);
+    void handleMetadataWithLock(mm_camera_super_buf_t *metadata_buf,
+            bool free_and_bufdone_meta_buf);
+    void handleBatchMetadata(mm_camera_super_buf_t *metadata_buf);
     void handleBufferWithLock(camera3_stream_buffer_t *buffer,
             uint32_t frame_number);
     void unblockRequestIfNecessary();
+    void resetInflightWindow();
+    void updateInflightWindow(uint32_t frame_number, nsecs_t capture_time);
     void dumpMetadataToFile(tuning_params_t &meta, uint32_t &dumpFrameCount,
             bool enabled, const char *type, uint32_t frameNumber);
     static void getLogLevel();
 
     void cleanAndSortStreamInfo();
+
+    /* a channel start or stop, run concurrently with the others on flush */
+    typedef struct {
+        QCamera3Channel *channel;
+        bool start;
+        int32_t rc;
+        pthread_t thread;
+        bool spawned;
+    } ChannelOp;
+    size_t collectChannelOps(ChannelOp *ops, size_t max, bool start);
+    static void runChannelOps(ChannelOp *ops, size_t count);
+    static void *channelOpRoutine(void *data);
+
     void extractJpegMetadata(CameraMetadata& jpegMetadata,
             const camera3_capture_request_t *request);
 
@@ -234,6 +314,9 @@ private:
     int32_t getSensorOutputSize(cam_dimension_t &sensor_dim);
     int32_t setHalFpsRange(const CameraMetadata &settings,
             metadata_buffer_t *hal_metadata);
+    int32_t setBatchMode(const CameraMetadata &settings);
+    int32_t flushPendingBatch();
+    static void *batchFlushRoutine(void *data);
     int32_t extractSceneMode(const CameraMetadata &frame_settings, uint8_t metaMode,
             metadata_buffer_t *hal_metadata);
 
@@ -257,6 +340,7 @@ private:
 
     void saveExifParams(metadata_buffer_t *metadata);
     mm_jpeg_exif_params_t mExifParams;
+    mm_jpeg_debug_exif_params_t mExifDebugParams;
 
      //First request yet to be processed after configureStreams
     bool mFirstRequest;
@@ -266,6 +350,12 @@ private:
     QCamera3HeapMemory *mParamHeap;
     metadata_buffer_t* mParameters;
     metadata_buffer_t* mPrevParameters;
+    /* translation of the last request settings, reused while they repeat */
+    metadata_buffer_t* mCachedParameters;
+    camera_metadata_t* mCachedSettings;
+    uint32_t mCachedSnapshotStreamId;
+    uint32_t mSettingsCacheHits;
+    uint32_t mSettingsCacheMisses;
     bool m_bIsVideo;
     bool m_bIs4KVideo;
     bool m_bEisSupportedSize;
@@ -324,12 +414,53 @@ private:
     typedef List<QCamera3HardwareInterface::PendingRequestInfo>::iterator
             pendingRequestIterator;
 
+    // Frame number indexed view of mPendingRequestsList, which still owns
+    // the requests and keeps them in retirement order
+    typedef struct {
+        bool valid;
+        uint32_t frame_number;
+        pendingRequestIterator request;
+    } PendingRequestSlot;
+
     List<PendingReprocessResult> mPendingReprocessResultList;
     List<PendingRequestInfo> mPendingRequestsList;
     List<PendingFrameDropInfo> mPendingFrameDropList;
     PendingBuffersMap mPendingBuffersMap;
+    PendingRequestSlot mPendingRequestRing[PENDING_REQUEST_RING_SIZE];
+    // pending requests whose ring slot was taken by an older request
+    uint32_t mPendingRequestUnindexed;
     pthread_cond_t mRequestCond;
     int mPendingRequest;
+
+    // processCaptureRequest blocks once mPendingRequest reaches 'window'.
+    // The window is MIN_INFLIGHT_REQUESTS up to 45fps. Faster sessions get
+    // sensor-to-result latency over frame interval plus one, bounded by the
+    // buffers negotiated per stream in configureStreams.
+    typedef struct {
+        uint32_t window;
+        uint32_t max;
+        nsecs_t latency;        // EWMA, sensor timestamp -> result metadata
+        nsecs_t interval;       // EWMA, sensor frame interval
+        nsecs_t last_capture_time;
+        uint32_t last_frame_number;
+        // framework thread blocking telemetry
+        uint32_t requests;
+        uint32_t blocked;
+        nsecs_t blocked_time;
+        nsecs_t max_blocked_time;
+    } InflightWindowInfo;
+    InflightWindowInfo mInflight;
+    // flush() phase timing, last call and worst case
+    typedef struct {
+        uint32_t count;
+        uint32_t over_target;
+        nsecs_t stop_time;
+        nsecs_t error_time;
+        nsecs_t start_time;
+        nsecs_t total_time;
+        nsecs_t max_total_time;
+    } FlushStats;
+    FlushStats mFlushStats;
     bool mWokenUpByDaemon;
     int32_t mCurrentRequestId;
     cam_stream_size_info_t mStreamConfigInfo;
@@ -354,6 +485,24 @@ private:
     /* sensor output size with current stream configuration */
     QCamera3CropRegionMapper mCropRegionMapper;
 
+    /* capture result metadata, reused across frames of a session */
+    QCamera3ResultBuilder mResultBuilder;
+
+    /* HFR batch mode */
+    bool mBatchCapable;
+    uint8_t mBatchSize;
+    uint32_t mHFRVideoFps;
+    uint8_t mBatchFrameCount;
+    uint32_t mFirstFrameNumberInBatch;
+    // frame number sent to the backend for a batch -> first frame of it
+    KeyedVector<uint32_t, uint32_t> mPendingBatchMap;
+    // a batch left partial for two batch durations is sent as it is
+    nsecs_t mBatchStartTime;
+    pthread_cond_t mBatchCond;
+    pthread_t mBatchFlushThread;
+    bool mBatchFlushThreadActive;
+    bool mBatchFlushExit;
+
     static const QCameraMap<camera_metadata_enum_android_control_effect_mode_t,
             cam_effect_mode_type> EFFECT_MODES_MAP[];
     static const QCameraMap<camera_metadata_enum_android_control_awb_mode_t,
@@ -381,9 +530,38 @@ private:
     static const QCameraMap<camera_metadata_enum_android_sensor_reference_illuminant1_t,
             cam_illuminat_t> REFERENCE_ILLUMINANT_MAP[];
 
+    static const QCameraMapIndex<camera_metadata_enum_android_control_effect_mode_t,
+            cam_effect_mode_type> EFFECT_MODES_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_control_awb_mode_t,
+            cam_wb_mode_type> WHITE_BALANCE_MODES_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_control_scene_mode_t,
+            cam_scene_mode_type> SCENE_MODES_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_control_af_mode_t,
+            cam_focus_mode_type> FOCUS_MODES_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_color_correction_aberration_mode_t,
+            cam_aberration_mode_t> COLOR_ABERRATION_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_control_ae_antibanding_mode_t,
+            cam_antibanding_mode_type> ANTIBANDING_MODES_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_lens_state_t,
+            cam_af_lens_state_t> LENS_STATE_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_control_ae_mode_t,
+            cam_flash_mode_t> AE_FLASH_MODE_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_flash_mode_t,
+            cam_flash_mode_t> FLASH_MODES_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_statistics_face_detect_mode_t,
+            cam_face_detect_mode_t> FACEDETECT_MODES_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_lens_info_focus_distance_calibration_t,
+            cam_focus_calibration_t> FOCUS_CALIBRATION_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_sensor_test_pattern_mode_t,
+            cam_test_pattern_mode_t> TEST_PATTERN_INDEX;
+    static const QCameraMapIndex<camera_metadata_enum_android_sensor_reference_illuminant1_t,
+            cam_illuminat_t> REFERENCE_ILLUMINANT_INDEX;
+
     static const QCameraPropMap CDS_MAP[];
 
     pendingRequestIterator erasePendingRequest(pendingRequestIterator i);
+    void addPendingRequest(const PendingRequestInfo &request);
+    pendingRequestIterator findPendingRequest(uint32_t frame_number);
 };
 
 }; // namespace qcamera
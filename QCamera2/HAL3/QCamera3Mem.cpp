@@ -498,8 +498,13 @@ int QCamera3HeapMemory::allocate(uint32_t count, size_t size, bool queueAll)
         } else
             mPtr[i] = vaddr;
     }
-    if (rc == 0)
+    if (rc == 0) {
+        Mutex::Autolock lock(mLock);
+        for (uint32_t i = 0; i < count; i++) {
+            mPtrIndex.add(mPtr[i], (int32_t)i);
+        }
         mBufferCount = count;
+    }
 
     mQueueAll = queueAll;
     return OK;
@@ -516,6 +521,10 @@ int QCamera3HeapMemory::allocate(uint32_t count, size_t size, bool queueAll)
  *==========================================================================*/
 void QCamera3HeapMemory::deallocate()
 {
+    {
+        Mutex::Autolock lock(mLock);
+        mPtrIndex.clear();
+    }
     for (uint32_t i = 0; i < mBufferCount; i++) {
         munmap(mPtr[i], mMemInfo[i].size);
         mPtr[i] = NULL;
@@ -566,35 +575,23 @@ int QCamera3HeapMemory::getRegFlags(uint8_t * regFlags)
 /*===========================================================================
  * FUNCTION   : getMatchBufIndex
  *
- * DESCRIPTION: query buffer index by object ptr
+ * DESCRIPTION: query buffer index by mapped buffer ptr
  *
  * PARAMETERS :
- *   @object  : object ptr
+ *   @object  : mapped buffer ptr, as returned by getPtr
  *
  * RETURN     : buffer index if match found,
  *              -1 if failed
  *==========================================================================*/
-int QCamera3HeapMemory::getMatchBufIndex(void * /*object*/)
+int QCamera3HeapMemory::getMatchBufIndex(void *object)
 {
+    Mutex::Autolock lock(mLock);
 
-/*
-    TODO for HEAP memory type, would there be an equivalent requirement?
-
-    int index = -1;
-    buffer_handle_t *key = (buffer_handle_t*) object;
-    if (!key) {
+    if (!object) {
         return BAD_VALUE;
     }
-    for (int i = 0; i < mBufferCount; i++) {
-        if (mBufferHandle[i] == key) {
-            index = i;
-            break;
-        }
-    }
-    return index;
-*/
-    ALOGE("%s: FATAL: Not supposed to come here", __func__);
-    return -1;
+
+    return mPtrIndex.find(object);
 }
 
 /*===========================================================================
@@ -720,6 +717,7 @@ int QCamera3GrallocMemory::registerBuffer(buffer_handle_t *buffer,
         ret = NO_MEMORY;
     } else {
         mPtr[idx] = vaddr;
+        mHandleIndex.add(buffer, idx);
         mBufferCount++;
     }
 
@@ -754,6 +752,7 @@ int32_t QCamera3GrallocMemory::unregisterBufferLocked(size_t idx)
     close(mMemInfo[idx].main_ion_fd);
     memset(&mMemInfo[idx], 0, sizeof(struct QCamera3MemInfo));
     mMemInfo[idx].main_ion_fd = -1;
+    mHandleIndex.remove(mBufferHandle[idx]);
     mBufferHandle[idx] = NULL;
     mPrivateHandle[idx] = NULL;
     mBufferCount--;
@@ -949,19 +948,12 @@ int QCamera3GrallocMemory::getMatchBufIndex(void *object)
 {
     Mutex::Autolock lock(mLock);
 
-    int index = -1;
     buffer_handle_t *key = (buffer_handle_t*) object;
     if (!key) {
         return BAD_VALUE;
     }
-    for (uint32_t i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
-        if (mBufferHandle[i] == key) {
-            index = (int)i;
-            break;
-        }
-    }
 
-    return index;
+    return mHandleIndex.find(key);
 }
 
 /*===========================================================================
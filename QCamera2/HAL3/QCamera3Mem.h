@@ -37,6 +37,7 @@ extern "C" {
 #include <linux/msm_ion.h>
 #include <mm_camera_interface.h>
 }
+#include "QCameraBufIndexMap.h"
 
 using namespace android;
 
@@ -115,6 +116,8 @@ private:
             unsigned int heap_id, size_t size);
     void deallocOneBuffer(struct QCamera3MemInfo &memInfo);
     bool mQueueAll;
+    // mapped buffer ptr -> buffer index
+    QCameraBufIndexMap mPtrIndex;
 };
 
 // Gralloc Memory shared with frameworks
@@ -141,6 +144,8 @@ private:
     buffer_handle_t *mBufferHandle[MM_CAMERA_MAX_NUM_FRAMES];
     struct private_handle_t *mPrivateHandle[MM_CAMERA_MAX_NUM_FRAMES];
     int32_t mCurrentFrameNumbers[MM_CAMERA_MAX_NUM_FRAMES];
+    // registered buffer_handle_t ptr -> buffer index
+    QCameraBufIndexMap mHandleIndex;
 };
 
 };
@@ -32,6 +32,7 @@
 //#define LOG_NDEBUG 0
 
 #include <stdlib.h>
+#include <cutils/properties.h>
 #include <utils/Errors.h>
 #include <utils/Trace.h>
 
@@ -67,9 +68,14 @@ QCamera3PostProcessor::QCamera3PostProcessor(QCamera3PicChannel* ch_ctrl)
       m_ongoingJpegQ(releaseJpegData, this),
       m_inputRawQ(releasePPInputData, this),
       m_inputMetaQ(releaseMetadata, this),
-      m_jpegSettingsQ(NULL, this)
+      m_jpegSettingsQ(NULL, this),
+      mUseThumbScaler(false),
+      m_bThumbScaled(false),
+      m_pThumbMem(NULL)
 {
     memset(&mJpegHandle, 0, sizeof(mJpegHandle));
+    memset(&m_thumbDim, 0, sizeof(m_thumbDim));
+    memset(&m_thumbOffset, 0, sizeof(m_thumbOffset));
     pthread_mutex_init(&mReprocJobLock, NULL);
 }
 
@@ -84,6 +90,7 @@ QCamera3PostProcessor::QCamera3PostProcessor(QCamera3PicChannel* ch_ctrl)
  *==========================================================================*/
 QCamera3PostProcessor::~QCamera3PostProcessor()
 {
+    releaseThumbMem();
     pthread_mutex_destroy(&mReprocJobLock);
 }
 
@@ -131,6 +138,22 @@ int32_t QCamera3PostProcessor::init(QCamera3Memory* mMemory,
     mPostProcMask = postprocess_mask;
     m_dataProcTh.launch(dataProcessRoutine, this);
 
+    // thumbnails are scaled from the main frame ahead of the encoder,
+    // unless the encoder takes them from the main image regardless
+    char prop[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.thumb.swscale", prop, "1");
+    mUseThumbScaler = (atoi(prop) > 0);
+    if (mUseThumbScaler && (mJpegHandle.thumb_from_main != NULL) &&
+            mJpegHandle.thumb_from_main()) {
+        CDBG_HIGH("%s: encoder thumbnails come from the main image, "
+                "not scaling them", __func__);
+        mUseThumbScaler = false;
+    }
+    if (mUseThumbScaler) {
+        property_get("persist.camera.thumb.scale.threads", prop, "4");
+        mThumbScaler.init((uint32_t)atoi(prop));
+    }
+
     return NO_ERROR;
 }
 
@@ -148,6 +171,8 @@ int32_t QCamera3PostProcessor::init(QCamera3Memory* mMemory,
 int32_t QCamera3PostProcessor::deinit()
 {
     m_dataProcTh.exit();
+    mThumbScaler.deinit();
+    releaseThumbMem();
 
     if (m_pReprocChannel != NULL) {
         m_pReprocChannel->stop();
@@ -802,6 +827,7 @@ void QCamera3PostProcessor::releaseOngoingPPData(void *data, void *user_data)
         }
 
         if (NULL != pp_job->fwk_src_frame) {
+            pme->m_parent->releaseOfflineInput(pp_job->fwk_src_frame);
             free(pp_job->fwk_src_frame);
             pp_job->fwk_src_frame = NULL;
         }
@@ -885,6 +911,7 @@ void QCamera3PostProcessor::releaseJpegJobData(qcamera_hal3_jpeg_data_t *job)
         }
 
         if (NULL != job->fwk_src_buffer) {
+            m_parent->releaseOfflineInput(job->fwk_src_buffer);
             free(job->fwk_src_buffer);
             job->fwk_src_buffer = NULL;
         } else if (NULL != job->src_metadata) {
@@ -894,6 +921,7 @@ void QCamera3PostProcessor::releaseJpegJobData(qcamera_hal3_jpeg_data_t *job)
         }
 
         if (NULL != job->fwk_frame) {
+            m_parent->releaseOfflineInput(job->fwk_frame);
             free(job->fwk_frame);
             job->fwk_frame = NULL;
         }
@@ -1042,6 +1070,11 @@ int32_t QCamera3PostProcessor::encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_
     dst_dim.width = recvd_frame->reproc_config.output_stream_dim.width;
     dst_dim.height = recvd_frame->reproc_config.output_stream_dim.height;
 
+    needJpegRotation = hal_obj->needJpegRotation();
+    // the scaled thumbnail is produced while the session is set up
+    if (m_bThumbScaled) {
+        needNewSess = TRUE;
+    }
     CDBG_HIGH("%s: Need new session?:%d",__func__, needNewSess);
     if (needNewSess) {
         //creating a new session, so we must destroy the old one
@@ -1063,6 +1096,30 @@ int32_t QCamera3PostProcessor::encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_
         encodeParam.thumb_dim.dst_dim = jpeg_settings->thumbnail_size;
 
         getFWKJpegEncodeConfig(encodeParam, recvd_frame, jpeg_settings);
+
+        // same thumbnail scaling as encodeData, from the framework input
+        cam_format_t img_fmt = recvd_frame->reproc_config.stream_format;
+        m_bThumbScaled = (m_bThumbnailNeeded == TRUE) && mUseThumbScaler &&
+                (needJpegRotation ||
+                ((jpeg_settings->jpeg_orientation != 90) &&
+                (jpeg_settings->jpeg_orientation != 270))) &&
+                ((CAM_FORMAT_YUV_420_NV21 == img_fmt) ||
+                (CAM_FORMAT_YUV_420_NV12 == img_fmt)) &&
+                (prepareThumbMem(jpeg_settings->thumbnail_size) == NO_ERROR);
+        if (m_bThumbScaled) {
+            QCamera3Memory *memObj =
+                    (QCamera3Memory *)recvd_frame->input_buffer.mem_info;
+            if (memObj != NULL) {
+                memObj->invalidateCache(recvd_frame->input_buffer.buf_idx);
+            }
+            m_bThumbScaled = (scaleThumbnail(&recvd_frame->input_buffer,
+                    src_dim,
+                    recvd_frame->reproc_config.input_stream_plane_info.plane_info) ==
+                    NO_ERROR);
+        }
+        if (m_bThumbScaled) {
+            setScaledThumbConfig(encodeParam);
+        }
         CDBG_HIGH("%s: #src bufs:%d # tmb bufs:%d #dst_bufs:%d", __func__,
                      encodeParam.num_src_bufs,encodeParam.num_tmb_bufs,encodeParam.num_dst_bufs);
 
@@ -1087,7 +1144,6 @@ int32_t QCamera3PostProcessor::encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_
     //main_stream->getCropInfo(crop);
 
     // Set main dim job parameters and handle rotation
-    needJpegRotation = hal_obj->needJpegRotation();
     if (!needJpegRotation && (jpeg_settings->jpeg_orientation == 90 ||
             jpeg_settings->jpeg_orientation == 270)) {
 
@@ -1138,6 +1194,12 @@ int32_t QCamera3PostProcessor::encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_
         jpg_job.encode_job.thumb_dim.src_dim = src_dim;
         jpg_job.encode_job.thumb_dim.crop = crop;
         jpg_job.encode_job.thumb_index = 0;
+
+        if (m_bThumbScaled) {
+            jpg_job.encode_job.thumb_dim.src_dim = m_thumbDim;
+            jpg_job.encode_job.thumb_dim.crop.width = m_thumbDim.width;
+            jpg_job.encode_job.thumb_dim.crop.height = m_thumbDim.height;
+        }
     }
 
     if (metadata != NULL) {
@@ -1160,6 +1222,130 @@ int32_t QCamera3PostProcessor::encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_
     return ret;
 }
 
+/*===========================================================================
+ * FUNCTION   : prepareThumbMem
+ *
+ * DESCRIPTION: get the buffer thumbnails are scaled into, kept across
+ *              sessions while the thumbnail size does not change
+ *
+ * PARAMETERS :
+ *   @dim     : thumbnail dimension
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3PostProcessor::prepareThumbMem(const cam_dimension_t &dim)
+{
+    if ((dim.width <= 0) || (dim.height <= 0)) {
+        return BAD_VALUE;
+    }
+    if ((m_pThumbMem != NULL) && (m_thumbDim.width == dim.width) &&
+            (m_thumbDim.height == dim.height)) {
+        return NO_ERROR;
+    }
+    releaseThumbMem();
+
+    cam_frame_len_offset_t offset;
+    QCameraThumbScaler::getFrameOffset(dim, offset);
+    m_pThumbMem = new QCamera3HeapMemory();
+    if (m_pThumbMem == NULL) {
+        ALOGE("%s: unable to create thumbnail memory", __func__);
+        return NO_MEMORY;
+    }
+    int rc = m_pThumbMem->allocate(1, offset.frame_len, false);
+    if (rc < 0) {
+        ALOGE("%s: unable to allocate thumbnail memory", __func__);
+        delete m_pThumbMem;
+        m_pThumbMem = NULL;
+        return NO_MEMORY;
+    }
+    m_thumbDim = dim;
+    m_thumbOffset = offset;
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseThumbMem
+ *
+ * DESCRIPTION: free the scaled thumbnail buffer
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::releaseThumbMem()
+{
+    if (m_pThumbMem != NULL) {
+        m_pThumbMem->deallocate();
+        delete m_pThumbMem;
+        m_pThumbMem = NULL;
+    }
+    m_bThumbScaled = false;
+}
+
+/*===========================================================================
+ * FUNCTION   : scaleThumbnail
+ *
+ * DESCRIPTION: scale the thumbnail of a main frame into the thumbnail buffer
+ *
+ * PARAMETERS :
+ *   @main_frame  : main frame, its cache already invalidated
+ *   @main_dim    : main frame dimension
+ *   @main_offset : main frame plane layout
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3PostProcessor::scaleThumbnail(mm_camera_buf_def_t *main_frame,
+        const cam_dimension_t &main_dim,
+        const cam_frame_len_offset_t &main_offset)
+{
+    ATRACE_CALL();
+    if ((m_pThumbMem == NULL) || (main_frame->buffer == NULL)) {
+        return NO_INIT;
+    }
+
+    thumb_scale_image_t src, dst;
+    QCameraThumbScaler::mapImage((uint8_t *)main_frame->buffer, main_dim,
+            main_offset, src);
+    QCameraThumbScaler::mapImage((uint8_t *)m_pThumbMem->getPtr(0),
+            m_thumbDim, m_thumbOffset, dst);
+    int32_t rc = mThumbScaler.scale(src, NULL, dst, 0);
+    if (rc == NO_ERROR) {
+        m_pThumbMem->cleanCache(0);
+    } else {
+        ALOGE("%s: Error scaling thumbnail, rc = %d, encoder scales it instead",
+                __func__, rc);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : setScaledThumbConfig
+ *
+ * DESCRIPTION: point the session thumbnail source at the scaled thumbnail
+ *
+ * PARAMETERS :
+ *   @encode_parm : session parameters to update
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::setScaledThumbConfig(
+        mm_jpeg_encode_params_t &encode_parm)
+{
+    encode_parm.num_tmb_bufs = 1;
+    memset(&encode_parm.src_thumb_buf[0], 0, sizeof(mm_jpeg_buf_t));
+    encode_parm.src_thumb_buf[0].index = 0;
+    encode_parm.src_thumb_buf[0].buf_size = m_thumbOffset.frame_len;
+    encode_parm.src_thumb_buf[0].buf_vaddr = (uint8_t *)m_pThumbMem->getPtr(0);
+    encode_parm.src_thumb_buf[0].fd = m_pThumbMem->getFd(0);
+    encode_parm.src_thumb_buf[0].format = MM_JPEG_FMT_YUV;
+    encode_parm.src_thumb_buf[0].offset = m_thumbOffset;
+    encode_parm.thumb_dim.src_dim = m_thumbDim;
+}
+
 /*===========================================================================
  * FUNCTION   : encodeData
  *
@@ -1275,6 +1461,10 @@ int32_t QCamera3PostProcessor::encodeData(qcamera_hal3_jpeg_data_t *jpeg_job_dat
     }
 
     needJpegRotation = hal_obj->needJpegRotation();
+    // the scaled thumbnail is produced while the session is set up
+    if (m_bThumbScaled) {
+        needNewSess = TRUE;
+    }
     CDBG_HIGH("%s: Need new session?:%d",__func__, needNewSess);
     if (needNewSess) {
         //creating a new session, so we must destroy the old one
@@ -1321,6 +1511,27 @@ int32_t QCamera3PostProcessor::encodeData(qcamera_hal3_jpeg_data_t *jpeg_job_dat
            encodeParam.rotation = (uint32_t)jpeg_settings->jpeg_orientation;
         }
 
+        // Scale the thumbnail from the main frame into a buffer of its own
+        // instead of having the encoder shrink the whole frame. Frames the
+        // encoder reads transposed keep the old path, and so does any frame
+        // the scaler fails on.
+        cam_format_t img_fmt = CAM_FORMAT_YUV_420_NV12;
+        cam_frame_len_offset_t main_offset;
+        memset(&main_offset, 0, sizeof(cam_frame_len_offset_t));
+        main_stream->getFormat(img_fmt);
+        main_stream->getFrameOffset(main_offset);
+        m_bThumbScaled = (m_bThumbnailNeeded == TRUE) && mUseThumbScaler &&
+                (needJpegRotation ||
+                ((jpeg_settings->jpeg_orientation != 90) &&
+                (jpeg_settings->jpeg_orientation != 270))) &&
+                ((CAM_FORMAT_YUV_420_NV21 == img_fmt) ||
+                (CAM_FORMAT_YUV_420_NV12 == img_fmt)) &&
+                (prepareThumbMem(jpeg_settings->thumbnail_size) == NO_ERROR) &&
+                (scaleThumbnail(main_frame, src_dim, main_offset) == NO_ERROR);
+        if (m_bThumbScaled) {
+            setScaledThumbConfig(encodeParam);
+        }
+
         ret = mJpegHandle.create_session(mJpegClientHandle, &encodeParam, &mJpegSessionId);
         if (ret != NO_ERROR) {
             ALOGE("%s: Error creating a new jpeg encoding session, ret = %d", __func__, ret);
@@ -1401,6 +1612,13 @@ int32_t QCamera3PostProcessor::encodeData(qcamera_hal3_jpeg_data_t *jpeg_job_dat
         }
         jpg_job.encode_job.thumb_dim.crop = crop;
         jpg_job.encode_job.thumb_index = main_frame->buf_idx;
+
+        if (m_bThumbScaled) {
+            jpg_job.encode_job.thumb_dim.src_dim = m_thumbDim;
+            jpg_job.encode_job.thumb_dim.crop.width = m_thumbDim.width;
+            jpg_job.encode_job.thumb_dim.crop.height = m_thumbDim.height;
+            jpg_job.encode_job.thumb_index = 0;
+        }
     }
 
     jpg_job.encode_job.cam_exif_params = hal_obj->get3AExifParams();
@@ -1417,37 +1635,41 @@ int32_t QCamera3PostProcessor::encodeData(qcamera_hal3_jpeg_data_t *jpeg_job_dat
                 jpg_job.encode_job.cam_exif_params.cam_3a_params;
        }
 
-       /* Save a copy of 3A debug params */
-        jpg_job.encode_job.p_metadata->is_statsdebug_ae_params_valid =
-                jpg_job.encode_job.cam_exif_params.ae_debug_params_valid;
-        jpg_job.encode_job.p_metadata->is_statsdebug_awb_params_valid =
-                jpg_job.encode_job.cam_exif_params.awb_debug_params_valid;
-        jpg_job.encode_job.p_metadata->is_statsdebug_af_params_valid =
-                jpg_job.encode_job.cam_exif_params.af_debug_params_valid;
-        jpg_job.encode_job.p_metadata->is_statsdebug_asd_params_valid =
-                jpg_job.encode_job.cam_exif_params.asd_debug_params_valid;
-        jpg_job.encode_job.p_metadata->is_statsdebug_stats_params_valid =
-                jpg_job.encode_job.cam_exif_params.stats_debug_params_valid;
-
-        if (jpg_job.encode_job.cam_exif_params.ae_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_ae_data =
-                    jpg_job.encode_job.cam_exif_params.ae_debug_params;
-        }
-        if (jpg_job.encode_job.cam_exif_params.awb_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_awb_data =
-                    jpg_job.encode_job.cam_exif_params.awb_debug_params;
-        }
-        if (jpg_job.encode_job.cam_exif_params.af_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_af_data =
-                    jpg_job.encode_job.cam_exif_params.af_debug_params;
-        }
-        if (jpg_job.encode_job.cam_exif_params.asd_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_asd_data =
-                    jpg_job.encode_job.cam_exif_params.asd_debug_params;
-        }
-        if (jpg_job.encode_job.cam_exif_params.stats_debug_params_valid) {
-            jpg_job.encode_job.p_metadata->statsdebug_stats_buffer_data =
-                    jpg_job.encode_job.cam_exif_params.stats_debug_params;
+        /* Save a copy of 3A debug params */
+        mm_jpeg_debug_exif_params_t *debug_params =
+                jpg_job.encode_job.cam_exif_params.debug_params;
+        if (NULL != debug_params) {
+            jpg_job.encode_job.p_metadata->is_statsdebug_ae_params_valid =
+                    debug_params->ae_debug_params_valid;
+            jpg_job.encode_job.p_metadata->is_statsdebug_awb_params_valid =
+                    debug_params->awb_debug_params_valid;
+            jpg_job.encode_job.p_metadata->is_statsdebug_af_params_valid =
+                    debug_params->af_debug_params_valid;
+            jpg_job.encode_job.p_metadata->is_statsdebug_asd_params_valid =
+                    debug_params->asd_debug_params_valid;
+            jpg_job.encode_job.p_metadata->is_statsdebug_stats_params_valid =
+                    debug_params->stats_debug_params_valid;
+
+            if (debug_params->ae_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_ae_data =
+                        debug_params->ae_debug_params;
+            }
+            if (debug_params->awb_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_awb_data =
+                        debug_params->awb_debug_params;
+            }
+            if (debug_params->af_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_af_data =
+                        debug_params->af_debug_params;
+            }
+            if (debug_params->asd_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_asd_data =
+                        debug_params->asd_debug_params;
+            }
+            if (debug_params->stats_debug_params_valid) {
+                jpg_job.encode_job.p_metadata->statsdebug_stats_buffer_data =
+                        debug_params->stats_debug_params;
+            }
         }
     } else {
        ALOGE("%s: Metadata is null", __func__);
@@ -1635,6 +1857,7 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
                                 }
                                 // free frame
                                 if (fwk_frame != NULL) {
+                                    pme->m_parent->releaseOfflineInput(fwk_frame);
                                     free(fwk_frame);
                                 }
                             }
@@ -1741,6 +1964,7 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
                     qcamera_fwk_input_pp_data_t *fwk_frame =
                             (qcamera_fwk_input_pp_data_t *) pme->m_inputFWKPPQ.dequeue();
                     if (NULL != fwk_frame) {
+                        pme->m_parent->releaseOfflineInput(fwk_frame);
                         free(fwk_frame);
                     }
                 }
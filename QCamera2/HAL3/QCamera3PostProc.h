@@ -38,6 +38,7 @@ extern "C" {
 //#include "QCamera3HWI.h"
 #include "QCameraQueue.h"
 #include "QCameraCmdThread.h"
+#include "QCameraThumbScaler.h"
 #include "QCamera3HALHeader.h"
 
 namespace qcamera {
@@ -48,12 +49,14 @@ class QCamera3PicChannel;
 class QCamera3ReprocessChannel;
 class QCamera3Stream;
 class QCamera3Memory;
+class QCamera3HeapMemory;
 
 typedef struct {
     camera3_stream_buffer_t src_frame;// source frame
     mm_camera_buf_def_t metadata_buffer;
     mm_camera_buf_def_t input_buffer;
     reprocess_config_t reproc_config;
+    bool offline_slot; // input and metadata hold a picture channel offline slot
 } qcamera_fwk_input_pp_data_t;
 
 typedef struct {
@@ -138,6 +141,12 @@ private:
     void releaseSuperBuf(mm_camera_super_buf_t *super_buf);
     static void releaseNotifyData(void *user_data, void *cookie);
     int32_t processRawImageImpl(mm_camera_super_buf_t *recvd_frame);
+    int32_t prepareThumbMem(const cam_dimension_t &dim);
+    void releaseThumbMem();
+    int32_t scaleThumbnail(mm_camera_buf_def_t *main_frame,
+            const cam_dimension_t &main_dim,
+            const cam_frame_len_offset_t &main_offset);
+    void setScaledThumbConfig(mm_jpeg_encode_params_t &encode_parm);
 
     static void releaseJpegData(void *data, void *user_data);
     static void releasePPInputData(void *data, void *user_data);
@@ -170,6 +179,13 @@ private:
     QCameraCmdThread m_dataProcTh;      // thread for data processing
 
     pthread_mutex_t mReprocJobLock;
+
+    QCameraThumbScaler mThumbScaler;    // scales thumbnails from main frames
+    bool mUseThumbScaler;
+    bool m_bThumbScaled;                // session encodes the scaled thumbnail
+    QCamera3HeapMemory *m_pThumbMem;
+    cam_dimension_t m_thumbDim;
+    cam_frame_len_offset_t m_thumbOffset;
 };
 
 }; // namespace qcamera
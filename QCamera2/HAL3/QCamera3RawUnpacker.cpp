@@ -0,0 +1,448 @@
+/* Copyright (c) 2015, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+#define LOG_TAG "QCamera3RawUnpacker"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include <utils/Trace.h>
+
+#include "QCamera3RawUnpacker.h"
+#include "QCamera3HWI.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCamera3RawUnpacker
+ *
+ * DESCRIPTION: Constructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3RawUnpacker::QCamera3RawUnpacker()
+        : mNumWorkers(0)
+{
+    memset(&mJob, 0, sizeof(mJob));
+    for (uint32_t i = 0; i < MAX_UNPACK_WORKERS; i++) {
+        mWorkers[i].owner = this;
+        mWorkers[i].firstRow = 0;
+        mWorkers[i].lastRow = 0;
+    }
+    cam_sem_init(&mDoneSem, 0);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCamera3RawUnpacker
+ *
+ * DESCRIPTION: destructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3RawUnpacker::~QCamera3RawUnpacker()
+{
+    deinit();
+    cam_sem_destroy(&mDoneSem);
+}
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: launch the worker threads. The calling thread always takes
+ *              a stripe of its own, so numThreads - 1 workers are started,
+ *              bounded by the online cpus.
+ *
+ * PARAMETERS :
+ *   @numThreads : threads to unpack a frame with, 1 for no workers
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3RawUnpacker::init(uint32_t numThreads)
+{
+    deinit();
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((cpus > 0) && (numThreads > (uint32_t)cpus)) {
+        numThreads = (uint32_t)cpus;
+    }
+    uint32_t numWorkers = (numThreads > 1) ? numThreads - 1 : 0;
+    if (numWorkers > MAX_UNPACK_WORKERS) {
+        numWorkers = MAX_UNPACK_WORKERS;
+    }
+
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        int32_t rc = mWorkers[i].thread.launch(workerRoutine, &mWorkers[i]);
+        if (rc != NO_ERROR) {
+            ALOGE("%s: Failed to launch worker %d", __func__, i);
+            break;
+        }
+        mNumWorkers++;
+    }
+    CDBG("%s: %d unpack workers", __func__, mNumWorkers);
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : deinit
+ *
+ * DESCRIPTION: stop the worker threads
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RawUnpacker::deinit()
+{
+    for (uint32_t i = 0; i < mNumWorkers; i++) {
+        mWorkers[i].thread.exit();
+    }
+    mNumWorkers = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : unpack
+ *
+ * DESCRIPTION: convert a 10 bit raw frame to RAW16 in place. Output row y
+ *              starts at or past input row y, so going bottom up a chunk
+ *              of rows [first, last) whose output begins at or past the
+ *              input of row last only overwrites input already consumed,
+ *              and its rows are independent of each other. The chunks
+ *              shrink towards the top of the frame; the few rows left
+ *              overlap their own input and are converted back to front.
+ *
+ * PARAMETERS :
+ *   @format    : packing of the input
+ *   @buffer    : frame buffer, input on entry and RAW16 on return
+ *   @width     : frame width in pixels
+ *   @height    : frame height in pixels
+ *   @srcStride : input row stride in bytes
+ *   @dstStride : output row stride in pixels
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RawUnpacker::unpack(raw_unpack_format_t format, void *buffer,
+        uint32_t width, uint32_t height, uint32_t srcStride, uint32_t dstStride)
+{
+    ATRACE_CALL();
+    uint64_t dstRowBytes = (uint64_t)dstStride * sizeof(uint16_t);
+    if ((buffer == NULL) || (width == 0) || (dstStride < width)) {
+        return;
+    }
+    if (srcStride > dstRowBytes) {
+        // output rows would start ahead of their input
+        ALOGE("%s: stride %u doesn't fit in place into %u pixels", __func__,
+                srcStride, dstStride);
+        return;
+    }
+
+    mJob.format = format;
+    mJob.buffer = (uint8_t *)buffer;
+    mJob.width = width;
+    mJob.srcStride = srcStride;
+    mJob.dstStride = dstStride;
+
+    uint32_t lastRow = height;
+    while (lastRow > 0) {
+        uint32_t firstRow = (uint32_t)
+                (((uint64_t)lastRow * srcStride + dstRowBytes - 1) / dstRowBytes);
+        if (firstRow >= lastRow) {
+            break;
+        }
+        unpackStriped(firstRow, lastRow);
+        lastRow = firstRow;
+    }
+
+    for (uint32_t y = lastRow; y > 0; y--) {
+        const uint8_t *src = mJob.buffer + (y - 1) * srcStride;
+        uint16_t *dst = (uint16_t *)mJob.buffer + (y - 1) * dstStride;
+        if (format == RAW_UNPACK_MIPI10) {
+            unpackMipiPixels(src, dst, 0, width);
+        } else {
+            unpackLegacyPixels(src, dst, 0, width);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : unpackStriped
+ *
+ * DESCRIPTION: convert independent rows, split in stripes across the
+ *              workers and the calling thread
+ *
+ * PARAMETERS :
+ *   @firstRow : first row to convert
+ *   @lastRow  : row past the last one to convert
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RawUnpacker::unpackStriped(uint32_t firstRow, uint32_t lastRow)
+{
+    uint32_t rows = lastRow - firstRow;
+    uint32_t stripes = rows / MIN_ROWS_PER_STRIPE;
+    if (stripes > mNumWorkers + 1) {
+        stripes = mNumWorkers + 1;
+    }
+    if (stripes <= 1) {
+        unpackRows(firstRow, lastRow);
+        return;
+    }
+
+    uint32_t rowsPerStripe = (rows + stripes - 1) / stripes;
+    uint32_t row = firstRow;
+    uint32_t dispatched = 0;
+    for (uint32_t i = 0; i < stripes - 1; i++) {
+        mWorkers[i].firstRow = row;
+        mWorkers[i].lastRow = row + rowsPerStripe;
+        row += rowsPerStripe;
+        if (mWorkers[i].thread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB,
+                FALSE, FALSE) == NO_ERROR) {
+            dispatched++;
+        } else {
+            unpackRows(mWorkers[i].firstRow, mWorkers[i].lastRow);
+        }
+    }
+    unpackRows(row, lastRow);
+
+    for (uint32_t i = 0; i < dispatched; i++) {
+        cam_sem_wait(&mDoneSem);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : unpackRows
+ *
+ * DESCRIPTION: convert rows whose output doesn't overlap their input
+ *
+ * PARAMETERS :
+ *   @firstRow : first row to convert
+ *   @lastRow  : row past the last one to convert
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RawUnpacker::unpackRows(uint32_t firstRow, uint32_t lastRow)
+{
+    for (uint32_t y = firstRow; y < lastRow; y++) {
+        const uint8_t *src = mJob.buffer + y * mJob.srcStride;
+        uint16_t *dst = (uint16_t *)mJob.buffer + y * mJob.dstStride;
+        if (mJob.format == RAW_UNPACK_MIPI10) {
+            unpackMipiRow(src, dst, mJob.width, mJob.srcStride);
+        } else {
+            unpackLegacyPixels(src, dst, 0, mJob.width);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : workerRoutine
+ *
+ * DESCRIPTION: worker thread, converts the stripe it is handed on every
+ *              CAMERA_CMD_TYPE_DO_NEXT_JOB
+ *
+ * PARAMETERS :
+ *   @data    : worker descriptor
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void *QCamera3RawUnpacker::workerRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    unpack_worker_t *worker = (unpack_worker_t *)data;
+    QCameraCmdThread *cmdThread = &worker->thread;
+    cmdThread->setName("cam_raw_unpack");
+
+    do {
+        do {
+            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            if (ret != 0 && errno != EINVAL) {
+                ALOGE("%s: cam_sem_wait error (%s)",
+                      __func__, strerror(errno));
+                return NULL;
+            }
+        } while (ret != 0);
+
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            worker->owner->unpackRows(worker->firstRow, worker->lastRow);
+            cam_sem_post(&worker->owner->mDoneSem);
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            running = 0;
+            break;
+        default:
+            break;
+        }
+    } while (running);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : unpackMipiPixels
+ *
+ * DESCRIPTION: convert pixels [from, to) of a mipi10 row:
+ *              P3(1:0) P2(1:0) P1(1:0) P0(1:0) P3(9:2) P2(9:2) P1(9:2) P0(9:2)
+ *              Goes back to front and reads a whole group before writing
+ *              it, so the row may be converted onto its own input.
+ *
+ * PARAMETERS :
+ *   @src  : input row
+ *   @dst  : output row
+ *   @from : first pixel
+ *   @to   : pixel past the last one
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RawUnpacker::unpackMipiPixels(const uint8_t *src, uint16_t *dst,
+        uint32_t from, uint32_t to)
+{
+    uint32_t x = to;
+    while (x > from) {
+        uint32_t base = (x - 1) & ~3U;
+        const uint8_t *group = src + 5 * (base / 4);
+        uint8_t msb[4] = {group[0], group[1], group[2], group[3]};
+        uint8_t lsb = group[4];
+        if ((x == base + 4) && (base >= from)) {
+            dst[base + 3] = (uint16_t)((msb[3] << 2) | ((lsb >> 3) & 0x3));
+            dst[base + 2] = (uint16_t)((msb[2] << 2) | ((lsb >> 2) & 0x3));
+            dst[base + 1] = (uint16_t)((msb[1] << 2) | ((lsb >> 1) & 0x3));
+            dst[base] = (uint16_t)((msb[0] << 2) | (lsb & 0x3));
+            x = base;
+            continue;
+        }
+        // partial group at either end of the range
+        uint32_t first = (base > from) ? base : from;
+        while (x > first) {
+            x--;
+            dst[x] = (uint16_t)((msb[x % 4] << 2) | ((lsb >> (x % 4)) & 0x3));
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : unpackLegacyPixels
+ *
+ * DESCRIPTION: convert pixels [from, to) of a legacy 10 bit row, 6 pixels
+ *              in the low 60 bits of each 64 bit word. Goes back to front
+ *              and reads a whole word before writing it, so the row may be
+ *              converted onto its own input.
+ *
+ * PARAMETERS :
+ *   @src  : input row
+ *   @dst  : output row
+ *   @from : first pixel
+ *   @to   : pixel past the last one
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RawUnpacker::unpackLegacyPixels(const uint8_t *src, uint16_t *dst,
+        uint32_t from, uint32_t to)
+{
+    uint64_t word;
+    uint32_t x = to;
+    while (x > from) {
+        uint32_t base = (x - 1) / 6 * 6;
+        memcpy(&word, src + 8 * (base / 6), sizeof(word));
+        if ((x == base + 6) && (base >= from)) {
+            dst[base + 5] = (uint16_t)(0x3FF & (word >> 50));
+            dst[base + 4] = (uint16_t)(0x3FF & (word >> 40));
+            dst[base + 3] = (uint16_t)(0x3FF & (word >> 30));
+            dst[base + 2] = (uint16_t)(0x3FF & (word >> 20));
+            dst[base + 1] = (uint16_t)(0x3FF & (word >> 10));
+            dst[base] = (uint16_t)(0x3FF & word);
+            x = base;
+            continue;
+        }
+        // partial word at either end of the range
+        uint32_t first = (base > from) ? base : from;
+        while (x > first) {
+            x--;
+            dst[x] = (uint16_t)(0x3FF & (word >> (10 * (x - base))));
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : unpackMipiRow
+ *
+ * DESCRIPTION: convert a mipi10 row whose output doesn't overlap its input.
+ *              With NEON 8 pixels are gathered from 10 bytes per step.
+ *
+ * PARAMETERS :
+ *   @src      : input row
+ *   @dst      : output row
+ *   @width    : pixels in the row
+ *   @srcBytes : readable bytes from the row start
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RawUnpacker::unpackMipiRow(const uint8_t *src, uint16_t *dst,
+        uint32_t width, uint32_t srcBytes)
+{
+    uint32_t x = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    static const uint8_t kMsbIdx[8] = {0, 1, 2, 3, 5, 6, 7, 8};
+    static const uint8_t kLsbIdx[8] = {4, 4, 4, 4, 9, 9, 9, 9};
+    static const int8_t kLsbShift[8] = {0, -1, -2, -3, 0, -1, -2, -3};
+    const uint8x8_t msbIdx = vld1_u8(kMsbIdx);
+    const uint8x8_t lsbIdx = vld1_u8(kLsbIdx);
+    const int8x8_t lsbShift = vld1_s8(kLsbShift);
+    const uint8x8_t lsbMask = vdup_n_u8(0x3);
+
+    // 16 byte loads for 10 bytes of input must stay within the row
+    for (; (x + 8 <= width) && (5 * (x / 4) + 16 <= srcBytes); x += 8) {
+        const uint8_t *group = src + 5 * (x / 4);
+        uint8x8x2_t in;
+        in.val[0] = vld1_u8(group);
+        in.val[1] = vld1_u8(group + 8);
+        uint8x8_t msb = vtbl2_u8(in, msbIdx);
+        uint8x8_t lsb = vand_u8(vshl_u8(vtbl2_u8(in, lsbIdx), lsbShift),
+                lsbMask);
+        vst1q_u16(dst + x, vorrq_u16(vshll_n_u8(msb, 2), vmovl_u8(lsb)));
+    }
+#else
+    (void)srcBytes;
+#endif
+    unpackMipiPixels(src, dst, x, width);
+}
+
+}; // namespace qcamera
@@ -0,0 +1,104 @@
+/* Copyright (c) 2015, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3RAWUNPACKER_H__
+#define __QCAMERA3RAWUNPACKER_H__
+
+#include <pthread.h>
+#include <utils/Errors.h>
+#include <cam_semaphore.h>
+#include "QCameraCmdThread.h"
+
+using namespace android;
+
+namespace qcamera {
+
+typedef enum {
+    RAW_UNPACK_MIPI10,   /* 4 pixels in 5 bytes, 2 lsbs of each in the 5th */
+    RAW_UNPACK_LEGACY10, /* 6 pixels in the low 60 bits of a 64 bit word */
+} raw_unpack_format_t;
+
+/* Unpacks 10 bit raw into RAW16 in place, within the same buffer. Rows are
+ * converted bottom up in chunks whose output only lands on input already
+ * consumed, so each chunk is split into stripes across a worker pool. */
+class QCamera3RawUnpacker {
+public:
+    QCamera3RawUnpacker();
+    virtual ~QCamera3RawUnpacker();
+
+    int32_t init(uint32_t numThreads);
+    void deinit();
+    void unpack(raw_unpack_format_t format, void *buffer, uint32_t width,
+            uint32_t height, uint32_t srcStride, uint32_t dstStride);
+
+private:
+    /* checks the row converters against each other */
+    friend class QCamera3RawUnpackerTest;
+
+    enum {
+        MAX_UNPACK_WORKERS = 3,
+        // fewer rows are not worth waking up the workers
+        MIN_ROWS_PER_STRIPE = 16
+    };
+
+    typedef struct {
+        raw_unpack_format_t format;
+        uint8_t *buffer;
+        uint32_t width;
+        uint32_t srcStride;  /* bytes */
+        uint32_t dstStride;  /* pixels */
+    } unpack_job_t;
+
+    typedef struct {
+        QCameraCmdThread thread;
+        QCamera3RawUnpacker *owner;
+        uint32_t firstRow;
+        uint32_t lastRow;
+    } unpack_worker_t;
+
+    static void *workerRoutine(void *data);
+    void unpackStriped(uint32_t firstRow, uint32_t lastRow);
+    void unpackRows(uint32_t firstRow, uint32_t lastRow);
+
+    static void unpackMipiPixels(const uint8_t *src, uint16_t *dst,
+            uint32_t from, uint32_t to);
+    static void unpackLegacyPixels(const uint8_t *src, uint16_t *dst,
+            uint32_t from, uint32_t to);
+    static void unpackMipiRow(const uint8_t *src, uint16_t *dst,
+            uint32_t width, uint32_t srcBytes);
+
+    unpack_job_t mJob;
+    unpack_worker_t mWorkers[MAX_UNPACK_WORKERS];
+    uint32_t mNumWorkers;
+    cam_semaphore_t mDoneSem;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3RAWUNPACKER_H__ */
@@ -0,0 +1,283 @@
+/* Copyright (c) 2015, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+#define LOG_TAG "QCamera3ResultBuilder"
+
+#include <string.h>
+#include <utils/Log.h>
+#include "QCamera3ResultBuilder.h"
+#include "QCamera3HWI.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCamera3ResultBuilder
+ *
+ * DESCRIPTION: Constructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3ResultBuilder::QCamera3ResultBuilder()
+        : mGeneration(0),
+          mEntryHint(0),
+          mDataHint(0)
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCamera3ResultBuilder
+ *
+ * DESCRIPTION: destructor
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+QCamera3ResultBuilder::~QCamera3ResultBuilder()
+{
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: drop all cached result entries at the start of a session. If
+ *              an earlier session produced results, the new buffer is
+ *              preallocated to the largest result seen so far.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3ResultBuilder::reset()
+{
+    mMetadata.clear();
+    if (mEntryHint > 0) {
+        CameraMetadata presized(mEntryHint, mDataHint);
+        mMetadata.acquire(presized);
+    }
+    mTagGeneration.clear();
+    mGeneration = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : begin
+ *
+ * DESCRIPTION: start building the result of a new frame. Entries of the
+ *              previous frame stay in the buffer until finish().
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3ResultBuilder::begin()
+{
+    mGeneration++;
+}
+
+/*===========================================================================
+ * FUNCTION   : finish
+ *
+ * DESCRIPTION: drop the entries the current frame did not produce and lock
+ *              the result buffer for the framework callback. The buffer
+ *              must be handed back through release() once the callback
+ *              returns; it is not to be freed by the caller.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : result metadata of the current frame
+ *==========================================================================*/
+const camera_metadata_t *QCamera3ResultBuilder::finish()
+{
+    const camera_metadata_t *buffer = mMetadata.getAndLock();
+    size_t entryCount = get_camera_metadata_entry_count(buffer);
+    size_t staleCount = 0;
+    camera_metadata_ro_entry_t entry;
+
+    for (size_t i = 0; i < entryCount; i++) {
+        get_camera_metadata_ro_entry(buffer, i, &entry);
+        ssize_t idx = mTagGeneration.indexOfKey(entry.tag);
+        if (idx < 0 || mTagGeneration.valueAt(idx) != mGeneration) {
+            staleCount++;
+        }
+    }
+
+    if (staleCount > 0) {
+        Vector<uint32_t> staleTags;
+        staleTags.setCapacity(staleCount);
+        for (size_t i = 0; i < entryCount; i++) {
+            get_camera_metadata_ro_entry(buffer, i, &entry);
+            ssize_t idx = mTagGeneration.indexOfKey(entry.tag);
+            if (idx < 0 || mTagGeneration.valueAt(idx) != mGeneration) {
+                staleTags.push_back(entry.tag);
+            }
+        }
+        mMetadata.unlock(buffer);
+        for (size_t i = 0; i < staleTags.size(); i++) {
+            mMetadata.erase(staleTags[i]);
+        }
+        buffer = mMetadata.getAndLock();
+    }
+
+    if (get_camera_metadata_entry_count(buffer) > mEntryHint) {
+        mEntryHint = get_camera_metadata_entry_count(buffer);
+    }
+    if (get_camera_metadata_data_count(buffer) > mDataHint) {
+        mDataHint = get_camera_metadata_data_count(buffer);
+    }
+    return buffer;
+}
+
+/*===========================================================================
+ * FUNCTION   : release
+ *
+ * DESCRIPTION: hand back the buffer returned by finish() after the
+ *              framework callback has copied it
+ *
+ * PARAMETERS :
+ *   @buffer  : buffer returned by finish()
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3ResultBuilder::release(const camera_metadata_t *buffer)
+{
+    mMetadata.unlock(buffer);
+}
+
+/*===========================================================================
+ * FUNCTION   : update
+ *
+ * DESCRIPTION: update a string entry of the current frame
+ *
+ * PARAMETERS :
+ *   @tag     : metadata tag
+ *   @string  : string value, stored with its terminating NUL
+ *
+ * RETURN     : NO_ERROR on success
+ *              none-zero failure code
+ *==========================================================================*/
+status_t QCamera3ResultBuilder::update(uint32_t tag, const String8 &string)
+{
+    if (isUnchanged(tag, string.string(), string.size() + 1,
+            string.size() + 1)) {
+        return NO_ERROR;
+    }
+    return mMetadata.update(tag, string);
+}
+
+/*===========================================================================
+ * FUNCTION   : update
+ *
+ * DESCRIPTION: update the current frame from an entry of another buffer
+ *
+ * PARAMETERS :
+ *   @entry   : entry to copy
+ *
+ * RETURN     : NO_ERROR on success
+ *              none-zero failure code
+ *==========================================================================*/
+status_t QCamera3ResultBuilder::update(const camera_metadata_ro_entry &entry)
+{
+    if (entry.type >= NUM_TYPES) {
+        return BAD_VALUE;
+    }
+    if (isUnchanged(entry.tag, entry.data.u8,
+            entry.count * camera_metadata_type_size[entry.type],
+            entry.count)) {
+        return NO_ERROR;
+    }
+    return mMetadata.update(entry);
+}
+
+/*===========================================================================
+ * FUNCTION   : append
+ *
+ * DESCRIPTION: update the current frame with all entries of another buffer.
+ *              Unlike CameraMetadata::append, existing tags are overwritten
+ *              instead of duplicated.
+ *
+ * PARAMETERS :
+ *   @other   : metadata to merge in
+ *
+ * RETURN     : NO_ERROR on success
+ *              none-zero failure code
+ *==========================================================================*/
+status_t QCamera3ResultBuilder::append(const CameraMetadata &other)
+{
+    status_t rc = NO_ERROR;
+    const camera_metadata_t *buffer = other.getAndLock();
+    size_t entryCount = get_camera_metadata_entry_count(buffer);
+    camera_metadata_ro_entry_t entry;
+
+    for (size_t i = 0; i < entryCount && rc == NO_ERROR; i++) {
+        get_camera_metadata_ro_entry(buffer, i, &entry);
+        rc = update(entry);
+    }
+    other.unlock(buffer);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : isUnchanged
+ *
+ * DESCRIPTION: mark a tag as produced by the current frame and check whether
+ *              the buffer already holds the same value for it
+ *
+ * PARAMETERS :
+ *   @tag        : metadata tag
+ *   @data       : new value
+ *   @size       : size of new value in bytes
+ *   @data_count : number of elements of new value
+ *
+ * RETURN     : true if the stored entry can be kept as is
+ *==========================================================================*/
+bool QCamera3ResultBuilder::isUnchanged(uint32_t tag, const void *data,
+        size_t size, size_t data_count)
+{
+    ssize_t idx = mTagGeneration.indexOfKey(tag);
+    if (idx < 0) {
+        mTagGeneration.add(tag, mGeneration);
+    } else {
+        mTagGeneration.editValueAt(idx) = mGeneration;
+    }
+
+    if (data_count == 0) {
+        return false;
+    }
+    camera_metadata_entry_t entry = mMetadata.find(tag);
+    return (entry.count == data_count) &&
+            (memcmp(entry.data.u8, data, size) == 0);
+}
+
+}; // namespace qcamera
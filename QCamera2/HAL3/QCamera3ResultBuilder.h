@@ -0,0 +1,82 @@
+/* Copyright (c) 2015, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3RESULTBUILDER_H__
+#define __QCAMERA3RESULTBUILDER_H__
+
+#include <utils/Errors.h>
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <camera/CameraMetadata.h>
+
+using namespace android;
+
+namespace qcamera {
+
+// Per-session builder for capture result metadata. The result buffer is kept
+// across frames: entries are rewritten in place only when their value changes,
+// and entries not produced by the current frame are dropped at finish().
+class QCamera3ResultBuilder {
+public:
+    QCamera3ResultBuilder();
+    virtual ~QCamera3ResultBuilder();
+
+    void reset();
+    void begin();
+    const camera_metadata_t *finish();
+    void release(const camera_metadata_t *buffer);
+
+    template <typename T>
+    status_t update(uint32_t tag, const T *data, size_t data_count)
+    {
+        if (isUnchanged(tag, data, data_count * sizeof(T), data_count)) {
+            return NO_ERROR;
+        }
+        return mMetadata.update(tag, data, data_count);
+    }
+    status_t update(uint32_t tag, const String8 &string);
+    status_t update(const camera_metadata_ro_entry &entry);
+    status_t append(const CameraMetadata &other);
+
+private:
+    bool isUnchanged(uint32_t tag, const void *data, size_t size,
+            size_t data_count);
+
+    CameraMetadata mMetadata;
+    // tag -> generation of the frame that last produced it
+    KeyedVector<uint32_t, uint32_t> mTagGeneration;
+    uint32_t mGeneration;
+    // largest result seen, used to presize the buffer of the next session
+    size_t mEntryHint;
+    size_t mDataHint;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3RESULTBUILDER_H__ */
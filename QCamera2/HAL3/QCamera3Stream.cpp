@@ -177,6 +177,9 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
         mStreamInfoBuf(NULL),
         mStreamBufs(NULL),
         mBufDefs(NULL),
+        mNumBatchBufs(0),
+        mStreamBatchBufs(NULL),
+        mBatchBufDefs(NULL),
         mChannel(channel)
 {
     mMemVtbl.user_data = this;
@@ -228,6 +231,10 @@ QCamera3Stream::~QCamera3Stream()
  *   @streamDim      : stream dimension
  *   @reprocess_config: reprocess stream input configuration
  *   @minNumBuffers  : minimal buffer count for particular stream type
+ *   @postprocess_mask: postprocess feature mask
+ *   @is_type        : image stabilization type
+ *   @batch_info     : batch (HFR) configuration, NULL for one frame per
+ *                     kernel buffer
  *   @stream_cb      : callback handle
  *   @userdata       : user data
  *
@@ -242,6 +249,7 @@ int32_t QCamera3Stream::init(cam_stream_type_t streamType,
                             uint8_t minNumBuffers,
                             uint32_t postprocess_mask,
                             cam_is_type_t is_type,
+                            cam_stream_user_buf_info_t* batch_info,
                             hal3_stream_cb_routine stream_cb,
                             void *userdata)
 {
@@ -303,6 +311,23 @@ int32_t QCamera3Stream::init(cam_stream_type_t streamType,
        //mStreamInfo->num_of_burst = reprocess_config->offline.num_of_bufs;
        mStreamInfo->num_of_burst = 1;
        ALOGI("%s: num_of_burst is %d", __func__, mStreamInfo->num_of_burst);
+    } else if ((batch_info != NULL) && (batch_info->frame_buf_cnt > 1)) {
+       if ((batch_info->frame_buf_cnt > MSM_CAMERA_MAX_USER_BUFF_CNT) ||
+               (minNumBuffers < batch_info->frame_buf_cnt)) {
+           ALOGE("%s: Invalid batch size %d for %d buffers", __func__,
+                   batch_info->frame_buf_cnt, minNumBuffers);
+           rc = BAD_VALUE;
+           goto err4;
+       }
+       mStreamInfo->streaming_mode = CAM_STREAMING_MODE_BATCH;
+       mStreamInfo->user_buf_info = *batch_info;
+       mStreamInfo->user_buf_info.size =
+               (uint32_t)sizeof(struct msm_camera_user_buf_cont_t);
+       // the kernel only sees the containers, each one carrying a batch
+       mNumBatchBufs = (uint8_t)(minNumBuffers / batch_info->frame_buf_cnt);
+       mStreamInfo->num_bufs = mNumBatchBufs;
+       ALOGI("%s: batch size %d, %d containers", __func__,
+               batch_info->frame_buf_cnt, mNumBatchBufs);
     } else {
        mStreamInfo->streaming_mode = CAM_STREAMING_MODE_CONTINUOUS;
     }
@@ -338,6 +363,7 @@ err1:
     mCamOps->delete_stream(mCamHandle, mChannelHandle, mHandle);
     mHandle = 0;
     mNumBufs = 0;
+    mNumBatchBufs = 0;
 done:
     return rc;
 }
@@ -359,6 +385,7 @@ int32_t QCamera3Stream::start()
     int32_t rc = 0;
 
     mDataQ.init();
+    mProcTh.setDrainMode(true);
     rc = mProcTh.launch(dataProcRoutine, this);
     return rc;
 }
@@ -434,6 +461,11 @@ void QCamera3Stream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         return;
     }
 
+    if (recvd_frame->bufs[0]->buf_type == CAM_STREAM_BUF_TYPE_USERPTR) {
+        stream->handleBatchBuffer(recvd_frame);
+        return;
+    }
+
     mm_camera_super_buf_t *frame =
         (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
     if (frame == NULL) {
@@ -441,11 +473,66 @@ void QCamera3Stream::dataNotifyCB(mm_camera_super_buf_t *recvd_frame,
         stream->bufDone(recvd_frame->bufs[0]->buf_idx);
         return;
     }
+    mm_camera_trace_frame(MM_CAMERA_TRACE_HAL_NOTIFY, recvd_frame->bufs[0]);
     *frame = *recvd_frame;
     stream->processDataNotify(frame);
     return;
 }
 
+/*===========================================================================
+ * FUNCTION   : handleBatchBuffer
+ *
+ * DESCRIPTION: split a dequeued batch container into its frames. Every frame
+ *              goes down the regular per-frame path and comes back through
+ *              bufDone on its own, the container itself is released at once.
+ *
+ * PARAMETERS :
+ *   @superBuf : super buffer holding the container
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::handleBatchBuffer(mm_camera_super_buf_t *superBuf)
+{
+    mm_camera_buf_def_t *batchBuf = superBuf->bufs[0];
+    int32_t numFrames = batchBuf->user_buf.bufs_used;
+
+    if ((mBufDefs == NULL) || (numFrames > MSM_CAMERA_MAX_USER_BUFF_CNT)) {
+        ALOGE("%s: Invalid batch buffer %d", __func__, batchBuf->buf_idx);
+        return;
+    }
+
+    for (int32_t i = 0; i < numFrames; i++) {
+        int32_t index = batchBuf->user_buf.buf_idx[i];
+        if ((index < 0) || (index >= mNumBufs)) {
+            ALOGE("%s: Invalid frame %d in batch buffer %d",
+                    __func__, index, batchBuf->buf_idx);
+            continue;
+        }
+
+        mm_camera_super_buf_t *frame =
+            (mm_camera_super_buf_t *)malloc(sizeof(mm_camera_super_buf_t));
+        if (frame == NULL) {
+            ALOGE("%s: No mem for mm_camera_buf_def_t", __func__);
+            bufDone((uint32_t)index);
+            continue;
+        }
+        *frame = *superBuf;
+        frame->bufs[0] = &mBufDefs[index];
+        mm_camera_trace_frame(MM_CAMERA_TRACE_HAL_NOTIFY, frame->bufs[0]);
+        processDataNotify(frame);
+    }
+
+    // frames were handed out individually, tell the interface to only
+    // put the container back into its free pool
+    for (int32_t i = 0; i < MSM_CAMERA_MAX_USER_BUFF_CNT; i++) {
+        batchBuf->user_buf.buf_idx[i] = -1;
+    }
+    if (mCamOps->qbuf(mCamHandle, mChannelHandle, batchBuf) < 0) {
+        ALOGE("%s: Failed to release batch buffer %d",
+                __func__, batchBuf->buf_idx);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : dataProcRoutine
  *
@@ -481,15 +568,18 @@ void *QCamera3Stream::dataProcRoutine(void *data)
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
             {
                 CDBG("%s: Do next job", __func__);
+                // drain mode: one wakeup handles every queued frame
                 mm_camera_super_buf_t *frame =
                     (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
-                if (NULL != frame) {
+                while (NULL != frame) {
+                    mm_camera_trace_frame(MM_CAMERA_TRACE_HAL_CB, frame->bufs[0]);
                     if (pme->mDataCB != NULL) {
                         pme->mDataCB(frame, pme, pme->mUserData);
                     } else {
                         // no data cb routine, return buf here
                         pme->bufDone(frame->bufs[0]->buf_idx);
                     }
+                    frame = (mm_camera_super_buf_t *)pme->mDataQ.dequeue();
                 }
             }
             break;
@@ -705,6 +795,21 @@ int32_t QCamera3Stream::getBufs(cam_frame_len_offset_t *offset,
         return INVALID_OPERATION;
     }
 
+    if (isBatchMode()) {
+        // frames only reach the kernel inside batch containers
+        free(regFlags);
+        regFlags = NULL;
+        rc = getBatchBufs(num_bufs, initial_reg_flag, bufs, ops_tbl);
+        if (rc < 0) {
+            for (uint32_t i = 0; i < registeredBuffers; i++) {
+                ops_tbl->unmap_ops(i, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF, ops_tbl->userdata);
+            }
+            free(mBufDefs);
+            mBufDefs = NULL;
+        }
+        return rc;
+    }
+
     *num_bufs = mNumBufs;
     *initial_reg_flag = regFlags;
     *bufs = mBufDefs;
@@ -738,12 +843,158 @@ int32_t QCamera3Stream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
     }
     mBufDefs = NULL; // mBufDefs just keep a ptr to the buffer
                      // mm-camera-interface own the buffer, so no need to free
+    if (mStreamBatchBufs != NULL) {
+        putBatchBufs(ops_tbl);
+    }
     memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
     mChannel->putStreamBufs();
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : getBatchBufs
+ *
+ * DESCRIPTION: allocate the batch containers handed to the kernel in place
+ *              of the frame buffers. The frame buffer defs are chained to
+ *              the containers as their planes.
+ *
+ * PARAMETERS :
+ *   @num_bufs   : number of containers allocated
+ *   @initial_reg_flag: flag to indicate if buffer needs to be registered
+ *                      at kernel initially
+ *   @bufs       : output of allocated containers
+ *   @ops_tbl    : ptr to buf mapping/unmapping ops
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Stream::getBatchBufs(uint8_t *num_bufs,
+                     uint8_t **initial_reg_flag,
+                     mm_camera_buf_def_t **bufs,
+                     mm_camera_map_unmap_ops_tbl_t *ops_tbl)
+{
+    int32_t rc = NO_ERROR;
+    uint8_t *regFlags;
+    uint8_t batchSize = mStreamInfo->user_buf_info.frame_buf_cnt;
+    cam_frame_len_offset_t offset;
+
+    mStreamBatchBufs = new QCamera3HeapMemory();
+    if (!mStreamBatchBufs) {
+        ALOGE("%s: No memory for batch buffer object", __func__);
+        return NO_MEMORY;
+    }
+    rc = mStreamBatchBufs->allocate(mNumBatchBufs,
+            mStreamInfo->user_buf_info.size, false);
+    if (rc < 0) {
+        ALOGE("%s: Failed to allocate batch buffers", __func__);
+        delete mStreamBatchBufs;
+        mStreamBatchBufs = NULL;
+        return NO_MEMORY;
+    }
+
+    for (uint32_t i = 0; i < mNumBatchBufs; i++) {
+        ssize_t bufSize = mStreamBatchBufs->getSize(i);
+        if (BAD_INDEX != bufSize) {
+            rc = ops_tbl->map_ops(i, -1, mStreamBatchBufs->getFd(i),
+                    (size_t)bufSize, CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF,
+                    ops_tbl->userdata);
+        } else {
+            ALOGE("%s: Failed to retrieve batch buffer size (bad index)",
+                    __func__);
+            rc = INVALID_OPERATION;
+        }
+        if (rc < 0) {
+            ALOGE("%s: map batch buf %d failed: %d", __func__, i, rc);
+            for (uint32_t j = 0; j < i; j++) {
+                ops_tbl->unmap_ops(j, -1, CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF,
+                        ops_tbl->userdata);
+            }
+            goto err1;
+        }
+    }
+
+    //regFlags array is allocated by us, but consumed and freed by mm-camera-interface
+    regFlags = (uint8_t *)malloc(sizeof(uint8_t) * mNumBatchBufs);
+    mBatchBufDefs = (mm_camera_buf_def_t *)
+            malloc(mNumBatchBufs * sizeof(mm_camera_buf_def_t));
+    if ((regFlags == NULL) || (mBatchBufDefs == NULL)) {
+        ALOGE("%s: Out of memory", __func__);
+        rc = NO_MEMORY;
+        goto err2;
+    }
+    // containers are queued once filled through bufDone, none up front
+    memset(regFlags, 0, sizeof(uint8_t) * mNumBatchBufs);
+    memset(mBatchBufDefs, 0, mNumBatchBufs * sizeof(mm_camera_buf_def_t));
+    memset(&offset, 0, sizeof(offset));
+    // the interface only tags the frames a full set of containers covers
+    for (uint32_t i = 0; i < mNumBufs; i++) {
+        mBufDefs[i].stream_id = mHandle;
+        mBufDefs[i].stream_type = mStreamInfo->stream_type;
+    }
+    for (uint32_t i = 0; i < mNumBatchBufs; i++) {
+        mStreamBatchBufs->getBufDef(offset, mBatchBufDefs[i], i);
+        mBatchBufDefs[i].buf_type = CAM_STREAM_BUF_TYPE_USERPTR;
+        mBatchBufDefs[i].user_buf.num_buffers = batchSize;
+        mBatchBufDefs[i].user_buf.bufs_used = batchSize;
+        mBatchBufDefs[i].user_buf.plane_buf = mBufDefs;
+        for (uint32_t j = 0; j < MSM_CAMERA_MAX_USER_BUFF_CNT; j++) {
+            mBatchBufDefs[i].user_buf.buf_idx[j] = -1;
+        }
+    }
+
+    *num_bufs = mNumBatchBufs;
+    *initial_reg_flag = regFlags;
+    *bufs = mBatchBufDefs;
+    return NO_ERROR;
+
+err2:
+    free(regFlags);
+    free(mBatchBufDefs);
+    mBatchBufDefs = NULL;
+    for (uint32_t i = 0; i < mNumBatchBufs; i++) {
+        ops_tbl->unmap_ops(i, -1, CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF,
+                ops_tbl->userdata);
+    }
+err1:
+    mStreamBatchBufs->deallocate();
+    delete mStreamBatchBufs;
+    mStreamBatchBufs = NULL;
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : putBatchBufs
+ *
+ * DESCRIPTION: release the batch containers
+ *
+ * PARAMETERS :
+ *   @ops_tbl    : ptr to buf mapping/unmapping ops
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Stream::putBatchBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
+{
+    int32_t rc = NO_ERROR;
+
+    for (uint32_t i = 0; i < mNumBatchBufs; i++) {
+        rc = ops_tbl->unmap_ops(i, -1, CAM_MAPPING_BUF_TYPE_STREAM_USER_BUF,
+                ops_tbl->userdata);
+        if (rc < 0) {
+            ALOGE("%s: un-map batch buf failed: %d", __func__, rc);
+        }
+    }
+    mBatchBufDefs = NULL; // owned and freed by mm-camera-interface
+    mStreamBatchBufs->deallocate();
+    delete mStreamBatchBufs;
+    mStreamBatchBufs = NULL;
+
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : invalidateBuf
  *
@@ -758,6 +1009,21 @@ int32_t QCamera3Stream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
  *==========================================================================*/
 int32_t QCamera3Stream::invalidateBuf(uint32_t index)
 {
+    if (isBatchMode()) {
+        int32_t rc = NO_ERROR;
+        if ((mBatchBufDefs == NULL) || (index >= mNumBatchBufs)) {
+            return BAD_INDEX;
+        }
+        // the index names a container, walk the frames it carries
+        for (uint32_t i = 0; i < mBatchBufDefs[index].user_buf.bufs_used; i++) {
+            int32_t frameIdx = mBatchBufDefs[index].user_buf.buf_idx[i];
+            if ((frameIdx >= 0) &&
+                    (mStreamBufs->invalidateCache((uint32_t)frameIdx) < 0)) {
+                rc = UNKNOWN_ERROR;
+            }
+        }
+        return rc;
+    }
     return mStreamBufs->invalidateCache(index);
 }
 
@@ -775,6 +1041,20 @@ int32_t QCamera3Stream::invalidateBuf(uint32_t index)
  *==========================================================================*/
 int32_t QCamera3Stream::cleanInvalidateBuf(uint32_t index)
 {
+    if (isBatchMode()) {
+        int32_t rc = NO_ERROR;
+        if ((mBatchBufDefs == NULL) || (index >= mNumBatchBufs)) {
+            return BAD_INDEX;
+        }
+        for (uint32_t i = 0; i < mBatchBufDefs[index].user_buf.bufs_used; i++) {
+            int32_t frameIdx = mBatchBufDefs[index].user_buf.buf_idx[i];
+            if ((frameIdx >= 0) &&
+                    (mStreamBufs->cleanInvalidateCache((uint32_t)frameIdx) < 0)) {
+                rc = UNKNOWN_ERROR;
+            }
+        }
+        return rc;
+    }
     return mStreamBufs->cleanInvalidateCache(index);
 }
 
@@ -838,6 +1118,45 @@ int32_t QCamera3Stream::getFormat(cam_format_t &fmt)
     return -1;
 }
 
+/*===========================================================================
+ * FUNCTION   : isBatchMode
+ *
+ * DESCRIPTION: query if the stream queues its frames to the kernel in batches
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true if the stream runs in batch mode
+ *==========================================================================*/
+bool QCamera3Stream::isBatchMode() const
+{
+    return (mStreamInfo != NULL) &&
+            (mStreamInfo->streaming_mode == CAM_STREAMING_MODE_BATCH);
+}
+
+/*===========================================================================
+ * FUNCTION   : flushBatch
+ *
+ * DESCRIPTION: queue the frames staged for the current batch container to
+ *              the kernel without waiting for the rest of the batch
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Stream::flushBatch()
+{
+    if (!isBatchMode()) {
+        return NO_ERROR;
+    }
+    int32_t rc = mCamOps->flush_user_buf(mCamHandle, mChannelHandle, mHandle);
+    if (rc < 0) {
+        ALOGE("%s: Failed to queue partial batch: %d", __func__, rc);
+    }
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : getMyServerID
  *
@@ -64,6 +64,7 @@ public:
                          uint8_t minStreamBufNum,
                          uint32_t postprocess_mask,
                          cam_is_type_t is_type,
+                         cam_stream_user_buf_info_t* batch_info,
                          hal3_stream_cb_routine stream_cb,
                          void *userdata);
     virtual int32_t bufDone(uint32_t index);
@@ -80,6 +81,8 @@ public:
     int32_t getFrameDimension(cam_dimension_t &dim);
     int32_t getFormat(cam_format_t &fmt);
     QCamera3Memory *getStreamBufs() {return mStreamBufs;};
+    bool isBatchMode() const;
+    int32_t flushBatch();
     uint32_t getMyServerID();
 
     int32_t mapBuf(uint8_t buf_type, uint32_t buf_idx,
@@ -107,6 +110,11 @@ private:
     QCamera3HeapMemory *mStreamInfoBuf;
     QCamera3Memory *mStreamBufs;
     mm_camera_buf_def_t *mBufDefs;
+    /* batch mode: frames are queued one by one into containers of
+     * user_buf_info.frame_buf_cnt frames, only containers reach the kernel */
+    uint8_t mNumBatchBufs;
+    QCamera3HeapMemory *mStreamBatchBufs;
+    mm_camera_buf_def_t *mBatchBufDefs;
     cam_frame_len_offset_t mFrameLenOffset;
     cam_padding_info_t mPaddingInfo;
     QCamera3Channel *mChannel;
@@ -131,6 +139,12 @@ private:
                      mm_camera_buf_def_t **bufs,
                      mm_camera_map_unmap_ops_tbl_t *ops_tbl);
     int32_t putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl);
+    int32_t getBatchBufs(uint8_t *num_bufs,
+                     uint8_t **initial_reg_flag,
+                     mm_camera_buf_def_t **bufs,
+                     mm_camera_map_unmap_ops_tbl_t *ops_tbl);
+    int32_t putBatchBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl);
+    void handleBatchBuffer(mm_camera_super_buf_t *superBuf);
     int32_t invalidateBuf(uint32_t index);
     int32_t cleanInvalidateBuf(uint32_t index);
 
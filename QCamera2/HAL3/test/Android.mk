@@ -0,0 +1,47 @@
+#RAW10 to RAW16 unpacker test and benchmark
+LOCAL_PATH := $(call my-dir)
+
+RAW_UNPACK_C_INCLUDES := \
+        $(LOCAL_PATH)/.. \
+        $(LOCAL_PATH)/../../stack/common \
+        $(LOCAL_PATH)/../../util \
+        $(LOCAL_PATH)/../../../mm-image-codec/qexif \
+        $(LOCAL_PATH)/../../../mm-image-codec/qomx_core \
+        frameworks/native/include/media/hardware \
+        system/media/camera/include
+
+ifeq ($(TARGET_COMPILE_WITH_MSM_KERNEL),true)
+RAW_UNPACK_C_INCLUDES += $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
+RAW_UNPACK_C_INCLUDES += $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include/media
+endif
+
+RAW_UNPACK_SRC_FILES := \
+        ../QCamera3RawUnpacker.cpp \
+        ../../util/QCameraCmdThread.cpp \
+        ../../util/QCameraQueue.cpp
+
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+LOCAL_C_INCLUDES := $(RAW_UNPACK_C_INCLUDES)
+ifeq ($(TARGET_COMPILE_WITH_MSM_KERNEL),true)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+endif
+LOCAL_SRC_FILES := qcamera3_raw_unpack_test.cpp $(RAW_UNPACK_SRC_FILES)
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_MODULE           := qcamera3-raw-unpack-test
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libcamera_metadata
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+LOCAL_C_INCLUDES := $(RAW_UNPACK_C_INCLUDES)
+ifeq ($(TARGET_COMPILE_WITH_MSM_KERNEL),true)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+endif
+LOCAL_SRC_FILES := qcamera3_raw_unpack_bench.cpp $(RAW_UNPACK_SRC_FILES)
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_MODULE           := qcamera3-raw-unpack-bench
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils libcamera_metadata
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,235 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "QCamera3RawUnpacker.h"
+#include "qcamera3_raw_unpack_ref.h"
+
+namespace qcamera {
+
+// defined by QCamera3HWI.cpp in the HAL
+volatile uint32_t gCamHal3LogLevel = 1;
+
+}; // namespace qcamera
+
+using namespace qcamera;
+
+#define MAX_BENCH_THREADS 4
+#define DEFAULT_ITERATIONS 10
+
+/* Benchmark options */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t iterations;        // conversions per format and thread count
+    uint32_t maxThreads;        // highest thread count of the sweep
+} raw_bench_t;
+
+/* best and average of a run, in us */
+typedef struct {
+    uint64_t best;
+    uint64_t total;
+} bench_time_t;
+
+static uint64_t benchTimeUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : runFormat
+ *
+ * DESCRIPTION: time the in-place per-pixel loop against the unpacker with
+ *              1, 2, 4 .. maxThreads threads on one frame. The packed input
+ *              is restored before every conversion, outside the timing.
+ *
+ * PARAMETERS :
+ *   @bench   : options
+ *   @format  : packing of the input
+ *
+ * RETURN     : 0 for success else failure
+ *==========================================================================*/
+static int runFormat(const raw_bench_t &bench, raw_unpack_format_t format)
+{
+    bool mipi = (format == RAW_UNPACK_MIPI10);
+    uint32_t stride = mipi ? mipiStride(bench.width) :
+            legacyStride(bench.width);
+    uint32_t dstStride = raw16Stride(bench.width);
+    size_t srcLen = (size_t)stride * bench.height;
+    size_t dstLen = (size_t)dstStride * sizeof(uint16_t) * bench.height;
+    size_t len = (srcLen > dstLen) ? srcLen : dstLen;
+    bench_time_t ref;
+
+    uint64_t *in = (uint64_t *)malloc(srcLen);
+    uint64_t *frame = (uint64_t *)malloc(len);
+    if ((in == NULL) || (frame == NULL)) {
+        fprintf(stderr, "no memory for %ux%u\n", bench.width, bench.height);
+        free(in);
+        free(frame);
+        return -1;
+    }
+    uint32_t seed = 0x12345678;
+    for (size_t i = 0; i < srcLen; i++) {
+        seed = seed * 1103515245 + 12345;
+        ((uint8_t *)in)[i] = (uint8_t)(seed >> 16);
+    }
+
+    fprintf(stderr, "%s %ux%u, stride %u -> %u\n", mipi ? "mipi10" :
+            "legacy10", bench.width, bench.height, stride, dstStride);
+    fprintf(stderr, "%-12s%-12s%-12s%-10s%-10s\n", "threads", "best ms",
+            "avg ms", "MP/s", "speedup");
+
+    ref.best = (uint64_t)-1;
+    ref.total = 0;
+    for (uint32_t i = 0; i < bench.iterations; i++) {
+        memcpy(frame, in, srcLen);
+        uint64_t start = benchTimeUs();
+        if (mipi) {
+            refMipiToRaw16((uint8_t *)frame, (uint8_t *)frame, bench.width,
+                    bench.height, stride, dstStride);
+        } else {
+            refLegacyToRaw16((uint8_t *)frame, (uint8_t *)frame, bench.width,
+                    bench.height, stride, dstStride);
+        }
+        uint64_t elapsed = benchTimeUs() - start;
+        ref.total += elapsed;
+        if (elapsed < ref.best) {
+            ref.best = elapsed;
+        }
+    }
+    fprintf(stderr, "%-12s%-12.2f%-12.2f%-10.1f%-10.2f\n", "per-pixel",
+            (double)ref.best / 1000.0,
+            (double)ref.total / 1000.0 / bench.iterations,
+            (double)bench.width * bench.height / (double)(ref.best ? ref.best : 1),
+            1.0);
+
+    for (uint32_t threads = 1; threads <= bench.maxThreads; threads *= 2) {
+        QCamera3RawUnpacker unpacker;
+        bench_time_t run;
+        run.best = (uint64_t)-1;
+        run.total = 0;
+        unpacker.init(threads);
+        for (uint32_t i = 0; i < bench.iterations; i++) {
+            memcpy(frame, in, srcLen);
+            uint64_t start = benchTimeUs();
+            unpacker.unpack(format, frame, bench.width, bench.height, stride,
+                    dstStride);
+            uint64_t elapsed = benchTimeUs() - start;
+            run.total += elapsed;
+            if (elapsed < run.best) {
+                run.best = elapsed;
+            }
+        }
+        unpacker.deinit();
+        fprintf(stderr, "%-12u%-12.2f%-12.2f%-10.1f%-10.2f\n", threads,
+                (double)run.best / 1000.0,
+                (double)run.total / 1000.0 / bench.iterations,
+                (double)bench.width * bench.height /
+                (double)(run.best ? run.best : 1),
+                (double)ref.best / (double)(run.best ? run.best : 1));
+    }
+
+    free(in);
+    free(frame);
+    return 0;
+}
+
+static void printUsage()
+{
+    fprintf(stderr, "Usage: qcamera3-raw-unpack-bench [options]\n");
+    fprintf(stderr, "  -W WIDTH\t\tFrame width (default 4208)\n");
+    fprintf(stderr, "  -H HEIGHT\t\tFrame height (default 3120)\n");
+    fprintf(stderr, "  -n COUNT\t\tConversions per run (default %d)\n",
+            DEFAULT_ITERATIONS);
+    fprintf(stderr, "  -t THREADS\t\tHighest thread count (default: CPUs)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    raw_bench_t bench;
+    long cpus;
+    int c;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.width = 4208;
+    bench.height = 3120;
+    bench.iterations = DEFAULT_ITERATIONS;
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    bench.maxThreads = (cpus > 0) ? (uint32_t)cpus : 1;
+
+    while ((c = getopt(argc, argv, "W:H:n:t:")) != -1) {
+        switch (c) {
+        case 'W':
+            bench.width = (uint32_t)atoi(optarg);
+            break;
+        case 'H':
+            bench.height = (uint32_t)atoi(optarg);
+            break;
+        case 'n':
+            bench.iterations = (uint32_t)atoi(optarg);
+            break;
+        case 't':
+            bench.maxThreads = (uint32_t)atoi(optarg);
+            break;
+        default:
+            printUsage();
+            return 1;
+        }
+    }
+
+    if ((bench.width == 0) || (bench.height == 0)) {
+        printUsage();
+        return 1;
+    }
+    if (bench.iterations == 0) {
+        bench.iterations = 1;
+    }
+    if (bench.maxThreads == 0) {
+        bench.maxThreads = 1;
+    }
+    if (bench.maxThreads > MAX_BENCH_THREADS) {
+        bench.maxThreads = MAX_BENCH_THREADS;
+    }
+
+    if (runFormat(bench, RAW_UNPACK_MIPI10) ||
+            runFormat(bench, RAW_UNPACK_LEGACY10)) {
+        fprintf(stderr, "%-25s\n", "Fail!");
+        return 1;
+    }
+    fprintf(stderr, "%-25s\n", "Success!");
+    return 0;
+}
@@ -0,0 +1,126 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3_RAW_UNPACK_REF_H__
+#define __QCAMERA3_RAW_UNPACK_REF_H__
+
+#include <stdint.h>
+
+/* The per-pixel loops QCamera3RawChannel converted RAW10 with before
+ * QCamera3RawUnpacker, kept as the reference. Input and output are separate
+ * so the reference stays exact; run in place, with in == out, the first
+ * packed group of row 0 is overwritten before it is read. */
+
+/*===========================================================================
+ * FUNCTION   : refMipiToRaw16
+ *
+ * DESCRIPTION: mipi10 to RAW16, bottom-right to top-left pixel by pixel
+ *
+ * PARAMETERS :
+ *   @in        : packed input
+ *   @out       : RAW16 output, may be in
+ *   @width     : frame width in pixels
+ *   @height    : frame height in pixels
+ *   @srcStride : input row stride in bytes
+ *   @dstStride : output row stride in pixels
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static inline void refMipiToRaw16(const uint8_t *in, uint8_t *out,
+        uint32_t width, uint32_t height, uint32_t srcStride,
+        uint32_t dstStride)
+{
+    uint16_t* raw16_buffer = (uint16_t *)out;
+
+    for (int32_t ys = (int32_t)height - 1; ys >= 0; ys--) {
+        uint32_t y = (uint32_t)ys;
+        const uint8_t* row_start = in + y * srcStride;
+        for (int32_t xs = (int32_t)width - 1; xs >= 0; xs--) {
+            uint32_t x = (uint32_t)xs;
+            uint8_t upper_8bit = row_start[5*(x/4)+x%4];
+            uint8_t lower_2bit = ((row_start[5*(x/4)+4] >> (x%4)) & 0x3);
+            uint16_t raw16_pixel =
+                    (uint16_t)(((uint16_t)upper_8bit)<<2 |
+                    (uint16_t)lower_2bit);
+            raw16_buffer[y*dstStride+x] = raw16_pixel;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : refLegacyToRaw16
+ *
+ * DESCRIPTION: legacy 10 bit (6 pixels per 64 bit word) to RAW16,
+ *              bottom-right to top-left pixel by pixel
+ *
+ * PARAMETERS :
+ *   @in        : packed input, 8 byte aligned
+ *   @out       : RAW16 output, may be in
+ *   @width     : frame width in pixels
+ *   @height    : frame height in pixels
+ *   @srcStride : input row stride in bytes
+ *   @dstStride : output row stride in pixels
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static inline void refLegacyToRaw16(const uint8_t *in, uint8_t *out,
+        uint32_t width, uint32_t height, uint32_t srcStride,
+        uint32_t dstStride)
+{
+    uint16_t* raw16_buffer = (uint16_t *)out;
+
+    for (int32_t ys = (int32_t)height - 1; ys >= 0; ys--) {
+        uint32_t y = (uint32_t)ys;
+        const uint64_t* row_start = (const uint64_t *)in + y * srcStride / 8;
+        for (int32_t xs = (int32_t)width - 1; xs >= 0; xs--) {
+            uint32_t x = (uint32_t)xs;
+            uint16_t raw16_pixel =
+                    (uint16_t)(0x3FF & (row_start[x/6] >> (10*(x%6))));
+            raw16_buffer[y*dstStride+x] = raw16_pixel;
+        }
+    }
+}
+
+/* row strides as the backend lays the formats out, 16 byte aligned */
+static inline uint32_t mipiStride(uint32_t width)
+{
+    return (((width + 3) / 4) * 5 + 15) & ~15U;
+}
+
+static inline uint32_t legacyStride(uint32_t width)
+{
+    return (((width + 5) / 6) * 8 + 15) & ~15U;
+}
+
+static inline uint32_t raw16Stride(uint32_t width)
+{
+    return (width + 15U) & ~15U;
+}
+
+#endif /* __QCAMERA3_RAW_UNPACK_REF_H__ */
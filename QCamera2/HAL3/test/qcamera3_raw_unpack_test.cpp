@@ -0,0 +1,337 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "QCamera3RawUnpacker.h"
+#include "qcamera3_raw_unpack_ref.h"
+
+namespace qcamera {
+
+// defined by QCamera3HWI.cpp in the HAL
+volatile uint32_t gCamHal3LogLevel = 1;
+
+/* Bit-exactness of QCamera3RawUnpacker against the per-pixel loops it
+ * replaced: the scalar and NEON row converters on their own, then whole
+ * frames converted in place with the stripes spread over 1 .. 4 threads. */
+class QCamera3RawUnpackerTest {
+public:
+    static int checkRows(raw_unpack_format_t format, uint32_t width);
+    static int checkFrame(QCamera3RawUnpacker &unpacker,
+            raw_unpack_format_t format, uint32_t width, uint32_t height,
+            uint32_t srcPadding);
+    static uint32_t numThreads(const QCamera3RawUnpacker &unpacker)
+    {
+        return unpacker.mNumWorkers + 1;
+    }
+};
+
+}; // namespace qcamera
+
+using namespace qcamera;
+
+#define MAX_TEST_THREADS 4
+// widths around the 4 and 6 pixel groups and the 8 pixel NEON step
+static const uint32_t kWidths[] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 9, 11, 12, 13, 15, 16, 17, 23, 24, 25,
+    31, 33, 63, 64, 65, 127, 641, 4207, 4208
+};
+// heights around the stripe size and its multiples
+static const uint32_t kHeights[] = {
+    1, 2, 3, 15, 16, 17, 31, 32, 33, 47, 48, 49, 63, 64, 65, 97, 255
+};
+
+static const char *formatName(raw_unpack_format_t format)
+{
+    return (format == RAW_UNPACK_MIPI10) ? "mipi10" : "legacy10";
+}
+
+static uint32_t srcStride(raw_unpack_format_t format, uint32_t width)
+{
+    return (format == RAW_UNPACK_MIPI10) ? mipiStride(width) :
+            legacyStride(width);
+}
+
+/*===========================================================================
+ * FUNCTION   : fillPacked
+ *
+ * DESCRIPTION: fill a buffer with reproducible noise, every 10 bit value
+ *              and lsb combination shows up
+ *
+ * PARAMETERS :
+ *   @buf     : buffer to fill
+ *   @len     : length in bytes
+ *   @seed    : noise seed
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static void fillPacked(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : compareRows
+ *
+ * DESCRIPTION: compare the pixels of RAW16 frames byte for byte, row
+ *              padding excluded
+ *
+ * PARAMETERS :
+ *   @ref     : expected frame
+ *   @out     : frame to check
+ *   @width   : frame width in pixels
+ *   @height  : frame height in pixels
+ *   @stride  : row stride in pixels
+ *
+ * RETURN     : number of mismatching rows, the first one is printed
+ *==========================================================================*/
+static uint32_t compareRows(const uint8_t *ref, const uint8_t *out,
+        uint32_t width, uint32_t height, uint32_t stride)
+{
+    uint32_t errors = 0;
+
+    for (uint32_t y = 0; y < height; y++) {
+        size_t offset = (size_t)y * stride * sizeof(uint16_t);
+        if (memcmp(ref + offset, out + offset, width * sizeof(uint16_t))) {
+            if (errors == 0) {
+                const uint16_t *r = (const uint16_t *)(ref + offset);
+                const uint16_t *o = (const uint16_t *)(out + offset);
+                uint32_t x = 0;
+                while (r[x] == o[x]) {
+                    x++;
+                }
+                fprintf(stderr, "  row %u pixel %u: 0x%03x != 0x%03x\n",
+                        y, x, o[x], r[x]);
+            }
+            errors++;
+        }
+    }
+    return errors;
+}
+
+/*===========================================================================
+ * FUNCTION   : checkRows
+ *
+ * DESCRIPTION: convert one row out of place with the scalar converter and
+ *              with the row converter (NEON on ARM) and compare both with
+ *              the reference loop
+ *
+ * PARAMETERS :
+ *   @format  : packing of the input
+ *   @width   : row width in pixels
+ *
+ * RETURN     : 0 for success else failure
+ *==========================================================================*/
+int QCamera3RawUnpackerTest::checkRows(raw_unpack_format_t format,
+        uint32_t width)
+{
+    uint32_t stride = srcStride(format, width);
+    uint32_t dstStride = raw16Stride(width);
+    size_t dstLen = dstStride * sizeof(uint16_t);
+    int rc = 0;
+
+    uint64_t *in = (uint64_t *)malloc(stride);
+    uint8_t *ref = (uint8_t *)malloc(dstLen);
+    uint8_t *out = (uint8_t *)malloc(dstLen);
+    if ((in == NULL) || (ref == NULL) || (out == NULL)) {
+        fprintf(stderr, "no memory for width %u\n", width);
+        rc = -1;
+        goto done;
+    }
+    fillPacked((uint8_t *)in, stride, width);
+    if (format == RAW_UNPACK_MIPI10) {
+        refMipiToRaw16((uint8_t *)in, ref, width, 1, stride, dstStride);
+    } else {
+        refLegacyToRaw16((uint8_t *)in, ref, width, 1, stride, dstStride);
+    }
+
+    memset(out, 0, dstLen);
+    if (format == RAW_UNPACK_MIPI10) {
+        QCamera3RawUnpacker::unpackMipiPixels((uint8_t *)in,
+                (uint16_t *)out, 0, width);
+    } else {
+        QCamera3RawUnpacker::unpackLegacyPixels((uint8_t *)in,
+                (uint16_t *)out, 0, width);
+    }
+    if (compareRows(ref, out, width, 1, dstStride)) {
+        fprintf(stderr, "%s scalar row of %u: mismatch\n",
+                formatName(format), width);
+        rc = -1;
+    }
+
+    if (format == RAW_UNPACK_MIPI10) {
+        memset(out, 0, dstLen);
+        QCamera3RawUnpacker::unpackMipiRow((uint8_t *)in, (uint16_t *)out,
+                width, stride);
+        if (compareRows(ref, out, width, 1, dstStride)) {
+            fprintf(stderr, "%s vector row of %u: mismatch\n",
+                    formatName(format), width);
+            rc = -1;
+        }
+    }
+
+done:
+    free(in);
+    free(ref);
+    free(out);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : checkFrame
+ *
+ * DESCRIPTION: convert a frame in place and compare it with the reference
+ *              loop run on a copy of the input
+ *
+ * PARAMETERS :
+ *   @unpacker  : unpacker, already initialized
+ *   @format    : packing of the input
+ *   @width     : frame width in pixels
+ *   @height    : frame height in pixels
+ *   @srcPadding: bytes added to the packed row stride, moves the in-place
+ *                chunk and stripe boundaries. The padded stride must not
+ *                exceed the RAW16 row.
+ *
+ * RETURN     : 0 for success else failure
+ *==========================================================================*/
+int QCamera3RawUnpackerTest::checkFrame(QCamera3RawUnpacker &unpacker,
+        raw_unpack_format_t format, uint32_t width, uint32_t height,
+        uint32_t srcPadding)
+{
+    uint32_t stride = srcStride(format, width) + srcPadding;
+    uint32_t dstStride = raw16Stride(width);
+    size_t srcLen = (size_t)stride * height;
+    size_t dstLen = (size_t)dstStride * sizeof(uint16_t) * height;
+    size_t len = (srcLen > dstLen) ? srcLen : dstLen;
+    int rc = 0;
+
+    uint64_t *in = (uint64_t *)malloc(srcLen);
+    uint8_t *ref = (uint8_t *)malloc(dstLen);
+    uint64_t *frame = (uint64_t *)malloc(len);
+    if ((in == NULL) || (ref == NULL) || (frame == NULL)) {
+        fprintf(stderr, "no memory for %ux%u\n", width, height);
+        rc = -1;
+        goto done;
+    }
+    fillPacked((uint8_t *)in, srcLen, width * 65536 + height);
+    memset(ref, 0, dstLen);
+    if (format == RAW_UNPACK_MIPI10) {
+        refMipiToRaw16((uint8_t *)in, ref, width, height, stride, dstStride);
+    } else {
+        refLegacyToRaw16((uint8_t *)in, ref, width, height, stride,
+                dstStride);
+    }
+
+    memset(frame, 0, len);
+    memcpy(frame, in, srcLen);
+    unpacker.unpack(format, frame, width, height, stride, dstStride);
+    {
+        uint32_t errors = compareRows(ref, (uint8_t *)frame, width, height,
+                dstStride);
+        if (errors != 0) {
+            fprintf(stderr, "%s %ux%u stride %u, %u threads: %u rows "
+                    "mismatch\n", formatName(format), width, height, stride,
+                    numThreads(unpacker), errors);
+            rc = -1;
+        }
+    }
+
+done:
+    free(in);
+    free(ref);
+    free(frame);
+    return rc;
+}
+
+int main()
+{
+    static const raw_unpack_format_t formats[] =
+            {RAW_UNPACK_MIPI10, RAW_UNPACK_LEGACY10};
+    uint32_t failures = 0;
+    uint32_t checks = 0;
+
+    for (uint32_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (uint32_t w = 0; w < sizeof(kWidths) / sizeof(kWidths[0]); w++) {
+            checks++;
+            if (QCamera3RawUnpackerTest::checkRows(formats[f], kWidths[w])) {
+                failures++;
+            }
+        }
+    }
+
+    for (uint32_t threads = 1; threads <= MAX_TEST_THREADS; threads++) {
+        QCamera3RawUnpacker unpacker;
+        unpacker.init(threads);
+        fprintf(stderr, "%u threads requested, %u used\n", threads,
+                QCamera3RawUnpackerTest::numThreads(unpacker));
+        for (uint32_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+            for (uint32_t w = 0; w < sizeof(kWidths) / sizeof(kWidths[0]);
+                    w++) {
+                for (uint32_t h = 0;
+                        h < sizeof(kHeights) / sizeof(kHeights[0]); h++) {
+                    // up to input rows as long as the output rows, where
+                    // no chunk is left for the stripes
+                    uint32_t maxPad = raw16Stride(kWidths[w]) *
+                            (uint32_t)sizeof(uint16_t) -
+                            srcStride(formats[f], kWidths[w]);
+                    uint32_t pads[] = {0, maxPad / 32 * 16, maxPad};
+                    for (uint32_t p = 0; p < sizeof(pads) / sizeof(pads[0]);
+                            p++) {
+                        checks++;
+                        if (QCamera3RawUnpackerTest::checkFrame(unpacker,
+                                formats[f], kWidths[w], kHeights[h],
+                                pads[p])) {
+                            failures++;
+                        }
+                    }
+                }
+            }
+            // full 13MP frame
+            checks++;
+            if (QCamera3RawUnpackerTest::checkFrame(unpacker, formats[f],
+                    4208, 3120, 0)) {
+                failures++;
+            }
+        }
+        unpacker.deinit();
+    }
+
+    fprintf(stderr, "%u checks, %u failed\n", checks, failures);
+    if (failures != 0) {
+        fprintf(stderr, "%-25s\n", "Fail!");
+        return 1;
+    }
+    fprintf(stderr, "%-25s\n", "Success!");
+    return 0;
+}
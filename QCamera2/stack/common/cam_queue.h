@@ -128,3 +128,154 @@ static inline int32_t cam_queue_deinit(cam_queue_t *queue)
     pthread_mutex_destroy(&queue->lock);
     return 0;
 }
+
+/* Bounded MPMC ring variant of cam_queue_t. Capacity is fixed at init and
+ * the hot path is lock and allocation free: each cell carries a sequence
+ * number telling producers/consumers whether it is free or filled, and the
+ * producer/consumer cursors sit on their own cache lines. Should the ring
+ * ever fill up, entries spill to a regular cam_queue_t so enqueue never
+ * fails; the ring is drained before the spill list to keep FIFO order. */
+#define CAM_CACHE_LINE_SIZE 64
+
+typedef struct {
+    uint32_t seq;
+    void *data;
+} cam_ring_cell_t;
+
+typedef struct {
+    uint32_t enq_pos;
+    char pad0[CAM_CACHE_LINE_SIZE - sizeof(uint32_t)];
+    uint32_t deq_pos;
+    char pad1[CAM_CACHE_LINE_SIZE - sizeof(uint32_t)];
+    uint32_t spill_cnt;
+    char pad2[CAM_CACHE_LINE_SIZE - sizeof(uint32_t)];
+    cam_ring_cell_t *cells;
+    uint32_t mask;
+    cam_queue_t spill;
+} cam_ring_queue_t;
+
+static inline int32_t cam_ring_queue_init(cam_ring_queue_t *queue,
+        uint32_t capacity)
+{
+    uint32_t i, size = 1;
+
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    memset(queue, 0, sizeof(cam_ring_queue_t));
+    queue->cells = (cam_ring_cell_t *)malloc(sizeof(cam_ring_cell_t) * size);
+    if (NULL == queue->cells) {
+        return -1;
+    }
+    for (i = 0; i < size; i++) {
+        queue->cells[i].seq = i;
+        queue->cells[i].data = NULL;
+    }
+    queue->mask = size - 1;
+    cam_queue_init(&queue->spill);
+    return 0;
+}
+
+static inline int32_t cam_ring_queue_enq(cam_ring_queue_t *queue, void *data)
+{
+    cam_ring_cell_t *cell;
+    uint32_t pos, seq;
+    int32_t diff;
+
+    if (0 == __atomic_load_n(&queue->spill_cnt, __ATOMIC_ACQUIRE)) {
+        pos = __atomic_load_n(&queue->enq_pos, __ATOMIC_RELAXED);
+        for (;;) {
+            cell = &queue->cells[pos & queue->mask];
+            seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+            diff = (int32_t)(seq - pos);
+            if (0 == diff) {
+                if (__atomic_compare_exchange_n(&queue->enq_pos, &pos, pos + 1,
+                        1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                    cell->data = data;
+                    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+                    return 0;
+                }
+            } else if (diff < 0) {
+                /* ring full */
+                break;
+            } else {
+                pos = __atomic_load_n(&queue->enq_pos, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    __atomic_add_fetch(&queue->spill_cnt, 1, __ATOMIC_ACQ_REL);
+    if (0 != cam_queue_enq(&queue->spill, data)) {
+        __atomic_sub_fetch(&queue->spill_cnt, 1, __ATOMIC_ACQ_REL);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void *cam_ring_queue_deq(cam_ring_queue_t *queue)
+{
+    cam_ring_cell_t *cell;
+    uint32_t pos, seq;
+    int32_t diff;
+    void *data = NULL;
+
+    pos = __atomic_load_n(&queue->deq_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &queue->cells[pos & queue->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (int32_t)(seq - (pos + 1));
+        if (0 == diff) {
+            if (__atomic_compare_exchange_n(&queue->deq_pos, &pos, pos + 1,
+                    1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                data = cell->data;
+                __atomic_store_n(&cell->seq, pos + queue->mask + 1,
+                        __ATOMIC_RELEASE);
+                return data;
+            }
+        } else if (diff < 0) {
+            /* ring empty */
+            break;
+        } else {
+            pos = __atomic_load_n(&queue->deq_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    if (0 != __atomic_load_n(&queue->spill_cnt, __ATOMIC_ACQUIRE)) {
+        data = cam_queue_deq(&queue->spill);
+        if (NULL != data) {
+            __atomic_sub_fetch(&queue->spill_cnt, 1, __ATOMIC_ACQ_REL);
+        }
+    }
+    return data;
+}
+
+static inline uint32_t cam_ring_queue_size(cam_ring_queue_t *queue)
+{
+    return __atomic_load_n(&queue->enq_pos, __ATOMIC_ACQUIRE) -
+            __atomic_load_n(&queue->deq_pos, __ATOMIC_ACQUIRE) +
+            __atomic_load_n(&queue->spill_cnt, __ATOMIC_ACQUIRE);
+}
+
+static inline int32_t cam_ring_queue_flush(cam_ring_queue_t *queue)
+{
+    void *data;
+
+    /* same ownership rule as cam_queue_flush: data is freed directly */
+    while (NULL != (data = cam_ring_queue_deq(queue))) {
+        free(data);
+    }
+    return 0;
+}
+
+static inline int32_t cam_ring_queue_deinit(cam_ring_queue_t *queue)
+{
+    if (NULL == queue->cells) {
+        return 0;
+    }
+    cam_ring_queue_flush(queue);
+    cam_queue_deinit(&queue->spill);
+    free(queue->cells);
+    queue->cells = NULL;
+    return 0;
+}
@@ -104,6 +104,8 @@
 
 #define MAX_INFLIGHT_REQUESTS  6
 #define MIN_INFLIGHT_REQUESTS  3
+/* HFR batch mode keeps several batches in flight */
+#define MAX_INFLIGHT_HFR_REQUESTS 48
 
 #define QCAMERA_DUMP_FRM_LOCATION "/data/misc/camera/"
 #define QCAMERA_MAX_FILEPATH_LENGTH 64
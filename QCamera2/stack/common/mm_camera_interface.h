@@ -689,6 +689,19 @@ typedef struct {
             uint32_t ch_id,
             uint32_t stream_id);
 
+    /** flush_user_buf: fucntion definition for queuing the partially
+     *                  filled container of a batch mode stream to kernel
+     *                  without waiting for the rest of its batch
+     *    @camera_handle : camer handler
+     *    @ch_id : channel handler
+     *    @stream_id : stream handler
+     *  Return value: 0 -- success
+     *                -1 -- failure
+     **/
+    int32_t (*flush_user_buf) (uint32_t camera_handle,
+            uint32_t ch_id,
+            uint32_t stream_id);
+
     /** request_super_buf: fucntion definition for requesting frames
      *                     from superbuf queue in burst mode
      *    @camera_handle : camer handler
@@ -808,4 +821,27 @@ int32_t mm_stream_calc_offset_analysis(cam_format_t fmt,
         cam_stream_buf_plane_info_t *buf_planes);
 
 struct camera_info *get_cam_info(uint32_t camera_id);
+
+/* per frame latency tracing: hops a frame passes through, in order */
+typedef enum {
+    MM_CAMERA_TRACE_DQBUF,          /* buffer dequeued from kernel */
+    MM_CAMERA_TRACE_STREAM_NOTIFY,  /* stream dispatches buffer to channel/cb */
+    MM_CAMERA_TRACE_CH_PROCESS,     /* channel superbuf matching */
+    MM_CAMERA_TRACE_CH_DISPATCH,    /* channel superbuf dispatched to user */
+    MM_CAMERA_TRACE_HAL_NOTIFY,     /* HAL stream receives frame */
+    MM_CAMERA_TRACE_HAL_CB,         /* HAL stream data callback invoked */
+    MM_CAMERA_TRACE_HOP_MAX
+} mm_camera_trace_hop_t;
+
+/* timestamp a frame at one hop. Lock free, safe from any thread */
+void mm_camera_trace_frame(mm_camera_trace_hop_t hop,
+        const mm_camera_buf_def_t *buf);
+
+/* print p50/p99/max hop latency per stream to fd */
+void mm_camera_trace_dump(int fd);
+
+/* copy only the valid entries of a metadata/parm buffer into dst,
+ * returns the number of payload bytes copied */
+size_t mm_camera_copy_metadata(metadata_buffer_t *dst,
+        const metadata_buffer_t *src);
 #endif /*__MM_CAMERA_INTERFACE_H__*/
@@ -43,9 +43,6 @@ typedef enum {
 } mm_jpeg_format_t;
 
 typedef struct {
-  cam_3a_params_t cam_3a_params;
-  uint8_t cam_3a_params_valid;
-  cam_sensor_params_t sensor_params;
   cam_ae_exif_debug_t ae_debug_params;
   cam_awb_exif_debug_t awb_debug_params;
   cam_af_exif_debug_t af_debug_params;
@@ -56,6 +53,16 @@ typedef struct {
   uint8_t af_debug_params_valid;
   uint8_t asd_debug_params_valid;
   uint8_t stats_debug_params_valid;
+} mm_jpeg_debug_exif_params_t;
+
+typedef struct {
+  cam_3a_params_t cam_3a_params;
+  uint8_t cam_3a_params_valid;
+  cam_sensor_params_t sensor_params;
+  /* 3A debug data owned by the client, NULL if none. The maker
+   * note is read from the metadata buffer of the job, the blobs
+   * are referenced rather than carried with every job */
+  mm_jpeg_debug_exif_params_t *debug_params;
 } mm_jpeg_exif_params_t;
 
 typedef struct {
@@ -174,6 +181,9 @@ typedef struct {
 
   /* get memory function ptr */
   int (*get_memory)( omx_jpeg_ouput_buf_t *p_out_buf);
+
+  /* encode with the built-in software encoder */
+  uint32_t sw_encode;
 } mm_jpeg_encode_params_t;
 
 typedef struct {
@@ -286,6 +296,10 @@ typedef struct {
 
   /* close a jpeg client -- sync call */
   int (*close) (uint32_t clientHdl);
+
+  /* nonzero if encode sessions take the thumbnail from the main image
+   * and ignore src_thumb_buf/thumb_dim -- sync call */
+  int (*thumb_from_main)(void);
 } mm_jpeg_ops_t;
 
 typedef struct {
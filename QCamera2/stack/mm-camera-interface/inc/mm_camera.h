@@ -45,6 +45,17 @@
 #define MM_CAMERA_STREAM_BUF_CB_MAX 4
 /* num of data poll threads allowed in a channel obj */
 #define MM_CAMERA_CHANNEL_POLL_THREAD_MAX 1
+/* max num of worker threads of a camera poll engine */
+#define MM_CAMERA_POLL_WORKER_MAX 4
+/* poll clients of a camera poll engine: evt poll plus channel data polls */
+#define MM_CAMERA_POLL_CLIENT_MAX \
+    (MM_CAMERA_CHANNEL_MAX * MM_CAMERA_CHANNEL_POLL_THREAD_MAX + 1)
+/* cmd thread ring capacity: every buffer of a full bundle in flight at once
+ * fits without spilling to the overflow list */
+#define MM_CAMERA_CMD_QUEUE_SIZE (MM_CAMERA_MAX_NUM_FRAMES * MAX_STREAM_NUM_IN_BUNDLE)
+/* preallocated cmd payloads per cmd thread: one stream worth of buffers in
+ * flight; commands beyond that are allocated from the heap */
+#define MM_CAMERA_CMD_POOL_SIZE MM_CAMERA_MAX_NUM_FRAMES
 
 #define MM_CAMERA_DEV_NAME_LEN 32
 #define MM_CAMERA_DEV_OPEN_TRIES 2
@@ -124,7 +135,9 @@ typedef struct {
 typedef void (*mm_camera_cmd_cb_t)(mm_camera_cmdcb_t * cmd_cb, void* user_data);
 
 typedef struct {
-    cam_queue_t cmd_queue; /* cmd queue (queuing dataCB, asyncCB, or exitCMD) */
+    cam_ring_queue_t cmd_queue; /* cmd queue (queuing dataCB, asyncCB, or exitCMD) */
+    mm_camera_cmdcb_t *cmd_pool; /* preallocated cmd payloads */
+    cam_ring_queue_t cmd_free;   /* free entries of cmd_pool */
     pthread_t cmd_pid;           /* cmd thread ID */
     cam_semaphore_t cmd_sem;     /* semaphore for cmd thread */
     mm_camera_cmd_cb_t cb;       /* cb for cmd */
@@ -147,28 +160,41 @@ typedef struct {
     mm_camera_poll_notify_t notify_cb;
     uint32_t handler;
     void* user_data;
+    uint32_t gen;     /* bumped on every add/del, tags epoll events */
+    uint8_t busy;     /* notify_cb is being run by a poll worker */
+    uint8_t pending;  /* fd fired again while busy, rerun by that worker */
+    pthread_t worker; /* poll worker running notify_cb */
 } mm_camera_poll_entry_t;
 
+struct mm_camera_poll_engine;
+
+/* poll client of the camera poll engine. One for the evt fd of a camera
+ * object and one per channel for its stream fds. It owns no thread, fds
+ * are added to/removed from the engine epoll set directly. */
 typedef struct {
     mm_camera_poll_thread_type_t poll_type;
     /* array to store poll fd and cb info
      * for MM_CAMERA_POLL_TYPE_EVT, only index 0 is valid;
      * for MM_CAMERA_POLL_TYPE_DATA, depends on valid stream fd */
     mm_camera_poll_entry_t poll_entries[MAX_STREAM_NUM_IN_BUNDLE];
-    int32_t pfds[2];
-    pthread_t pid;
+    struct mm_camera_poll_engine *engine;
+    uint8_t client_idx;
     int32_t state;
-    int timeoutms;
-    uint32_t cmd;
-    struct pollfd poll_fds[MAX_STREAM_NUM_IN_BUNDLE + 1];
-    uint8_t num_fds;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond_v;
-    int32_t status;
-    char threadName[THREAD_NAME_SIZE];
-    //void *my_obj;
 } mm_camera_poll_thread_t;
 
+/* poll engine of a camera object: one epoll set served by a configurable
+ * number of worker threads for the evt fd and all stream fds */
+typedef struct mm_camera_poll_engine {
+    int32_t epoll_fd;
+    int32_t exit_fd; /* eventfd, readable once the engine is stopping */
+    pthread_t pid[MM_CAMERA_POLL_WORKER_MAX];
+    uint8_t num_workers;
+    mm_camera_poll_thread_t *clients[MM_CAMERA_POLL_CLIENT_MAX];
+    pthread_mutex_t mutex;  /* protects clients and their poll entries */
+    pthread_cond_t cond_v;  /* signaled when a worker is done with an entry */
+    char threadName[THREAD_NAME_SIZE];
+} mm_camera_poll_engine_t;
+
 /* mm_stream */
 typedef enum {
     MM_STREAM_STATE_NOTUSED = 0,      /* not used */
@@ -196,6 +222,7 @@ typedef enum {
     MM_STREAM_EVT_GET_PARM,
     MM_STREAM_EVT_DO_ACTION,
     MM_STREAM_EVT_GET_QUEUED_BUF_COUNT,
+    MM_STREAM_EVT_FLUSH_USER_BUF,
     MM_STREAM_EVT_MAX
 } mm_stream_evt_type_t;
 
@@ -312,6 +339,7 @@ typedef enum {
     MM_CHANNEL_EVT_ZOOM_1X,
     MM_CAMERA_EVT_CAPTURE_SETTING,
     MM_CHANNEL_EVT_GET_STREAM_QUEUED_BUF_COUNT,
+    MM_CHANNEL_EVT_FLUSH_STREAM_USER_BUF,
 } mm_channel_evt_type_t;
 
 typedef struct {
@@ -353,8 +381,18 @@ typedef struct {
     uint32_t frame_idx;
 } mm_channel_queue_node_t;
 
+/* size of frame_idx keyed index of unmatched superbufs, power of 2 */
+#define MM_CHANNEL_SUPERBUF_IDX_SIZE 64
+
 typedef struct {
     cam_queue_t que;
+    /* unmatched superbufs in que indexed by frame_idx modulo
+     * MM_CHANNEL_SUPERBUF_IDX_SIZE, for O(1) matching */
+    cam_node_t *unmatched_idx[MM_CHANNEL_SUPERBUF_IDX_SIZE];
+    uint32_t unmatched_cnt;      /* unmatched superbufs in que */
+    uint32_t unindexed_cnt;      /* unmatched superbufs lost to slot collision */
+    cam_node_t *first_unmatched; /* unmatched superbuf with lowest frame_idx */
+    cam_node_t *last_unmatched;  /* unmatched superbuf with highest frame_idx */
     uint8_t num_streams;
     /* container for bundled stream handlers */
     uint32_t bundled_streams[MAX_STREAM_NUM_IN_BUNDLE];
@@ -406,9 +444,8 @@ typedef struct mm_channel {
     /* cb thread for sending data cb */
     mm_camera_cmd_thread_t cb_thread;
 
-    /* data poll thread
-    * currently one data poll thread per channel
-    * could extended to support one data poll thread per stream in the channel */
+    /* data poll client of the camera poll engine
+    * currently one data poll client per channel */
     mm_camera_poll_thread_t poll_thread[MM_CAMERA_CHANNEL_POLL_THREAD_MAX];
 
     /* container for all streams in channel */
@@ -456,6 +493,19 @@ typedef struct {
     void *user_data;
 } mm_camera_evt_entry_t;
 
+/* backend ops to reach the camera server. Default backend talks to the
+ * kernel v4l2 nodes and the daemon domain socket; the loopback backend
+ * emulates both in-process so the stack can run without hardware */
+typedef struct {
+    const char *name;
+    int (*open_dev)(const char *dev_name, int flags);
+    int (*close_dev)(int fd);
+    int (*ioctl)(int fd, unsigned long req, void *arg);
+    int (*sock_create)(int cam_id);
+    int (*sock_sendmsg)(int fd, void *msg, size_t buf_size, int sendfd);
+    void (*sock_close)(int fd);
+} mm_camera_backend_ops_t;
+
 typedef struct {
     mm_camera_evt_entry_t evt[MM_CAMERA_EVT_ENTRY_MAX];
     /* reg_count <=0: infinite
@@ -472,7 +522,8 @@ typedef struct mm_camera_obj {
     pthread_mutex_t cb_lock; /* lock for evt cb */
     mm_channel_t ch[MM_CAMERA_CHANNEL_MAX];
     mm_camera_evt_obj_t evt;
-    mm_camera_poll_thread_t evt_poll_thread; /* evt poll thread */
+    mm_camera_poll_engine_t poll_engine;     /* epoll engine for evt/data fds */
+    mm_camera_poll_thread_t evt_poll_thread; /* evt poll client */
     mm_camera_cmd_thread_t evt_thread;       /* thread for evt CB */
     mm_camera_vtbl_t vtbl;
 
@@ -481,6 +532,8 @@ typedef struct mm_camera_obj {
     mm_camera_event_t evt_rcvd;
 
     pthread_mutex_t msg_lock; /* lock for sending msg through socket */
+
+    const mm_camera_backend_ops_t *backend; /* server backend ops */
 } mm_camera_obj_t;
 
 typedef struct {
@@ -500,12 +553,14 @@ typedef enum {
 ***********************************************************************************/
 /* utility functions */
 /* set int32_t value */
-extern int32_t mm_camera_util_s_ctrl(int32_t fd,
+extern int32_t mm_camera_util_s_ctrl(mm_camera_obj_t *my_obj,
+                                     int32_t fd,
                                      uint32_t id,
                                      int32_t *value);
 
 /* get int32_t value */
-extern int32_t mm_camera_util_g_ctrl(int32_t fd,
+extern int32_t mm_camera_util_g_ctrl(mm_camera_obj_t *my_obj,
+                                     int32_t fd,
                                      uint32_t id,
                                      int32_t *value);
 
@@ -517,6 +572,13 @@ extern int32_t mm_camera_util_sendmsg(mm_camera_obj_t *my_obj,
 /* Check if hardware target is A family */
 uint8_t mm_camera_util_chip_is_a_family(void);
 
+/* server backends */
+extern const mm_camera_backend_ops_t mm_camera_v4l2_backend;
+extern const mm_camera_backend_ops_t mm_camera_loopback_backend;
+extern uint8_t mm_camera_loopback_enabled(void);
+extern int8_t mm_camera_loopback_get_num_of_cameras(char dev_name[][MM_CAMERA_DEV_NAME_LEN],
+                                                    struct camera_info *info);
+
 /* mm-camera */
 extern int32_t mm_camera_open(mm_camera_obj_t *my_obj);
 extern int32_t mm_camera_close(mm_camera_obj_t *my_obj);
@@ -529,6 +591,8 @@ extern int32_t mm_camera_qbuf(mm_camera_obj_t *my_obj,
                               mm_camera_buf_def_t *buf);
 extern int32_t mm_camera_get_queued_buf_count(mm_camera_obj_t *my_obj,
         uint32_t ch_id, uint32_t stream_id);
+extern int32_t mm_camera_flush_user_buf(mm_camera_obj_t *my_obj,
+        uint32_t ch_id, uint32_t stream_id);
 extern int32_t mm_camera_query_capability(mm_camera_obj_t *my_obj);
 extern int32_t mm_camera_set_parms(mm_camera_obj_t *my_obj,
                                    parm_buffer_t *parms);
@@ -663,9 +727,12 @@ const char * mm_camera_util_get_dev_name(uint32_t cam_handler);
 uint8_t mm_camera_util_get_index_by_handler(uint32_t handler);
 
 /* poll/cmd thread functions */
+extern int32_t mm_camera_poll_engine_launch(mm_camera_poll_engine_t *engine);
+extern int32_t mm_camera_poll_engine_release(mm_camera_poll_engine_t *engine);
 extern int32_t mm_camera_poll_thread_launch(
                                 mm_camera_poll_thread_t * poll_cb,
-                                mm_camera_poll_thread_type_t poll_type);
+                                mm_camera_poll_thread_type_t poll_type,
+                                mm_camera_poll_engine_t *engine);
 extern int32_t mm_camera_poll_thread_release(mm_camera_poll_thread_t *poll_cb);
 extern int32_t mm_camera_poll_thread_add_poll_fd(
                                 mm_camera_poll_thread_t * poll_cb,
@@ -686,6 +753,10 @@ extern int32_t mm_camera_cmd_thread_launch(
                                 void* user_data);
 extern int32_t mm_camera_cmd_thread_name(const char* name);
 extern int32_t mm_camera_cmd_thread_release(mm_camera_cmd_thread_t * cmd_thread);
+extern mm_camera_cmdcb_t *mm_camera_cmd_thread_alloc_cmd(
+                                mm_camera_cmd_thread_t * cmd_thread);
+extern void mm_camera_cmd_thread_free_cmd(mm_camera_cmd_thread_t * cmd_thread,
+                                mm_camera_cmdcb_t *node);
 
 extern int32_t mm_camera_channel_advanced_capture(mm_camera_obj_t *my_obj,
         uint32_t ch_id, mm_camera_advanced_capture_t type,
@@ -85,6 +85,79 @@ mm_channel_t * mm_camera_util_get_channel_by_handler(
     return ch_obj;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_v4l2_open_dev
+ *
+ * DESCRIPTION: v4l2 backend: open a kernel device node
+ *
+ * PARAMETERS :
+ *   @dev_name: device node path
+ *   @flags   : open flags
+ *
+ * RETURN     : file descriptor, negative if failed
+ *==========================================================================*/
+static int mm_camera_v4l2_open_dev(const char *dev_name, int flags)
+{
+    return open(dev_name, flags);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_v4l2_close_dev
+ *
+ * DESCRIPTION: v4l2 backend: close a kernel device node
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor of the device node
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+static int mm_camera_v4l2_close_dev(int fd)
+{
+    return close(fd);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_v4l2_ioctl
+ *
+ * DESCRIPTION: v4l2 backend: issue an ioctl to a kernel device node
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor of the device node
+ *   @req     : ioctl request
+ *   @arg     : ioctl payload
+ *
+ * RETURN     : ioctl return value
+ *==========================================================================*/
+static int mm_camera_v4l2_ioctl(int fd, unsigned long req, void *arg)
+{
+    return ioctl(fd, req, arg);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_v4l2_sock_create
+ *
+ * DESCRIPTION: v4l2 backend: connect domain socket to camera daemon
+ *
+ * PARAMETERS :
+ *   @cam_id  : camera index
+ *
+ * RETURN     : socket fd, negative if failed
+ *==========================================================================*/
+static int mm_camera_v4l2_sock_create(int cam_id)
+{
+    return mm_camera_socket_create(cam_id, MM_CAMERA_SOCK_TYPE_UDP);
+}
+
+const mm_camera_backend_ops_t mm_camera_v4l2_backend = {
+    .name = "v4l2",
+    .open_dev = mm_camera_v4l2_open_dev,
+    .close_dev = mm_camera_v4l2_close_dev,
+    .ioctl = mm_camera_v4l2_ioctl,
+    .sock_create = mm_camera_v4l2_sock_create,
+    .sock_sendmsg = mm_camera_socket_sendmsg,
+    .sock_close = mm_camera_socket_close,
+};
+
 /*===========================================================================
  * FUNCTION   : mm_camera_util_chip_is_a_family
  *
@@ -159,7 +232,7 @@ static void mm_camera_event_notify(void* user_data)
     if (NULL != my_obj) {
         /* read evt */
         memset(&ev, 0, sizeof(ev));
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_DQEVENT, &ev);
+        rc = my_obj->backend->ioctl(my_obj->ctrl_fd, VIDIOC_DQEVENT, &ev);
 
         if (rc >= 0 && ev.id == MSM_CAMERA_MSM_NOTIFY) {
             msm_evt = (struct msm_v4l2_event_data *)ev.u.data;
@@ -215,14 +288,13 @@ int32_t mm_camera_enqueue_evt(mm_camera_obj_t *my_obj,
     int32_t rc = 0;
     mm_camera_cmdcb_t *node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&(my_obj->evt_thread));
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_EVT_CB;
         node->u.evt = *event;
 
         /* enqueue to evt cmd thread */
-        cam_queue_enq(&(my_obj->evt_thread.cmd_queue), node);
+        cam_ring_queue_enq(&(my_obj->evt_thread.cmd_queue), node);
         /* wake up evt cmd thread */
         cam_sem_post(&(my_obj->evt_thread.cmd_sem));
     } else {
@@ -287,7 +359,7 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
 
     do{
         n_try--;
-        my_obj->ctrl_fd = open(dev_name, O_RDWR | O_NONBLOCK);
+        my_obj->ctrl_fd = my_obj->backend->open_dev(dev_name, O_RDWR | O_NONBLOCK);
         CDBG("%s:  ctrl_fd = %d, errno == %d", __func__, my_obj->ctrl_fd, errno);
         if((my_obj->ctrl_fd >= 0) || (errno != EIO) || (n_try <= 0 )) {
             CDBG("%s:  opened, break out while loop", __func__);
@@ -312,7 +384,7 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
     n_try = MM_CAMERA_DEV_OPEN_TRIES;
     do {
         n_try--;
-        my_obj->ds_fd = mm_camera_socket_create(cam_idx, MM_CAMERA_SOCK_TYPE_UDP);
+        my_obj->ds_fd = my_obj->backend->sock_create(cam_idx);
         CDBG("%s:  ds_fd = %d, errno = %d", __func__, my_obj->ds_fd, errno);
         if((my_obj->ds_fd >= 0) || (n_try <= 0 )) {
             CDBG("%s:  opened, break out while loop", __func__);
@@ -341,12 +413,19 @@ int32_t mm_camera_open(mm_camera_obj_t *my_obj)
                                 mm_camera_dispatch_app_event,
                                 (void *)my_obj);
 
-    /* launch event poll thread
-     * we will add evt fd into event poll thread upon user first register for evt */
-    CDBG("%s : Launch evt Poll Thread in Cam Open", __func__);
-    snprintf(my_obj->evt_thread.threadName, THREAD_NAME_SIZE, "CAM_Poll");
+    /* launch poll engine shared by the evt fd and all channel stream fds
+     * we will add evt fd into event poll client upon user first register for evt */
+    CDBG("%s : Launch Poll engine in Cam Open", __func__);
+    snprintf(my_obj->poll_engine.threadName, THREAD_NAME_SIZE, "CAM_Poll");
+    if (mm_camera_poll_engine_launch(&my_obj->poll_engine) < 0) {
+        CDBG_ERROR("%s: cannot launch poll engine", __func__);
+        mm_camera_cmd_thread_release(&my_obj->evt_thread);
+        rc = -1;
+        goto on_error;
+    }
     mm_camera_poll_thread_launch(&my_obj->evt_poll_thread,
-                                 MM_CAMERA_POLL_TYPE_EVT);
+                                 MM_CAMERA_POLL_TYPE_EVT,
+                                 &my_obj->poll_engine);
     mm_camera_evt_sub(my_obj, TRUE);
 
     /* unlock cam_lock, we need release global intf_lock in camera_open(),
@@ -367,11 +446,11 @@ on_error:
         rc = -1;
     } else {
         if (my_obj->ctrl_fd >= 0) {
-            close(my_obj->ctrl_fd);
+            my_obj->backend->close_dev(my_obj->ctrl_fd);
             my_obj->ctrl_fd = -1;
         }
         if (my_obj->ds_fd >= 0) {
-            mm_camera_socket_close(my_obj->ds_fd);
+            my_obj->backend->sock_close(my_obj->ds_fd);
             my_obj->ds_fd = -1;
         }
     }
@@ -403,16 +482,17 @@ int32_t mm_camera_close(mm_camera_obj_t *my_obj)
 
     CDBG("%s : Close evt Poll Thread in Cam Close",__func__);
     mm_camera_poll_thread_release(&my_obj->evt_poll_thread);
+    mm_camera_poll_engine_release(&my_obj->poll_engine);
 
     CDBG("%s : Close evt cmd Thread in Cam Close",__func__);
     mm_camera_cmd_thread_release(&my_obj->evt_thread);
 
     if(my_obj->ctrl_fd >= 0) {
-        close(my_obj->ctrl_fd);
+        my_obj->backend->close_dev(my_obj->ctrl_fd);
         my_obj->ctrl_fd = -1;
     }
     if(my_obj->ds_fd >= 0) {
-        mm_camera_socket_close(my_obj->ds_fd);
+        my_obj->backend->sock_close(my_obj->ds_fd);
         my_obj->ds_fd = -1;
     }
     pthread_mutex_destroy(&my_obj->msg_lock);
@@ -443,11 +523,11 @@ int32_t mm_camera_close(mm_camera_obj_t *my_obj)
 int32_t mm_camera_close_fd(mm_camera_obj_t *my_obj)
 {
     if(my_obj->ctrl_fd >= 0) {
-        close(my_obj->ctrl_fd);
+        my_obj->backend->close_dev(my_obj->ctrl_fd);
         my_obj->ctrl_fd = -1;
     }
     if(my_obj->ds_fd >= 0) {
-        mm_camera_socket_close(my_obj->ds_fd);
+        my_obj->backend->sock_close(my_obj->ds_fd);
         my_obj->ds_fd = -1;
     }
     pthread_mutex_unlock(&my_obj->cam_lock);
@@ -601,6 +681,43 @@ int32_t mm_camera_get_queued_buf_count(mm_camera_obj_t *my_obj,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_flush_user_buf
+ *
+ * DESCRIPTION: queue the partially filled batch container of a stream
+ *
+ * PARAMETERS :
+ *   @my_obj       : camera object
+ *   @ch_id        : channel handle
+ *   @stream_id : stream id
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_camera_flush_user_buf(mm_camera_obj_t *my_obj,
+        uint32_t ch_id, uint32_t stream_id)
+{
+    int rc = -1;
+    mm_channel_t * ch_obj = NULL;
+    uint32_t payload;
+    ch_obj = mm_camera_util_get_channel_by_handler(my_obj, ch_id);
+    payload = stream_id;
+
+    if (NULL != ch_obj) {
+        pthread_mutex_lock(&ch_obj->ch_lock);
+        pthread_mutex_unlock(&my_obj->cam_lock);
+        rc = mm_channel_fsm_fn(ch_obj,
+                MM_CHANNEL_EVT_FLUSH_STREAM_USER_BUF,
+                (void *)&payload,
+                NULL);
+    } else {
+        pthread_mutex_unlock(&my_obj->cam_lock);
+    }
+
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_query_capability
  *
@@ -620,7 +737,7 @@ int32_t mm_camera_query_capability(mm_camera_obj_t *my_obj)
 
     /* get camera capabilities */
     memset(&cap, 0, sizeof(cap));
-    rc = ioctl(my_obj->ctrl_fd, VIDIOC_QUERYCAP, &cap);
+    rc = my_obj->backend->ioctl(my_obj->ctrl_fd, VIDIOC_QUERYCAP, &cap);
     if (rc != 0) {
         CDBG_ERROR("%s: cannot get camera capabilities, rc = %d\n", __func__, rc);
     }
@@ -652,7 +769,7 @@ int32_t mm_camera_set_parms(mm_camera_obj_t *my_obj,
     int32_t rc = -1;
     int32_t value = 0;
     if (parms !=  NULL) {
-        rc = mm_camera_util_s_ctrl(my_obj->ctrl_fd, CAM_PRIV_PARM, &value);
+        rc = mm_camera_util_s_ctrl(my_obj, my_obj->ctrl_fd, CAM_PRIV_PARM, &value);
     }
     pthread_mutex_unlock(&my_obj->cam_lock);
     return rc;
@@ -682,7 +799,7 @@ int32_t mm_camera_get_parms(mm_camera_obj_t *my_obj,
     int32_t rc = -1;
     int32_t value = 0;
     if (parms != NULL) {
-        rc = mm_camera_util_g_ctrl(my_obj->ctrl_fd, CAM_PRIV_PARM, &value);
+        rc = mm_camera_util_g_ctrl(my_obj, my_obj->ctrl_fd, CAM_PRIV_PARM, &value);
     }
     pthread_mutex_unlock(&my_obj->cam_lock);
     return rc;
@@ -706,7 +823,7 @@ int32_t mm_camera_do_auto_focus(mm_camera_obj_t *my_obj)
 {
     int32_t rc = -1;
     int32_t value = 0;
-    rc = mm_camera_util_s_ctrl(my_obj->ctrl_fd, CAM_PRIV_DO_AUTO_FOCUS, &value);
+    rc = mm_camera_util_s_ctrl(my_obj, my_obj->ctrl_fd, CAM_PRIV_DO_AUTO_FOCUS, &value);
     pthread_mutex_unlock(&my_obj->cam_lock);
     return rc;
 }
@@ -727,7 +844,7 @@ int32_t mm_camera_cancel_auto_focus(mm_camera_obj_t *my_obj)
 {
     int32_t rc = -1;
     int32_t value = 0;
-    rc = mm_camera_util_s_ctrl(my_obj->ctrl_fd, CAM_PRIV_CANCEL_AUTO_FOCUS, &value);
+    rc = mm_camera_util_s_ctrl(my_obj, my_obj->ctrl_fd, CAM_PRIV_CANCEL_AUTO_FOCUS, &value);
     pthread_mutex_unlock(&my_obj->cam_lock);
     return rc;
 }
@@ -750,7 +867,7 @@ int32_t mm_camera_prepare_snapshot(mm_camera_obj_t *my_obj,
 {
     int32_t rc = -1;
     int32_t value = do_af_flag;
-    rc = mm_camera_util_s_ctrl(my_obj->ctrl_fd, CAM_PRIV_PREPARE_SNAPSHOT, &value);
+    rc = mm_camera_util_s_ctrl(my_obj, my_obj->ctrl_fd, CAM_PRIV_PREPARE_SNAPSHOT, &value);
     pthread_mutex_unlock(&my_obj->cam_lock);
     return rc;
 }
@@ -772,7 +889,7 @@ int32_t mm_camera_start_zsl_snapshot(mm_camera_obj_t *my_obj)
     int32_t rc = -1;
     int32_t value = 0;
 
-    rc = mm_camera_util_s_ctrl(my_obj->ctrl_fd,
+    rc = mm_camera_util_s_ctrl(my_obj, my_obj->ctrl_fd,
              CAM_PRIV_START_ZSL_SNAPSHOT, &value);
     return rc;
 }
@@ -793,7 +910,7 @@ int32_t mm_camera_stop_zsl_snapshot(mm_camera_obj_t *my_obj)
 {
     int32_t rc = -1;
     int32_t value;
-    rc = mm_camera_util_s_ctrl(my_obj->ctrl_fd,
+    rc = mm_camera_util_s_ctrl(my_obj, my_obj->ctrl_fd,
              CAM_PRIV_STOP_ZSL_SNAPSHOT, &value);
     return rc;
 }
@@ -841,7 +958,12 @@ uint32_t mm_camera_add_channel(mm_camera_obj_t *my_obj,
         ch_obj->state = MM_CHANNEL_STATE_STOPPED;
         ch_obj->cam_obj = my_obj;
         pthread_mutex_init(&ch_obj->ch_lock, NULL);
-        mm_channel_init(ch_obj, attr, channel_cb, userdata);
+        if (mm_channel_init(ch_obj, attr, channel_cb, userdata) < 0) {
+            CDBG_ERROR("%s: channel init failed", __func__);
+            pthread_mutex_destroy(&ch_obj->ch_lock);
+            ch_obj->state = MM_CHANNEL_STATE_NOTUSED;
+            ch_hdl = 0;
+        }
     }
 
     pthread_mutex_unlock(&my_obj->cam_lock);
@@ -1658,7 +1780,7 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
     sub.id = MSM_CAMERA_MSM_NOTIFY;
     if(FALSE == reg_flag) {
         /* unsubscribe */
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
+        rc = my_obj->backend->ioctl(my_obj->ctrl_fd, VIDIOC_UNSUBSCRIBE_EVENT, &sub);
         if (rc < 0) {
             CDBG_ERROR("%s: unsubscribe event rc = %d", __func__, rc);
             return rc;
@@ -1668,7 +1790,7 @@ int32_t mm_camera_evt_sub(mm_camera_obj_t * my_obj,
                                                my_obj->my_hdl,
                                                mm_camera_sync_call);
     } else {
-        rc = ioctl(my_obj->ctrl_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
+        rc = my_obj->backend->ioctl(my_obj->ctrl_fd, VIDIOC_SUBSCRIBE_EVENT, &sub);
         if (rc < 0) {
             CDBG_ERROR("%s: subscribe event rc = %d", __func__, rc);
             return rc;
@@ -1745,7 +1867,7 @@ int32_t mm_camera_util_sendmsg(mm_camera_obj_t *my_obj,
 
     /* need to lock msg_lock, since sendmsg until reposonse back is deemed as one operation*/
     pthread_mutex_lock(&my_obj->msg_lock);
-    if(mm_camera_socket_sendmsg(my_obj->ds_fd, msg, buf_size, sendfd) > 0) {
+    if(my_obj->backend->sock_sendmsg(my_obj->ds_fd, msg, buf_size, sendfd) > 0) {
         /* wait for event that mapping/unmapping is done */
         mm_camera_util_wait_for_event(my_obj, CAM_EVENT_TYPE_MAP_UNMAP_DONE, &status);
         if (MSM_CAMERA_STATUS_SUCCESS == status) {
@@ -1832,6 +1954,7 @@ int32_t mm_camera_unmap_buf(mm_camera_obj_t *my_obj,
  * DESCRIPTION: utility function to send v4l2 ioctl for s_ctrl
  *
  * PARAMETERS :
+ *   @my_obj  : camera object
  *   @fd      : file descritpor for sending ioctl
  *   @id      : control id
  *   @value   : value of the ioctl to be sent
@@ -1840,7 +1963,8 @@ int32_t mm_camera_unmap_buf(mm_camera_obj_t *my_obj,
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-int32_t mm_camera_util_s_ctrl(int32_t fd,  uint32_t id, int32_t *value)
+int32_t mm_camera_util_s_ctrl(mm_camera_obj_t *my_obj,
+                              int32_t fd,  uint32_t id, int32_t *value)
 {
     int rc = 0;
     struct v4l2_control control;
@@ -1850,7 +1974,7 @@ int32_t mm_camera_util_s_ctrl(int32_t fd,  uint32_t id, int32_t *value)
     if (value != NULL) {
         control.value = *value;
     }
-    rc = ioctl(fd, VIDIOC_S_CTRL, &control);
+    rc = my_obj->backend->ioctl(fd, VIDIOC_S_CTRL, &control);
 
     CDBG("%s: fd=%d, S_CTRL, id=0x%x, value = %p, rc = %d\n",
          __func__, fd, id, value, rc);
@@ -1866,6 +1990,7 @@ int32_t mm_camera_util_s_ctrl(int32_t fd,  uint32_t id, int32_t *value)
  * DESCRIPTION: utility function to send v4l2 ioctl for g_ctrl
  *
  * PARAMETERS :
+ *   @my_obj  : camera object
  *   @fd      : file descritpor for sending ioctl
  *   @id      : control id
  *   @value   : value of the ioctl to be sent
@@ -1874,7 +1999,8 @@ int32_t mm_camera_util_s_ctrl(int32_t fd,  uint32_t id, int32_t *value)
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-int32_t mm_camera_util_g_ctrl( int32_t fd, uint32_t id, int32_t *value)
+int32_t mm_camera_util_g_ctrl(mm_camera_obj_t *my_obj,
+                              int32_t fd, uint32_t id, int32_t *value)
 {
     int rc = 0;
     struct v4l2_control control;
@@ -1884,7 +2010,7 @@ int32_t mm_camera_util_g_ctrl( int32_t fd, uint32_t id, int32_t *value)
     if (value != NULL) {
         control.value = *value;
     }
-    rc = ioctl(fd, VIDIOC_G_CTRL, &control);
+    rc = my_obj->backend->ioctl(fd, VIDIOC_G_CTRL, &control);
     CDBG("%s: fd=%d, G_CTRL, id=0x%x, rc = %d\n", __func__, fd, id, rc);
     if (value != NULL) {
         *value = control.value;
@@ -79,6 +79,8 @@ int32_t mm_channel_set_stream_parm(mm_channel_t *my_obj,
                                    mm_evt_paylod_set_get_stream_parms_t *payload);
 int32_t mm_channel_get_queued_buf_count(mm_channel_t *my_obj,
         uint32_t stream_id);
+int32_t mm_channel_flush_user_buf(mm_channel_t *my_obj,
+        uint32_t stream_id);
 
 int32_t mm_channel_get_stream_parm(mm_channel_t *my_obj,
                                    mm_evt_paylod_set_get_stream_parms_t *payload);
@@ -167,6 +169,7 @@ static void mm_channel_dispatch_super_buf(mm_camera_cmdcb_t *cmd_cb,
 {
     mm_camera_cmd_thread_name("mm_cam_cb");
     mm_channel_t * my_obj = (mm_channel_t *)user_data;
+    uint32_t i;
 
     if (NULL == my_obj) {
         return;
@@ -178,6 +181,11 @@ static void mm_channel_dispatch_super_buf(mm_camera_cmdcb_t *cmd_cb,
         return;
     }
 
+    for (i = 0; i < cmd_cb->u.superbuf.num_bufs; i++) {
+        mm_camera_trace_frame(MM_CAMERA_TRACE_CH_DISPATCH,
+                cmd_cb->u.superbuf.bufs[i]);
+    }
+
     if (my_obj->bundle.super_buf_notify_cb) {
         my_obj->bundle.super_buf_notify_cb(&cmd_cb->u.superbuf, my_obj->bundle.user_data);
     }
@@ -211,6 +219,7 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
         return;
     }
     if (MM_CAMERA_CMD_TYPE_DATA_CB  == cmd_cb->cmd_type) {
+        mm_camera_trace_frame(MM_CAMERA_TRACE_CH_PROCESS, cmd_cb->u.buf.buf);
         /* comp_and_enqueue */
         mm_channel_superbuf_comp_and_enqueue(
                         ch_obj,
@@ -421,9 +430,8 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                      __func__, ch_obj->pending_cnt);
 
                 /* send cam_sem_post to wake up cb thread to dispatch super buffer */
-                cb_node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+                cb_node = mm_camera_cmd_thread_alloc_cmd(&(ch_obj->cb_thread));
                 if (NULL != cb_node) {
-                    memset(cb_node, 0, sizeof(mm_camera_cmdcb_t));
                     cb_node->cmd_type = MM_CAMERA_CMD_TYPE_SUPER_BUF_DATA_CB;
                     cb_node->u.superbuf.num_bufs = node->num_of_bufs;
                     for (i=0; i<node->num_of_bufs; i++) {
@@ -439,7 +447,7 @@ static void mm_channel_process_stream_buf(mm_camera_cmdcb_t * cmd_cb,
                     }
 
                     /* enqueue to cb thread */
-                    cam_queue_enq(&(ch_obj->cb_thread.cmd_queue), cb_node);
+                    cam_ring_queue_enq(&(ch_obj->cb_thread.cmd_queue), cb_node);
                     /* wake up cb thread */
                     cam_sem_post(&(ch_obj->cb_thread.cmd_sem));
                 } else {
@@ -755,6 +763,12 @@ int32_t mm_channel_fsm_fn_active(mm_channel_t *my_obj,
             rc = mm_channel_get_queued_buf_count(my_obj, stream_id);
         }
         break;
+    case MM_CHANNEL_EVT_FLUSH_STREAM_USER_BUF:
+        {
+            uint32_t stream_id = *((uint32_t *)in_val);
+            rc = mm_channel_flush_user_buf(my_obj, stream_id);
+        }
+        break;
     case MM_CHANNEL_EVT_GET_STREAM_PARM:
         {
             mm_evt_paylod_set_get_stream_parms_t *payload =
@@ -928,10 +942,13 @@ int32_t mm_channel_init(mm_channel_t *my_obj,
         my_obj->bundle.superbuf_queue.attr = *attr;
     }
 
-    CDBG("%s : Launch data poll thread in channel open", __func__);
-    snprintf(my_obj->threadName, THREAD_NAME_SIZE, "DataPoll");
-    mm_camera_poll_thread_launch(&my_obj->poll_thread[0],
-                                 MM_CAMERA_POLL_TYPE_DATA);
+    CDBG("%s : Attach data poll to camera poll engine in channel open", __func__);
+    rc = mm_camera_poll_thread_launch(&my_obj->poll_thread[0],
+                                      MM_CAMERA_POLL_TYPE_DATA,
+                                      &my_obj->cam_obj->poll_engine);
+    if (rc < 0) {
+        return rc;
+    }
 
     /* change state to stopped state */
     my_obj->state = MM_CHANNEL_STATE_STOPPED;
@@ -951,7 +968,7 @@ int32_t mm_channel_init(mm_channel_t *my_obj,
  *==========================================================================*/
 void mm_channel_release(mm_channel_t *my_obj)
 {
-    /* stop data poll thread */
+    /* detach data poll from camera poll engine */
     mm_camera_poll_thread_release(&my_obj->poll_thread[0]);
 
     /* change state to notused state */
@@ -1548,15 +1565,14 @@ int32_t mm_channel_request_super_buf(mm_channel_t *my_obj,
     /* set pending_cnt
      * will trigger dispatching super frames if pending_cnt > 0 */
     /* send cam_sem_post to wake up cmd thread to dispatch super buffer */
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&(my_obj->cmd_thread));
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_REQ_DATA_CB;
         node->u.req_buf.num_buf_requested = num_buf_requested;
         node->u.req_buf.num_retro_buf_requested = num_retro_buf_requested;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        cam_ring_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1607,14 +1623,13 @@ int32_t mm_channel_flush_super_buf_queue(mm_channel_t *my_obj, uint32_t frame_id
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&(my_obj->cmd_thread));
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_FLUSH_QUEUE;
         node->u.frame_idx = frame_idx;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        cam_ring_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1645,14 +1660,13 @@ int32_t mm_channel_config_notify_mode(mm_channel_t *my_obj,
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&(my_obj->cmd_thread));
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->u.notify_mode = notify_mode;
         node->cmd_type = MM_CAMERA_CMD_TYPE_CONFIG_NOTIFY;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        cam_ring_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1681,13 +1695,12 @@ int32_t mm_channel_start_zsl_snapshot(mm_channel_t *my_obj)
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&(my_obj->cmd_thread));
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_START_ZSL;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        cam_ring_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1716,13 +1729,12 @@ int32_t mm_channel_stop_zsl_snapshot(mm_channel_t *my_obj)
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&(my_obj->cmd_thread));
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_STOP_ZSL;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        cam_ring_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -1805,6 +1817,42 @@ int32_t mm_channel_get_queued_buf_count(mm_channel_t *my_obj, uint32_t stream_id
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_flush_user_buf
+ *
+ * DESCRIPTION: queue the partially filled batch container of a stream
+ *
+ * PARAMETERS :
+ *   @my_obj       : channel object
+ *   @stream_id    : steam_id
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_channel_flush_user_buf(mm_channel_t *my_obj, uint32_t stream_id)
+{
+    int32_t rc = -1;
+    mm_stream_t* s_obj = mm_channel_util_get_stream_by_handler(my_obj, stream_id);
+
+    if (NULL != s_obj) {
+        if (s_obj->ch_obj != my_obj) {
+            /* Redirect to linked stream */
+            rc = mm_stream_fsm_fn(s_obj->linked_stream,
+                    MM_STREAM_EVT_FLUSH_USER_BUF,
+                    NULL,
+                    NULL);
+        } else {
+            rc = mm_stream_fsm_fn(s_obj,
+                    MM_STREAM_EVT_FLUSH_USER_BUF,
+                    NULL,
+                    NULL);
+        }
+    }
+
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_set_stream_parms
  *
@@ -2004,6 +2052,11 @@ int32_t mm_channel_unmap_stream_buf(mm_channel_t *my_obj,
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
 {
+    memset(queue->unmatched_idx, 0, sizeof(queue->unmatched_idx));
+    queue->unmatched_cnt = 0;
+    queue->unindexed_cnt = 0;
+    queue->first_unmatched = NULL;
+    queue->last_unmatched = NULL;
     return cam_queue_init(&queue->que);
 }
 
@@ -2021,9 +2074,144 @@ int32_t mm_channel_superbuf_queue_init(mm_channel_queue_t * queue)
  *==========================================================================*/
 int32_t mm_channel_superbuf_queue_deinit(mm_channel_queue_t * queue)
 {
+    memset(queue->unmatched_idx, 0, sizeof(queue->unmatched_idx));
+    queue->unmatched_cnt = 0;
+    queue->unindexed_cnt = 0;
+    queue->first_unmatched = NULL;
+    queue->last_unmatched = NULL;
     return cam_queue_deinit(&queue->que);
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_walk_unmatched
+ *
+ * DESCRIPTION: find the nearest unmatched superbuf from a position of the
+ *              superbuf queue, skipping matched ones. Caller holds que.lock.
+ *
+ * PARAMETERS :
+ *   @queue   : superbuf queue
+ *   @pos     : list position to start from (inclusive)
+ *   @forward : TRUE to walk towards tail, FALSE towards head
+ *
+ * RETURN     : node of unmatched superbuf, NULL if none
+ *==========================================================================*/
+static cam_node_t *mm_channel_superbuf_walk_unmatched(mm_channel_queue_t *queue,
+        struct cam_list *pos, uint8_t forward)
+{
+    struct cam_list *head = &queue->que.head.list;
+    cam_node_t *node;
+    mm_channel_queue_node_t *super_buf;
+
+    while (pos != head) {
+        node = member_of(pos, cam_node_t, list);
+        super_buf = (mm_channel_queue_node_t *)node->data;
+        if (NULL != super_buf && !super_buf->matched) {
+            return node;
+        }
+        pos = forward ? pos->next : pos->prev;
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_idx_add
+ *
+ * DESCRIPTION: index a newly queued unmatched superbuf. Unmatched superbufs
+ *              are kept sorted by frame_idx in the queue, so the lowest and
+ *              highest ones bound every lookup. Caller holds que.lock.
+ *
+ * PARAMETERS :
+ *   @queue   : superbuf queue
+ *   @node    : node of unmatched superbuf, already linked into que
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_idx_add(mm_channel_queue_t *queue,
+        cam_node_t *node)
+{
+    mm_channel_queue_node_t *super_buf = (mm_channel_queue_node_t *)node->data;
+    uint32_t slot = super_buf->frame_idx & (MM_CHANNEL_SUPERBUF_IDX_SIZE - 1);
+
+    if (NULL == queue->unmatched_idx[slot]) {
+        queue->unmatched_idx[slot] = node;
+    } else {
+        queue->unindexed_cnt++;
+    }
+    queue->unmatched_cnt++;
+
+    if ((NULL == queue->first_unmatched) || (super_buf->frame_idx <
+            ((mm_channel_queue_node_t *)queue->first_unmatched->data)->frame_idx)) {
+        queue->first_unmatched = node;
+    }
+    if ((NULL == queue->last_unmatched) || (super_buf->frame_idx >=
+            ((mm_channel_queue_node_t *)queue->last_unmatched->data)->frame_idx)) {
+        queue->last_unmatched = node;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_idx_del
+ *
+ * DESCRIPTION: drop a superbuf from the unmatched index, either because it
+ *              got matched or because it is about to be removed from the
+ *              queue. Must be called while the node is still linked and
+ *              still flagged unmatched. Caller holds que.lock.
+ *
+ * PARAMETERS :
+ *   @queue   : superbuf queue
+ *   @node    : node of unmatched superbuf
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_idx_del(mm_channel_queue_t *queue,
+        cam_node_t *node)
+{
+    mm_channel_queue_node_t *super_buf = (mm_channel_queue_node_t *)node->data;
+    uint32_t slot = super_buf->frame_idx & (MM_CHANNEL_SUPERBUF_IDX_SIZE - 1);
+
+    if (queue->unmatched_idx[slot] == node) {
+        queue->unmatched_idx[slot] = NULL;
+    } else if (queue->unindexed_cnt > 0) {
+        queue->unindexed_cnt--;
+    }
+    if (queue->unmatched_cnt > 0) {
+        queue->unmatched_cnt--;
+    }
+
+    if (queue->first_unmatched == node) {
+        queue->first_unmatched =
+                mm_channel_superbuf_walk_unmatched(queue, node->list.next, TRUE);
+    }
+    if (queue->last_unmatched == node) {
+        queue->last_unmatched =
+                mm_channel_superbuf_walk_unmatched(queue, node->list.prev, FALSE);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_idx_lookup
+ *
+ * DESCRIPTION: find unmatched superbuf by frame_idx. Caller holds que.lock.
+ *
+ * PARAMETERS :
+ *   @queue     : superbuf queue
+ *   @frame_idx : frame index to look up
+ *
+ * RETURN     : node of unmatched superbuf, NULL if not queued
+ *==========================================================================*/
+static cam_node_t *mm_channel_superbuf_idx_lookup(mm_channel_queue_t *queue,
+        uint32_t frame_idx)
+{
+    cam_node_t *node =
+            queue->unmatched_idx[frame_idx & (MM_CHANNEL_SUPERBUF_IDX_SIZE - 1)];
+
+    if ((NULL != node) &&
+            (((mm_channel_queue_node_t *)node->data)->frame_idx == frame_idx)) {
+        return node;
+    }
+    return NULL;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_util_seq_comp_w_rollover
  *
@@ -2358,7 +2546,32 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
     insert_before_buf = NULL;
     last_buf_ptr = NULL;
 
-    while (pos != head) {
+    /* Fast path: with plain frame_idx matching and every unmatched superbuf
+     * indexed, the match, the oldest unmatched superbuf and the insert
+     * position all come from the index. Anything else takes the walk. */
+    if ((0 == queue->unindexed_cnt) && (0 == queue->nomatch_frame_id) &&
+            (MM_CAMERA_SUPER_BUF_PRIORITY_LOW != queue->attr.priority)) {
+        node = mm_channel_superbuf_idx_lookup(queue, buf_info->frame_idx);
+        if ((NULL != node) || (NULL == queue->last_unmatched) ||
+                (((mm_channel_queue_node_t *)queue->last_unmatched->data)->frame_idx <
+                buf_info->frame_idx)) {
+            if ((NULL != queue->first_unmatched) &&
+                    (((mm_channel_queue_node_t *)queue->first_unmatched->data)->frame_idx <
+                    buf_info->frame_idx)) {
+                last_buf = &queue->first_unmatched->list;
+            }
+            if (NULL != node) {
+                super_buf = (mm_channel_queue_node_t *)node->data;
+                pos = &node->list;
+                found_super_buf = 1;
+            } else {
+                unmatched_bundles = (uint8_t)queue->unmatched_cnt;
+                pos = head;
+            }
+        }
+    }
+
+    while (!found_super_buf && (pos != head)) {
         node = member_of(pos, cam_node_t, list);
         super_buf = (mm_channel_queue_node_t*)node->data;
 
@@ -2416,13 +2629,15 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
         super_buf->super_buf[buf_s_idx] = *buf_info;
 
         /* check if superbuf is all matched */
-        super_buf->matched = 1;
         for (i=0; i < super_buf->num_of_bufs; i++) {
             if (super_buf->super_buf[i].frame_idx == 0) {
-                super_buf->matched = 0;
                 break;
             }
         }
+        if (i == super_buf->num_of_bufs) {
+            mm_channel_superbuf_idx_del(queue, member_of(pos, cam_node_t, list));
+            super_buf->matched = 1;
+        }
 
         if (super_buf->matched) {
             if(ch_obj->isFlashBracketingEnabled) {
@@ -2456,6 +2671,9 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                                 mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
                             }
                         }
+                        if (!super_buf->matched) {
+                            mm_channel_superbuf_idx_del(queue, node);
+                        }
                         queue->que.size--;
                         last_buf = last_buf->next;
                         cam_list_del_node(&node->list);
@@ -2493,11 +2711,17 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                             mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
                         }
                     }
+                    /* step past the node before it is freed */
+                    last_buf_ptr = last_buf_ptr->next;
+                    if (!super_buf->matched) {
+                        mm_channel_superbuf_idx_del(queue, node);
+                    }
                     queue->que.size--;
                     cam_list_del_node(&node->list);
                     free(node);
                     free(super_buf);
                     unmatched_bundles--;
+                    continue;
                 }
                 last_buf_ptr = last_buf_ptr->next;
             }
@@ -2510,6 +2734,9 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                         mm_channel_qbuf(ch_obj, super_buf->super_buf[i].buf);
                     }
                 }
+                if (!super_buf->matched) {
+                    mm_channel_superbuf_idx_del(queue, node);
+                }
                 queue->que.size--;
                 cam_list_del_node(&node->list);
                 free(node);
@@ -2549,6 +2776,8 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                     new_buf->expected = FALSE;
                     queue->expected_frame_id = buf_info->frame_idx + queue->attr.post_frame_skip;
                     queue->match_cnt++;
+                } else {
+                    mm_channel_superbuf_idx_add(queue, new_node);
                 }
 
                 if ((queue->attr.priority == MM_CAMERA_SUPER_BUF_PRIORITY_LOW)
@@ -2609,6 +2838,9 @@ mm_channel_queue_node_t* mm_channel_superbuf_dequeue_internal(mm_channel_queue_t
             super_buf = NULL;
         }
         if (NULL != super_buf) {
+            if (super_buf->matched == FALSE) {
+                mm_channel_superbuf_idx_del(queue, node);
+            }
             /* remove from the queue */
             cam_list_del_node(&node->list);
             queue->que.size--;
@@ -2793,14 +3025,13 @@ int32_t mm_channel_proc_general_cmd(mm_channel_t *my_obj,
     int32_t rc = 0;
     mm_camera_cmdcb_t* node = NULL;
 
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&(my_obj->cmd_thread));
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->u.gen_cmd = *p_gen_cmd;
         node->cmd_type = MM_CAMERA_CMD_TYPE_GENERAL;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+        cam_ring_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -651,6 +651,40 @@ static int32_t mm_camera_intf_get_queued_buf_count(uint32_t camera_handle,
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_intf_flush_user_buf
+ *
+ * DESCRIPTION: queue the partially filled batch container of a stream
+ *
+ * PARAMETERS :
+ *   @camera_handle: camera handle
+ *   @ch_id        : channel handle
+ *   @stream_id : stream id
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_camera_intf_flush_user_buf(uint32_t camera_handle,
+        uint32_t ch_id, uint32_t stream_id)
+{
+    int32_t rc = -1;
+    mm_camera_obj_t * my_obj = NULL;
+
+    pthread_mutex_lock(&g_intf_lock);
+    my_obj = mm_camera_util_get_camera_by_handler(camera_handle);
+
+    if(my_obj) {
+        pthread_mutex_lock(&my_obj->cam_lock);
+        pthread_mutex_unlock(&g_intf_lock);
+        rc = mm_camera_flush_user_buf(my_obj, ch_id, stream_id);
+    } else {
+        pthread_mutex_unlock(&g_intf_lock);
+    }
+    CDBG("%s :X rc = %d",__func__,rc);
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_camera_intf_link_stream
  *
@@ -1544,6 +1578,16 @@ uint8_t get_num_of_cameras()
     /* lock the mutex */
     pthread_mutex_lock(&g_intf_lock);
 
+    if (mm_camera_loopback_enabled()) {
+        /* virtual sensors only, no media device enumeration */
+        g_cam_ctrl.num_cam = mm_camera_loopback_get_num_of_cameras(
+                g_cam_ctrl.video_dev_name, g_cam_ctrl.info);
+        pthread_mutex_unlock(&g_intf_lock);
+        CDBG_HIGH("%s: loopback num_cameras=%d\n", __func__,
+                (int)g_cam_ctrl.num_cam);
+        return (uint8_t)g_cam_ctrl.num_cam;
+    }
+
     while (1) {
         uint32_t num_entities = 1U;
         char dev_name[32];
@@ -1740,6 +1784,7 @@ static mm_camera_ops_t mm_camera_ops = {
     .config_stream = mm_camera_intf_config_stream,
     .qbuf = mm_camera_intf_qbuf,
     .get_queued_buf_count = mm_camera_intf_get_queued_buf_count,
+    .flush_user_buf = mm_camera_intf_flush_user_buf,
     .map_stream_buf = mm_camera_intf_map_stream_buf,
     .unmap_stream_buf = mm_camera_intf_unmap_stream_buf,
     .set_stream_parms = mm_camera_intf_set_stream_parms,
@@ -1803,6 +1848,13 @@ int32_t camera_open(uint8_t camera_idx, mm_camera_vtbl_t **camera_vtbl)
     cam_obj->my_hdl = mm_camera_util_generate_handler(camera_idx);
     cam_obj->vtbl.camera_handle = cam_obj->my_hdl; /* set handler */
     cam_obj->vtbl.ops = &mm_camera_ops;
+    if (mm_camera_loopback_enabled()) {
+        cam_obj->backend = &mm_camera_loopback_backend;
+    } else {
+        cam_obj->backend = &mm_camera_v4l2_backend;
+    }
+    CDBG_HIGH("%s: camera %d uses %s backend", __func__,
+            camera_idx, cam_obj->backend->name);
     pthread_mutex_init(&cam_obj->cam_lock, NULL);
     /* unlock global interface lock, if not, in dual camera use case,
       * current open will block operation of another opened camera obj*/
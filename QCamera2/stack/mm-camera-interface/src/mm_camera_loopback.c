@@ -0,0 +1,1217 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Loopback "virtual sensor" backend.
+ *
+ * Emulates the msm v4l2 video node (QBUF/DQBUF/STREAMON/...), the event
+ * subdev (DQEVENT) and the daemon domain socket map/unmap protocol inside
+ * the calling process. Every node handed out is the read end of a pipe, so
+ * the regular poll threads wake up exactly as they would on hardware:
+ * one byte is written per ready frame (stream node) or per pending event
+ * (control node).
+ *
+ * A per-session sensor thread ticks at persist.camera.loopback.fps and, on
+ * each tick, fills one queued buffer of every streaming stream with a
+ * synthetic pattern. All streams of a session share the same frame id per
+ * tick, so bundling and super buffer matching behave as on a real ISP.
+ *
+ * g_lb_lock only guards queue and mapping bookkeeping. Frames are filled
+ * with the lock dropped so that ioctls of other streams and cameras do not
+ * wait behind the memsets; a node being filled is marked and anything that
+ * would unmap or reset its buffers waits for the fill on g_lb_fill_cond.
+ */
+
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <cutils/properties.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+#include "mm_camera.h"
+
+#define MM_LOOPBACK_MAX_NODES      (MM_CAMERA_MAX_NUM_SENSORS * (MAX_STREAM_NUM_IN_BUNDLE * 4 + 2))
+#define MM_LOOPBACK_MAX_EVTS       16
+#define MM_LOOPBACK_DEFAULT_FPS    30
+#define MM_LOOPBACK_MAX_FPS        480
+#define MM_LOOPBACK_NSEC_PER_SEC   1000000000LL
+
+#ifndef MSM_CAMERA_STATUS_FAIL
+#define MSM_CAMERA_STATUS_FAIL     (MSM_CAMERA_STATUS_SUCCESS + 1)
+#endif
+
+typedef enum {
+    MM_LOOPBACK_NODE_CTRL,      /* session control node with event queue */
+    MM_LOOPBACK_NODE_STREAM,    /* per stream video node */
+    MM_LOOPBACK_NODE_SOCK,      /* domain socket */
+} mm_loopback_node_type_t;
+
+typedef struct {
+    void *vaddr;
+    size_t size;
+} mm_loopback_map_t;
+
+typedef struct {
+    uint8_t mapped_planes;          /* bitmask of planes mapped via socket */
+    uint8_t shared_fd;              /* all planes share map[0] */
+    uint32_t num_planes;            /* plane layout from last QBUF */
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    mm_loopback_map_t map[VIDEO_MAX_PLANES];
+} mm_loopback_buf_t;
+
+typedef struct {
+    uint32_t buf_idx;
+    uint32_t sequence;
+    struct timeval ts;
+} mm_loopback_frame_t;
+
+typedef struct {
+    uint8_t in_use;
+    mm_loopback_node_type_t type;
+    int cam_idx;
+    int pfds[2];
+
+    /* stream node only */
+    uint32_t stream_id;
+    uint8_t streaming;
+    uint32_t num_bufs;
+    mm_loopback_map_t stream_info;
+    mm_loopback_buf_t bufs[MM_CAMERA_MAX_NUM_FRAMES];
+    uint32_t queued[MM_CAMERA_MAX_NUM_FRAMES];  /* fifo of queued buf idx */
+    uint32_t queued_head;
+    uint32_t queued_cnt;
+    mm_loopback_frame_t done[MM_CAMERA_MAX_NUM_FRAMES]; /* fifo of filled bufs */
+    uint32_t done_head;
+    uint32_t done_cnt;
+    uint8_t filling;                /* bufs[fill_idx] is filled unlocked */
+    uint32_t fill_idx;
+} mm_loopback_node_t;
+
+typedef struct {
+    uint32_t command;
+    uint32_t status;
+} mm_loopback_evt_t;
+
+typedef struct {
+    uint8_t opened;
+    mm_loopback_node_t *ctrl;
+    uint32_t next_stream_id;
+    uint32_t frame_id;
+    uint32_t fps;
+
+    pthread_t sensor_pid;
+    uint8_t sensor_running;
+    pthread_cond_t sensor_cond;
+
+    mm_loopback_map_t capability;
+    mm_loopback_map_t parm_buf;
+
+    mm_loopback_evt_t evts[MM_LOOPBACK_MAX_EVTS];
+    uint32_t evt_head;
+    uint32_t evt_cnt;
+} mm_loopback_session_t;
+
+static pthread_mutex_t g_lb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_lb_fill_cond = PTHREAD_COND_INITIALIZER;
+static mm_loopback_node_t g_lb_nodes[MM_LOOPBACK_MAX_NODES];
+static mm_loopback_session_t g_lb_sessions[MM_CAMERA_MAX_NUM_SENSORS];
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_loopback_enabled
+ *
+ * DESCRIPTION: check if loopback backend is selected. Selected by setting
+ *              persist.camera.mm.backend (or MM_CAMERA_BACKEND in the
+ *              environment when no property service is available) to
+ *              "loopback".
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : TRUE if loopback backend is selected
+ *              FALSE otherwise
+ *==========================================================================*/
+uint8_t mm_camera_loopback_enabled(void)
+{
+    char prop[PROPERTY_VALUE_MAX];
+    const char *env = getenv("MM_CAMERA_BACKEND");
+
+    property_get("persist.camera.mm.backend", prop, (NULL != env) ? env : "v4l2");
+    return (0 == strcmp(prop, "loopback")) ? TRUE : FALSE;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_loopback_get_num_of_cameras
+ *
+ * DESCRIPTION: fill in device names and static info of virtual sensors
+ *
+ * PARAMETERS :
+ *   @dev_name : array of device names to be filled
+ *   @info     : array of camera info to be filled
+ *
+ * RETURN     : number of virtual sensors
+ *==========================================================================*/
+int8_t mm_camera_loopback_get_num_of_cameras(char dev_name[][MM_CAMERA_DEV_NAME_LEN],
+                                             struct camera_info *info)
+{
+    char prop[PROPERTY_VALUE_MAX];
+    int num_cam, i;
+
+    property_get("persist.camera.loopback.num_cam", prop, "1");
+    num_cam = atoi(prop);
+    if (num_cam <= 0) {
+        num_cam = 1;
+    } else if (num_cam > MM_CAMERA_MAX_NUM_SENSORS) {
+        num_cam = MM_CAMERA_MAX_NUM_SENSORS;
+    }
+
+    for (i = 0; i < num_cam; i++) {
+        snprintf(dev_name[i], MM_CAMERA_DEV_NAME_LEN, "video%d", i);
+        info[i].facing = (0 == i) ? CAMERA_FACING_BACK : CAMERA_FACING_FRONT;
+        info[i].orientation = (0 == i) ? 90 : 270;
+    }
+    return (int8_t)num_cam;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_get_node
+ *
+ * DESCRIPTION: look up an in use node by its fd. Caller holds g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @fd      : fd handed out by the loopback backend
+ *
+ * RETURN     : ptr to node, NULL if not found
+ *==========================================================================*/
+static mm_loopback_node_t *mm_loopback_get_node(int fd)
+{
+    int i;
+    for (i = 0; i < MM_LOOPBACK_MAX_NODES; i++) {
+        if (g_lb_nodes[i].in_use && g_lb_nodes[i].pfds[0] == fd) {
+            return &g_lb_nodes[i];
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_get_stream_node
+ *
+ * DESCRIPTION: look up a stream node by its server stream id. Caller holds
+ *              g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @cam_idx   : session index
+ *   @stream_id : server stream id
+ *
+ * RETURN     : ptr to node, NULL if not found
+ *==========================================================================*/
+static mm_loopback_node_t *mm_loopback_get_stream_node(int cam_idx,
+                                                      uint32_t stream_id)
+{
+    int i;
+    for (i = 0; i < MM_LOOPBACK_MAX_NODES; i++) {
+        if (g_lb_nodes[i].in_use &&
+            g_lb_nodes[i].type == MM_LOOPBACK_NODE_STREAM &&
+            g_lb_nodes[i].cam_idx == cam_idx &&
+            g_lb_nodes[i].stream_id == stream_id) {
+            return &g_lb_nodes[i];
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_alloc_node
+ *
+ * DESCRIPTION: allocate a node backed by a non-blocking pipe. Caller holds
+ *              g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @type    : node type
+ *   @cam_idx : session index
+ *
+ * RETURN     : ptr to node, NULL if failed
+ *==========================================================================*/
+static mm_loopback_node_t *mm_loopback_alloc_node(mm_loopback_node_type_t type,
+                                                 int cam_idx)
+{
+    int i;
+    for (i = 0; i < MM_LOOPBACK_MAX_NODES; i++) {
+        if (!g_lb_nodes[i].in_use) {
+            mm_loopback_node_t *node = &g_lb_nodes[i];
+            memset(node, 0, sizeof(mm_loopback_node_t));
+            if (pipe(node->pfds) < 0) {
+                CDBG_ERROR("%s: pipe failed: %s", __func__, strerror(errno));
+                return NULL;
+            }
+            fcntl(node->pfds[0], F_SETFL, O_NONBLOCK);
+            fcntl(node->pfds[1], F_SETFL, O_NONBLOCK);
+            node->in_use = TRUE;
+            node->type = type;
+            node->cam_idx = cam_idx;
+            return node;
+        }
+    }
+    errno = EMFILE;
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_unmap
+ *
+ * DESCRIPTION: release an emulated server side mapping
+ *
+ * PARAMETERS :
+ *   @map     : mapping to be released
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_unmap(mm_loopback_map_t *map)
+{
+    if (NULL != map->vaddr) {
+        munmap(map->vaddr, map->size);
+    }
+    map->vaddr = NULL;
+    map->size = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_map
+ *
+ * DESCRIPTION: emulate server side mapping of a client buffer fd
+ *
+ * PARAMETERS :
+ *   @map     : mapping to be filled
+ *   @fd      : buffer fd
+ *   @size    : buffer size
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+static int32_t mm_loopback_map(mm_loopback_map_t *map, int fd, size_t size)
+{
+    void *vaddr;
+
+    mm_loopback_unmap(map);
+    vaddr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == vaddr) {
+        CDBG_ERROR("%s: mmap fd %d size %zu failed: %s",
+                   __func__, fd, size, strerror(errno));
+        return -1;
+    }
+    map->vaddr = vaddr;
+    map->size = size;
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_signal
+ *
+ * DESCRIPTION: make the node fd readable once more
+ *
+ * PARAMETERS :
+ *   @node    : node to be signaled
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_signal(mm_loopback_node_t *node)
+{
+    uint8_t token = 1;
+    if (write(node->pfds[1], &token, sizeof(token)) != sizeof(token)) {
+        CDBG_ERROR("%s: pipe full on fd %d", __func__, node->pfds[0]);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_consume
+ *
+ * DESCRIPTION: consume one readiness token of the node fd
+ *
+ * PARAMETERS :
+ *   @node    : node to be consumed
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_consume(mm_loopback_node_t *node)
+{
+    uint8_t token;
+    if (read(node->pfds[0], &token, sizeof(token)) != sizeof(token)) {
+        CDBG("%s: no token on fd %d", __func__, node->pfds[0]);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_post_evt
+ *
+ * DESCRIPTION: queue a server event to session control node. Caller holds
+ *              g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @session : session object
+ *   @command : event type (CAM_EVENT_TYPE_*)
+ *   @status  : event status
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_post_evt(mm_loopback_session_t *session,
+                                 uint32_t command,
+                                 uint32_t status)
+{
+    uint32_t idx;
+
+    if (NULL == session->ctrl || session->evt_cnt >= MM_LOOPBACK_MAX_EVTS) {
+        CDBG_ERROR("%s: drop event 0x%x", __func__, command);
+        return;
+    }
+    idx = (session->evt_head + session->evt_cnt) % MM_LOOPBACK_MAX_EVTS;
+    session->evts[idx].command = command;
+    session->evts[idx].status = status;
+    session->evt_cnt++;
+    mm_loopback_signal(session->ctrl);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_fill_caps
+ *
+ * DESCRIPTION: describe the virtual sensor in the mapped capability buffer
+ *
+ * PARAMETERS :
+ *   @session : session object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_fill_caps(mm_loopback_session_t *session)
+{
+    static const cam_dimension_t sizes[] = {
+        {4160, 3120}, {1920, 1080}, {1280, 720}, {640, 480}, {320, 240}
+    };
+    cam_capability_t *cap = (cam_capability_t *)session->capability.vaddr;
+    size_t i, cnt = ARRAY_SIZE(sizes);
+
+    if (NULL == cap || session->capability.size < sizeof(cam_capability_t)) {
+        return;
+    }
+
+    memset(cap, 0, sizeof(cam_capability_t));
+    cap->position = CAM_POSITION_BACK;
+    cap->zoom_ratio_tbl_cnt = 1;
+    cap->zoom_ratio_tbl[0] = 100;
+    cap->fps_ranges_tbl_cnt = 1;
+    cap->fps_ranges_tbl[0].min_fps = (float)session->fps;
+    cap->fps_ranges_tbl[0].max_fps = (float)session->fps;
+    cap->fps_ranges_tbl[0].video_min_fps = (float)session->fps;
+    cap->fps_ranges_tbl[0].video_max_fps = (float)session->fps;
+    for (i = 0; i < cnt; i++) {
+        cap->picture_sizes_tbl[i] = sizes[i];
+        cap->picture_min_duration[i] = MM_LOOPBACK_NSEC_PER_SEC / session->fps;
+        cap->preview_sizes_tbl[i] = sizes[i];
+        cap->video_sizes_tbl[i] = sizes[i];
+        cap->livesnapshot_sizes_tbl[i] = sizes[i];
+    }
+    cap->picture_sizes_tbl_cnt = cnt;
+    cap->preview_sizes_tbl_cnt = cnt;
+    cap->video_sizes_tbl_cnt = cnt;
+    cap->livesnapshot_sizes_tbl_cnt = cnt;
+    cap->supported_preview_fmt_cnt = 1;
+    cap->supported_preview_fmts[0] = CAM_FORMAT_YUV_420_NV21;
+    cap->supported_raw_dim_cnt = 1;
+    cap->raw_dim[0] = sizes[0];
+    cap->supported_raw_fmt_cnt = 1;
+    cap->supported_raw_fmts[0] = CAM_FORMAT_BAYER_MIPI_RAW_10BPP_GBRG;
+    cap->pixel_array_size = sizes[0];
+    cap->active_array_size.width = sizes[0].width;
+    cap->active_array_size.height = sizes[0].height;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_fill_buf
+ *
+ * DESCRIPTION: fill a stream buffer with a synthetic frame. Luma/raw plane
+ *              gets a moving ramp, chroma planes are neutral and metadata
+ *              buffers are cleared so no tag is reported valid.
+ *
+ * PARAMETERS :
+ *   @node     : stream node
+ *   @buf      : buffer to be filled
+ *   @sequence : frame id of this frame
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_fill_buf(mm_loopback_node_t *node,
+                                 mm_loopback_buf_t *buf,
+                                 uint32_t sequence)
+{
+    cam_stream_info_t *info = (cam_stream_info_t *)node->stream_info.vaddr;
+    uint32_t i;
+
+    for (i = 0; i < buf->num_planes && i < VIDEO_MAX_PLANES; i++) {
+        mm_loopback_map_t *map = buf->shared_fd ? &buf->map[0] : &buf->map[i];
+        size_t offset = buf->shared_fd ? buf->planes[i].reserved[0] : 0;
+        size_t len = buf->planes[i].length;
+        uint8_t *base;
+
+        if (NULL == map->vaddr || offset >= map->size) {
+            continue;
+        }
+        if (len == 0 || offset + len > map->size) {
+            len = map->size - offset;
+        }
+        base = (uint8_t *)map->vaddr + offset;
+
+        if (NULL != info && CAM_STREAM_TYPE_METADATA == info->stream_type) {
+            memset(base, 0, len);
+        } else if (0 == i && NULL != info &&
+                info->buf_planes.plane_info.mp[0].stride > 0) {
+            size_t stride = (size_t)info->buf_planes.plane_info.mp[0].stride;
+            size_t row;
+            for (row = 0; (row + 1) * stride <= len; row++) {
+                memset(base + row * stride, (int)((row + sequence) & 0xFF), stride);
+            }
+        } else {
+            memset(base, (0 == i) ? (int)(sequence & 0xFF) : 0x80, len);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_wait_fill
+ *
+ * DESCRIPTION: wait until the sensor thread is done filling a buffer of the
+ *              node. Caller holds g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @node    : stream node
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_wait_fill(mm_loopback_node_t *node)
+{
+    while (node->filling) {
+        pthread_cond_wait(&g_lb_fill_cond, &g_lb_lock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_take_frame
+ *
+ * DESCRIPTION: take one queued buffer of a streaming node for filling.
+ *              Caller holds g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @node     : stream node
+ *
+ * RETURN     : TRUE if a buffer was taken
+ *==========================================================================*/
+static uint8_t mm_loopback_take_frame(mm_loopback_node_t *node)
+{
+    if (0 == node->queued_cnt) {
+        /* client starved the stream, frame is dropped as ISP would do */
+        return FALSE;
+    }
+    node->fill_idx = node->queued[node->queued_head];
+    node->queued_head = (node->queued_head + 1) % MM_CAMERA_MAX_NUM_FRAMES;
+    node->queued_cnt--;
+    node->filling = TRUE;
+    return TRUE;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_done_frame
+ *
+ * DESCRIPTION: move the filled buffer of a node to done queue. Caller holds
+ *              g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @node     : stream node
+ *   @sequence : frame id of this tick
+ *   @ts       : frame timestamp
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_done_frame(mm_loopback_node_t *node,
+                                   uint32_t sequence,
+                                   struct timespec *ts)
+{
+    uint32_t done_idx;
+
+    done_idx = (node->done_head + node->done_cnt) % MM_CAMERA_MAX_NUM_FRAMES;
+    node->done[done_idx].buf_idx = node->fill_idx;
+    node->done[done_idx].sequence = sequence;
+    node->done[done_idx].ts.tv_sec = ts->tv_sec;
+    node->done[done_idx].ts.tv_usec = ts->tv_nsec / 1000;
+    node->done_cnt++;
+    node->filling = FALSE;
+    mm_loopback_signal(node);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_session_streaming
+ *
+ * DESCRIPTION: check if any stream of the session is streaming. Caller holds
+ *              g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @cam_idx : session index
+ *
+ * RETURN     : TRUE if at least one stream is on
+ *==========================================================================*/
+static uint8_t mm_loopback_session_streaming(int cam_idx)
+{
+    int i;
+    for (i = 0; i < MM_LOOPBACK_MAX_NODES; i++) {
+        if (g_lb_nodes[i].in_use &&
+            g_lb_nodes[i].type == MM_LOOPBACK_NODE_STREAM &&
+            g_lb_nodes[i].cam_idx == cam_idx &&
+            g_lb_nodes[i].streaming) {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_sensor_thread
+ *
+ * DESCRIPTION: virtual sensor routine. Produces one frame per tick on every
+ *              streaming stream of the session.
+ *
+ * PARAMETERS :
+ *   @data    : ptr to session object
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void *mm_loopback_sensor_thread(void *data)
+{
+    mm_loopback_session_t *session = (mm_loopback_session_t *)data;
+    int cam_idx = (int)(session - g_lb_sessions);
+    mm_loopback_node_t *fills[MM_LOOPBACK_MAX_NODES];
+    struct timespec next;
+    long long period_ns;
+    int i, num_fills;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    pthread_mutex_lock(&g_lb_lock);
+    while (session->sensor_running) {
+        if (!mm_loopback_session_streaming(cam_idx)) {
+            pthread_cond_wait(&session->sensor_cond, &g_lb_lock);
+            clock_gettime(CLOCK_MONOTONIC, &next);
+            continue;
+        }
+
+        period_ns = MM_LOOPBACK_NSEC_PER_SEC / session->fps;
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= MM_LOOPBACK_NSEC_PER_SEC) {
+            next.tv_nsec -= MM_LOOPBACK_NSEC_PER_SEC;
+            next.tv_sec++;
+        }
+        pthread_mutex_unlock(&g_lb_lock);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        pthread_mutex_lock(&g_lb_lock);
+
+        session->frame_id++;
+        num_fills = 0;
+        for (i = 0; i < MM_LOOPBACK_MAX_NODES; i++) {
+            mm_loopback_node_t *node = &g_lb_nodes[i];
+            if (node->in_use && node->type == MM_LOOPBACK_NODE_STREAM &&
+                node->cam_idx == cam_idx && node->streaming &&
+                mm_loopback_take_frame(node)) {
+                fills[num_fills++] = node;
+            }
+        }
+        if (0 == num_fills) {
+            continue;
+        }
+
+        /* taken buffers stay mapped until done_frame clears filling */
+        pthread_mutex_unlock(&g_lb_lock);
+        for (i = 0; i < num_fills; i++) {
+            mm_loopback_fill_buf(fills[i], &fills[i]->bufs[fills[i]->fill_idx],
+                                 session->frame_id);
+        }
+        pthread_mutex_lock(&g_lb_lock);
+
+        for (i = 0; i < num_fills; i++) {
+            mm_loopback_done_frame(fills[i], session->frame_id, &next);
+        }
+        pthread_cond_broadcast(&g_lb_fill_cond);
+    }
+    pthread_mutex_unlock(&g_lb_lock);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_release_node
+ *
+ * DESCRIPTION: release all emulated state of a node. Caller holds g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @node    : node to be released
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_release_node(mm_loopback_node_t *node)
+{
+    uint32_t i, j;
+
+    mm_loopback_wait_fill(node);
+    for (i = 0; i < MM_CAMERA_MAX_NUM_FRAMES; i++) {
+        for (j = 0; j < VIDEO_MAX_PLANES; j++) {
+            mm_loopback_unmap(&node->bufs[i].map[j]);
+        }
+    }
+    mm_loopback_unmap(&node->stream_info);
+    close(node->pfds[0]);
+    close(node->pfds[1]);
+    memset(node, 0, sizeof(mm_loopback_node_t));
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_open_dev
+ *
+ * DESCRIPTION: loopback backend: open a virtual video node. The first open of
+ *              a device is the control node of the session, following opens
+ *              are stream nodes.
+ *
+ * PARAMETERS :
+ *   @dev_name: device node path, /dev/videoN
+ *   @flags   : open flags (unused)
+ *
+ * RETURN     : file descriptor, negative if failed
+ *==========================================================================*/
+static int mm_loopback_open_dev(const char *dev_name, int flags)
+{
+    char prop[PROPERTY_VALUE_MAX];
+    mm_loopback_session_t *session;
+    mm_loopback_node_t *node;
+    int cam_idx = 0;
+    int fps, rc;
+    (void)flags;
+
+    if (1 != sscanf(dev_name, "/dev/video%d", &cam_idx) ||
+        cam_idx < 0 || cam_idx >= MM_CAMERA_MAX_NUM_SENSORS) {
+        errno = ENODEV;
+        return -1;
+    }
+    session = &g_lb_sessions[cam_idx];
+
+    pthread_mutex_lock(&g_lb_lock);
+    if (session->opened) {
+        node = mm_loopback_alloc_node(MM_LOOPBACK_NODE_STREAM, cam_idx);
+        pthread_mutex_unlock(&g_lb_lock);
+        return (NULL != node) ? node->pfds[0] : -1;
+    }
+
+    node = mm_loopback_alloc_node(MM_LOOPBACK_NODE_CTRL, cam_idx);
+    if (NULL == node) {
+        pthread_mutex_unlock(&g_lb_lock);
+        return -1;
+    }
+
+    property_get("persist.camera.loopback.fps", prop, "30");
+    fps = atoi(prop);
+    if (fps <= 0 || fps > MM_LOOPBACK_MAX_FPS) {
+        fps = MM_LOOPBACK_DEFAULT_FPS;
+    }
+
+    memset(session, 0, sizeof(mm_loopback_session_t));
+    session->opened = TRUE;
+    session->ctrl = node;
+    session->fps = (uint32_t)fps;
+    session->sensor_running = TRUE;
+    pthread_cond_init(&session->sensor_cond, NULL);
+    rc = pthread_create(&session->sensor_pid, NULL,
+                        mm_loopback_sensor_thread, (void *)session);
+    if (0 != rc) {
+        CDBG_ERROR("%s: cannot start virtual sensor %d: %s",
+                   __func__, cam_idx, strerror(rc));
+        mm_loopback_release_node(node);
+        pthread_cond_destroy(&session->sensor_cond);
+        memset(session, 0, sizeof(mm_loopback_session_t));
+        pthread_mutex_unlock(&g_lb_lock);
+        errno = rc;
+        return -1;
+    }
+    pthread_setname_np(session->sensor_pid, "CAM_loopback");
+    pthread_mutex_unlock(&g_lb_lock);
+
+    CDBG_HIGH("%s: virtual sensor %d opened at %d fps", __func__, cam_idx, fps);
+    return node->pfds[0];
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_close_dev
+ *
+ * DESCRIPTION: loopback backend: close a virtual node. Closing the control
+ *              node tears down the session and its sensor thread.
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor of the node
+ *
+ * RETURN     : 0 on success, -1 on failure
+ *==========================================================================*/
+static int mm_loopback_close_dev(int fd)
+{
+    mm_loopback_session_t *session = NULL;
+    mm_loopback_node_t *node;
+    pthread_t sensor_pid;
+
+    pthread_mutex_lock(&g_lb_lock);
+    node = mm_loopback_get_node(fd);
+    if (NULL == node) {
+        pthread_mutex_unlock(&g_lb_lock);
+        errno = EBADF;
+        return -1;
+    }
+
+    if (MM_LOOPBACK_NODE_CTRL == node->type) {
+        session = &g_lb_sessions[node->cam_idx];
+        session->sensor_running = FALSE;
+        session->ctrl = NULL;
+        pthread_cond_signal(&session->sensor_cond);
+    }
+    mm_loopback_release_node(node);
+    pthread_mutex_unlock(&g_lb_lock);
+
+    if (NULL != session) {
+        sensor_pid = session->sensor_pid;
+        pthread_join(sensor_pid, NULL);
+        pthread_mutex_lock(&g_lb_lock);
+        mm_loopback_unmap(&session->capability);
+        mm_loopback_unmap(&session->parm_buf);
+        pthread_cond_destroy(&session->sensor_cond);
+        memset(session, 0, sizeof(mm_loopback_session_t));
+        pthread_mutex_unlock(&g_lb_lock);
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_stream_ioctl
+ *
+ * DESCRIPTION: emulate v4l2 ioctls on a stream node. Caller holds g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @node    : stream node
+ *   @req     : ioctl request
+ *   @arg     : ioctl payload
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_loopback_stream_ioctl(mm_loopback_node_t *node,
+                                    unsigned long req,
+                                    void *arg)
+{
+    mm_loopback_session_t *session = &g_lb_sessions[node->cam_idx];
+
+    switch (req) {
+    case VIDIOC_S_PARM: {
+        struct v4l2_streamparm *s_parm = (struct v4l2_streamparm *)arg;
+        node->stream_id = ++session->next_stream_id;
+        s_parm->parm.capture.extendedmode = node->stream_id;
+        return 0;
+    }
+    case VIDIOC_S_FMT:
+    case VIDIOC_S_CTRL:
+    case VIDIOC_G_CTRL:
+        return 0;
+    case VIDIOC_REQBUFS: {
+        struct v4l2_requestbuffers *bufreq = (struct v4l2_requestbuffers *)arg;
+        if (bufreq->count > MM_CAMERA_MAX_NUM_FRAMES) {
+            errno = EINVAL;
+            return -1;
+        }
+        mm_loopback_wait_fill(node);
+        node->num_bufs = bufreq->count;
+        node->queued_cnt = 0;
+        node->done_cnt = 0;
+        return 0;
+    }
+    case VIDIOC_QBUF: {
+        struct v4l2_buffer *vb = (struct v4l2_buffer *)arg;
+        mm_loopback_buf_t *buf;
+        if (vb->index >= node->num_bufs ||
+            node->queued_cnt >= MM_CAMERA_MAX_NUM_FRAMES) {
+            errno = EINVAL;
+            return -1;
+        }
+        buf = &node->bufs[vb->index];
+        buf->num_planes = (vb->length < VIDEO_MAX_PLANES) ?
+                vb->length : VIDEO_MAX_PLANES;
+        memcpy(buf->planes, vb->m.planes,
+               sizeof(struct v4l2_plane) * buf->num_planes);
+        node->queued[(node->queued_head + node->queued_cnt) %
+                MM_CAMERA_MAX_NUM_FRAMES] = vb->index;
+        node->queued_cnt++;
+        return 0;
+    }
+    case VIDIOC_DQBUF: {
+        struct v4l2_buffer *vb = (struct v4l2_buffer *)arg;
+        mm_loopback_frame_t *frame;
+        if (0 == node->done_cnt) {
+            errno = EAGAIN;
+            return -1;
+        }
+        mm_loopback_consume(node);
+        frame = &node->done[node->done_head];
+        node->done_head = (node->done_head + 1) % MM_CAMERA_MAX_NUM_FRAMES;
+        node->done_cnt--;
+        vb->index = frame->buf_idx;
+        vb->sequence = frame->sequence;
+        vb->timestamp = frame->ts;
+        vb->reserved = 0;
+        return 0;
+    }
+    case VIDIOC_STREAMON:
+        node->streaming = TRUE;
+        pthread_cond_signal(&session->sensor_cond);
+        return 0;
+    case VIDIOC_STREAMOFF:
+        node->streaming = FALSE;
+        mm_loopback_wait_fill(node);
+        while (node->done_cnt > 0) {
+            mm_loopback_consume(node);
+            node->done_cnt--;
+        }
+        node->done_head = 0;
+        node->queued_head = 0;
+        node->queued_cnt = 0;
+        return 0;
+    default:
+        CDBG_ERROR("%s: unsupported ioctl 0x%lx on stream node", __func__, req);
+        errno = ENOTTY;
+        return -1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_ctrl_ioctl
+ *
+ * DESCRIPTION: emulate v4l2 ioctls on a control node. Caller holds g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @node    : control node
+ *   @req     : ioctl request
+ *   @arg     : ioctl payload
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_loopback_ctrl_ioctl(mm_loopback_node_t *node,
+                                  unsigned long req,
+                                  void *arg)
+{
+    mm_loopback_session_t *session = &g_lb_sessions[node->cam_idx];
+
+    switch (req) {
+    case VIDIOC_QUERYCAP:
+        mm_loopback_fill_caps(session);
+        return 0;
+    case VIDIOC_SUBSCRIBE_EVENT:
+    case VIDIOC_UNSUBSCRIBE_EVENT:
+    case VIDIOC_S_CTRL:
+    case VIDIOC_G_CTRL:
+        return 0;
+    case VIDIOC_DQEVENT: {
+        struct v4l2_event *ev = (struct v4l2_event *)arg;
+        struct msm_v4l2_event_data *msm_evt =
+                (struct msm_v4l2_event_data *)ev->u.data;
+        if (0 == session->evt_cnt) {
+            errno = ENOENT;
+            return -1;
+        }
+        mm_loopback_consume(node);
+        memset(ev, 0, sizeof(struct v4l2_event));
+        ev->type = MSM_CAMERA_V4L2_EVENT_TYPE;
+        ev->id = MSM_CAMERA_MSM_NOTIFY;
+        msm_evt->command = session->evts[session->evt_head].command;
+        msm_evt->status = session->evts[session->evt_head].status;
+        session->evt_head = (session->evt_head + 1) % MM_LOOPBACK_MAX_EVTS;
+        session->evt_cnt--;
+        return 0;
+    }
+    default:
+        CDBG_ERROR("%s: unsupported ioctl 0x%lx on ctrl node", __func__, req);
+        errno = ENOTTY;
+        return -1;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_ioctl
+ *
+ * DESCRIPTION: loopback backend: emulate an ioctl on a virtual node
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor of the node
+ *   @req     : ioctl request
+ *   @arg     : ioctl payload
+ *
+ * RETURN     : 0 on success, -1 with errno set on failure
+ *==========================================================================*/
+static int mm_loopback_ioctl(int fd, unsigned long req, void *arg)
+{
+    mm_loopback_node_t *node;
+    int rc = -1;
+
+    pthread_mutex_lock(&g_lb_lock);
+    node = mm_loopback_get_node(fd);
+    if (NULL == node) {
+        errno = EBADF;
+    } else if (MM_LOOPBACK_NODE_STREAM == node->type) {
+        rc = mm_loopback_stream_ioctl(node, req, arg);
+    } else if (MM_LOOPBACK_NODE_CTRL == node->type) {
+        rc = mm_loopback_ctrl_ioctl(node, req, arg);
+    } else {
+        errno = ENOTTY;
+    }
+    pthread_mutex_unlock(&g_lb_lock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_sock_create
+ *
+ * DESCRIPTION: loopback backend: create the emulated daemon domain socket
+ *
+ * PARAMETERS :
+ *   @cam_id  : camera index
+ *
+ * RETURN     : socket fd, negative if failed
+ *==========================================================================*/
+static int mm_loopback_sock_create(int cam_id)
+{
+    mm_loopback_node_t *node = NULL;
+
+    if (cam_id < 0 || cam_id >= MM_CAMERA_MAX_NUM_SENSORS) {
+        errno = ENODEV;
+        return -1;
+    }
+    pthread_mutex_lock(&g_lb_lock);
+    if (g_lb_sessions[cam_id].opened) {
+        node = mm_loopback_alloc_node(MM_LOOPBACK_NODE_SOCK, cam_id);
+    } else {
+        errno = ECONNREFUSED;
+    }
+    pthread_mutex_unlock(&g_lb_lock);
+    return (NULL != node) ? node->pfds[0] : -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_process_map
+ *
+ * DESCRIPTION: emulate daemon handling of a buffer map packet. Caller holds
+ *              g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @cam_idx : session index
+ *   @map     : map payload
+ *   @sendfd  : fd passed along with the packet
+ *
+ * RETURN     : MSM_CAMERA_STATUS_SUCCESS or MSM_CAMERA_STATUS_FAIL
+ *==========================================================================*/
+static uint32_t mm_loopback_process_map(int cam_idx,
+                                        cam_buf_map_type *map,
+                                        int sendfd)
+{
+    mm_loopback_session_t *session = &g_lb_sessions[cam_idx];
+    mm_loopback_node_t *node = NULL;
+    mm_loopback_buf_t *buf;
+    int32_t rc = 0;
+
+    switch (map->type) {
+    case CAM_MAPPING_BUF_TYPE_CAPABILITY:
+        rc = mm_loopback_map(&session->capability, sendfd, map->size);
+        break;
+    case CAM_MAPPING_BUF_TYPE_PARM_BUF:
+        rc = mm_loopback_map(&session->parm_buf, sendfd, map->size);
+        break;
+    case CAM_MAPPING_BUF_TYPE_STREAM_INFO:
+        node = mm_loopback_get_stream_node(cam_idx, map->stream_id);
+        if (NULL == node) {
+            rc = -1;
+            break;
+        }
+        mm_loopback_wait_fill(node);
+        rc = mm_loopback_map(&node->stream_info, sendfd, map->size);
+        break;
+    case CAM_MAPPING_BUF_TYPE_STREAM_BUF:
+        node = mm_loopback_get_stream_node(cam_idx, map->stream_id);
+        if (NULL == node || map->frame_idx >= MM_CAMERA_MAX_NUM_FRAMES ||
+            map->plane_idx >= VIDEO_MAX_PLANES) {
+            rc = -1;
+            break;
+        }
+        mm_loopback_wait_fill(node);
+        buf = &node->bufs[map->frame_idx];
+        buf->shared_fd = (map->plane_idx < 0) ? TRUE : FALSE;
+        rc = mm_loopback_map(&buf->map[buf->shared_fd ? 0 : map->plane_idx],
+                             sendfd, map->size);
+        break;
+    default:
+        /* offline/misc buffers are accepted but never touched */
+        break;
+    }
+    return (0 == rc) ? MSM_CAMERA_STATUS_SUCCESS : MSM_CAMERA_STATUS_FAIL;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_process_unmap
+ *
+ * DESCRIPTION: emulate daemon handling of a buffer unmap packet. Caller holds
+ *              g_lb_lock.
+ *
+ * PARAMETERS :
+ *   @cam_idx : session index
+ *   @unmap   : unmap payload
+ *
+ * RETURN     : MSM_CAMERA_STATUS_SUCCESS
+ *==========================================================================*/
+static uint32_t mm_loopback_process_unmap(int cam_idx,
+                                          cam_buf_unmap_type *unmap)
+{
+    mm_loopback_session_t *session = &g_lb_sessions[cam_idx];
+    mm_loopback_node_t *node = NULL;
+    uint32_t i;
+
+    switch (unmap->type) {
+    case CAM_MAPPING_BUF_TYPE_CAPABILITY:
+        mm_loopback_unmap(&session->capability);
+        break;
+    case CAM_MAPPING_BUF_TYPE_PARM_BUF:
+        mm_loopback_unmap(&session->parm_buf);
+        break;
+    case CAM_MAPPING_BUF_TYPE_STREAM_INFO:
+        node = mm_loopback_get_stream_node(cam_idx, unmap->stream_id);
+        if (NULL != node) {
+            mm_loopback_wait_fill(node);
+            mm_loopback_unmap(&node->stream_info);
+        }
+        break;
+    case CAM_MAPPING_BUF_TYPE_STREAM_BUF:
+        node = mm_loopback_get_stream_node(cam_idx, unmap->stream_id);
+        if (NULL != node && unmap->frame_idx < MM_CAMERA_MAX_NUM_FRAMES) {
+            mm_loopback_wait_fill(node);
+            for (i = 0; i < VIDEO_MAX_PLANES; i++) {
+                if (unmap->plane_idx < 0 || (int32_t)i == unmap->plane_idx) {
+                    mm_loopback_unmap(&node->bufs[unmap->frame_idx].map[i]);
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return MSM_CAMERA_STATUS_SUCCESS;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_sock_sendmsg
+ *
+ * DESCRIPTION: loopback backend: handle a map/unmap packet and acknowledge
+ *              it with CAM_EVENT_TYPE_MAP_UNMAP_DONE on the control node,
+ *              as the daemon does.
+ *
+ * PARAMETERS :
+ *   @fd       : socket fd
+ *   @msg      : cam_sock_packet_t packet
+ *   @buf_size : size of the packet
+ *   @sendfd   : fd passed along with the packet, -1 if none
+ *
+ * RETURN     : bytes consumed, -1 on failure
+ *==========================================================================*/
+static int mm_loopback_sock_sendmsg(int fd, void *msg, size_t buf_size, int sendfd)
+{
+    cam_sock_packet_t *packet = (cam_sock_packet_t *)msg;
+    mm_loopback_node_t *node;
+    uint32_t status = MSM_CAMERA_STATUS_FAIL;
+
+    if (NULL == packet || buf_size < sizeof(cam_sock_packet_t)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    pthread_mutex_lock(&g_lb_lock);
+    node = mm_loopback_get_node(fd);
+    if (NULL == node || MM_LOOPBACK_NODE_SOCK != node->type) {
+        pthread_mutex_unlock(&g_lb_lock);
+        errno = EBADF;
+        return -1;
+    }
+
+    if (CAM_MAPPING_TYPE_FD_MAPPING == packet->msg_type) {
+        status = mm_loopback_process_map(node->cam_idx,
+                                         &packet->payload.buf_map, sendfd);
+    } else if (CAM_MAPPING_TYPE_FD_UNMAPPING == packet->msg_type) {
+        status = mm_loopback_process_unmap(node->cam_idx,
+                                           &packet->payload.buf_unmap);
+    }
+    mm_loopback_post_evt(&g_lb_sessions[node->cam_idx],
+                         CAM_EVENT_TYPE_MAP_UNMAP_DONE, status);
+    pthread_mutex_unlock(&g_lb_lock);
+    return (int)buf_size;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_loopback_sock_close
+ *
+ * DESCRIPTION: loopback backend: close the emulated domain socket
+ *
+ * PARAMETERS :
+ *   @fd      : socket fd
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_loopback_sock_close(int fd)
+{
+    mm_loopback_node_t *node;
+
+    pthread_mutex_lock(&g_lb_lock);
+    node = mm_loopback_get_node(fd);
+    if (NULL != node) {
+        mm_loopback_release_node(node);
+    }
+    pthread_mutex_unlock(&g_lb_lock);
+}
+
+const mm_camera_backend_ops_t mm_camera_loopback_backend = {
+    .name = "loopback",
+    .open_dev = mm_loopback_open_dev,
+    .close_dev = mm_loopback_close_dev,
+    .ioctl = mm_loopback_ioctl,
+    .sock_create = mm_loopback_sock_create,
+    .sock_sendmsg = mm_loopback_sock_sendmsg,
+    .sock_close = mm_loopback_sock_close,
+};
@@ -0,0 +1,127 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Sparse copy of metadata/parm buffers.
+ *
+ * metadata_buffer_t is a flat struct holding a slot for every
+ * CAM_INTF_PARM_* entry (over a megabyte with tuning data), while a frame
+ * usually carries a few dozen valid entries. The layout is shared with the
+ * backend and cannot change, so instead of copying the whole struct only
+ * the valid payloads are copied, using an offset/size table generated from
+ * CAM_INTF_METADATA_TABLE.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} mm_camera_meta_entry_t;
+
+#define MM_CAMERA_META_ENTRY(PARAM_ID, DATATYPE, COUNT) \
+    [PARAM_ID] = { \
+        (uint32_t)offsetof(metadata_data_t, member_variable_##PARAM_ID), \
+        (uint32_t)(sizeof(DATATYPE) * (COUNT)) },
+#define MM_CAMERA_META_SLOT(PARAM_ID, DATATYPE, COUNT)
+
+/* entries not carried in metadata_data_t keep a zero size */
+static const mm_camera_meta_entry_t mm_camera_meta_table[CAM_INTF_PARM_MAX] = {
+    CAM_INTF_METADATA_TABLE(MM_CAMERA_META_ENTRY, MM_CAMERA_META_SLOT)
+};
+
+#define MM_CAMERA_META_COPY_OPT(DST, SRC, FLAG, FIELD, COPIED) \
+    do { \
+        (DST)->FLAG = (SRC)->FLAG; \
+        if ((SRC)->FLAG) { \
+            memcpy(&(DST)->FIELD, &(SRC)->FIELD, sizeof((SRC)->FIELD)); \
+            (COPIED) += sizeof((SRC)->FIELD); \
+        } \
+    } while (0)
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_copy_metadata
+ *
+ * DESCRIPTION: copy a metadata/parm buffer touching only its valid entries.
+ *              Afterwards dst reads back through POINTER_OF_META /
+ *              IF_META_AVAILABLE exactly like src; payloads of entries not
+ *              valid in src are left as they were in dst.
+ *
+ * PARAMETERS :
+ *   @dst     : destination buffer
+ *   @src     : source buffer
+ *
+ * RETURN     : number of payload bytes copied
+ *==========================================================================*/
+size_t mm_camera_copy_metadata(metadata_buffer_t *dst,
+        const metadata_buffer_t *src)
+{
+    size_t copied = 0;
+    uint32_t i;
+
+    if ((NULL == dst) || (NULL == src)) {
+        CDBG_ERROR("%s: invalid buffers dst %p src %p", __func__, dst, src);
+        return 0;
+    }
+    if (dst == src) {
+        return 0;
+    }
+
+    /* is_valid and is_reqd share storage, this carries either */
+    memcpy(dst->is_valid, src->is_valid, sizeof(src->is_valid));
+    for (i = 0; i < CAM_INTF_PARM_MAX; i++) {
+        if (!src->is_valid[i] || (0 == mm_camera_meta_table[i].size)) {
+            continue;
+        }
+        memcpy((uint8_t *)&dst->data + mm_camera_meta_table[i].offset,
+                (const uint8_t *)&src->data + mm_camera_meta_table[i].offset,
+                mm_camera_meta_table[i].size);
+        copied += mm_camera_meta_table[i].size;
+    }
+
+    MM_CAMERA_META_COPY_OPT(dst, src, is_tuning_params_valid, tuning_params,
+            copied);
+    MM_CAMERA_META_COPY_OPT(dst, src, is_mobicat_aec_params_valid,
+            mobicat_aec_params, copied);
+    MM_CAMERA_META_COPY_OPT(dst, src, is_statsdebug_ae_params_valid,
+            statsdebug_ae_data, copied);
+    MM_CAMERA_META_COPY_OPT(dst, src, is_statsdebug_awb_params_valid,
+            statsdebug_awb_data, copied);
+    MM_CAMERA_META_COPY_OPT(dst, src, is_statsdebug_af_params_valid,
+            statsdebug_af_data, copied);
+    MM_CAMERA_META_COPY_OPT(dst, src, is_statsdebug_asd_params_valid,
+            statsdebug_asd_data, copied);
+    MM_CAMERA_META_COPY_OPT(dst, src, is_statsdebug_stats_params_valid,
+            statsdebug_stats_buffer_data, copied);
+
+    return copied;
+}
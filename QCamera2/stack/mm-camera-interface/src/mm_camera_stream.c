@@ -71,6 +71,8 @@ int32_t mm_stream_read_user_buf(mm_stream_t * my_obj,
         mm_camera_buf_info_t* buf_info);
 int32_t mm_stream_write_user_buf(mm_stream_t * my_obj,
         mm_camera_buf_def_t *buf);
+int32_t mm_stream_queue_user_buf(mm_stream_t * my_obj, int32_t index);
+int32_t mm_stream_flush_user_buf(mm_stream_t * my_obj);
 
 int32_t mm_stream_config(mm_stream_t *my_obj,
                          mm_camera_stream_config_t *config);
@@ -159,14 +161,13 @@ int32_t mm_stream_notify_channel(struct mm_channel* ch_obj,
 
     /* send cam_sem_post to wake up channel cmd thread to enqueue
      * to super buffer */
-    node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    node = mm_camera_cmd_thread_alloc_cmd(&(ch_obj->cmd_thread));
     if (NULL != node) {
-        memset(node, 0, sizeof(mm_camera_cmdcb_t));
         node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
         node->u.buf = *buf_info;
 
         /* enqueue to cmd thread */
-        cam_queue_enq(&(ch_obj->cmd_thread.cmd_queue), node);
+        cam_ring_queue_enq(&(ch_obj->cmd_thread.cmd_queue), node);
 
         /* wake up cmd thread */
         cam_sem_post(&(ch_obj->cmd_thread.cmd_sem));
@@ -221,14 +222,13 @@ void mm_stream_handle_rcvd_buf(mm_stream_t *my_obj,
         mm_camera_cmdcb_t* node = NULL;
 
         /* send cam_sem_post to wake up cmd thread to dispatch dataCB */
-        node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+        node = mm_camera_cmd_thread_alloc_cmd(&(my_obj->cmd_thread));
         if (NULL != node) {
-            memset(node, 0, sizeof(mm_camera_cmdcb_t));
             node->cmd_type = MM_CAMERA_CMD_TYPE_DATA_CB;
             node->u.buf = *buf_info;
 
             /* enqueue to cmd thread */
-            cam_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
+            cam_ring_queue_enq(&(my_obj->cmd_thread.cmd_queue), node);
 
             /* wake up cmd thread */
             cam_sem_post(&(my_obj->cmd_thread.cmd_sem));
@@ -306,6 +306,7 @@ static void mm_stream_data_notify(void* user_data)
         (uint8_t)(my_obj->buf_status[idx].buf_refcnt + has_cb);
     pthread_mutex_unlock(&my_obj->buf_lock);
 
+    mm_camera_trace_frame(MM_CAMERA_TRACE_STREAM_NOTIFY, buf_info.buf);
     mm_stream_handle_rcvd_buf(my_obj, &buf_info, has_cb);
 }
 
@@ -493,7 +494,8 @@ int32_t mm_stream_fsm_inited(mm_stream_t *my_obj,
         snprintf(dev_name, sizeof(dev_name), "/dev/%s",
                  dev_name_value);
 
-        my_obj->fd = open(dev_name, O_RDWR | O_NONBLOCK);
+        my_obj->fd = my_obj->ch_obj->cam_obj->backend->open_dev(dev_name,
+                O_RDWR | O_NONBLOCK);
         if (my_obj->fd < 0) {
             CDBG_ERROR("%s: open dev returned %d\n", __func__, my_obj->fd);
             rc = -1;
@@ -506,7 +508,7 @@ int32_t mm_stream_fsm_inited(mm_stream_t *my_obj,
         } else {
             /* failed setting ext_mode
              * close fd */
-            close(my_obj->fd);
+            my_obj->ch_obj->cam_obj->backend->close_dev(my_obj->fd);
             my_obj->fd = -1;
             break;
         }
@@ -831,6 +833,9 @@ int32_t mm_stream_fsm_active(mm_stream_t * my_obj,
     case MM_STREAM_EVT_GET_QUEUED_BUF_COUNT:
         rc = mm_stream_get_queued_buf_count(my_obj);
         break;
+    case MM_STREAM_EVT_FLUSH_USER_BUF:
+        rc = mm_stream_flush_user_buf(my_obj);
+        break;
     case MM_STREAM_EVT_STOP:
         {
             uint8_t has_cb = 0;
@@ -932,7 +937,7 @@ int32_t mm_stream_release(mm_stream_t *my_obj)
     /* close fd */
     if(my_obj->fd >= 0)
     {
-        close(my_obj->fd);
+        my_obj->ch_obj->cam_obj->backend->close_dev(my_obj->fd);
     }
 
     /* destroy mutex */
@@ -966,7 +971,7 @@ int32_t mm_stream_streamon(mm_stream_t *my_obj)
     CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
          __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
 
-    rc = ioctl(my_obj->fd, VIDIOC_STREAMON, &buf_type);
+    rc = my_obj->ch_obj->cam_obj->backend->ioctl(my_obj->fd, VIDIOC_STREAMON, &buf_type);
     if (rc < 0) {
         CDBG_ERROR("%s: ioctl VIDIOC_STREAMON failed: rc=%d\n",
                    __func__, rc);
@@ -1010,7 +1015,7 @@ int32_t mm_stream_streamoff(mm_stream_t *my_obj)
     }
 
     /* step2: stream off */
-    rc = ioctl(my_obj->fd, VIDIOC_STREAMOFF, &buf_type);
+    rc = my_obj->ch_obj->cam_obj->backend->ioctl(my_obj->fd, VIDIOC_STREAMOFF, &buf_type);
     if (rc < 0) {
         CDBG_ERROR("%s: STREAMOFF failed: %s\n",
                 __func__, strerror(errno));
@@ -1022,7 +1027,13 @@ int32_t mm_stream_streamoff(mm_stream_t *my_obj)
 /*===========================================================================
  * FUNCTION   : mm_stream_write_user_buf
  *
- * DESCRIPTION: dequeue a stream buffer from user buffer queue and fill internal structure
+ * DESCRIPTION: return a buffer of a batch mode stream. A container buffer
+ *              returned with its planes is queued back as a whole. A
+ *              container whose planes were handed out one by one (all
+ *              plane indices reset to -1) only goes back to the free pool.
+ *              A plane buffer is staged into the container being filled,
+ *              which is queued once it holds a full batch, or earlier by
+ *              mm_stream_flush_user_buf.
  *
  * PARAMETERS :
  *   @my_obj       : stream object
@@ -1036,12 +1047,19 @@ int32_t mm_stream_write_user_buf(mm_stream_t * my_obj,
         mm_camera_buf_def_t *buf)
 {
     int32_t rc = 0, i;
-    int32_t index = -1, count = 0;
+    int32_t index = -1;
+    uint8_t batch_cnt = my_obj->stream_info->user_buf_info.frame_buf_cnt;
     struct msm_camera_user_buf_cont_t *cont_buf = NULL;
 
     if (buf->buf_type == CAM_STREAM_BUF_TYPE_USERPTR) {
         my_obj->buf_status[buf->buf_idx].buf_refcnt--;
         if (0 == my_obj->buf_status[buf->buf_idx].buf_refcnt) {
+            if (my_obj->buf[buf->buf_idx].user_buf.buf_idx[0] < 0) {
+                /* planes already went back one by one */
+                my_obj->buf[buf->buf_idx].user_buf.bufs_used = batch_cnt;
+                my_obj->buf[buf->buf_idx].user_buf.buf_in_use = 0;
+                return rc;
+            }
             cont_buf = (struct msm_camera_user_buf_cont_t *)my_obj->buf[buf->buf_idx].buffer;
             cont_buf->buf_cnt = my_obj->buf[buf->buf_idx].user_buf.bufs_used;
             for (i = 0; i < (int32_t)cont_buf->buf_cnt; i++) {
@@ -1085,43 +1103,96 @@ int32_t mm_stream_write_user_buf(mm_stream_t * my_obj,
     }
 
     //Insert Buffer to Batch structure.
-    my_obj->buf[index].user_buf.buf_idx[count] = buf->buf_idx;
+    my_obj->buf[index].user_buf.buf_idx[my_obj->cur_bufs_staged] =
+            (int32_t)buf->buf_idx;
     my_obj->cur_bufs_staged++;
 
-    CDBG("%s index = %d filled = %d used = %d", __func__,
-            index,
-            my_obj->cur_bufs_staged,
-            my_obj->buf[index].user_buf.bufs_used);
-
-    if (my_obj->cur_bufs_staged
-            == my_obj->buf[index].user_buf.bufs_used){
-        my_obj->buf_status[index].buf_refcnt--;
-        if (0 == my_obj->buf_status[index].buf_refcnt) {
-            cont_buf = (struct msm_camera_user_buf_cont_t *)my_obj->buf[index].buffer;
-            cont_buf->buf_cnt = my_obj->buf[index].user_buf.bufs_used;
-            for (i = 0; i < (int32_t)cont_buf->buf_cnt; i++) {
-                cont_buf->buf_idx[i] = my_obj->buf[index].user_buf.buf_idx[i];
-                my_obj->buf[index].user_buf.buf_idx[i] = -1;
-            }
-            rc = mm_stream_qbuf(my_obj, &my_obj->buf[index]);
-            if(rc < 0) {
-                CDBG_ERROR("%s: mm_camera_stream_qbuf(idx=%d) err=%d\n",
-                           __func__, index, rc);
-            } else {
-                my_obj->buf_status[index].in_kernel = 1;
-                my_obj->buf[index].user_buf.buf_in_use = 1;
-                my_obj->cur_bufs_staged = 0;
-                my_obj->cur_buf_idx = -1;
-            }
-        }else{
-            CDBG("<DEBUG> : ref count pending count :%d idx = %d",
-                 my_obj->buf_status[index].buf_refcnt, index);
-        }
+    CDBG("%s index = %d filled = %d batch = %d", __func__,
+            index, my_obj->cur_bufs_staged, batch_cnt);
+
+    if (my_obj->cur_bufs_staged == batch_cnt) {
+        rc = mm_stream_queue_user_buf(my_obj, index);
+    }
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_stream_queue_user_buf
+ *
+ * DESCRIPTION: queue the container being filled to the kernel with the
+ *              frames staged so far, which may be less than a full batch.
+ *              A free container holds no reference, so it goes right away.
+ *              Note that buf_lock is held when this function is called.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *   @index        : index of the container being filled
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_stream_queue_user_buf(mm_stream_t * my_obj, int32_t index)
+{
+    int32_t rc = 0, i;
+    struct msm_camera_user_buf_cont_t *cont_buf = NULL;
+
+    cont_buf = (struct msm_camera_user_buf_cont_t *)my_obj->buf[index].buffer;
+    cont_buf->buf_cnt = my_obj->cur_bufs_staged;
+    for (i = 0; i < (int32_t)cont_buf->buf_cnt; i++) {
+        cont_buf->buf_idx[i] = my_obj->buf[index].user_buf.buf_idx[i];
+        my_obj->buf[index].user_buf.buf_idx[i] = -1;
+    }
+    my_obj->buf[index].user_buf.bufs_used = (uint8_t)cont_buf->buf_cnt;
+    rc = mm_stream_qbuf(my_obj, &my_obj->buf[index]);
+    if(rc < 0) {
+        CDBG_ERROR("%s: mm_camera_stream_qbuf(idx=%d) err=%d\n",
+                   __func__, index, rc);
+    } else {
+        my_obj->buf_status[index].in_kernel = 1;
+        my_obj->buf[index].user_buf.buf_in_use = 1;
     }
+    my_obj->cur_bufs_staged = 0;
+    my_obj->cur_buf_idx = -1;
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_stream_flush_user_buf
+ *
+ * DESCRIPTION: queue a partially filled container of a batch mode stream
+ *              instead of waiting for the rest of its batch, so that the
+ *              frames staged in it reach the kernel.
+ *
+ * PARAMETERS :
+ *   @my_obj       : stream object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success, nothing was staged
+ *              -1 -- failure
+ *==========================================================================*/
+int32_t mm_stream_flush_user_buf(mm_stream_t * my_obj)
+{
+    int32_t rc = 0;
+    CDBG("%s: E, my_handle = 0x%x, fd = %d, state = %d",
+            __func__, my_obj->my_hdl, my_obj->fd, my_obj->state);
+
+    pthread_mutex_lock(&my_obj->buf_lock);
+    if ((my_obj->stream_info->streaming_mode == CAM_STREAMING_MODE_BATCH) &&
+            (my_obj->cur_bufs_staged > 0) &&
+            (my_obj->cur_buf_idx >= 0) &&
+            (my_obj->cur_buf_idx < my_obj->buf_num)) {
+        CDBG("%s: queue index = %d with %d of %d frames", __func__,
+                my_obj->cur_buf_idx, my_obj->cur_bufs_staged,
+                my_obj->stream_info->user_buf_info.frame_buf_cnt);
+        rc = mm_stream_queue_user_buf(my_obj, my_obj->cur_buf_idx);
+    }
+    pthread_mutex_unlock(&my_obj->buf_lock);
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : mm_stream_read_user_buf
  *
@@ -1237,7 +1308,7 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
     vb.m.planes = &planes[0];
     vb.length = num_planes;
 
-    rc = ioctl(my_obj->fd, VIDIOC_DQBUF, &vb);
+    rc = my_obj->ch_obj->cam_obj->backend->ioctl(my_obj->fd, VIDIOC_DQBUF, &vb);
     if (0 > rc) {
         CDBG_ERROR("%s: VIDIOC_DQBUF ioctl call failed on stream type %d (rc=%d): %s",
             __func__, my_obj->stream_info->stream_type, rc, strerror(errno));
@@ -1276,6 +1347,7 @@ int32_t mm_stream_read_msm_frame(mm_stream_t * my_obj,
             mm_stream_read_user_buf(my_obj, buf_info);
         }
         pthread_mutex_unlock(&my_obj->buf_lock);
+        mm_camera_trace_frame(MM_CAMERA_TRACE_DQBUF, buf_info->buf);
 
         if ( NULL != my_obj->mem_vtbl.clean_invalidate_buf ) {
             rc = my_obj->mem_vtbl.clean_invalidate_buf(idx,
@@ -1315,7 +1387,7 @@ int32_t mm_stream_set_parm(mm_stream_t *my_obj,
     int32_t rc = -1;
     int32_t value = 0;
     if (in_value != NULL) {
-        rc = mm_camera_util_s_ctrl(my_obj->fd, CAM_PRIV_STREAM_PARM, &value);
+        rc = mm_camera_util_s_ctrl(my_obj->ch_obj->cam_obj, my_obj->fd, CAM_PRIV_STREAM_PARM, &value);
     }
     return rc;
 }
@@ -1342,7 +1414,7 @@ int32_t mm_stream_get_parm(mm_stream_t *my_obj,
     int32_t rc = -1;
     int32_t value = 0;
     if (in_value != NULL) {
-        rc = mm_camera_util_g_ctrl(my_obj->fd, CAM_PRIV_STREAM_PARM, &value);
+        rc = mm_camera_util_g_ctrl(my_obj->ch_obj->cam_obj, my_obj->fd, CAM_PRIV_STREAM_PARM, &value);
     }
     return rc;
 }
@@ -1369,7 +1441,7 @@ int32_t mm_stream_do_action(mm_stream_t *my_obj,
     int32_t rc = -1;
     int32_t value = 0;
     if (in_value != NULL) {
-        rc = mm_camera_util_s_ctrl(my_obj->fd, CAM_PRIV_STREAM_PARM, &value);
+        rc = mm_camera_util_s_ctrl(my_obj->ch_obj->cam_obj, my_obj->fd, CAM_PRIV_STREAM_PARM, &value);
     }
     return rc;
 }
@@ -1399,7 +1471,7 @@ int32_t mm_stream_set_ext_mode(mm_stream_t * my_obj)
     memset(&s_parm, 0, sizeof(s_parm));
     s_parm.type =  V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
 
-    rc = ioctl(my_obj->fd, VIDIOC_S_PARM, &s_parm);
+    rc = my_obj->ch_obj->cam_obj->backend->ioctl(my_obj->fd, VIDIOC_S_PARM, &s_parm);
     CDBG("%s:stream fd=%d, rc=%d, extended_mode=%d\n",
          __func__, my_obj->fd, rc, s_parm.parm.capture.extendedmode);
     if (rc == 0) {
@@ -1492,7 +1564,7 @@ int32_t mm_stream_qbuf(mm_stream_t *my_obj, mm_camera_buf_def_t *buf)
         }
     }
 
-    rc = ioctl(my_obj->fd, VIDIOC_QBUF, &buffer);
+    rc = my_obj->ch_obj->cam_obj->backend->ioctl(my_obj->fd, VIDIOC_QBUF, &buffer);
     if (0 > rc) {
         CDBG_ERROR("%s: VIDIOC_QBUF ioctl call failed on stream type %d (rc=%d): %s",
             __func__, my_obj->stream_info->stream_type, rc, strerror(errno));
@@ -1549,7 +1621,7 @@ int32_t mm_stream_request_buf(mm_stream_t * my_obj)
     bufreq.count = buf_num;
     bufreq.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     bufreq.memory = V4L2_MEMORY_USERPTR;
-    rc = ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
+    rc = my_obj->ch_obj->cam_obj->backend->ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
     if (rc < 0) {
       CDBG_ERROR("%s: fd=%d, ioctl VIDIOC_REQBUFS failed: rc=%d\n",
            __func__, my_obj->fd, rc);
@@ -1932,7 +2004,7 @@ int32_t mm_stream_unreg_buf(mm_stream_t * my_obj)
     bufreq.count = 0;
     bufreq.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
     bufreq.memory = V4L2_MEMORY_USERPTR;
-    rc = ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
+    rc = my_obj->ch_obj->cam_obj->backend->ioctl(my_obj->fd, VIDIOC_REQBUFS, &bufreq);
     if (rc < 0) {
         CDBG_ERROR("%s: fd=%d, VIDIOC_REQBUFS failed, rc=%d\n",
               __func__, my_obj->fd, rc);
@@ -3379,7 +3451,7 @@ int32_t mm_stream_sync_info(mm_stream_t *my_obj)
     rc = mm_stream_calc_offset(my_obj);
 
     if (rc == 0) {
-        rc = mm_camera_util_s_ctrl(my_obj->fd,
+        rc = mm_camera_util_s_ctrl(my_obj->ch_obj->cam_obj, my_obj->fd,
                                    CAM_PRIV_STREAM_INFO_SYNC,
                                    &value);
     }
@@ -3439,7 +3511,7 @@ int32_t mm_stream_set_fmt(mm_stream_t *my_obj)
     }
 
     memcpy(fmt.fmt.raw_data, &msm_fmt, sizeof(msm_fmt));
-    rc = ioctl(my_obj->fd, VIDIOC_S_FMT, &fmt);
+    rc = my_obj->ch_obj->cam_obj->backend->ioctl(my_obj->fd, VIDIOC_S_FMT, &fmt);
     return rc;
 }
 
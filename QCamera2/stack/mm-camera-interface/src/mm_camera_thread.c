@@ -35,346 +35,364 @@
 #include <sys/prctl.h>
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <stdlib.h>
+#include <cutils/properties.h>
 #include <cam_semaphore.h>
 
 #include "mm_camera_dbg.h"
 #include "mm_camera_interface.h"
 #include "mm_camera.h"
 
-typedef enum {
-    /* poll entries updated */
-    MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED,
-    /* poll entries updated asynchronous */
-    MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC,
-    /* commit updates */
-    MM_CAMERA_PIPE_CMD_COMMIT,
-    /* exit */
-    MM_CAMERA_PIPE_CMD_EXIT,
-    /* max count */
-    MM_CAMERA_PIPE_CMD_MAX
-} mm_camera_pipe_cmd_type_t;
-
 typedef enum {
     MM_CAMERA_POLL_TASK_STATE_STOPPED,
     MM_CAMERA_POLL_TASK_STATE_POLL,     /* polling pid in polling state. */
     MM_CAMERA_POLL_TASK_STATE_MAX
 } mm_camera_poll_task_state_type_t;
 
-typedef struct {
-    uint32_t cmd;
-    mm_camera_event_t event;
-} mm_camera_sig_evt_t;
-
+/* epoll event tag of the engine exit eventfd */
+#define MM_CAMERA_POLL_EXIT_TAG  UINT64_MAX
+/* max num of epoll events fetched by a worker per wakeup */
+#define MM_CAMERA_POLL_MAX_EVENTS \
+    (MM_CAMERA_POLL_CLIENT_MAX * MAX_STREAM_NUM_IN_BUNDLE)
+/* default num of poll engine worker threads */
+#define MM_CAMERA_POLL_WORKER_DEFAULT 2
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig_async
+ * FUNCTION   : mm_camera_poll_tag
  *
- * DESCRIPTION: Asynchoronous call to send a command through pipe.
+ * DESCRIPTION: build the epoll event tag of a poll entry. The tag carries
+ *              the entry generation so that events fetched before the fd
+ *              got removed (or replaced) are dropped by the workers.
  *
  * PARAMETERS :
- *   @poll_cb      : ptr to poll thread object
- *   @cmd          : command to be sent
+ *   @poll_cb : ptr to poll client object
+ *   @idx     : poll entry index
  *
- * RETURN     : int32_t type of status
- *              0  -- success
- *              -1 -- failure
+ * RETURN     : epoll event tag
  *==========================================================================*/
-static int32_t mm_camera_poll_sig_async(mm_camera_poll_thread_t *poll_cb,
-                                  uint32_t cmd)
+static uint64_t mm_camera_poll_tag(mm_camera_poll_thread_t *poll_cb,
+                                   uint8_t idx)
 {
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
-
-    CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
-    pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
-
-    /* send cmd to worker */
-    ssize_t len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if (len < 1) {
-        CDBG_ERROR("%s: len = %lld, errno = %d", __func__,
-                (long long int)len, errno);
-        /* Avoid waiting for the signal */
-        pthread_mutex_unlock(&poll_cb->mutex);
-        return 0;
-    }
-    CDBG("%s: begin IN mutex write done, len = %lld", __func__,
-            (long long int)len);
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: X", __func__);
-    return 0;
+    return ((uint64_t)poll_cb->poll_entries[idx].gen << 32) |
+           ((uint64_t)poll_cb->client_idx << 8) | idx;
 }
 
-
-
-
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
+ * FUNCTION   : mm_camera_poll_arm
  *
- * DESCRIPTION: synchorinzed call to send a command through pipe.
+ * DESCRIPTION: add a poll entry fd to the engine epoll set, or re-arm it.
+ *              Entries are one-shot so that a fd is only ever served by a
+ *              single worker, which keeps per stream buffers in order.
+ *              Caller holds engine mutex.
  *
  * PARAMETERS :
- *   @poll_cb      : ptr to poll thread object
- *   @cmd          : command to be sent
+ *   @poll_cb : ptr to poll client object
+ *   @idx     : poll entry index
+ *   @op      : EPOLL_CTL_ADD or EPOLL_CTL_MOD
  *
  * RETURN     : int32_t type of status
  *              0  -- success
  *              -1 -- failure
  *==========================================================================*/
-static int32_t mm_camera_poll_sig(mm_camera_poll_thread_t *poll_cb,
-                                  uint32_t cmd)
+static int32_t mm_camera_poll_arm(mm_camera_poll_thread_t *poll_cb,
+                                  uint8_t idx, int op)
 {
-    /* send through pipe */
-    /* get the mutex */
-    mm_camera_sig_evt_t cmd_evt;
-
-    CDBG("%s: E cmd = %d", __func__,cmd);
-    memset(&cmd_evt, 0, sizeof(cmd_evt));
-    cmd_evt.cmd = cmd;
-    pthread_mutex_lock(&poll_cb->mutex);
-    /* reset the statue to false */
-    poll_cb->status = FALSE;
-    /* send cmd to worker */
-
-    ssize_t len = write(poll_cb->pfds[1], &cmd_evt, sizeof(cmd_evt));
-    if(len < 1) {
-        CDBG_ERROR("%s: len = %lld, errno = %d", __func__,
-                (long long int)len, errno);
-        /* Avoid waiting for the signal */
-        pthread_mutex_unlock(&poll_cb->mutex);
-        return 0;
+    struct epoll_event ev;
+    int rc;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDNORM | EPOLLPRI | EPOLLONESHOT;
+    ev.data.u64 = mm_camera_poll_tag(poll_cb, idx);
+    rc = epoll_ctl(poll_cb->engine->epoll_fd, op,
+                   poll_cb->poll_entries[idx].fd, &ev);
+    if ((rc < 0) && (EPOLL_CTL_ADD == op) && (EEXIST == errno)) {
+        rc = epoll_ctl(poll_cb->engine->epoll_fd, EPOLL_CTL_MOD,
+                       poll_cb->poll_entries[idx].fd, &ev);
     }
-    CDBG("%s: begin IN mutex write done, len = %lld", __func__,
-            (long long int)len);
-    /* wait till worker task gives positive signal */
-    if (FALSE == poll_cb->status) {
-        CDBG("%s: wait", __func__);
-        pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
+    if (rc < 0) {
+        CDBG_ERROR("%s: epoll_ctl op %d fd %d failed (%s)", __func__, op,
+                   poll_cb->poll_entries[idx].fd, strerror(errno));
+        return -1;
     }
-    /* done */
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: X", __func__);
     return 0;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_sig
+ * FUNCTION   : mm_camera_poll_wait_idle
  *
- * DESCRIPTION: signal the status of done
+ * DESCRIPTION: wait until no worker other than the caller is running the
+ *              notify cb of a poll entry. Caller holds engine mutex.
  *
  * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
+ *   @poll_cb : ptr to poll client object
+ *   @idx     : poll entry index
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_sig_done(mm_camera_poll_thread_t *poll_cb)
+static void mm_camera_poll_wait_idle(mm_camera_poll_thread_t *poll_cb,
+                                     uint8_t idx)
 {
-    pthread_mutex_lock(&poll_cb->mutex);
-    poll_cb->status = TRUE;
-    pthread_cond_signal(&poll_cb->cond_v);
-    CDBG("%s: done, in mutex", __func__);
-    pthread_mutex_unlock(&poll_cb->mutex);
-}
+    mm_camera_poll_entry_t *entry = &poll_cb->poll_entries[idx];
 
-/*===========================================================================
- * FUNCTION   : mm_camera_poll_set_state
- *
- * DESCRIPTION: set a polling state
- *
- * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
- *   @state   : polling state (stopped/polling)
- *
- * RETURN     : none
- *==========================================================================*/
-static void mm_camera_poll_set_state(mm_camera_poll_thread_t *poll_cb,
-                                     mm_camera_poll_task_state_type_t state)
-{
-    poll_cb->state = state;
+    while (entry->busy && !pthread_equal(entry->worker, pthread_self())) {
+        pthread_cond_wait(&poll_cb->engine->cond_v, &poll_cb->engine->mutex);
+    }
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_proc_pipe
+ * FUNCTION   : mm_camera_poll_dispatch
  *
- * DESCRIPTION: polling thread routine to process pipe
+ * DESCRIPTION: run the notify cb of the poll entry an epoll event belongs to
  *
  * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
+ *   @engine  : ptr to poll engine object
+ *   @ev      : epoll event fetched by the worker
  *
  * RETURN     : none
  *==========================================================================*/
-static void mm_camera_poll_proc_pipe(mm_camera_poll_thread_t *poll_cb)
+static void mm_camera_poll_dispatch(mm_camera_poll_engine_t *engine,
+                                    struct epoll_event *ev)
 {
-    ssize_t read_len;
-    int i;
-    mm_camera_sig_evt_t cmd_evt;
-    read_len = read(poll_cb->pfds[0], &cmd_evt, sizeof(cmd_evt));
-    CDBG("%s: read_fd = %d, read_len = %d, expect_len = %d cmd = %d",
-         __func__, poll_cb->pfds[0], (int)read_len, (int)sizeof(cmd_evt), cmd_evt.cmd);
-    switch (cmd_evt.cmd) {
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED:
-    case MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC:
-        /* we always have index 0 for pipe read */
-        poll_cb->num_fds = 0;
-        poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->pfds[0];
-        poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-        poll_cb->num_fds++;
-
-        if (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type &&
-                poll_cb->num_fds < MAX_STREAM_NUM_IN_BUNDLE) {
-            if (poll_cb->poll_entries[0].fd >= 0) {
-                /* fd is valid, we update poll_fds */
-                poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[0].fd;
-                poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                poll_cb->num_fds++;
-            }
-        } else if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type &&
-                poll_cb->num_fds <= MAX_STREAM_NUM_IN_BUNDLE) {
-            for(i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
-                if(poll_cb->poll_entries[i].fd >= 0) {
-                    /* fd is valid, we update poll_fds to this fd */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = poll_cb->poll_entries[i].fd;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = POLLIN|POLLRDNORM|POLLPRI;
-                    poll_cb->num_fds++;
-                } else {
-                    /* fd is invalid, we set the entry to -1 to prevent polling.
-                     * According to spec, polling will not poll on entry with fd=-1.
-                     * If this is not the case, we need to skip these invalid fds
-                     * when updating this array.
-                     * We still keep fd=-1 in this array because this makes easier to
-                     * map cb associated with this fd once incoming data avail by directly
-                     * using the index-1(0 is reserved for pipe read, so need to reduce index by 1) */
-                    poll_cb->poll_fds[poll_cb->num_fds].fd = -1;
-                    poll_cb->poll_fds[poll_cb->num_fds].events = 0;
-                    poll_cb->num_fds++;
-                }
-            }
+    uint32_t gen = (uint32_t)(ev->data.u64 >> 32);
+    uint8_t client_idx = (uint8_t)((ev->data.u64 >> 8) & 0xFF);
+    uint8_t idx = (uint8_t)(ev->data.u64 & 0xFF);
+    mm_camera_poll_thread_t *poll_cb = NULL;
+    mm_camera_poll_entry_t *entry = NULL;
+    mm_camera_poll_notify_t notify_cb = NULL;
+    void *user_data = NULL;
+    uint8_t notify = 0;
+
+    if ((MM_CAMERA_POLL_CLIENT_MAX <= client_idx) ||
+            (MAX_STREAM_NUM_IN_BUNDLE <= idx)) {
+        return;
+    }
+
+    pthread_mutex_lock(&engine->mutex);
+    poll_cb = engine->clients[client_idx];
+    if (NULL == poll_cb) {
+        pthread_mutex_unlock(&engine->mutex);
+        return;
+    }
+    entry = &poll_cb->poll_entries[idx];
+    if ((entry->fd < 0) || (entry->gen != gen)) {
+        /* fd removed after the event was fetched */
+        pthread_mutex_unlock(&engine->mutex);
+        return;
+    }
+    if (entry->busy) {
+        /* fd replaced and fired again while its old cb is still running,
+         * let that worker run it so the stream is served in order */
+        entry->pending = 1;
+        pthread_mutex_unlock(&engine->mutex);
+        return;
+    }
+
+    /* Checking for ctrl events. Kernel signals events with
+     * POLLPRI, loopback backend signals them with POLLIN */
+    if (MM_CAMERA_POLL_TYPE_EVT == poll_cb->poll_type) {
+        notify = (ev->events & (EPOLLPRI | EPOLLIN)) ? 1 : 0;
+    } else {
+        notify = ((ev->events & EPOLLIN) && (ev->events & EPOLLRDNORM)) ? 1 : 0;
+    }
+
+    entry->busy = 1;
+    entry->worker = pthread_self();
+    do {
+        entry->pending = 0;
+        notify_cb = entry->notify_cb;
+        user_data = entry->user_data;
+        pthread_mutex_unlock(&engine->mutex);
+
+        if (notify && (NULL != notify_cb)) {
+            CDBG("%s: notify poll type %d\n", __func__, poll_cb->poll_type);
+            notify_cb(user_data);
         }
-        if (cmd_evt.cmd != MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC)
-            mm_camera_poll_sig_done(poll_cb);
-        break;
-
-    case MM_CAMERA_PIPE_CMD_COMMIT:
-        mm_camera_poll_sig_done(poll_cb);
-        break;
-    case MM_CAMERA_PIPE_CMD_EXIT:
-    default:
-        mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_STOPPED);
-        mm_camera_poll_sig_done(poll_cb);
-        break;
+
+        pthread_mutex_lock(&engine->mutex);
+        notify = 1;
+    } while (entry->pending && (entry->fd >= 0));
+    entry->busy = 0;
+    entry->pending = 0;
+
+    if (entry->fd >= 0) {
+        mm_camera_poll_arm(poll_cb, idx, EPOLL_CTL_MOD);
     }
+    pthread_cond_broadcast(&engine->cond_v);
+    pthread_mutex_unlock(&engine->mutex);
 }
 
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_fn
  *
- * DESCRIPTION: polling thread routine
+ * DESCRIPTION: poll engine worker thread routine
  *
  * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
+ *   @data    : ptr to poll engine object
  *
  * RETURN     : none
  *==========================================================================*/
-static void *mm_camera_poll_fn(mm_camera_poll_thread_t *poll_cb)
+static void *mm_camera_poll_fn(void *data)
 {
+    mm_camera_poll_engine_t *engine = (mm_camera_poll_engine_t *)data;
+    struct epoll_event events[MM_CAMERA_POLL_MAX_EVENTS];
     int rc = 0, i;
 
-    if (NULL == poll_cb) {
-        CDBG_ERROR("%s: poll_cb is NULL!\n", __func__);
-        return NULL;
-    }
-    CDBG("%s: poll type = %d, num_fd = %d poll_cb = %p\n",
-         __func__, poll_cb->poll_type, poll_cb->num_fds,poll_cb);
+    prctl(PR_SET_NAME, (unsigned long)"mm_cam_poll_th", 0, 0, 0);
     do {
-         for(i = 0; i < poll_cb->num_fds; i++) {
-            poll_cb->poll_fds[i].events = POLLIN|POLLRDNORM|POLLPRI;
-         }
-
-         rc = poll(poll_cb->poll_fds, poll_cb->num_fds, poll_cb->timeoutms);
-         if(rc > 0) {
-            if ((poll_cb->poll_fds[0].revents & POLLIN) &&
-                (poll_cb->poll_fds[0].revents & POLLRDNORM)) {
-                /* if we have data on pipe, we only process pipe in this iteration */
-                CDBG("%s: cmd received on pipe\n", __func__);
-                mm_camera_poll_proc_pipe(poll_cb);
-            } else {
-                for(i=1; i<poll_cb->num_fds; i++) {
-                    /* Checking for ctrl events */
-                    if ((poll_cb->poll_type == MM_CAMERA_POLL_TYPE_EVT) &&
-                        (poll_cb->poll_fds[i].revents & POLLPRI)) {
-                        CDBG("%s: mm_camera_evt_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-
-                    if ((MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) &&
-                        (poll_cb->poll_fds[i].revents & POLLIN) &&
-                        (poll_cb->poll_fds[i].revents & POLLRDNORM)) {
-                        CDBG("%s: mm_stream_data_notify\n", __func__);
-                        if (NULL != poll_cb->poll_entries[i-1].notify_cb) {
-                            poll_cb->poll_entries[i-1].notify_cb(poll_cb->poll_entries[i-1].user_data);
-                        }
-                    }
-                }
+        rc = epoll_wait(engine->epoll_fd, events, MM_CAMERA_POLL_MAX_EVENTS, -1);
+        if (rc < 0) {
+            if (EINTR != errno) {
+                CDBG_ERROR("%s: epoll_wait failed (%s)", __func__, strerror(errno));
+                /* in error case sleep 10 us and then continue. hard coded here */
+                usleep(10);
             }
-        } else {
-            /* in error case sleep 10 us and then continue. hard coded here */
-            usleep(10);
             continue;
         }
-    } while ((poll_cb != NULL) && (poll_cb->state == MM_CAMERA_POLL_TASK_STATE_POLL));
+        for (i = 0; i < rc; i++) {
+            if (MM_CAMERA_POLL_EXIT_TAG == events[i].data.u64) {
+                CDBG("%s: exit received\n", __func__);
+                return NULL;
+            }
+            mm_camera_poll_dispatch(engine, &events[i]);
+        }
+    } while (1);
     return NULL;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_thread
+ * FUNCTION   : mm_camera_poll_engine_launch
  *
- * DESCRIPTION: polling thread entry function
+ * DESCRIPTION: create the epoll set of a camera object and launch its
+ *              worker threads. Number of workers is read from
+ *              persist.camera.mm.poll_workers.
  *
  * PARAMETERS :
- *   @data    : ptr to poll thread object
+ *   @engine  : ptr to poll engine object
  *
- * RETURN     : none
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
  *==========================================================================*/
-static void *mm_camera_poll_thread(void *data)
+int32_t mm_camera_poll_engine_launch(mm_camera_poll_engine_t *engine)
 {
-    prctl(PR_SET_NAME, (unsigned long)"mm_cam_poll_th", 0, 0, 0);
-    mm_camera_poll_thread_t *poll_cb = (mm_camera_poll_thread_t *)data;
+    char prop[PROPERTY_VALUE_MAX];
+    struct epoll_event ev;
+    int num_workers;
+    uint8_t i;
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.mm.poll_workers", prop, "2");
+    num_workers = atoi(prop);
+    if (num_workers <= 0) {
+        num_workers = MM_CAMERA_POLL_WORKER_DEFAULT;
+    } else if (num_workers > MM_CAMERA_POLL_WORKER_MAX) {
+        num_workers = MM_CAMERA_POLL_WORKER_MAX;
+    }
 
-    /* add pipe read fd into poll first */
-    poll_cb->poll_fds[poll_cb->num_fds++].fd = poll_cb->pfds[0];
+    memset(engine->clients, 0, sizeof(engine->clients));
+    engine->num_workers = 0;
+    engine->exit_fd = -1;
+    engine->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (engine->epoll_fd < 0) {
+        CDBG_ERROR("%s: epoll_create1 failed (%s)", __func__, strerror(errno));
+        return -1;
+    }
+    engine->exit_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (engine->exit_fd < 0) {
+        CDBG_ERROR("%s: eventfd failed (%s)", __func__, strerror(errno));
+        close(engine->epoll_fd);
+        engine->epoll_fd = -1;
+        return -1;
+    }
+    /* level triggered, so that every worker sees the exit */
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = MM_CAMERA_POLL_EXIT_TAG;
+    if (epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, engine->exit_fd, &ev) < 0) {
+        CDBG_ERROR("%s: add exit fd failed (%s)", __func__, strerror(errno));
+        close(engine->exit_fd);
+        close(engine->epoll_fd);
+        engine->exit_fd = -1;
+        engine->epoll_fd = -1;
+        return -1;
+    }
 
-    mm_camera_poll_sig_done(poll_cb);
-    mm_camera_poll_set_state(poll_cb, MM_CAMERA_POLL_TASK_STATE_POLL);
-    return mm_camera_poll_fn(poll_cb);
+    pthread_mutex_init(&engine->mutex, NULL);
+    pthread_cond_init(&engine->cond_v, NULL);
+
+    for (i = 0; i < num_workers; i++) {
+        if (pthread_create(&engine->pid[i], NULL, mm_camera_poll_fn,
+                (void *)engine) != 0) {
+            CDBG_ERROR("%s: cannot launch poll worker %d", __func__, i);
+            break;
+        }
+        if ('\0' == engine->threadName[0]) {
+            pthread_setname_np(engine->pid[i], "CAM_poll");
+        } else {
+            pthread_setname_np(engine->pid[i], engine->threadName);
+        }
+        engine->num_workers++;
+    }
+    if (0 == engine->num_workers) {
+        mm_camera_poll_engine_release(engine);
+        return -1;
+    }
+
+    CDBG("%s: epoll fd = %d, workers = %d", __func__,
+         engine->epoll_fd, engine->num_workers);
+    return 0;
 }
 
 /*===========================================================================
- * FUNCTION   : mm_camera_poll_thread
+ * FUNCTION   : mm_camera_poll_engine_release
  *
- * DESCRIPTION: notify the polling thread that entries for polling fd have
- *              been updated
+ * DESCRIPTION: stop the poll engine worker threads and close the epoll set.
+ *              All poll clients must have been released before.
  *
  * PARAMETERS :
- *   @poll_cb : ptr to poll thread object
+ *   @engine  : ptr to poll engine object
  *
- * RETURN     : none
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
  *==========================================================================*/
-int32_t mm_camera_poll_thread_notify_entries_updated(mm_camera_poll_thread_t * poll_cb)
+int32_t mm_camera_poll_engine_release(mm_camera_poll_engine_t *engine)
 {
-    /* send poll entries updated signal to poll thread */
-    return mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
+    uint64_t val = 1;
+    uint8_t i;
+
+    if (engine->epoll_fd < 0) {
+        CDBG_ERROR("%s: err, poll engine is not running.\n", __func__);
+        return 0;
+    }
+
+    /* wake up all workers */
+    if (write(engine->exit_fd, &val, sizeof(val)) != sizeof(val)) {
+        CDBG_ERROR("%s: exit signal failed (%s)", __func__, strerror(errno));
+    }
+    for (i = 0; i < engine->num_workers; i++) {
+        if (pthread_join(engine->pid[i], NULL) != 0) {
+            CDBG_ERROR("%s: pthread dead already\n", __func__);
+        }
+    }
+
+    close(engine->exit_fd);
+    close(engine->epoll_fd);
+    pthread_mutex_destroy(&engine->mutex);
+    pthread_cond_destroy(&engine->cond_v);
+    memset(engine, 0, sizeof(mm_camera_poll_engine_t));
+    engine->epoll_fd = -1;
+    engine->exit_fd = -1;
+    return 0;
 }
 
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_thread_commit_updates
  *
- * DESCRIPTION: sync with all previously pending async updates
+ * DESCRIPTION: sync with all previously pending async updates, i.e. wait
+ *              until the workers are done with every removed entry
  *
  * PARAMETERS :
  *   @poll_cb : ptr to poll thread object
@@ -385,13 +403,24 @@ int32_t mm_camera_poll_thread_notify_entries_updated(mm_camera_poll_thread_t * p
  *==========================================================================*/
 int32_t mm_camera_poll_thread_commit_updates(mm_camera_poll_thread_t * poll_cb)
 {
-    return mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_COMMIT);
+    uint8_t i;
+
+    if (NULL == poll_cb->engine) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&poll_cb->engine->mutex);
+    for (i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
+        mm_camera_poll_wait_idle(poll_cb, i);
+    }
+    pthread_mutex_unlock(&poll_cb->engine->mutex);
+    return 0;
 }
 
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_thread_add_poll_fd
  *
- * DESCRIPTION: add a new fd into polling thread
+ * DESCRIPTION: add a new fd into the poll engine
  *
  * PARAMETERS :
  *   @poll_cb   : ptr to poll thread object
@@ -413,6 +442,12 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
 {
     int32_t rc = -1;
     uint8_t idx = 0;
+    mm_camera_poll_entry_t *entry = NULL;
+
+    if (NULL == poll_cb->engine) {
+        CDBG_ERROR("%s: poll thread is not running", __func__);
+        return -1;
+    }
 
     if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
         /* get stream idx from handler if CH type */
@@ -423,16 +458,25 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
     }
 
     if (MAX_STREAM_NUM_IN_BUNDLE > idx) {
-        poll_cb->poll_entries[idx].fd = fd;
-        poll_cb->poll_entries[idx].handler = handler;
-        poll_cb->poll_entries[idx].notify_cb = notify_cb;
-        poll_cb->poll_entries[idx].user_data = userdata;
-        /* send poll entries updated signal to poll thread */
-        if (call_type == mm_camera_sync_call ) {
-            rc = mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
-        } else {
-            rc = mm_camera_poll_sig_async(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC );
+        pthread_mutex_lock(&poll_cb->engine->mutex);
+        entry = &poll_cb->poll_entries[idx];
+        if ((entry->fd >= 0) && (entry->fd != fd)) {
+            epoll_ctl(poll_cb->engine->epoll_fd, EPOLL_CTL_DEL, entry->fd, NULL);
         }
+        entry->fd = fd;
+        entry->handler = handler;
+        entry->notify_cb = notify_cb;
+        entry->user_data = userdata;
+        entry->gen++;
+        rc = mm_camera_poll_arm(poll_cb, idx, EPOLL_CTL_ADD);
+        if (rc < 0) {
+            entry->fd = -1;
+            entry->handler = 0;
+            entry->notify_cb = NULL;
+        } else if (call_type == mm_camera_sync_call) {
+            mm_camera_poll_wait_idle(poll_cb, idx);
+        }
+        pthread_mutex_unlock(&poll_cb->engine->mutex);
     } else {
         CDBG_ERROR("%s: invalid handler %d (%d)",
                    __func__, handler, idx);
@@ -443,7 +487,8 @@ int32_t mm_camera_poll_thread_add_poll_fd(mm_camera_poll_thread_t * poll_cb,
 /*===========================================================================
  * FUNCTION   : mm_camera_poll_thread_del_poll_fd
  *
- * DESCRIPTION: delete a fd from polling thread
+ * DESCRIPTION: delete a fd from the poll engine. A synchronous call also
+ *              waits for a running notify cb of the fd to return.
  *
  * PARAMETERS :
  *   @poll_cb   : ptr to poll thread object
@@ -460,6 +505,12 @@ int32_t mm_camera_poll_thread_del_poll_fd(mm_camera_poll_thread_t * poll_cb,
 {
     int32_t rc = -1;
     uint8_t idx = 0;
+    mm_camera_poll_entry_t *entry = NULL;
+
+    if (NULL == poll_cb->engine) {
+        CDBG_ERROR("%s: poll thread is not running", __func__);
+        return -1;
+    }
 
     if (MM_CAMERA_POLL_TYPE_DATA == poll_cb->poll_type) {
         /* get stream idx from handler if CH type */
@@ -469,109 +520,181 @@ int32_t mm_camera_poll_thread_del_poll_fd(mm_camera_poll_thread_t * poll_cb,
         idx = 0;
     }
 
-    if ((MAX_STREAM_NUM_IN_BUNDLE > idx) &&
-        (handler == poll_cb->poll_entries[idx].handler)) {
-        /* reset poll entry */
-        poll_cb->poll_entries[idx].fd = -1; /* set fd to invalid */
-        poll_cb->poll_entries[idx].handler = 0;
-        poll_cb->poll_entries[idx].notify_cb = NULL;
+    if (MAX_STREAM_NUM_IN_BUNDLE <= idx) {
+        CDBG_ERROR("%s: invalid handler %d (%d)",
+                   __func__, handler, idx);
+        return -1;
+    }
 
-        /* send poll entries updated signal to poll thread */
-        if (call_type == mm_camera_sync_call ) {
-            rc = mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED);
-        } else {
-            rc = mm_camera_poll_sig_async(poll_cb, MM_CAMERA_PIPE_CMD_POLL_ENTRIES_UPDATED_ASYNC );
+    pthread_mutex_lock(&poll_cb->engine->mutex);
+    entry = &poll_cb->poll_entries[idx];
+    if ((handler == entry->handler) && (entry->fd >= 0)) {
+        /* fd may be closed already, it is dropped from the set then */
+        epoll_ctl(poll_cb->engine->epoll_fd, EPOLL_CTL_DEL, entry->fd, NULL);
+        /* reset poll entry */
+        entry->fd = -1; /* set fd to invalid */
+        entry->handler = 0;
+        entry->notify_cb = NULL;
+        entry->gen++;
+        if (call_type == mm_camera_sync_call) {
+            mm_camera_poll_wait_idle(poll_cb, idx);
         }
+        rc = 0;
     } else {
         CDBG_ERROR("%s: invalid handler %d (%d)",
                    __func__, handler, idx);
-        return -1;
     }
+    pthread_mutex_unlock(&poll_cb->engine->mutex);
 
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_poll_thread_launch
+ *
+ * DESCRIPTION: attach a poll client to the camera poll engine
+ *
+ * PARAMETERS :
+ *   @poll_cb   : ptr to poll thread object
+ *   @poll_type : evt or data poll
+ *   @engine    : ptr to poll engine of the camera object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
 int32_t mm_camera_poll_thread_launch(mm_camera_poll_thread_t * poll_cb,
-                                     mm_camera_poll_thread_type_t poll_type)
+                                     mm_camera_poll_thread_type_t poll_type,
+                                     mm_camera_poll_engine_t *engine)
 {
-    int32_t rc = 0;
+    int32_t rc = -1;
     size_t i = 0, cnt = 0;
-    poll_cb->poll_type = poll_type;
 
-    //Initialize poll_fds
-    cnt = sizeof(poll_cb->poll_fds) / sizeof(poll_cb->poll_fds[0]);
-    for (i = 0; i < cnt; i++) {
-        poll_cb->poll_fds[i].fd = -1;
-    }
+    poll_cb->poll_type = poll_type;
     //Initialize poll_entries
     cnt = sizeof(poll_cb->poll_entries) / sizeof(poll_cb->poll_entries[0]);
     for (i = 0; i < cnt; i++) {
+        memset(&poll_cb->poll_entries[i], 0, sizeof(poll_cb->poll_entries[i]));
         poll_cb->poll_entries[i].fd = -1;
     }
-    //Initialize pipe fds
-    poll_cb->pfds[0] = -1;
-    poll_cb->pfds[1] = -1;
-    rc = pipe(poll_cb->pfds);
-    if(rc < 0) {
-        CDBG_ERROR("%s: pipe open rc=%d\n", __func__, rc);
+
+    if ((NULL == engine) || (engine->epoll_fd < 0)) {
+        CDBG_ERROR("%s: poll engine is not running", __func__);
         return -1;
     }
 
-    poll_cb->timeoutms = -1;  /* Infinite seconds */
-
-    CDBG("%s: poll_type = %d, read fd = %d, write fd = %d timeout = %d",
-        __func__, poll_cb->poll_type,
-        poll_cb->pfds[0], poll_cb->pfds[1],poll_cb->timeoutms);
-
-    pthread_mutex_init(&poll_cb->mutex, NULL);
-    pthread_cond_init(&poll_cb->cond_v, NULL);
+    pthread_mutex_lock(&engine->mutex);
+    for (i = 0; i < MM_CAMERA_POLL_CLIENT_MAX; i++) {
+        if (NULL == engine->clients[i]) {
+            engine->clients[i] = poll_cb;
+            poll_cb->client_idx = (uint8_t)i;
+            poll_cb->engine = engine;
+            poll_cb->state = MM_CAMERA_POLL_TASK_STATE_POLL;
+            rc = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&engine->mutex);
 
-    /* launch the thread */
-    pthread_mutex_lock(&poll_cb->mutex);
-    poll_cb->status = 0;
-    pthread_create(&poll_cb->pid, NULL, mm_camera_poll_thread, (void *)poll_cb);
-    if(!poll_cb->status) {
-        pthread_cond_wait(&poll_cb->cond_v, &poll_cb->mutex);
-    }
-    if (!poll_cb->threadName) {
-        pthread_setname_np(poll_cb->pid, "CAM_poll");
-    } else {
-        pthread_setname_np(poll_cb->pid, poll_cb->threadName);
+    if (rc < 0) {
+        CDBG_ERROR("%s: no free poll client", __func__);
     }
-    pthread_mutex_unlock(&poll_cb->mutex);
-    CDBG("%s: End",__func__);
+    CDBG("%s: poll_type = %d, client = %d", __func__,
+         poll_cb->poll_type, poll_cb->client_idx);
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_camera_poll_thread_release
+ *
+ * DESCRIPTION: detach a poll client from the camera poll engine, removing
+ *              all of its fds
+ *
+ * PARAMETERS :
+ *   @poll_cb   : ptr to poll thread object
+ *
+ * RETURN     : int32_t type of status
+ *              0  -- success
+ *              -1 -- failure
+ *==========================================================================*/
 int32_t mm_camera_poll_thread_release(mm_camera_poll_thread_t *poll_cb)
 {
     int32_t rc = 0;
-    if(MM_CAMERA_POLL_TASK_STATE_STOPPED == poll_cb->state) {
+    mm_camera_poll_engine_t *engine = poll_cb->engine;
+    uint8_t i;
+
+    if ((MM_CAMERA_POLL_TASK_STATE_STOPPED == poll_cb->state) ||
+            (NULL == engine)) {
         CDBG_ERROR("%s: err, poll thread is not running.\n", __func__);
         return rc;
     }
 
-    /* send exit signal to poll thread */
-    mm_camera_poll_sig(poll_cb, MM_CAMERA_PIPE_CMD_EXIT);
-    /* wait until poll thread exits */
-    if (pthread_join(poll_cb->pid, NULL) != 0) {
-        CDBG_ERROR("%s: pthread dead already\n", __func__);
+    pthread_mutex_lock(&engine->mutex);
+    for (i = 0; i < MAX_STREAM_NUM_IN_BUNDLE; i++) {
+        if (poll_cb->poll_entries[i].fd >= 0) {
+            epoll_ctl(engine->epoll_fd, EPOLL_CTL_DEL,
+                      poll_cb->poll_entries[i].fd, NULL);
+            poll_cb->poll_entries[i].fd = -1;
+            poll_cb->poll_entries[i].gen++;
+        }
+        mm_camera_poll_wait_idle(poll_cb, i);
     }
+    engine->clients[poll_cb->client_idx] = NULL;
+    pthread_mutex_unlock(&engine->mutex);
+
+    memset(poll_cb, 0, sizeof(mm_camera_poll_thread_t));
+    return rc;
+}
 
-    /* close pipe */
-    if(poll_cb->pfds[0] >= 0) {
-        close(poll_cb->pfds[0]);
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_alloc_cmd
+ *
+ * DESCRIPTION: get a zeroed cmd payload to be queued to a cmd thread. Taken
+ *              from the thread's preallocated pool, or from the heap once the
+ *              pool is used up. The cmd thread returns it after processing.
+ *
+ * PARAMETERS :
+ *   @cmd_thread : cmd thread the payload will be queued to
+ *
+ * RETURN     : ptr to cmd payload, NULL if out of memory
+ *==========================================================================*/
+mm_camera_cmdcb_t *mm_camera_cmd_thread_alloc_cmd(
+        mm_camera_cmd_thread_t *cmd_thread)
+{
+    mm_camera_cmdcb_t *node = NULL;
+
+    if (NULL != cmd_thread->cmd_pool) {
+        node = (mm_camera_cmdcb_t *)cam_ring_queue_deq(&cmd_thread->cmd_free);
+    }
+    if (NULL == node) {
+        node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
     }
-    if(poll_cb->pfds[1] >= 0) {
-        close(poll_cb->pfds[1]);
+    if (NULL != node) {
+        memset(node, 0, sizeof(mm_camera_cmdcb_t));
     }
+    return node;
+}
 
-    pthread_mutex_destroy(&poll_cb->mutex);
-    pthread_cond_destroy(&poll_cb->cond_v);
-    memset(poll_cb, 0, sizeof(mm_camera_poll_thread_t));
-    poll_cb->pfds[0] = -1;
-    poll_cb->pfds[1] = -1;
-    return rc;
+/*===========================================================================
+ * FUNCTION   : mm_camera_cmd_thread_free_cmd
+ *
+ * DESCRIPTION: return a cmd payload got from mm_camera_cmd_thread_alloc_cmd
+ *
+ * PARAMETERS :
+ *   @cmd_thread : cmd thread the payload was allocated for
+ *   @node       : cmd payload
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_cmd_thread_free_cmd(mm_camera_cmd_thread_t *cmd_thread,
+        mm_camera_cmdcb_t *node)
+{
+    if (NULL != cmd_thread->cmd_pool && node >= cmd_thread->cmd_pool &&
+            node < cmd_thread->cmd_pool + MM_CAMERA_CMD_POOL_SIZE) {
+        cam_ring_queue_enq(&cmd_thread->cmd_free, node);
+    } else {
+        free(node);
+    }
 }
 
 static void *mm_camera_cmd_thread(void *data)
@@ -593,7 +716,7 @@ static void *mm_camera_cmd_thread(void *data)
         } while (ret != 0);
 
         /* we got notified about new cmd avail in cmd queue */
-        node = (mm_camera_cmdcb_t*)cam_queue_deq(&cmd_thread->cmd_queue);
+        node = (mm_camera_cmdcb_t*)cam_ring_queue_deq(&cmd_thread->cmd_queue);
         while (node != NULL) {
             switch (node->cmd_type) {
             case MM_CAMERA_CMD_TYPE_EVT_CB:
@@ -614,8 +737,8 @@ static void *mm_camera_cmd_thread(void *data)
                 running = 0;
                 break;
             }
-            free(node);
-            node = (mm_camera_cmdcb_t*)cam_queue_deq(&cmd_thread->cmd_queue);
+            mm_camera_cmd_thread_free_cmd(cmd_thread, node);
+            node = (mm_camera_cmdcb_t*)cam_ring_queue_deq(&cmd_thread->cmd_queue);
         } /* (node != NULL) */
     } while (running);
     return NULL;
@@ -626,9 +749,31 @@ int32_t mm_camera_cmd_thread_launch(mm_camera_cmd_thread_t * cmd_thread,
                                     void* user_data)
 {
     int32_t rc = 0;
+    uint32_t i;
 
+    if (0 != cam_ring_queue_init(&cmd_thread->cmd_queue,
+            MM_CAMERA_CMD_QUEUE_SIZE)) {
+        CDBG_ERROR("%s: No memory for cmd queue", __func__);
+        return -1;
+    }
+
+    /* without a pool every cmd falls back to the heap */
+    cmd_thread->cmd_pool = (mm_camera_cmdcb_t *)
+            malloc(sizeof(mm_camera_cmdcb_t) * MM_CAMERA_CMD_POOL_SIZE);
+    if (NULL != cmd_thread->cmd_pool &&
+            0 != cam_ring_queue_init(&cmd_thread->cmd_free,
+                    MM_CAMERA_CMD_POOL_SIZE)) {
+        free(cmd_thread->cmd_pool);
+        cmd_thread->cmd_pool = NULL;
+    }
+    if (NULL == cmd_thread->cmd_pool) {
+        CDBG_ERROR("%s: No memory for cmd pool", __func__);
+    } else {
+        for (i = 0; i < MM_CAMERA_CMD_POOL_SIZE; i++) {
+            cam_ring_queue_enq(&cmd_thread->cmd_free, &cmd_thread->cmd_pool[i]);
+        }
+    }
     cam_sem_init(&cmd_thread->cmd_sem, 0);
-    cam_queue_init(&cmd_thread->cmd_queue);
     cmd_thread->cb = cb;
     cmd_thread->user_data = user_data;
 
@@ -658,16 +803,15 @@ int32_t mm_camera_cmd_thread_name(const char* name)
 int32_t mm_camera_cmd_thread_stop(mm_camera_cmd_thread_t * cmd_thread)
 {
     int32_t rc = 0;
-    mm_camera_cmdcb_t* node = (mm_camera_cmdcb_t *)malloc(sizeof(mm_camera_cmdcb_t));
+    mm_camera_cmdcb_t* node = mm_camera_cmd_thread_alloc_cmd(cmd_thread);
     if (NULL == node) {
         CDBG_ERROR("%s: No memory for mm_camera_cmdcb_t", __func__);
         return -1;
     }
 
-    memset(node, 0, sizeof(mm_camera_cmdcb_t));
     node->cmd_type = MM_CAMERA_CMD_TYPE_EXIT;
 
-    cam_queue_enq(&cmd_thread->cmd_queue, node);
+    cam_ring_queue_enq(&cmd_thread->cmd_queue, node);
     cam_sem_post(&cmd_thread->cmd_sem);
 
     /* wait until cmd thread exits */
@@ -680,7 +824,20 @@ int32_t mm_camera_cmd_thread_stop(mm_camera_cmd_thread_t * cmd_thread)
 int32_t mm_camera_cmd_thread_destroy(mm_camera_cmd_thread_t * cmd_thread)
 {
     int32_t rc = 0;
-    cam_queue_deinit(&cmd_thread->cmd_queue);
+    mm_camera_cmdcb_t *node;
+
+    /* pool entries must not reach the free() of the queue flush */
+    while (NULL != (node = (mm_camera_cmdcb_t *)
+            cam_ring_queue_deq(&cmd_thread->cmd_queue))) {
+        mm_camera_cmd_thread_free_cmd(cmd_thread, node);
+    }
+    cam_ring_queue_deinit(&cmd_thread->cmd_queue);
+    if (NULL != cmd_thread->cmd_pool) {
+        while (NULL != cam_ring_queue_deq(&cmd_thread->cmd_free)) {
+        }
+        cam_ring_queue_deinit(&cmd_thread->cmd_free);
+        free(cmd_thread->cmd_pool);
+    }
     cam_sem_destroy(&cmd_thread->cmd_sem);
     memset(cmd_thread, 0, sizeof(mm_camera_cmd_thread_t));
     return rc;
@@ -0,0 +1,429 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Per frame latency tracing.
+ *
+ * Every thread that stamps a frame owns a private ring of records, so the
+ * hot path is a TLS lookup, a monotonic clock read and one release store;
+ * no lock is taken. Rings are registered once per thread in a small global
+ * table which the dump walks to join records of the same (stream, frame_idx)
+ * and compute hop to hop latency. A record overwritten while the dump copies
+ * a ring is detected through the ring head and discarded.
+ *
+ * Tracing is on by default; set persist.camera.mm.trace to 0 to disable.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cutils/properties.h>
+
+#include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
+
+#define MM_CAMERA_TRACE_MAX_THREADS  32
+#define MM_CAMERA_TRACE_RING_SIZE    512  /* must be power of 2 */
+#define MM_CAMERA_TRACE_RING_MASK    (MM_CAMERA_TRACE_RING_SIZE - 1)
+
+typedef struct {
+    uint64_t ts_ns;
+    uint32_t stream_id;
+    uint32_t frame_idx;
+    uint16_t hop;
+    uint16_t stream_type;
+} mm_camera_trace_rec_t;
+
+typedef struct {
+    uint32_t head;      /* total records written, only owner thread writes */
+    uint8_t in_use;     /* owned by a live thread */
+    mm_camera_trace_rec_t rec[MM_CAMERA_TRACE_RING_SIZE];
+} mm_camera_trace_ring_t;
+
+typedef struct {
+    uint32_t stream_id;
+    uint16_t stream_type;
+    uint16_t hop;
+    uint64_t lat_ns;
+} mm_camera_trace_sample_t;
+
+static const char *mm_camera_trace_hop_name[MM_CAMERA_TRACE_HOP_MAX] = {
+    "dqbuf",
+    "stream_notify",
+    "ch_process",
+    "ch_dispatch",
+    "hal_notify",
+    "hal_cb",
+};
+
+static pthread_once_t g_trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_trace_key;
+static pthread_mutex_t g_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t g_trace_enabled = 0;
+static mm_camera_trace_ring_t *g_trace_rings[MM_CAMERA_TRACE_MAX_THREADS];
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_thread_exit
+ *
+ * DESCRIPTION: TLS destructor, hands ring back for reuse by a new thread.
+ *              Records stay in place until then so they still show in dump.
+ *
+ * PARAMETERS :
+ *   @data    : ptr to ring owned by exiting thread
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_trace_thread_exit(void *data)
+{
+    mm_camera_trace_ring_t *ring = (mm_camera_trace_ring_t *)data;
+
+    pthread_mutex_lock(&g_trace_lock);
+    ring->in_use = 0;
+    pthread_mutex_unlock(&g_trace_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_init
+ *
+ * DESCRIPTION: one time init of trace key and enable flag
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_camera_trace_init(void)
+{
+    char prop[PROPERTY_VALUE_MAX];
+
+    property_get("persist.camera.mm.trace", prop, "1");
+    g_trace_enabled = (uint8_t)(atoi(prop) != 0);
+    if (pthread_key_create(&g_trace_key, mm_camera_trace_thread_exit) != 0) {
+        CDBG_ERROR("%s: failed to create trace key", __func__);
+        g_trace_enabled = 0;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_get_ring
+ *
+ * DESCRIPTION: get ring of calling thread, registering one on first use
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : ptr to ring, NULL if none available
+ *==========================================================================*/
+static mm_camera_trace_ring_t *mm_camera_trace_get_ring(void)
+{
+    mm_camera_trace_ring_t *ring =
+            (mm_camera_trace_ring_t *)pthread_getspecific(g_trace_key);
+    int i;
+
+    if (NULL != ring) {
+        return ring;
+    }
+
+    pthread_mutex_lock(&g_trace_lock);
+    for (i = 0; i < MM_CAMERA_TRACE_MAX_THREADS; i++) {
+        if (NULL == g_trace_rings[i]) {
+            g_trace_rings[i] = (mm_camera_trace_ring_t *)
+                    calloc(1, sizeof(mm_camera_trace_ring_t));
+            if (NULL == g_trace_rings[i]) {
+                break;
+            }
+        } else if (g_trace_rings[i]->in_use) {
+            continue;
+        }
+        ring = g_trace_rings[i];
+        ring->in_use = 1;
+        break;
+    }
+    pthread_mutex_unlock(&g_trace_lock);
+
+    if (NULL != ring) {
+        pthread_setspecific(g_trace_key, ring);
+    }
+    return ring;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_frame
+ *
+ * DESCRIPTION: timestamp a frame at one hop of the pipeline
+ *
+ * PARAMETERS :
+ *   @hop     : hop the frame is passing
+ *   @buf     : frame buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_trace_frame(mm_camera_trace_hop_t hop,
+        const mm_camera_buf_def_t *buf)
+{
+    mm_camera_trace_ring_t *ring;
+    mm_camera_trace_rec_t *rec;
+    struct timespec ts;
+    uint32_t head;
+
+    pthread_once(&g_trace_once, mm_camera_trace_init);
+    if (!g_trace_enabled || NULL == buf || hop >= MM_CAMERA_TRACE_HOP_MAX) {
+        return;
+    }
+
+    ring = mm_camera_trace_get_ring();
+    if (NULL == ring) {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    head = ring->head;
+    rec = &ring->rec[head & MM_CAMERA_TRACE_RING_MASK];
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+    rec->stream_id = buf->stream_id;
+    rec->frame_idx = buf->frame_idx;
+    rec->hop = (uint16_t)hop;
+    rec->stream_type = (uint16_t)buf->stream_type;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_snapshot
+ *
+ * DESCRIPTION: copy the valid records of one ring. Records the owner thread
+ *              overwrote during the copy are dropped.
+ *
+ * PARAMETERS :
+ *   @ring    : ring to be copied
+ *   @out     : destination, room for MM_CAMERA_TRACE_RING_SIZE records
+ *
+ * RETURN     : number of records copied
+ *==========================================================================*/
+static uint32_t mm_camera_trace_snapshot(mm_camera_trace_ring_t *ring,
+        mm_camera_trace_rec_t *out)
+{
+    uint32_t head, start, end, i, cnt = 0;
+
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    start = (head > MM_CAMERA_TRACE_RING_SIZE) ?
+            head - MM_CAMERA_TRACE_RING_SIZE : 0;
+    for (i = start; i != head; i++) {
+        out[i - start] = ring->rec[i & MM_CAMERA_TRACE_RING_MASK];
+    }
+
+    /* slots the writer may have reused while we copied */
+    end = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (end - start > MM_CAMERA_TRACE_RING_SIZE) {
+        uint32_t stale = end - start - MM_CAMERA_TRACE_RING_SIZE;
+        if (stale >= head - start) {
+            return 0;
+        }
+        memmove(out, out + stale, (head - start - stale) * sizeof(*out));
+        cnt = head - start - stale;
+    } else {
+        cnt = head - start;
+    }
+    return cnt;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_rec_cmp
+ *
+ * DESCRIPTION: order records by stream, frame, time
+ *==========================================================================*/
+static int mm_camera_trace_rec_cmp(const void *a, const void *b)
+{
+    const mm_camera_trace_rec_t *ra = (const mm_camera_trace_rec_t *)a;
+    const mm_camera_trace_rec_t *rb = (const mm_camera_trace_rec_t *)b;
+
+    if (ra->stream_id != rb->stream_id) {
+        return (ra->stream_id < rb->stream_id) ? -1 : 1;
+    }
+    if (ra->frame_idx != rb->frame_idx) {
+        return (ra->frame_idx < rb->frame_idx) ? -1 : 1;
+    }
+    if (ra->ts_ns != rb->ts_ns) {
+        return (ra->ts_ns < rb->ts_ns) ? -1 : 1;
+    }
+    return (int)ra->hop - (int)rb->hop;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_sample_cmp
+ *
+ * DESCRIPTION: order samples by stream, hop, latency
+ *==========================================================================*/
+static int mm_camera_trace_sample_cmp(const void *a, const void *b)
+{
+    const mm_camera_trace_sample_t *sa = (const mm_camera_trace_sample_t *)a;
+    const mm_camera_trace_sample_t *sb = (const mm_camera_trace_sample_t *)b;
+
+    if (sa->stream_id != sb->stream_id) {
+        return (sa->stream_id < sb->stream_id) ? -1 : 1;
+    }
+    if (sa->hop != sb->hop) {
+        return (int)sa->hop - (int)sb->hop;
+    }
+    if (sa->lat_ns != sb->lat_ns) {
+        return (sa->lat_ns < sb->lat_ns) ? -1 : 1;
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_collect
+ *
+ * DESCRIPTION: join records of each (stream, frame) and turn them into hop
+ *              latency samples. Latency of a hop is measured from the
+ *              previous hop the frame was seen at; the first occurrence of
+ *              each hop is used.
+ *
+ * PARAMETERS :
+ *   @recs    : records sorted by mm_camera_trace_rec_cmp
+ *   @num_recs: number of records
+ *   @samples : destination, room for num_recs samples
+ *
+ * RETURN     : number of samples
+ *==========================================================================*/
+static uint32_t mm_camera_trace_collect(mm_camera_trace_rec_t *recs,
+        uint32_t num_recs, mm_camera_trace_sample_t *samples)
+{
+    uint32_t i = 0, j, cnt = 0;
+
+    while (i < num_recs) {
+        uint64_t hop_ts[MM_CAMERA_TRACE_HOP_MAX];
+        uint16_t stream_type = recs[i].stream_type;
+        int last = -1;
+        int h;
+
+        memset(hop_ts, 0, sizeof(hop_ts));
+        for (j = i; j < num_recs &&
+                recs[j].stream_id == recs[i].stream_id &&
+                recs[j].frame_idx == recs[i].frame_idx; j++) {
+            if (0 == hop_ts[recs[j].hop]) {
+                hop_ts[recs[j].hop] = recs[j].ts_ns;
+            }
+        }
+
+        for (h = 0; h < MM_CAMERA_TRACE_HOP_MAX; h++) {
+            if (0 == hop_ts[h]) {
+                continue;
+            }
+            if (last >= 0 && hop_ts[h] >= hop_ts[last]) {
+                samples[cnt].stream_id = recs[i].stream_id;
+                samples[cnt].stream_type = stream_type;
+                samples[cnt].hop = (uint16_t)h;
+                samples[cnt].lat_ns = hop_ts[h] - hop_ts[last];
+                cnt++;
+            }
+            last = h;
+        }
+        i = j;
+    }
+    return cnt;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_camera_trace_dump
+ *
+ * DESCRIPTION: print p50/p99/max latency of every hop per stream. Latency of
+ *              a hop is the time since the frame passed the previous hop.
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor to print to
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void mm_camera_trace_dump(int fd)
+{
+    mm_camera_trace_rec_t *recs = NULL;
+    mm_camera_trace_sample_t *samples = NULL;
+    uint32_t num_recs = 0, num_samples, i, j;
+    int r;
+
+    pthread_once(&g_trace_once, mm_camera_trace_init);
+    dprintf(fd, "\n mm-camera frame latency trace Begin \n");
+    if (!g_trace_enabled) {
+        dprintf(fd, "Tracing disabled (persist.camera.mm.trace)\n");
+        goto end;
+    }
+
+    recs = (mm_camera_trace_rec_t *)malloc(sizeof(mm_camera_trace_rec_t) *
+            MM_CAMERA_TRACE_MAX_THREADS * MM_CAMERA_TRACE_RING_SIZE);
+    if (NULL == recs) {
+        dprintf(fd, "No memory for trace snapshot\n");
+        goto end;
+    }
+
+    pthread_mutex_lock(&g_trace_lock);
+    for (r = 0; r < MM_CAMERA_TRACE_MAX_THREADS; r++) {
+        if (NULL != g_trace_rings[r]) {
+            num_recs += mm_camera_trace_snapshot(g_trace_rings[r],
+                    &recs[num_recs]);
+        }
+    }
+    pthread_mutex_unlock(&g_trace_lock);
+
+    if (0 == num_recs) {
+        dprintf(fd, "No frames traced\n");
+        goto end;
+    }
+
+    samples = (mm_camera_trace_sample_t *)
+            malloc(sizeof(mm_camera_trace_sample_t) * num_recs);
+    if (NULL == samples) {
+        dprintf(fd, "No memory for trace samples\n");
+        goto end;
+    }
+
+    qsort(recs, num_recs, sizeof(*recs), mm_camera_trace_rec_cmp);
+    num_samples = mm_camera_trace_collect(recs, num_recs, samples);
+    qsort(samples, num_samples, sizeof(*samples), mm_camera_trace_sample_cmp);
+
+    dprintf(fd, "-----------+------+---------------+-------+----------+----------+----------\n");
+    dprintf(fd, "  Stream   | Type |      Hop      | Count | p50 (us) | p99 (us) | max (us) \n");
+    dprintf(fd, "-----------+------+---------------+-------+----------+----------+----------\n");
+    for (i = 0; i < num_samples; i = j) {
+        uint32_t cnt;
+        for (j = i; j < num_samples &&
+                samples[j].stream_id == samples[i].stream_id &&
+                samples[j].hop == samples[i].hop; j++);
+        cnt = j - i;
+        dprintf(fd, " 0x%08x | %4d | %-13s | %5u | %8llu | %8llu | %8llu \n",
+                samples[i].stream_id, samples[i].stream_type,
+                mm_camera_trace_hop_name[samples[i].hop], cnt,
+                (unsigned long long)(samples[i + (cnt - 1) / 2].lat_ns / 1000),
+                (unsigned long long)(samples[i + ((cnt - 1) * 99) / 100].lat_ns / 1000),
+                (unsigned long long)(samples[j - 1].lat_ns / 1000));
+    }
+
+end:
+    free(samples);
+    free(recs);
+    dprintf(fd, "\n mm-camera frame latency trace End \n");
+}
@@ -228,3 +228,21 @@ LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
 
 LOCAL_MODULE:= libmm-qcamera
 include $(BUILD_SHARED_LIBRARY)
+
+# Build cmd thread queue microbenchmark: mm-qcamera-queue-bench
+include $(CLEAR_VARS)
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+LOCAL_CFLAGS += -D_ANDROID_
+
+LOCAL_SRC_FILES := src/mm_qcamera_queue_bench.c
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../common
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+
+LOCAL_MODULE := mm-qcamera-queue-bench
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,425 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/* Microbenchmark of the mm_camera cmd thread queues. Several producer
+ * threads hand payloads to one consumer through a cam_semaphore_t, the way
+ * stream and channel threads feed a cmd thread, with:
+ *   list      - cam_queue_t, payload malloc'ed per item (original path)
+ *   ring      - cam_ring_queue_t, payload malloc'ed per item
+ *   ring+pool - cam_ring_queue_t, payload from a preallocated free ring
+ *               with heap fallback (mm_camera_cmd_thread_alloc_cmd)
+ * Like camera streams, which only have so many buffers, each producer keeps
+ * a bounded number of items in flight unless -u is given. The consumer
+ * checks that no item is lost and that items of one producer arrive in
+ * order. */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdint.h>
+#include "cam_queue.h"
+#include "cam_semaphore.h"
+
+#define MAX_PRODUCERS 8
+#define DEFAULT_PRODUCERS 4
+#define DEFAULT_ITEMS 200000
+#define DEFAULT_RUNS 5
+/* sizeof(mm_camera_cmdcb_t) on arm64 */
+#define DEFAULT_PAYLOAD 656
+/* MM_CAMERA_CMD_QUEUE_SIZE and MM_CAMERA_CMD_POOL_SIZE */
+#define RING_SIZE (64 * 6)
+#define POOL_SIZE 64
+
+typedef enum {
+    BENCH_MODE_LIST,
+    BENCH_MODE_RING,
+    BENCH_MODE_POOL,
+    BENCH_MODE_MAX
+} bench_mode_t;
+
+typedef struct {
+    uint32_t producer;
+    uint32_t seq;
+    uint8_t exit;
+} bench_item_t;
+
+typedef struct {
+    bench_mode_t mode;
+    uint32_t num_producers;
+    uint32_t items;
+    size_t payload;
+    uint32_t max_in_flight;     /* per producer, 0 for unbounded */
+
+    cam_queue_t list;
+    cam_ring_queue_t ring;
+    cam_ring_queue_t free_ring;
+    uint8_t *pool;
+    cam_semaphore_t sem;
+
+    uint32_t in_flight[MAX_PRODUCERS];
+    uint32_t next_seq[MAX_PRODUCERS];
+    uint32_t received;
+    uint32_t errors;
+    uint32_t heap_allocs;
+} bench_ctx_t;
+
+typedef struct {
+    bench_ctx_t *ctx;
+    uint32_t id;
+} bench_producer_t;
+
+static const char *mode_names[BENCH_MODE_MAX] = { "list", "ring", "ring+pool" };
+
+static uint64_t bench_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static bench_item_t *bench_alloc(bench_ctx_t *ctx)
+{
+    bench_item_t *item = NULL;
+
+    if (BENCH_MODE_POOL == ctx->mode) {
+        item = (bench_item_t *)cam_ring_queue_deq(&ctx->free_ring);
+    }
+    if (NULL == item) {
+        item = (bench_item_t *)malloc(ctx->payload);
+        if (BENCH_MODE_POOL == ctx->mode) {
+            __atomic_add_fetch(&ctx->heap_allocs, 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (NULL != item) {
+        memset(item, 0, ctx->payload);
+    }
+    return item;
+}
+
+static void bench_free(bench_ctx_t *ctx, bench_item_t *item)
+{
+    uint8_t *p = (uint8_t *)item;
+
+    if (BENCH_MODE_POOL == ctx->mode && p >= ctx->pool &&
+            p < ctx->pool + ctx->payload * POOL_SIZE) {
+        cam_ring_queue_enq(&ctx->free_ring, item);
+    } else {
+        free(item);
+    }
+}
+
+static void bench_enq(bench_ctx_t *ctx, bench_item_t *item)
+{
+    if (BENCH_MODE_LIST == ctx->mode) {
+        cam_queue_enq(&ctx->list, item);
+    } else {
+        cam_ring_queue_enq(&ctx->ring, item);
+    }
+    cam_sem_post(&ctx->sem);
+}
+
+static bench_item_t *bench_deq(bench_ctx_t *ctx)
+{
+    if (BENCH_MODE_LIST == ctx->mode) {
+        return (bench_item_t *)cam_queue_deq(&ctx->list);
+    }
+    return (bench_item_t *)cam_ring_queue_deq(&ctx->ring);
+}
+
+static void *bench_producer(void *data)
+{
+    bench_producer_t *producer = (bench_producer_t *)data;
+    bench_ctx_t *ctx = producer->ctx;
+    bench_item_t *item;
+    uint32_t i;
+
+    for (i = 0; i < ctx->items; i++) {
+        while (0 != ctx->max_in_flight &&
+                __atomic_load_n(&ctx->in_flight[producer->id],
+                        __ATOMIC_ACQUIRE) >= ctx->max_in_flight) {
+            sched_yield();
+        }
+        item = bench_alloc(ctx);
+        if (NULL == item) {
+            __atomic_add_fetch(&ctx->errors, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        item->producer = producer->id;
+        item->seq = i;
+        __atomic_add_fetch(&ctx->in_flight[producer->id], 1, __ATOMIC_RELEASE);
+        bench_enq(ctx, item);
+    }
+    return NULL;
+}
+
+/* same drain loop as mm_camera_cmd_thread */
+static void *bench_consumer(void *data)
+{
+    bench_ctx_t *ctx = (bench_ctx_t *)data;
+    bench_item_t *item;
+    uint32_t producer;
+    int running = 1;
+
+    do {
+        cam_sem_wait(&ctx->sem);
+        item = bench_deq(ctx);
+        while (NULL != item) {
+            producer = item->exit ? MAX_PRODUCERS : item->producer;
+            if (item->exit) {
+                running = 0;
+            } else if (producer >= ctx->num_producers ||
+                    item->seq != ctx->next_seq[producer]) {
+                ctx->errors++;
+            } else {
+                ctx->next_seq[producer]++;
+                ctx->received++;
+            }
+            bench_free(ctx, item);
+            if (producer < ctx->num_producers) {
+                __atomic_sub_fetch(&ctx->in_flight[producer], 1,
+                        __ATOMIC_RELEASE);
+            }
+            item = bench_deq(ctx);
+        }
+    } while (running);
+    return NULL;
+}
+
+static int bench_init(bench_ctx_t *ctx)
+{
+    uint32_t i;
+
+    cam_sem_init(&ctx->sem, 0);
+    cam_queue_init(&ctx->list);
+    if (0 != cam_ring_queue_init(&ctx->ring, RING_SIZE) ||
+            0 != cam_ring_queue_init(&ctx->free_ring, POOL_SIZE)) {
+        return -1;
+    }
+    ctx->pool = (uint8_t *)malloc(ctx->payload * POOL_SIZE);
+    if (NULL == ctx->pool) {
+        return -1;
+    }
+    for (i = 0; i < POOL_SIZE; i++) {
+        cam_ring_queue_enq(&ctx->free_ring, ctx->pool + i * ctx->payload);
+    }
+    return 0;
+}
+
+static void bench_deinit(bench_ctx_t *ctx)
+{
+    /* pool entries must not reach the free() of the queue flush */
+    while (NULL != cam_ring_queue_deq(&ctx->free_ring)) {
+    }
+    cam_ring_queue_deinit(&ctx->free_ring);
+    cam_ring_queue_deinit(&ctx->ring);
+    cam_queue_deinit(&ctx->list);
+    cam_sem_destroy(&ctx->sem);
+    free(ctx->pool);
+}
+
+/* returns elapsed ns of one run, 0 on failure */
+static uint64_t bench_run(bench_ctx_t *ctx)
+{
+    bench_producer_t producers[MAX_PRODUCERS];
+    pthread_t producer_pids[MAX_PRODUCERS];
+    pthread_t consumer_pid;
+    bench_item_t *item;
+    uint64_t start, end;
+    uint32_t i;
+
+    memset(ctx->in_flight, 0, sizeof(ctx->in_flight));
+    memset(ctx->next_seq, 0, sizeof(ctx->next_seq));
+    ctx->received = 0;
+    ctx->errors = 0;
+    ctx->heap_allocs = 0;
+
+    if (0 != pthread_create(&consumer_pid, NULL, bench_consumer, ctx)) {
+        return 0;
+    }
+    start = bench_time_ns();
+    for (i = 0; i < ctx->num_producers; i++) {
+        producers[i].ctx = ctx;
+        producers[i].id = i;
+        if (0 != pthread_create(&producer_pids[i], NULL, bench_producer,
+                &producers[i])) {
+            ctx->errors++;
+            ctx->num_producers = i;
+            break;
+        }
+    }
+    for (i = 0; i < ctx->num_producers; i++) {
+        pthread_join(producer_pids[i], NULL);
+    }
+
+    item = bench_alloc(ctx);
+    if (NULL == item) {
+        /* consumer would never exit */
+        abort();
+    }
+    item->exit = 1;
+    bench_enq(ctx, item);
+    pthread_join(consumer_pid, NULL);
+    end = bench_time_ns();
+
+    if (0 != ctx->errors || ctx->received != ctx->items * ctx->num_producers) {
+        printf("%s: %u errors, %u of %u items received\n",
+                mode_names[ctx->mode], ctx->errors, ctx->received,
+                ctx->items * ctx->num_producers);
+        return 0;
+    }
+    return end - start;
+}
+
+/* single threaded enqueue/dequeue pairs, no contention */
+static uint64_t bench_uncontended(bench_ctx_t *ctx)
+{
+    uint64_t start;
+    bench_item_t *item;
+    uint32_t i;
+
+    start = bench_time_ns();
+    for (i = 0; i < ctx->items; i++) {
+        item = bench_alloc(ctx);
+        if (NULL == item) {
+            return 0;
+        }
+        if (BENCH_MODE_LIST == ctx->mode) {
+            cam_queue_enq(&ctx->list, item);
+        } else {
+            cam_ring_queue_enq(&ctx->ring, item);
+        }
+        bench_free(ctx, bench_deq(ctx));
+    }
+    return bench_time_ns() - start;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options]\n", name);
+    printf("  -p producers  producer threads (default %d, max %d)\n",
+            DEFAULT_PRODUCERS, MAX_PRODUCERS);
+    printf("  -n items      items per producer (default %d)\n", DEFAULT_ITEMS);
+    printf("  -s bytes      payload size (default %d)\n", DEFAULT_PAYLOAD);
+    printf("  -r runs       runs per mode, best is reported (default %d)\n",
+            DEFAULT_RUNS);
+    printf("  -u            no bound on items in flight per producer\n");
+}
+
+int main(int argc, char **argv)
+{
+    bench_ctx_t ctx;
+    uint32_t num_producers = DEFAULT_PRODUCERS;
+    uint32_t items = DEFAULT_ITEMS;
+    uint32_t runs = DEFAULT_RUNS;
+    size_t payload = DEFAULT_PAYLOAD;
+    uint8_t unbounded = 0;
+    uint64_t best, single, elapsed;
+    uint32_t mode, run, heap_allocs;
+    int fail = 0;
+    int c;
+
+    while ((c = getopt(argc, argv, "p:n:s:r:uh")) != -1) {
+        switch (c) {
+        case 'p':
+            num_producers = (uint32_t)atoi(optarg);
+            break;
+        case 'n':
+            items = (uint32_t)atoi(optarg);
+            break;
+        case 's':
+            payload = (size_t)atoi(optarg);
+            break;
+        case 'r':
+            runs = (uint32_t)atoi(optarg);
+            break;
+        case 'u':
+            unbounded = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 0;
+        }
+    }
+    if (num_producers < 1 || num_producers > MAX_PRODUCERS || items < 1 ||
+            runs < 1 || payload < sizeof(bench_item_t)) {
+        usage(argv[0]);
+        return -1;
+    }
+
+    printf("%u producers x %u items, %zu byte payload, %s in flight\n",
+            num_producers, items, payload, unbounded ? "unbounded" : "bounded");
+    printf("%-12s%-14s%-14s%-14s%-12s\n",
+            "queue", "1 thread ns", "mpsc ns", "Mitems/s", "heap allocs");
+    for (mode = 0; mode < BENCH_MODE_MAX; mode++) {
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.mode = (bench_mode_t)mode;
+        ctx.items = items;
+        ctx.payload = payload;
+        ctx.max_in_flight = unbounded ? 0 : POOL_SIZE / num_producers;
+        if (0 != bench_init(&ctx)) {
+            printf("%s: no memory\n", mode_names[mode]);
+            bench_deinit(&ctx);
+            return -1;
+        }
+
+        single = bench_uncontended(&ctx);
+        best = 0;
+        heap_allocs = 0;
+        for (run = 0; run < runs; run++) {
+            ctx.num_producers = num_producers;
+            elapsed = bench_run(&ctx);
+            if (0 == elapsed) {
+                fail = 1;
+                break;
+            }
+            if (0 == best || elapsed < best) {
+                best = elapsed;
+                heap_allocs = ctx.heap_allocs;
+            }
+        }
+        bench_deinit(&ctx);
+        if (0 == best || 0 == single) {
+            fail = 1;
+            continue;
+        }
+        printf("%-12s%-14.1f%-14.1f%-14.2f%-12u\n", mode_names[mode],
+                (double)single / items,
+                (double)best / ((uint64_t)items * num_producers),
+                (double)items * num_producers * 1000.0 / (double)best,
+                heap_allocs);
+    }
+
+    printf("%s\n", fail ? "Fail!" : "Success!");
+    return fail ? -1 : 0;
+}
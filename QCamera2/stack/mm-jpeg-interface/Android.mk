@@ -48,6 +48,7 @@ LOCAL_SRC_FILES := \
     src/mm_jpeg_queue.c \
     src/mm_jpeg_exif.c \
     src/mm_jpeg.c \
+    src/mm_jpeg_swenc.c \
     src/mm_jpeg_interface.c \
     src/mm_jpeg_ionbuf.c \
     src/mm_jpegdec_interface.c \
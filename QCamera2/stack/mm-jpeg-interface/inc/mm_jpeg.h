@@ -39,17 +39,20 @@
 #include "OMX_Component.h"
 #include "QOMX_JpegExtensions.h"
 #include "mm_jpeg_ionbuf.h"
+#include "mm_jpeg_swenc.h"
 
 #define MM_JPEG_MAX_THREADS 30
 #define MM_JPEG_CIRQ_SIZE 30
 #define MM_JPEG_MAX_SESSION 10
 #define MAX_EXIF_TABLE_ENTRIES 50
+#define MAX_EXIF_ARENA_SIZE 2048
 #define MAX_JPEG_SIZE 20000000
 #define MAX_OMX_HANDLES (5)
 #define ASPECT_TOLERANCE 0.001
 #define MM_JPEG_NOM_QUALITY_THRESHOLD 95
 #define MM_JPEG_NOM_QUALITY_MUL_FACTOR 3U / 2U
 #define MM_JPEG_HIGH_QUALITY_MUL_FACTOR 2U
+#define MM_JPEG_MAX_CACHED_SESSIONS 2
 
 /** mm_jpeg_abort_state_t:
  *  @MM_JPEG_ABORT_NONE: Abort is not issued
@@ -72,6 +75,13 @@ typedef enum {
 #define JOB_ID_MAGICVAL 0x1
 #define JOB_HIST_MAX 10000
 
+/* upper bound of job manager workers, see persist.camera.jpeg.workers */
+#define MM_JPEG_MAX_JOB_WORKERS 4
+
+/* returned by job processing when the job could not be started yet and
+ * has to go back to the head of its queue */
+#define MM_JPEG_JOB_DEFERRED 1
+
 /** DUMP_TO_FILE:
  *  @filename: file name
  *  @p_addr: address of the buffer
@@ -262,11 +272,87 @@ typedef struct {
 
 typedef enum {
   MM_JPEG_CMD_TYPE_JOB,          /* job cmd */
-  MM_JPEG_CMD_TYPE_EXIT,         /* EXIT cmd for exiting jobMgr thread */
   MM_JPEG_CMD_TYPE_DECODE_JOB,
   MM_JPEG_CMD_TYPE_MAX
 } mm_jpeg_cmd_type_t;
 
+/** mm_jpeg_job_lane_t:
+ *  @MM_JPEG_LANE_PRIO: single snapshot encodes, always served first
+ *  @MM_JPEG_LANE_NORMAL: burst/longshot encodes and decodes
+ *
+ *  Queue a job waits in before it is admitted
+ **/
+typedef enum {
+  MM_JPEG_LANE_PRIO,
+  MM_JPEG_LANE_NORMAL,
+  MM_JPEG_LANE_MAX
+} mm_jpeg_job_lane_t;
+
+/** mm_jpeg_port_key_t:
+ *  @main_dim: main image source dimension
+ *  @thumb_dim: thumbnail source dimension
+ *  @main_offset: main image plane layout
+ *  @thumb_offset: thumbnail plane layout
+ *  @main_buf_size: main image buffer size
+ *  @thumb_buf_size: thumbnail buffer size
+ *  @dst_buf_size: output buffer size
+ *  @color_format: main image color format
+ *  @thumb_color_format: thumbnail color format
+ *  @num_src_bufs: main image buffer count
+ *  @num_tmb_bufs: thumbnail buffer count
+ *  @num_dst_bufs: output buffer count
+ *  @encode_thumbnail: thumbnail port enabled
+ *  @rotation: session rotation
+ *
+ *  Everything the OMX port definitions are programmed from
+ **/
+typedef struct {
+  cam_dimension_t main_dim;
+  cam_dimension_t thumb_dim;
+  cam_frame_len_offset_t main_offset;
+  cam_frame_len_offset_t thumb_offset;
+  size_t main_buf_size;
+  size_t thumb_buf_size;
+  size_t dst_buf_size;
+  mm_jpeg_color_format color_format;
+  mm_jpeg_color_format thumb_color_format;
+  uint32_t num_src_bufs;
+  uint32_t num_tmb_bufs;
+  uint32_t num_dst_bufs;
+  uint32_t encode_thumbnail;
+  uint32_t rotation;
+} mm_jpeg_port_key_t;
+
+/** mm_jpeg_session_key_t:
+ *  @ports: port configuration
+ *  @burst_mode: encoder burst mode
+ *  @get_memory: output memory callback
+ *
+ *  Session level configuration held by an OMX component,
+ *  used to match a parked component with a new session
+ **/
+typedef struct {
+  mm_jpeg_port_key_t ports;
+  uint32_t burst_mode;
+  int (*get_memory)(omx_jpeg_ouput_buf_t *p_out_buf);
+} mm_jpeg_session_key_t;
+
+/** mm_jpeg_exif_arena_t:
+ *  @info: exif info handed to the encoder, points to @entries
+ *  @entries: exif entry table
+ *  @storage: backing store for tag values not held in the entry
+ *  @used: bytes of @storage in use
+ *
+ *  Exif tags of one job, built without heap allocations and
+ *  reset between jobs
+ **/
+typedef struct {
+  QOMX_EXIF_INFO info;
+  QEXIF_INFO_DATA entries[MAX_EXIF_TABLE_ENTRIES];
+  uint64_t storage[MAX_EXIF_ARENA_SIZE / sizeof(uint64_t)];
+  uint32_t used;
+} mm_jpeg_exif_arena_t;
+
 typedef struct mm_jpeg_job_session {
   uint32_t client_hdl;           /* client handler */
   uint32_t jobId;                /* job ID */
@@ -301,8 +387,7 @@ typedef struct mm_jpeg_job_session {
   pthread_mutex_t lock;
   pthread_cond_t cond;
 
-  QEXIF_INFO_DATA exif_info_local[MAX_EXIF_TABLE_ENTRIES];  //all exif tags for JPEG encoder
-  int exif_count_local;
+  mm_jpeg_exif_arena_t exif_arena;  //all exif tags for JPEG encoder
 
   mm_jpeg_cirq_t cb_q;
   int32_t ebd_count;
@@ -339,6 +424,18 @@ typedef struct mm_jpeg_job_session {
 
   int thumb_from_main;
   uint32_t job_index;
+
+  /* OMX handle kept in loaded state after the session was destroyed */
+  OMX_BOOL cached;
+
+  /* OMX handle came from the cache, cache_key is what it holds */
+  OMX_BOOL warm;
+
+  /* configuration last programmed into the OMX handle */
+  mm_jpeg_session_key_t cache_key;
+
+  /* jobs run on the software encoder, no OMX handle */
+  OMX_BOOL sw_encode;
 } mm_jpeg_job_session_t;
 
 typedef struct {
@@ -359,6 +456,7 @@ typedef struct {
     mm_jpeg_encode_job_info_t enc_info;
     mm_jpeg_decode_job_info_t dec_info;
   };
+  uint64_t enq_time_us;          /* time the job was queued */
 } mm_jpeg_job_q_node_t;
 
 typedef struct {
@@ -368,10 +466,41 @@ typedef struct {
   pthread_mutex_t lock;           /* job lock */
 } mm_jpeg_client_t;
 
+/** mm_jpeg_sched_stats_t:
+ *  @enqueued: jobs queued per lane
+ *  @max_depth: deepest each lane has been
+ *  @admitted: jobs handed to a worker
+ *  @deferred: admitted jobs put back for lack of a free OMX handle
+ *  @total_wait_us: sum of queue to admission time
+ *  @max_wait_us: longest queue to admission time
+ *
+ *  Job manager counters, dumped when the job manager is released
+ **/
 typedef struct {
-  pthread_t pid;                  /* job cmd thread ID */
-  cam_semaphore_t job_sem;        /* semaphore for job cmd thread */
-  mm_jpeg_queue_t job_queue;      /* queue for job to do */
+  uint32_t enqueued[MM_JPEG_LANE_MAX];
+  uint32_t max_depth[MM_JPEG_LANE_MAX];
+  uint32_t admitted;
+  uint32_t deferred;
+  uint64_t total_wait_us;
+  uint64_t max_wait_us;
+} mm_jpeg_sched_stats_t;
+
+typedef struct {
+  pthread_t pid[MM_JPEG_MAX_JOB_WORKERS]; /* job worker thread IDs */
+  uint32_t num_workers;           /* number of workers running */
+  mm_jpeg_queue_t job_queue;      /* queue for job to do, normal lane */
+  mm_jpeg_queue_t prio_queue;     /* queue for job to do, priority lane */
+
+  /* scheduler state, protected by sched_lock */
+  pthread_mutex_t sched_lock;
+  pthread_cond_t sched_cond;      /* signalled on any scheduler change */
+  int running;                    /* cleared to stop the workers */
+  uint32_t num_submitting;        /* admitted jobs still being started */
+  uint32_t num_paused;            /* callers holding off admissions */
+  uint32_t kick_gen;              /* bumped on new jobs and freed slots */
+  uint32_t stall_gen;             /* kick_gen when a job got deferred */
+  int stalled;                    /* no admission until kick_gen moves */
+  mm_jpeg_sched_stats_t stats;
 } mm_jpeg_job_cmd_thread_t;
 
 #define MAX_JPEG_CLIENT_NUM 8
@@ -398,6 +527,20 @@ typedef struct mm_jpeg_obj_t {
 
   uint32_t num_sessions;
 
+  /* keep OMX handles of destroyed sessions for reuse */
+  uint32_t session_cache;
+
+  /* software encoder, started on the first session using it */
+  mm_jpeg_swenc_t swenc;
+  OMX_BOOL swenc_started;
+  uint32_t swenc_threads;
+
+  /* encode every session in software */
+  uint32_t swenc_only;
+
+  /* OMX core loaded by OMX_Init */
+  OMX_BOOL omx_loaded;
+
 } mm_jpeg_obj;
 
 /** mm_jpeg_pending_func_t:
@@ -420,6 +563,7 @@ extern int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
   uint32_t client_hdl,
   mm_jpeg_encode_params_t *p_params,
   uint32_t* p_session_id);
+extern int32_t mm_jpeg_thumb_from_main(mm_jpeg_obj *my_obj);
 extern int32_t mm_jpeg_destroy_session_by_id(mm_jpeg_obj *my_obj,
   uint32_t session_id);
 
@@ -427,6 +571,11 @@ extern int32_t mm_jpegdec_init(mm_jpeg_obj *my_obj);
 extern int32_t mm_jpegdec_deinit(mm_jpeg_obj *my_obj);
 extern int32_t mm_jpeg_jobmgr_thread_release(mm_jpeg_obj * my_obj);
 extern int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj);
+extern int32_t mm_jpeg_jobmgr_enqueue(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_q_node_t *node, mm_jpeg_job_lane_t lane);
+extern void mm_jpeg_jobmgr_kick(mm_jpeg_obj *my_obj);
+extern void mm_jpeg_jobmgr_pause(mm_jpeg_obj *my_obj);
+extern void mm_jpeg_jobmgr_resume(mm_jpeg_obj *my_obj);
 extern int32_t mm_jpegdec_start_decode_job(mm_jpeg_obj *my_obj,
   mm_jpeg_job_t* job,
   uint32_t* jobId);
@@ -461,11 +610,11 @@ extern int32_t mm_jpeg_queue_deinit(mm_jpeg_queue_t* queue);
 extern int32_t mm_jpeg_queue_flush(mm_jpeg_queue_t* queue);
 extern uint32_t mm_jpeg_queue_get_size(mm_jpeg_queue_t* queue);
 extern mm_jpeg_q_data_t mm_jpeg_queue_peek(mm_jpeg_queue_t* queue);
-extern int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
+extern void mm_jpeg_exif_arena_reset(mm_jpeg_exif_arena_t *p_arena);
+extern int32_t addExifEntry(mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
   exif_tag_type_t type, uint32_t count, void *data);
-extern int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data);
 extern int process_meta_data(metadata_buffer_t *p_meta,
-  QOMX_EXIF_INFO *exif_info, mm_jpeg_exif_params_t *p_cam3a_params,
+  mm_jpeg_exif_arena_t *exif_info, mm_jpeg_exif_params_t *p_cam3a_params,
   cam_hal_version_t hal_version);
 
 OMX_ERRORTYPE mm_jpeg_session_change_state(mm_jpeg_job_session_t* p_session,
@@ -0,0 +1,168 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __MM_JPEG_SWENC_H__
+#define __MM_JPEG_SWENC_H__
+
+#include <pthread.h>
+#include "mm_jpeg_interface.h"
+
+#define MM_JPEG_SWENC_MAX_THREADS 8
+#define MM_JPEG_SWENC_MAX_STRIPES 64
+#define MM_JPEG_SWENC_NUM_HUFF 4
+
+/** mm_jpeg_swenc_huff_t:
+ *  @code: huffman code per symbol
+ *  @size: code length per symbol, 0 if unused
+ *
+ *  Encoder side huffman table
+ **/
+typedef struct {
+  uint16_t code[256];
+  uint8_t size[256];
+} mm_jpeg_swenc_huff_t;
+
+/** mm_jpeg_swenc_stripe_t:
+ *  @p_buf: entropy coded data of the stripe
+ *  @size: allocated size of p_buf
+ *  @len: bytes used in p_buf
+ *  @first_row: first MCU row of the stripe
+ *  @num_rows: number of MCU rows in the stripe
+ *  @error: set if the stripe could not be encoded
+ *  @p_band: resampled MCU row for scaled or rotated jobs
+ *  @band_size: allocated size of p_band
+ *
+ *  Horizontal band of MCU rows encoded by one worker
+ **/
+typedef struct {
+  uint8_t *p_buf;
+  size_t size;
+  size_t len;
+  uint32_t first_row;
+  uint32_t num_rows;
+  int error;
+  uint8_t *p_band;
+  size_t band_size;
+} mm_jpeg_swenc_stripe_t;
+
+struct mm_jpeg_swenc_frame;
+
+/** mm_jpeg_swenc_t:
+ *  @pid: worker thread IDs
+ *  @num_threads: number of workers, the caller of
+ *                mm_jpeg_swenc_encode works as well
+ *  @lock: serializes frames, the workers encode one at a time
+ *  @work_lock: protects the stripe dispatch state below
+ *  @work_cond: signalled when a frame is posted or on exit
+ *  @done_cond: signalled when the last stripe is done
+ *  @running: cleared to stop the workers
+ *  @p_frame: frame being encoded, NULL when idle
+ *  @num_stripes: stripes in the current frame
+ *  @next_stripe: next stripe to hand out
+ *  @stripes_left: stripes not yet finished
+ *  @stripe: per stripe output, kept across frames
+ *  @huff: DC/AC luma and chroma huffman tables
+ *  @p_scratch: sample maps for scaled or rotated jobs
+ *  @scratch_size: allocated size of p_scratch
+ *
+ *  Software baseline JPEG encoder. The image is split into
+ *  stripes of MCU rows separated by restart markers, which
+ *  are entropy coded in parallel and concatenated.
+ **/
+typedef struct {
+  pthread_t pid[MM_JPEG_SWENC_MAX_THREADS];
+  uint32_t num_threads;
+  pthread_mutex_t lock;
+  pthread_mutex_t work_lock;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  int running;
+  const struct mm_jpeg_swenc_frame *p_frame;
+  uint32_t num_stripes;
+  uint32_t next_stripe;
+  uint32_t stripes_left;
+  mm_jpeg_swenc_stripe_t stripe[MM_JPEG_SWENC_MAX_STRIPES];
+  mm_jpeg_swenc_huff_t huff[MM_JPEG_SWENC_NUM_HUFF];
+  uint32_t *p_scratch;
+  size_t scratch_size;
+} mm_jpeg_swenc_t;
+
+/** mm_jpeg_swenc_init:
+ *
+ *  Arguments:
+ *     @p_enc: software encoder
+ *     @num_threads: threads encoding a frame, including the
+ *                   caller, 0 for one per online CPU
+ *
+ *  Return:
+ *     0 for success else failure
+ *
+ *  Description:
+ *      Builds the huffman tables and starts the workers
+ *
+ **/
+int32_t mm_jpeg_swenc_init(mm_jpeg_swenc_t *p_enc, uint32_t num_threads);
+
+/** mm_jpeg_swenc_deinit:
+ *
+ *  Arguments:
+ *     @p_enc: software encoder
+ *
+ *  Return:
+ *     none
+ *
+ *  Description:
+ *      Stops the workers and frees the stripe buffers
+ *
+ **/
+void mm_jpeg_swenc_deinit(mm_jpeg_swenc_t *p_enc);
+
+/** mm_jpeg_swenc_encode:
+ *
+ *  Arguments:
+ *     @p_enc: software encoder
+ *     @p_params: session parameters
+ *     @p_job: job to encode
+ *     @p_out: filled with the output buffer and length
+ *
+ *  Return:
+ *     0 for success else failure
+ *
+ *  Description:
+ *      Encodes the main image of a job into its destination
+ *      buffer, or into memory from p_params->get_memory.
+ *      Blocks until the frame is done.
+ *
+ **/
+int32_t mm_jpeg_swenc_encode(mm_jpeg_swenc_t *p_enc,
+  const mm_jpeg_encode_params_t *p_params,
+  const mm_jpeg_encode_job_t *p_job,
+  mm_jpeg_output_t *p_out);
+
+#endif /* __MM_JPEG_SWENC_H__ */
@@ -38,7 +38,9 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <cutils/trace.h>
+#include <cutils/properties.h>
 #include <math.h>
+#include <time.h>
 
 #include "mm_jpeg_dbg.h"
 #include "mm_jpeg_interface.h"
@@ -62,6 +64,9 @@
 #ifdef MM_JPEG_USE_PIPELINE
 #undef MM_JPEG_CONCURRENT_SESSIONS_COUNT
 #define MM_JPEG_CONCURRENT_SESSIONS_COUNT 1
+#define MM_JPEG_THUMB_FROM_MAIN 1
+#else
+#define MM_JPEG_THUMB_FROM_MAIN 0
 #endif
 
 OMX_ERRORTYPE mm_jpeg_ebd(OMX_HANDLETYPE hComponent,
@@ -279,7 +284,9 @@ OMX_ERRORTYPE mm_jpeg_session_change_state(mm_jpeg_job_session_t* p_session,
  *       OMX error types
  *
  *  Description:
- *       Create a jpeg encode session
+ *       Create a jpeg encode session. If the slot still holds
+ *       the OMX handle of an earlier session it is reused
+ *       instead of loading a new component
  *
  **/
 OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
@@ -288,8 +295,11 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
   mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
   char *omx_lib = "OMX.qcom.image.jpeg.encoder";
 
-  pthread_mutex_init(&p_session->lock, NULL);
-  pthread_cond_init(&p_session->cond, NULL);
+  /* a parked handle keeps its event lock, OMX may still use it */
+  if (OMX_TRUE != p_session->cached) {
+    pthread_mutex_init(&p_session->lock, NULL);
+    pthread_cond_init(&p_session->cond, NULL);
+  }
   cirq_reset(&p_session->cb_q);
   p_session->state_change_pending = OMX_FALSE;
   p_session->abort_state = MM_JPEG_ABORT_NONE;
@@ -298,19 +308,35 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
   p_session->fbd_count = 0;
   p_session->encode_pid = -1;
   p_session->config = OMX_FALSE;
-  p_session->exif_count_local = 0;
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
   p_session->auto_out_buf = OMX_FALSE;
 
   p_session->omx_callbacks.EmptyBufferDone = mm_jpeg_ebd;
   p_session->omx_callbacks.FillBufferDone = mm_jpeg_fbd;
   p_session->omx_callbacks.EventHandler = mm_jpeg_event_handler;
 
-  p_session->thumb_from_main = 0;
+  p_session->thumb_from_main = MM_JPEG_THUMB_FROM_MAIN;
 #ifdef MM_JPEG_USE_PIPELINE
-  p_session->thumb_from_main = 1;
   omx_lib = "OMX.qcom.image.jpeg.encoder_pipeline";
 #endif
 
+  if (OMX_TRUE == p_session->sw_encode) {
+    p_session->warm = OMX_FALSE;
+    p_session->thumb_from_main = 0;
+    my_obj->num_sessions++;
+    return rc;
+  }
+
+  /* the parked handle is bound to this slot through pAppData */
+  p_session->warm = p_session->cached;
+  if (OMX_TRUE == p_session->cached) {
+    CDBG_HIGH("%s:%d] reuse cached OMX handle %p", __func__, __LINE__,
+      p_session->omx_handle);
+    p_session->cached = OMX_FALSE;
+    my_obj->num_sessions++;
+    return rc;
+  }
+
   rc = OMX_GetHandle(&p_session->omx_handle,
       omx_lib,
       (void *)p_session,
@@ -327,29 +353,23 @@ OMX_ERRORTYPE mm_jpeg_session_create(mm_jpeg_job_session_t* p_session)
 
 
 
-/** mm_jpeg_session_destroy:
+/** mm_jpeg_session_unload:
  *
  *  Arguments:
  *    @p_session: job session
  *
  *  Return:
- *       none
+ *       OMX state the component is left in
  *
  *  Description:
- *       Destroy a jpeg encode session
+ *       Bring the OMX component back to loaded state,
+ *       freeing the buffers registered with it
  *
  **/
-void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
+static OMX_STATETYPE mm_jpeg_session_unload(mm_jpeg_job_session_t* p_session)
 {
   OMX_ERRORTYPE rc = OMX_ErrorNone;
-  OMX_STATETYPE state;
-  mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
-
-  CDBG("%s:%d] E", __func__, __LINE__);
-  if (NULL == p_session->omx_handle) {
-    CDBG_ERROR("%s:%d] invalid handle", __func__, __LINE__);
-    return;
-  }
+  OMX_STATETYPE state = OMX_StateInvalid;
 
   rc = OMX_GetState(p_session->omx_handle, &state);
 
@@ -371,11 +391,36 @@ void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
     }
   }
 
+  rc = OMX_GetState(p_session->omx_handle, &state);
+  if (OMX_ErrorNone != rc) {
+    state = OMX_StateInvalid;
+  }
+  return state;
+}
+
+/** mm_jpeg_session_free_handle:
+ *
+ *  Arguments:
+ *    @p_session: job session
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Release the OMX component and the event lock of a
+ *       session slot
+ *
+ **/
+static void mm_jpeg_session_free_handle(mm_jpeg_job_session_t* p_session)
+{
+  OMX_ERRORTYPE rc = OMX_ErrorNone;
+
   rc = OMX_FreeHandle(p_session->omx_handle);
   if (0 != rc) {
     CDBG_ERROR("%s:%d] OMX_FreeHandle failed (%d)", __func__, __LINE__, rc);
   }
   p_session->omx_handle = NULL;
+  p_session->cached = OMX_FALSE;
 
   pthread_mutex_destroy(&p_session->lock);
   pthread_cond_destroy(&p_session->cond);
@@ -384,6 +429,32 @@ void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
     free(p_session->meta_enc_key);
     p_session->meta_enc_key = NULL;
   }
+}
+
+/** mm_jpeg_session_destroy:
+ *
+ *  Arguments:
+ *    @p_session: job session
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Destroy a jpeg encode session
+ *
+ **/
+void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
+{
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *) p_session->jpeg_obj;
+
+  CDBG("%s:%d] E", __func__, __LINE__);
+  if (NULL == p_session->omx_handle) {
+    CDBG_ERROR("%s:%d] invalid handle", __func__, __LINE__);
+    return;
+  }
+
+  mm_jpeg_session_unload(p_session);
+  mm_jpeg_session_free_handle(p_session);
 
   my_obj->num_sessions--;
 
@@ -395,6 +466,99 @@ void mm_jpeg_session_destroy(mm_jpeg_job_session_t* p_session)
   CDBG_HIGH("%s:%d] Session destroy successful. X", __func__, __LINE__);
 }
 
+/** mm_jpeg_session_park:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: job session
+ *
+ *  Return:
+ *       OMX_TRUE if the OMX handle is kept in the slot
+ *
+ *  Description:
+ *       Unload the component of a session being destroyed but
+ *       keep its handle, so the next session created in this
+ *       slot skips OMX_GetHandle and any port setup that did
+ *       not change. The buffers belong to the client and are
+ *       always freed
+ *
+ **/
+static OMX_BOOL mm_jpeg_session_park(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t* p_session)
+{
+  mm_jpeg_client_t *p_client =
+    &my_obj->clnt_mgr[GET_CLIENT_IDX(p_session->sessionId)];
+  uint32_t num_cached = 0;
+  int i;
+
+  if (!my_obj->session_cache || (OMX_TRUE != p_session->config) ||
+    (OMX_ErrorNone != p_session->error_flag) ||
+    (NULL != p_session->meta_enc_key)) {
+    return OMX_FALSE;
+  }
+
+  for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
+    if (OMX_TRUE == p_client->session[i].cached) {
+      num_cached++;
+    }
+  }
+  if (num_cached >= MM_JPEG_MAX_CACHED_SESSIONS) {
+    return OMX_FALSE;
+  }
+
+  if (OMX_StateLoaded != mm_jpeg_session_unload(p_session)) {
+    CDBG_ERROR("%s:%d] component not unloaded, dropping it",
+      __func__, __LINE__);
+    return OMX_FALSE;
+  }
+
+  p_session->cached = OMX_TRUE;
+  CDBG_HIGH("%s:%d] cached OMX handle %p", __func__, __LINE__,
+    p_session->omx_handle);
+  return OMX_TRUE;
+}
+
+/** mm_jpeg_session_release:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @p_session: job session
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Tear down all the OMX sessions chained to p_session,
+ *       parking the handles that can be reused
+ *
+ **/
+static void mm_jpeg_session_release(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_session_t* p_session)
+{
+  for (; NULL != p_session; p_session = p_session->next_session) {
+    if (OMX_TRUE == p_session->sw_encode) {
+      pthread_mutex_destroy(&p_session->lock);
+      pthread_cond_destroy(&p_session->cond);
+      if (NULL != p_session->meta_enc_key) {
+        free(p_session->meta_enc_key);
+        p_session->meta_enc_key = NULL;
+      }
+      p_session->sw_encode = OMX_FALSE;
+      my_obj->num_sessions--;
+      continue;
+    }
+    if (NULL == p_session->omx_handle) {
+      CDBG_ERROR("%s:%d] invalid handle", __func__, __LINE__);
+      continue;
+    }
+    if (OMX_TRUE != mm_jpeg_session_park(my_obj, p_session)) {
+      mm_jpeg_session_unload(p_session);
+      mm_jpeg_session_free_handle(p_session);
+    }
+    my_obj->num_sessions--;
+  }
+}
+
 
 
 /** mm_jpeg_session_config_main_buffer_offset:
@@ -920,6 +1084,7 @@ OMX_ERRORTYPE mm_jpeg_session_config_thumbnail(mm_jpeg_job_session_t* p_session)
   mm_jpeg_dim_t *p_main_dim = &p_jobparams->main_dim;
   QOMX_YUV_FRAME_INFO *p_frame_info = &thumbnail_info.tmbOffset;
   mm_jpeg_buf_t *p_tmb_buf = &p_params->src_thumb_buf[p_jobparams->thumb_index];
+  int prescaled;
 
   CDBG_HIGH("%s:%d] encode_thumbnail %u", __func__, __LINE__,
     p_params->encode_thumbnail);
@@ -996,6 +1161,16 @@ OMX_ERRORTYPE mm_jpeg_session_config_thumbnail(mm_jpeg_job_session_t* p_session)
     thumbnail_info.output_height = (OMX_U32)p_thumb_dim->src_dim.height;
   }
 
+  /* A thumbnail the client already scaled from the main image comes at
+   * the output size with a full crop. Its FOV and aspect ratio were taken
+   * care of while scaling, so it is encoded as is. */
+  prescaled = !p_session->thumb_from_main &&
+    ((OMX_U32)p_thumb_dim->src_dim.width == thumbnail_info.output_width) &&
+    ((OMX_U32)p_thumb_dim->src_dim.height == thumbnail_info.output_height) &&
+    (p_thumb_dim->crop.left == 0) && (p_thumb_dim->crop.top == 0) &&
+    (p_thumb_dim->crop.width == p_thumb_dim->src_dim.width) &&
+    (p_thumb_dim->crop.height == p_thumb_dim->src_dim.height);
+
   //If the main image and thumbnail aspect ratio are different, reset the
   // thumbnail crop info to avoid distortion
   double main_aspect_ratio = (double)p_main_dim->dst_dim.width /
@@ -1003,7 +1178,10 @@ OMX_ERRORTYPE mm_jpeg_session_config_thumbnail(mm_jpeg_job_session_t* p_session)
   double thumb_aspect_ratio = (double)thumbnail_info.output_width /
     (double)thumbnail_info.output_height;
 
-  if ((thumb_aspect_ratio - main_aspect_ratio) > ASPECT_TOLERANCE) {
+  if (prescaled) {
+    CDBG("%s:%d] Thumbnail prescaled to %dx%d", __func__, __LINE__,
+      p_thumb_dim->src_dim.width, p_thumb_dim->src_dim.height);
+  } else if ((thumb_aspect_ratio - main_aspect_ratio) > ASPECT_TOLERANCE) {
     mm_jpeg_get_thumbnail_crop(p_thumb_dim, p_main_dim, 0);
   } else if((main_aspect_ratio - thumb_aspect_ratio) > ASPECT_TOLERANCE){
     mm_jpeg_get_thumbnail_crop(p_thumb_dim, p_main_dim, 1);
@@ -1017,8 +1195,8 @@ OMX_ERRORTYPE mm_jpeg_session_config_thumbnail(mm_jpeg_job_session_t* p_session)
 
   //If main image cropping/scaling is enabled, thumb FOV should be within
   //main image FOV
-  if ((p_main_dim->crop.width != p_main_dim->src_dim.width) ||
-    (p_main_dim->crop.height != p_main_dim->src_dim.height)) {
+  if (!prescaled && ((p_main_dim->crop.width != p_main_dim->src_dim.width) ||
+    (p_main_dim->crop.height != p_main_dim->src_dim.height))) {
     if ((p_thumb_dim->crop.left < p_main_dim->crop.left) ||
       ((p_thumb_dim->crop.left + p_thumb_dim->crop.width) >
       (p_main_dim->crop.left + p_main_dim->crop.width)) ||
@@ -1139,6 +1317,56 @@ OMX_ERRORTYPE mm_jpeg_session_config_main_crop(mm_jpeg_job_session_t *p_session)
   return ret;
 }
 
+/** mm_jpeg_session_build_key:
+ *
+ *  Arguments:
+ *    @p_params: encode params
+ *    @thumb_from_main: thumbnail is taken from the main image
+ *    @p_key: configuration key
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Collect the session level configuration that
+ *       mm_jpeg_session_config_main programs into OMX
+ *
+ **/
+static void mm_jpeg_session_build_key(const mm_jpeg_encode_params_t *p_params,
+  int thumb_from_main, mm_jpeg_session_key_t *p_key)
+{
+  mm_jpeg_port_key_t *p_ports = &p_key->ports;
+  const mm_jpeg_buf_t *p_tmb_buf = &p_params->src_thumb_buf[0];
+  const cam_dimension_t *p_tmb_dim = &p_params->thumb_dim.src_dim;
+  uint32_t num_tmb_bufs = p_params->num_tmb_bufs;
+
+  if (thumb_from_main) {
+    p_tmb_buf = &p_params->src_main_buf[0];
+    p_tmb_dim = &p_params->main_dim.src_dim;
+    num_tmb_bufs = p_params->num_src_bufs;
+  }
+
+  memset(p_key, 0, sizeof(*p_key));
+  p_ports->main_dim = p_params->main_dim.src_dim;
+  p_ports->main_offset = p_params->src_main_buf[0].offset;
+  p_ports->main_buf_size = p_params->src_main_buf[0].buf_size;
+  p_ports->color_format = p_params->color_format;
+  p_ports->num_src_bufs = p_params->num_src_bufs;
+  p_ports->encode_thumbnail = p_params->encode_thumbnail;
+  if (p_params->encode_thumbnail) {
+    p_ports->thumb_dim = *p_tmb_dim;
+    p_ports->thumb_offset = p_tmb_buf->offset;
+    p_ports->thumb_buf_size = p_tmb_buf->buf_size;
+    p_ports->thumb_color_format = p_params->thumb_color_format;
+    p_ports->num_tmb_bufs = num_tmb_bufs;
+  }
+  p_ports->dst_buf_size = p_params->dest_buf[0].buf_size;
+  p_ports->num_dst_bufs = p_params->num_dst_bufs;
+  p_ports->rotation = p_params->rotation;
+  p_key->burst_mode = p_params->burst_mode;
+  p_key->get_memory = p_params->get_memory;
+}
+
 /** mm_jpeg_session_config_main:
  *
  *  Arguments:
@@ -1148,34 +1376,54 @@ OMX_ERRORTYPE mm_jpeg_session_config_main_crop(mm_jpeg_job_session_t *p_session)
  *       OMX error values
  *
  *  Description:
- *       Configure main image
+ *       Configure main image. On a reused OMX handle only the
+ *       settings that differ from what it already holds are
+ *       programmed again
  *
  **/
 OMX_ERRORTYPE mm_jpeg_session_config_main(mm_jpeg_job_session_t *p_session)
 {
   OMX_ERRORTYPE rc = OMX_ErrorNone;
+  mm_jpeg_session_key_t key;
+  mm_jpeg_session_key_t *p_held = &p_session->cache_key;
+  OMX_BOOL warm = p_session->warm;
+  OMX_BOOL ports_changed = OMX_TRUE;
+
+  mm_jpeg_session_build_key(&p_session->params, p_session->thumb_from_main,
+    &key);
+  p_session->warm = OMX_FALSE;
+  if (warm) {
+    ports_changed = memcmp(&key.ports, &p_held->ports, sizeof(key.ports)) ?
+      OMX_TRUE : OMX_FALSE;
+    CDBG_HIGH("%s:%d] cached handle, ports %s", __func__, __LINE__,
+      ports_changed ? "changed" : "unchanged");
+  }
+
+  if (ports_changed) {
+    /* config port */
+    CDBG_HIGH("%s:%d] config port", __func__, __LINE__);
+    rc = mm_jpeg_session_config_ports(p_session);
+    if (OMX_ErrorNone != rc) {
+      CDBG_ERROR("%s: config port failed", __func__);
+      return rc;
+    }
 
-  /* config port */
-  CDBG_HIGH("%s:%d] config port", __func__, __LINE__);
-  rc = mm_jpeg_session_config_ports(p_session);
-  if (OMX_ErrorNone != rc) {
-    CDBG_ERROR("%s: config port failed", __func__);
-    return rc;
-  }
-
-  /* config buffer offset */
-  CDBG("%s:%d] config main buf offset", __func__, __LINE__);
-  rc = mm_jpeg_session_config_main_buffer_offset(p_session);
-  if (OMX_ErrorNone != rc) {
-    CDBG_ERROR("%s: config buffer offset failed", __func__);
-    return rc;
+    /* config buffer offset */
+    CDBG("%s:%d] config main buf offset", __func__, __LINE__);
+    rc = mm_jpeg_session_config_main_buffer_offset(p_session);
+    if (OMX_ErrorNone != rc) {
+      CDBG_ERROR("%s: config buffer offset failed", __func__);
+      return rc;
+    }
   }
 
   /* set the encoding mode */
-  rc = mm_jpeg_encoding_mode(p_session);
-  if (OMX_ErrorNone != rc) {
-    CDBG_ERROR("%s: config encoding mode failed", __func__);
-    return rc;
+  if (!warm) {
+    rc = mm_jpeg_encoding_mode(p_session);
+    if (OMX_ErrorNone != rc) {
+      CDBG_ERROR("%s: config encoding mode failed", __func__);
+      return rc;
+    }
   }
 
   /* set the metadata encrypt key */
@@ -1186,18 +1434,23 @@ OMX_ERRORTYPE mm_jpeg_session_config_main(mm_jpeg_job_session_t *p_session)
   }
 
   /* set the mem ops */
-  rc = mm_jpeg_mem_ops(p_session);
-  if (OMX_ErrorNone != rc) {
-    CDBG_ERROR("%s: config mem ops failed", __func__);
-    return rc;
+  if (!warm || (key.get_memory != p_held->get_memory)) {
+    rc = mm_jpeg_mem_ops(p_session);
+    if (OMX_ErrorNone != rc) {
+      CDBG_ERROR("%s: config mem ops failed", __func__);
+      return rc;
+    }
   }
   /* set the jpeg speed mode */
-  rc = mm_jpeg_speed_mode(p_session);
-  if (OMX_ErrorNone != rc) {
-    CDBG_ERROR("%s: config speed mode failed", __func__);
-    return rc;
+  if (ports_changed || (key.burst_mode != p_held->burst_mode)) {
+    rc = mm_jpeg_speed_mode(p_session);
+    if (OMX_ErrorNone != rc) {
+      CDBG_ERROR("%s: config speed mode failed", __func__);
+      return rc;
+    }
   }
 
+  *p_held = key;
   return rc;
 }
 
@@ -1219,7 +1472,7 @@ OMX_ERRORTYPE mm_jpeg_session_config_common(mm_jpeg_job_session_t *p_session)
   OMX_INDEXTYPE exif_idx;
   OMX_CONFIG_ROTATIONTYPE rotate;
   mm_jpeg_encode_job_t *p_jobparams = &p_session->encode_job;
-  QOMX_EXIF_INFO exif_info;
+  QOMX_EXIF_INFO *exif_info = &p_session->exif_arena.info;
 
   /* set rotation */
   memset(&rotate, 0, sizeof(rotate));
@@ -1235,7 +1488,7 @@ OMX_ERRORTYPE mm_jpeg_session_config_common(mm_jpeg_job_session_t *p_session)
     (int)p_jobparams->rotation, (int)rotate.nPortIndex);
 
   /* Set Exif data*/
-  memset(&p_session->exif_info_local[0], 0, sizeof(p_session->exif_info_local));
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
   rc = OMX_GetExtensionIndex(p_session->omx_handle, QOMX_IMAGE_EXT_EXIF_NAME,
     &exif_idx);
   if (OMX_ErrorNone != rc) {
@@ -1254,20 +1507,16 @@ OMX_ERRORTYPE mm_jpeg_session_config_common(mm_jpeg_job_session_t *p_session)
     }
   }
   /*parse aditional exif data from the metadata*/
-  exif_info.numOfEntries = 0;
-  exif_info.exif_data = &p_session->exif_info_local[0];
-  process_meta_data(p_jobparams->p_metadata, &exif_info,
+  process_meta_data(p_jobparams->p_metadata, &p_session->exif_arena,
     &p_jobparams->cam_exif_params, p_jobparams->hal_version);
-  /* After Parse metadata */
-  p_session->exif_count_local = (int)exif_info.numOfEntries;
 
-  if (exif_info.numOfEntries > 0) {
+  if (exif_info->numOfEntries > 0) {
     /* set exif tags */
-    CDBG("%s:%d] exif tags from metadata count %d", __func__, __LINE__,
-      (int)exif_info.numOfEntries);
+    CDBG("%s:%d] exif tags from metadata count %d, %u bytes", __func__,
+      __LINE__, (int)exif_info->numOfEntries, p_session->exif_arena.used);
 
     rc = OMX_SetConfig(p_session->omx_handle, exif_idx,
-      &exif_info);
+      exif_info);
     if (OMX_ErrorNone != rc) {
       CDBG_ERROR("%s:%d] Error %d", __func__, __LINE__, rc);
       return rc;
@@ -1599,6 +1848,62 @@ error:
   return ret;
 }
 
+/** mm_jpeg_session_encode_sw:
+ *
+ *  Arguments:
+ *    @p_session: encode session
+ *
+ *  Return:
+ *       OMX error values
+ *
+ *  Description:
+ *       Encode the job on the software encoder. The encode is
+ *       synchronous, the job is completed and the client called
+ *       back before returning
+ *
+ **/
+static OMX_ERRORTYPE mm_jpeg_session_encode_sw(mm_jpeg_job_session_t *p_session)
+{
+  mm_jpeg_obj *my_obj = (mm_jpeg_obj *)p_session->jpeg_obj;
+  mm_jpeg_output_t output_buf;
+  int32_t rc = 0;
+
+  pthread_mutex_lock(&p_session->lock);
+  p_session->abort_state = MM_JPEG_ABORT_NONE;
+  p_session->encoding = OMX_TRUE;
+  pthread_mutex_unlock(&p_session->lock);
+
+  memset(&output_buf, 0, sizeof(output_buf));
+  rc = mm_jpeg_swenc_encode(&my_obj->swenc, &p_session->params,
+    &p_session->encode_job, &output_buf);
+  if (rc) {
+    CDBG_ERROR("%s:%d] software encode failed", __func__, __LINE__);
+    return OMX_ErrorUndefined;
+  }
+
+  pthread_mutex_lock(&p_session->lock);
+  ATRACE_INT("Camera:JPEG",
+      (int32_t)((uint32_t)GET_SESSION_IDX(
+        p_session->sessionId)<<16 | --p_session->job_index));
+  p_session->fbd_count++;
+  if ((MM_JPEG_ABORT_NONE == p_session->abort_state) &&
+    (NULL != p_session->params.jpeg_cb)) {
+    p_session->job_status = JPEG_JOB_STATUS_DONE;
+    CDBG_HIGH("%s:%d] send jpeg callback %d buf 0x%p len %zu JobID %u",
+      __func__, __LINE__, p_session->job_status, output_buf.buf_vaddr,
+      output_buf.buf_filled_len, p_session->jobId);
+    p_session->params.jpeg_cb(p_session->job_status,
+      p_session->client_hdl,
+      p_session->jobId,
+      &output_buf,
+      p_session->params.userdata);
+  }
+  mm_jpegenc_job_done(p_session);
+  pthread_mutex_unlock(&p_session->lock);
+
+  return OMX_ErrorNone;
+}
+
 /** mm_jpeg_process_encoding_job:
  *
  *  Arguments:
@@ -1607,6 +1912,7 @@ error:
  *
  *  Return:
  *       0 for success -1 otherwise
+ *       MM_JPEG_JOB_DEFERRED if no OMX handle is free for the job
  *
  *  Description:
  *       Start the encoding job
@@ -1636,16 +1942,10 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
   p_session = qdata.p;
 
   if (NULL == p_session) {
+    /* No available handles, the job manager puts the job back */
     CDBG_HIGH("%s:%d] No available sessions %d",
           __func__, __LINE__, ret);
-    /* No available handles */
-    qdata.p = job_node;
-    mm_jpeg_queue_enq_head(&my_obj->job_mgr.job_queue, qdata);
-
-    CDBG_HIGH("%s:%d]end enqueue %d",
-              __func__, __LINE__, ret);
-    return rc;
-
+    return MM_JPEG_JOB_DEFERRED;
   }
 
   p_session->auto_out_buf = OMX_FALSE;
@@ -1677,7 +1977,11 @@ int32_t mm_jpeg_process_encoding_job(mm_jpeg_obj *my_obj, mm_jpeg_job_q_node_t*
 
   p_session->encode_job = job_node->enc_info.encode_job;
   p_session->jobId = job_node->enc_info.job_id;
-  ret = mm_jpeg_session_encode(p_session);
+  if (OMX_TRUE == p_session->sw_encode) {
+    ret = mm_jpeg_session_encode_sw(p_session);
+  } else {
+    ret = mm_jpeg_session_encode(p_session);
+  }
   if (ret) {
     CDBG_ERROR("%s:%d] encode session failed", __func__, __LINE__);
     goto error;
@@ -1709,6 +2013,67 @@ error:
 
 
 
+/** mm_jpeg_time_us:
+ *
+ *  Arguments:
+ *    none
+ *
+ *  Return:
+ *       monotonic time in microseconds
+ *
+ *  Description:
+ *       Timestamp used for the job manager wait counters
+ *
+ **/
+static uint64_t mm_jpeg_time_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/** mm_jpeg_jobmgr_can_admit:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       1 if a worker may take the next job, 0 otherwise
+ *
+ *  Description:
+ *       Admission control of the job manager, called with sched_lock
+ *       held. A job is admitted only while the jobs in OMX and the ones
+ *       being started stay below the concurrent session count. After a
+ *       job got deferred nothing is admitted until something is kicked,
+ *       i.e. a job finished or a new one arrived.
+ *
+ **/
+static int mm_jpeg_jobmgr_can_admit(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+  uint32_t num_busy;
+
+  if (cmd_thread->num_paused ||
+    (cmd_thread->stalled && (cmd_thread->stall_gen == cmd_thread->kick_gen))) {
+    return 0;
+  }
+
+  if ((0 == mm_jpeg_queue_get_size(&cmd_thread->prio_queue)) &&
+    (0 == mm_jpeg_queue_get_size(&cmd_thread->job_queue))) {
+    return 0;
+  }
+
+  num_busy = mm_jpeg_queue_get_size(&my_obj->ongoing_job_q) +
+    cmd_thread->num_submitting;
+  if (num_busy >= MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
+    CDBG("%s:%d] ongoing job already reach max %d", __func__,
+      __LINE__, num_busy);
+    return 0;
+  }
+  return 1;
+}
+
 /** mm_jpeg_jobmgr_thread:
  *
  *  Arguments:
@@ -1718,68 +2083,205 @@ error:
  *       0 for success else failure
  *
  *  Description:
- *       job manager thread main function
+ *       job manager worker main function. Workers take jobs from the
+ *       priority lane first, start them without holding sched_lock and
+ *       put deferred jobs back at the head of the lane they came from.
  *
  **/
 static void *mm_jpeg_jobmgr_thread(void *data)
 {
   mm_jpeg_q_data_t qdata;
-  int rc = 0;
-  int running = 1;
-  uint32_t num_ongoing_jobs = 0;
+  int32_t rc = 0;
+  uint32_t gen;
+  uint64_t wait_us;
+  mm_jpeg_job_lane_t lane;
   mm_jpeg_obj *my_obj = (mm_jpeg_obj*)data;
   mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+  mm_jpeg_sched_stats_t *stats = &cmd_thread->stats;
   mm_jpeg_job_q_node_t* node = NULL;
   prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_thread", 0, 0, 0);
 
-  do {
-    do {
-      rc = cam_sem_wait(&cmd_thread->job_sem);
-      if (rc != 0 && errno != EINVAL) {
-        CDBG_ERROR("%s: cam_sem_wait error (%s)",
-          __func__, strerror(errno));
-        return NULL;
-      }
-    } while (rc != 0);
-
-    /* check ongoing q size */
-    num_ongoing_jobs = mm_jpeg_queue_get_size(&my_obj->ongoing_job_q);
-
-    CDBG("%s:%d] ongoing job  %d %d", __func__,
-      __LINE__, num_ongoing_jobs, MM_JPEG_CONCURRENT_SESSIONS_COUNT);
-    if (num_ongoing_jobs >= MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
-      CDBG_ERROR("%s:%d] ongoing job already reach max %d", __func__,
-        __LINE__, num_ongoing_jobs);
+  pthread_mutex_lock(&cmd_thread->sched_lock);
+  while (cmd_thread->running) {
+    if (!mm_jpeg_jobmgr_can_admit(my_obj)) {
+      pthread_cond_wait(&cmd_thread->sched_cond, &cmd_thread->sched_lock);
       continue;
     }
 
-    pthread_mutex_lock(&my_obj->job_lock);
     /* can go ahead with new work */
-    qdata = mm_jpeg_queue_deq(&cmd_thread->job_queue);
+    lane = MM_JPEG_LANE_PRIO;
+    qdata = mm_jpeg_queue_deq(&cmd_thread->prio_queue);
+    if (NULL == qdata.p) {
+      lane = MM_JPEG_LANE_NORMAL;
+      qdata = mm_jpeg_queue_deq(&cmd_thread->job_queue);
+    }
     node = (mm_jpeg_job_q_node_t*)qdata.p;
-    if (node != NULL) {
-      switch (node->type) {
-      case MM_JPEG_CMD_TYPE_JOB:
-        rc = mm_jpeg_process_encoding_job(my_obj, node);
-        break;
-      case MM_JPEG_CMD_TYPE_DECODE_JOB:
-        rc = mm_jpegdec_process_decoding_job(my_obj, node);
-        break;
-      case MM_JPEG_CMD_TYPE_EXIT:
-      default:
-        /* free node */
-        free(node);
-        /* set running flag to false */
-        running = 0;
-        break;
-      }
+    if (NULL == node) {
+      continue;
+    }
+
+    gen = cmd_thread->kick_gen;
+    cmd_thread->num_submitting++;
+    wait_us = mm_jpeg_time_us() - node->enq_time_us;
+    stats->admitted++;
+    stats->total_wait_us += wait_us;
+    if (wait_us > stats->max_wait_us) {
+      stats->max_wait_us = wait_us;
     }
-    pthread_mutex_unlock(&my_obj->job_lock);
+    pthread_mutex_unlock(&cmd_thread->sched_lock);
+
+    CDBG("%s:%d] job 0x%x lane %d waited %llu us", __func__, __LINE__,
+      node->enc_info.job_id, lane, (unsigned long long)wait_us);
+
+    switch (node->type) {
+    case MM_JPEG_CMD_TYPE_JOB:
+      rc = mm_jpeg_process_encoding_job(my_obj, node);
+      break;
+    case MM_JPEG_CMD_TYPE_DECODE_JOB:
+      rc = mm_jpegdec_process_decoding_job(my_obj, node);
+      break;
+    default:
+      CDBG_ERROR("%s:%d] invalid job type %d", __func__, __LINE__,
+        node->type);
+      free(node);
+      rc = -1;
+      break;
+    }
+
+    pthread_mutex_lock(&cmd_thread->sched_lock);
+    if (MM_JPEG_JOB_DEFERRED == rc) {
+      qdata.p = node;
+      mm_jpeg_queue_enq_head((MM_JPEG_LANE_PRIO == lane) ?
+        &cmd_thread->prio_queue : &cmd_thread->job_queue, qdata);
+      /* retry once a handle comes back, unless one already did */
+      cmd_thread->stalled = 1;
+      cmd_thread->stall_gen = gen;
+      stats->deferred++;
+    }
+    cmd_thread->num_submitting--;
+    pthread_cond_broadcast(&cmd_thread->sched_cond);
+  }
+  pthread_mutex_unlock(&cmd_thread->sched_lock);
 
-  } while (running);
   return NULL;
 }
 
+/** mm_jpeg_jobmgr_enqueue:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @node: job to queue
+ *    @lane: lane the job waits in
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Queues a job and wakes up the workers
+ *
+ **/
+int32_t mm_jpeg_jobmgr_enqueue(mm_jpeg_obj *my_obj,
+  mm_jpeg_job_q_node_t *node, mm_jpeg_job_lane_t lane)
+{
+  mm_jpeg_q_data_t qdata;
+  int32_t rc;
+  uint32_t depth = 0;
+  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+  mm_jpeg_queue_t *queue = (MM_JPEG_LANE_PRIO == lane) ?
+    &cmd_thread->prio_queue : &cmd_thread->job_queue;
+
+  node->enq_time_us = mm_jpeg_time_us();
+  qdata.p = node;
+
+  pthread_mutex_lock(&cmd_thread->sched_lock);
+  rc = mm_jpeg_queue_enq(queue, qdata);
+  if (0 == rc) {
+    depth = mm_jpeg_queue_get_size(queue);
+    cmd_thread->stats.enqueued[lane]++;
+    if (depth > cmd_thread->stats.max_depth[lane]) {
+      cmd_thread->stats.max_depth[lane] = depth;
+    }
+    cmd_thread->kick_gen++;
+    pthread_cond_broadcast(&cmd_thread->sched_cond);
+  }
+  pthread_mutex_unlock(&cmd_thread->sched_lock);
+
+  CDBG("%s:%d] lane %d depth %d", __func__, __LINE__, lane, depth);
+  return rc;
+}
+
+/** mm_jpeg_jobmgr_kick:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Re-arms admission after a job slot or OMX handle got freed
+ *
+ **/
+void mm_jpeg_jobmgr_kick(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+
+  pthread_mutex_lock(&cmd_thread->sched_lock);
+  cmd_thread->kick_gen++;
+  pthread_cond_broadcast(&cmd_thread->sched_cond);
+  pthread_mutex_unlock(&cmd_thread->sched_lock);
+}
+
+/** mm_jpeg_jobmgr_pause:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Stops admitting jobs and waits for the workers to finish
+ *       starting the ones already admitted, so that the queues and
+ *       sessions can be torn down. Must be paired with
+ *       mm_jpeg_jobmgr_resume.
+ *
+ **/
+void mm_jpeg_jobmgr_pause(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+
+  pthread_mutex_lock(&cmd_thread->sched_lock);
+  cmd_thread->num_paused++;
+  while (cmd_thread->num_submitting > 0) {
+    pthread_cond_wait(&cmd_thread->sched_cond, &cmd_thread->sched_lock);
+  }
+  pthread_mutex_unlock(&cmd_thread->sched_lock);
+}
+
+/** mm_jpeg_jobmgr_resume:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Lets the workers admit jobs again after mm_jpeg_jobmgr_pause
+ *
+ **/
+void mm_jpeg_jobmgr_resume(mm_jpeg_obj *my_obj)
+{
+  mm_jpeg_job_cmd_thread_t *cmd_thread = &my_obj->job_mgr;
+
+  pthread_mutex_lock(&cmd_thread->sched_lock);
+  cmd_thread->num_paused--;
+  cmd_thread->kick_gen++;
+  pthread_cond_broadcast(&cmd_thread->sched_cond);
+  pthread_mutex_unlock(&cmd_thread->sched_lock);
+}
+
 /** mm_jpeg_jobmgr_thread_launch:
  *
  *  Arguments:
@@ -1789,23 +2291,56 @@ static void *mm_jpeg_jobmgr_thread(void *data)
  *       0 for success else failure
  *
  *  Description:
- *       launches the job manager thread
+ *       launches the job manager workers
  *
  **/
 int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj)
 {
   int32_t rc = 0;
+  uint32_t i;
+  uint32_t num_workers;
+  char prop[PROPERTY_VALUE_MAX];
   mm_jpeg_job_cmd_thread_t *job_mgr = &my_obj->job_mgr;
 
-  cam_sem_init(&job_mgr->job_sem, 0);
+  memset(job_mgr, 0, sizeof(mm_jpeg_job_cmd_thread_t));
   mm_jpeg_queue_init(&job_mgr->job_queue);
+  mm_jpeg_queue_init(&job_mgr->prio_queue);
+  pthread_mutex_init(&job_mgr->sched_lock, NULL);
+  pthread_cond_init(&job_mgr->sched_cond, NULL);
+  job_mgr->running = 1;
 
-  /* launch the thread */
-  pthread_create(&job_mgr->pid,
-    NULL,
-    mm_jpeg_jobmgr_thread,
-    (void *)my_obj);
-  pthread_setname_np(job_mgr->pid, "CAM_jpeg_jobmgr");
+  /* more workers than concurrent jobs would only sit idle */
+  property_get("persist.camera.jpeg.workers", prop, "0");
+  num_workers = (uint32_t)atoi(prop);
+  if (0 == num_workers) {
+    num_workers = MM_JPEG_CONCURRENT_SESSIONS_COUNT;
+  }
+  if (num_workers > MM_JPEG_MAX_JOB_WORKERS) {
+    num_workers = MM_JPEG_MAX_JOB_WORKERS;
+  }
+
+  /* launch the workers */
+  for (i = 0; i < num_workers; i++) {
+    if (pthread_create(&job_mgr->pid[i],
+      NULL,
+      mm_jpeg_jobmgr_thread,
+      (void *)my_obj)) {
+      CDBG_ERROR("%s:%d] Cannot launch worker %d", __func__, __LINE__, i);
+      break;
+    }
+    pthread_setname_np(job_mgr->pid[i], "CAM_jpeg_jobmgr");
+  }
+  job_mgr->num_workers = i;
+
+  if (0 == job_mgr->num_workers) {
+    mm_jpeg_queue_deinit(&job_mgr->prio_queue);
+    mm_jpeg_queue_deinit(&job_mgr->job_queue);
+    pthread_cond_destroy(&job_mgr->sched_cond);
+    pthread_mutex_destroy(&job_mgr->sched_lock);
+    rc = -1;
+  }
+
+  CDBG_HIGH("%s:%d] %d workers", __func__, __LINE__, job_mgr->num_workers);
   return rc;
 }
 
@@ -1818,35 +2353,41 @@ int32_t mm_jpeg_jobmgr_thread_launch(mm_jpeg_obj *my_obj)
  *       0 for success else failure
  *
  *  Description:
- *       Releases the job manager thread
+ *       Releases the job manager workers
  *
  **/
 int32_t mm_jpeg_jobmgr_thread_release(mm_jpeg_obj * my_obj)
 {
-  mm_jpeg_q_data_t qdata;
   int32_t rc = 0;
+  uint32_t i;
   mm_jpeg_job_cmd_thread_t * cmd_thread = &my_obj->job_mgr;
-  mm_jpeg_job_q_node_t* node =
-    (mm_jpeg_job_q_node_t *)malloc(sizeof(mm_jpeg_job_q_node_t));
-  if (NULL == node) {
-    CDBG_ERROR("%s: No memory for mm_jpeg_job_q_node_t", __func__);
-    return -1;
-  }
-
-  memset(node, 0, sizeof(mm_jpeg_job_q_node_t));
-  node->type = MM_JPEG_CMD_TYPE_EXIT;
+  mm_jpeg_sched_stats_t *stats = &cmd_thread->stats;
 
-  qdata.p = node;
-  mm_jpeg_queue_enq(&cmd_thread->job_queue, qdata);
-  cam_sem_post(&cmd_thread->job_sem);
+  pthread_mutex_lock(&cmd_thread->sched_lock);
+  cmd_thread->running = 0;
+  pthread_cond_broadcast(&cmd_thread->sched_cond);
+  pthread_mutex_unlock(&cmd_thread->sched_lock);
 
-  /* wait until cmd thread exits */
-  if (pthread_join(cmd_thread->pid, NULL) != 0) {
-    CDBG("%s: pthread dead already", __func__);
+  /* wait until the workers exit */
+  for (i = 0; i < cmd_thread->num_workers; i++) {
+    if (pthread_join(cmd_thread->pid[i], NULL) != 0) {
+      CDBG("%s: pthread dead already", __func__);
+    }
   }
-  mm_jpeg_queue_deinit(&cmd_thread->job_queue);
 
-  cam_sem_destroy(&cmd_thread->job_sem);
+  CDBG_HIGH("%s:%d] jobs prio %d normal %d, max depth prio %d normal %d, "
+    "deferred %d, wait avg %llu max %llu us", __func__, __LINE__,
+    stats->enqueued[MM_JPEG_LANE_PRIO], stats->enqueued[MM_JPEG_LANE_NORMAL],
+    stats->max_depth[MM_JPEG_LANE_PRIO], stats->max_depth[MM_JPEG_LANE_NORMAL],
+    stats->deferred,
+    (unsigned long long)(stats->admitted ?
+      stats->total_wait_us / stats->admitted : 0),
+    (unsigned long long)stats->max_wait_us);
+
+  mm_jpeg_queue_deinit(&cmd_thread->prio_queue);
+  mm_jpeg_queue_deinit(&cmd_thread->job_queue);
+  pthread_cond_destroy(&cmd_thread->sched_cond);
+  pthread_mutex_destroy(&cmd_thread->sched_lock);
   memset(cmd_thread, 0, sizeof(mm_jpeg_job_cmd_thread_t));
   return rc;
 }
@@ -1869,10 +2410,19 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
   uint32_t work_buf_size;
   unsigned int i = 0;
   unsigned int initial_workbufs_cnt = 1;
+  char prop[PROPERTY_VALUE_MAX];
 
   /* init locks */
   pthread_mutex_init(&my_obj->job_lock, NULL);
 
+  property_get("persist.camera.jpeg.session_cache", prop, "1");
+  my_obj->session_cache = (uint32_t)atoi(prop);
+
+  property_get("persist.camera.jpeg.swenc", prop, "0");
+  my_obj->swenc_only = (uint32_t)atoi(prop);
+  property_get("persist.camera.jpeg.swenc.threads", prop, "0");
+  my_obj->swenc_threads = (uint32_t)atoi(prop);
+
   /* init ongoing job queue */
   rc = mm_jpeg_queue_init(&my_obj->ongoing_job_q);
   if (0 != rc) {
@@ -1925,16 +2475,24 @@ int32_t mm_jpeg_init(mm_jpeg_obj *my_obj)
 
   my_obj->work_buf_cnt = i;
 
-  /* load OMX */
+  /* load OMX, only a forced software encoder can do without it since
+   * the software path writes no EXIF and no thumbnail */
   if (OMX_ErrorNone != OMX_Init()) {
-    /* roll back in error case */
-    CDBG_ERROR("%s:%d] OMX_Init failed (%d)", __func__, __LINE__, rc);
-    for (i = 0; i < initial_workbufs_cnt; i++) {
-      buffer_deallocate(&my_obj->ionBuffer[i]);
+    if (!my_obj->swenc_only) {
+      /* roll back in error case */
+      CDBG_ERROR("%s:%d] OMX_Init failed", __func__, __LINE__);
+      for (i = 0; i < initial_workbufs_cnt; i++) {
+        buffer_deallocate(&my_obj->ionBuffer[i]);
+      }
+      mm_jpeg_jobmgr_thread_release(my_obj);
+      mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
+      pthread_mutex_destroy(&my_obj->job_lock);
+      return -1;
     }
-    mm_jpeg_jobmgr_thread_release(my_obj);
-    mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
-    pthread_mutex_destroy(&my_obj->job_lock);
+    CDBG_ERROR("%s:%d] OMX_Init failed, software encoder forced",
+      __func__, __LINE__);
+  } else {
+    my_obj->omx_loaded = OMX_TRUE;
   }
 
 #ifdef LOAD_ADSP_RPC_LIB
@@ -1973,7 +2531,15 @@ int32_t mm_jpeg_deinit(mm_jpeg_obj *my_obj)
   }
 
   /* unload OMX engine */
-  OMX_Deinit();
+  if (OMX_TRUE == my_obj->omx_loaded) {
+    OMX_Deinit();
+    my_obj->omx_loaded = OMX_FALSE;
+  }
+
+  if (OMX_TRUE == my_obj->swenc_started) {
+    mm_jpeg_swenc_deinit(&my_obj->swenc);
+    my_obj->swenc_started = OMX_FALSE;
+  }
 
   /* deinit ongoing job and cb queue */
   rc = mm_jpeg_queue_deinit(&my_obj->ongoing_job_q);
@@ -2064,7 +2630,6 @@ int32_t mm_jpeg_start_job(mm_jpeg_obj *my_obj,
   mm_jpeg_job_t *job,
   uint32_t *job_id)
 {
-  mm_jpeg_q_data_t qdata;
   int32_t rc = -1;
   uint8_t session_idx = 0;
   uint8_t client_idx = 0;
@@ -2127,10 +2692,11 @@ int32_t mm_jpeg_start_job(mm_jpeg_obj *my_obj,
 
 
 
-  qdata.p = node;
-  rc = mm_jpeg_queue_enq(&my_obj->job_mgr.job_queue, qdata);
-  if (0 == rc) {
-      cam_sem_post(&my_obj->job_mgr.job_sem);
+  /* longshot bursts must not hold back a regular snapshot */
+  rc = mm_jpeg_jobmgr_enqueue(my_obj, node, p_session->params.burst_mode ?
+    MM_JPEG_LANE_NORMAL : MM_JPEG_LANE_PRIO);
+  if (0 != rc) {
+    free(node);
   }
 
   CDBG_HIGH("%s:%d] job_id %d X", __func__, __LINE__, *job_id);
@@ -2163,9 +2729,13 @@ int32_t mm_jpeg_abort_job(mm_jpeg_obj *my_obj,
 
   CDBG("%s:%d] ", __func__, __LINE__);
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_jobmgr_pause(my_obj);
 
   /* abort job if in todo queue */
-  node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->job_mgr.job_queue, jobId);
+  node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->job_mgr.prio_queue, jobId);
+  if (NULL == node) {
+    node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->job_mgr.job_queue, jobId);
+  }
   if (NULL != node) {
     free(node);
     goto abort_done;
@@ -2187,6 +2757,7 @@ int32_t mm_jpeg_abort_job(mm_jpeg_obj *my_obj,
   }
 
 abort_done:
+  mm_jpeg_jobmgr_resume(my_obj);
   pthread_mutex_unlock(&my_obj->job_lock);
 
   return rc;
@@ -2225,6 +2796,60 @@ static int32_t mm_jpeg_read_meta_keyfile(mm_jpeg_job_session_t *p_session,
 }
 #endif // MM_JPEG_READ_META_KEYFILE
 
+/** mm_jpeg_get_cached_session_idx:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *    @client_idx: client index
+ *    @p_key: configuration of the new session
+ *    @pp_session: free session slot
+ *
+ *  Return:
+ *       session index, -1 if no slot is free
+ *
+ *  Description:
+ *       Get a free session slot, preferring one whose cached
+ *       OMX handle holds the same configuration, then any
+ *       cached handle, then an empty slot. Sessions without an
+ *       OMX handle pass a NULL key and prefer an empty slot
+ *
+ **/
+static int mm_jpeg_get_cached_session_idx(mm_jpeg_obj *my_obj,
+  int client_idx, const mm_jpeg_session_key_t *p_key,
+  mm_jpeg_job_session_t **pp_session)
+{
+  mm_jpeg_client_t *p_client = &my_obj->clnt_mgr[client_idx];
+  mm_jpeg_job_session_t *p_slot;
+  int i = 0;
+  int index = -1;
+  int score = 0;
+  int best = 0;
+
+  pthread_mutex_lock(&p_client->lock);
+  for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
+    p_slot = &p_client->session[i];
+    if (p_slot->active) {
+      continue;
+    }
+    score = 1;
+    if (NULL == p_key) {
+      score = (OMX_TRUE == p_slot->cached) ? 1 : 2;
+    } else if (OMX_TRUE == p_slot->cached) {
+      score = memcmp(&p_slot->cache_key, p_key, sizeof(*p_key)) ? 2 : 3;
+    }
+    if (score > best) {
+      best = score;
+      index = i;
+    }
+  }
+  if (index >= 0) {
+    *pp_session = &p_client->session[index];
+    p_client->session[index].active = OMX_TRUE;
+  }
+  pthread_mutex_unlock(&p_client->lock);
+  return index;
+}
+
 /** mm_jpeg_create_session:
  *
  *  Arguments:
@@ -2259,6 +2884,8 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
   mm_jpeg_queue_t *p_session_handle_q, *p_out_buf_q;
   uint32_t work_bufs_need;
   char trace_tag[32];
+  mm_jpeg_session_key_t key;
+  OMX_BOOL sw_encode = OMX_FALSE;
 
   /* validate the parameters */
   if ((p_params->num_src_bufs > MM_JPEG_MAX_BUF)
@@ -2274,7 +2901,13 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
     return -1;
   }
 
-  if (p_params->quality > MM_JPEG_NOM_QUALITY_THRESHOLD) {
+  /* the software encoder needs no OMX work buffers */
+  if (p_params->sw_encode || my_obj->swenc_only) {
+    sw_encode = OMX_TRUE;
+  }
+
+  if ((OMX_FALSE == sw_encode) &&
+    (p_params->quality > MM_JPEG_NOM_QUALITY_THRESHOLD)) {
 
     work_buf_size = CEILING64((uint32_t)my_obj->max_pic_w) *
       CEILING64((uint32_t)my_obj->max_pic_h) *
@@ -2299,10 +2932,10 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
   }
 
   num_omx_sessions = 1;
-  if (p_params->burst_mode) {
+  if (p_params->burst_mode && (OMX_FALSE == sw_encode)) {
     num_omx_sessions = MM_JPEG_CONCURRENT_SESSIONS_COUNT;
   }
-  work_bufs_need = num_omx_sessions;
+  work_bufs_need = (OMX_TRUE == sw_encode) ? 0 : num_omx_sessions;
   if (work_bufs_need > MM_JPEG_CONCURRENT_SESSIONS_COUNT) {
     work_bufs_need = MM_JPEG_CONCURRENT_SESSIONS_COUNT;
   }
@@ -2349,14 +2982,32 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
     goto error1;
   }
 
+  mm_jpeg_session_build_key(p_params, MM_JPEG_THUMB_FROM_MAIN, &key);
+
+  if ((OMX_TRUE == sw_encode) && (OMX_FALSE == my_obj->swenc_started)) {
+    rc = mm_jpeg_swenc_init(&my_obj->swenc, my_obj->swenc_threads);
+    if (rc) {
+      CDBG_ERROR("%s:%d] software encoder init failed", __func__, __LINE__);
+      goto error1;
+    }
+    my_obj->swenc_started = OMX_TRUE;
+  }
+
   for (i = 0; i < num_omx_sessions; i++) {
     uint32_t buf_idx = 0U;
-    session_idx = mm_jpeg_get_new_session_idx(my_obj, clnt_idx, &p_session);
+    session_idx = mm_jpeg_get_cached_session_idx(my_obj, clnt_idx,
+      (OMX_TRUE == sw_encode) ? NULL : &key, &p_session);
     if (session_idx < 0 || NULL == p_session) {
       CDBG_ERROR("%s:%d] invalid session id (%d)", __func__, __LINE__, session_idx);
       goto error2;
     }
 
+    /* all slots hold parked OMX handles, drop the one taken */
+    if ((OMX_TRUE == sw_encode) && (OMX_TRUE == p_session->cached)) {
+      mm_jpeg_session_free_handle(p_session);
+    }
+    p_session->sw_encode = sw_encode;
+
     snprintf(trace_tag, sizeof(trace_tag), "Camera:JPEGsession%d", session_idx);
     ATRACE_INT(trace_tag, 1);
 
@@ -2422,7 +3073,9 @@ int32_t mm_jpeg_create_session(mm_jpeg_obj *my_obj,
     mm_jpeg_read_meta_keyfile(p_session, META_KEYFILE);
 #endif
 
-    if (OMX_FALSE == p_session->config) {
+    if (OMX_TRUE == p_session->sw_encode) {
+      p_session->config = OMX_TRUE;
+    } else if (OMX_FALSE == p_session->config) {
       rc = mm_jpeg_session_configure(p_session);
       if (rc) {
         CDBG_ERROR("%s:%d] Error", __func__, __LINE__);
@@ -2467,20 +3120,13 @@ error2:
 static int32_t mm_jpegenc_destroy_job(mm_jpeg_job_session_t *p_session)
 {
   mm_jpeg_encode_job_t *p_jobparams = &p_session->encode_job;
-  int i = 0, rc = 0;
 
   CDBG_HIGH("%s:%d] Exif entry count %d %d", __func__, __LINE__,
     (int)p_jobparams->exif_info.numOfEntries,
-    (int)p_session->exif_count_local);
-  for (i = 0; i < p_session->exif_count_local; i++) {
-    rc = releaseExifEntry(&p_session->exif_info_local[i]);
-    if (rc) {
-      CDBG_ERROR("%s:%d] Exif release failed (%d)", __func__, __LINE__, rc);
-    }
-  }
-  p_session->exif_count_local = 0;
+    (int)p_session->exif_arena.info.numOfEntries);
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
 
-  return rc;
+  return 0;
 }
 
 /** mm_jpeg_session_encode:
@@ -2522,8 +3168,31 @@ static void mm_jpegenc_job_done(mm_jpeg_job_session_t *p_session)
     mm_jpeg_queue_enq(p_session->out_buf_q, qdata);
   }
 
-  /* wake up jobMgr thread to work on new job if there is any */
-  cam_sem_post(&my_obj->job_mgr.job_sem);
+  /* a job slot and an OMX handle are free again */
+  mm_jpeg_jobmgr_kick(my_obj);
+}
+
+/** mm_jpeg_thumb_from_main:
+ *
+ *  Arguments:
+ *    @my_obj: jpeg object
+ *
+ *  Return:
+ *       1 if encode sessions take the thumbnail from the main
+ *       image, 0 if they encode the client's thumbnail buffers
+ *
+ *  Description:
+ *       Lets clients skip preparing thumbnails that the encoder
+ *       would replace with the main image
+ *
+ **/
+int32_t mm_jpeg_thumb_from_main(mm_jpeg_obj *my_obj)
+{
+  /* software sessions never use the pipeline component */
+  if (my_obj->swenc_only) {
+    return 0;
+  }
+  return MM_JPEG_THUMB_FROM_MAIN;
 }
 
 /** mm_jpeg_destroy_session:
@@ -2557,9 +3226,15 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
   session_id = p_session->sessionId;
 
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_jobmgr_pause(my_obj);
 
   /* abort job if in todo queue */
   CDBG_HIGH("%s:%d] abort todo jobs", __func__, __LINE__);
+  node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.prio_queue, session_id);
+  while (NULL != node) {
+    free(node);
+    node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.prio_queue, session_id);
+  }
   node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.job_queue, session_id);
   while (NULL != node) {
     free(node);
@@ -2576,7 +3251,7 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
 
   /* abort the current session */
   mm_jpeg_session_abort(p_session);
-  mm_jpeg_session_destroy(p_session);
+  mm_jpeg_session_release(my_obj, p_session);
 
   p_cur_sess = p_session;
 
@@ -2585,6 +3260,7 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
   } while (NULL != (p_cur_sess = p_cur_sess->next_session));
 
 
+  mm_jpeg_jobmgr_resume(my_obj);
   pthread_mutex_unlock(&my_obj->job_lock);
 
   while (1) {
@@ -2605,10 +3281,6 @@ int32_t mm_jpeg_destroy_session(mm_jpeg_obj *my_obj,
   free(p_session->out_buf_q);
   p_session->out_buf_q = NULL;
 
-
-  /* wake up jobMgr thread to work on new job if there is any */
-  cam_sem_post(&my_obj->job_mgr.job_sem);
-
   snprintf(trace_tag, sizeof(trace_tag), "Camera:JPEGsession%d", GET_SESSION_IDX(session_id));
   ATRACE_INT(trace_tag, 0);
 
@@ -2648,6 +3320,11 @@ int32_t mm_jpeg_destroy_session_unlocked(mm_jpeg_obj *my_obj,
 
   /* abort job if in todo queue */
   CDBG("%s:%d] abort todo jobs", __func__, __LINE__);
+  node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.prio_queue, session_id);
+  while (NULL != node) {
+    free(node);
+    node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.prio_queue, session_id);
+  }
   node = mm_jpeg_queue_remove_job_by_session_id(&my_obj->job_mgr.job_queue, session_id);
   while (NULL != node) {
     free(node);
@@ -2721,6 +3398,7 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
 
   /* abort all jobs from the client */
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_jobmgr_pause(my_obj);
 
   CDBG("%s:%d] ", __func__, __LINE__);
 
@@ -2730,6 +3408,12 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
         &my_obj->clnt_mgr[clnt_idx].session[i]);
   }
 
+  /* release the OMX handles kept by destroyed sessions */
+  for (i = 0; i < MM_JPEG_MAX_SESSION; i++) {
+    if (OMX_TRUE == my_obj->clnt_mgr[clnt_idx].session[i].cached)
+      mm_jpeg_session_free_handle(&my_obj->clnt_mgr[clnt_idx].session[i]);
+  }
+
   CDBG("%s:%d] ", __func__, __LINE__);
 
 #ifdef LOAD_ADSP_RPC_LIB
@@ -2739,6 +3423,7 @@ int32_t mm_jpeg_close(mm_jpeg_obj *my_obj, uint32_t client_hdl)
   }
 #endif
 
+  mm_jpeg_jobmgr_resume(my_obj);
   pthread_mutex_unlock(&my_obj->job_lock);
   CDBG("%s:%d] ", __func__, __LINE__);
 
@@ -41,11 +41,58 @@
         ((a >= 0) ? (uint32_t)(a + 0.5) : (uint32_t)(a - 0.5))
 
 
+/** mm_jpeg_exif_arena_reset:
+ *
+ *  Arguments:
+ *   @p_arena : exif arena
+ *
+ *  Return     : none
+ *
+ *  Description:
+ *       Drop all entries and their values, the arena can be
+ *       filled again for the next job
+ *
+ **/
+void mm_jpeg_exif_arena_reset(mm_jpeg_exif_arena_t *p_arena)
+{
+  memset(&p_arena->info, 0, sizeof(p_arena->info));
+  p_arena->info.exif_data = &p_arena->entries[0];
+  p_arena->used = 0;
+}
+
+/** mm_jpeg_exif_arena_alloc:
+ *
+ *  Arguments:
+ *   @p_arena : exif arena
+ *   @size    : number of bytes
+ *
+ *  Return     : ptr to zeroed storage, NULL if the arena is full
+ *
+ *  Description:
+ *       Carve the storage of a tag value out of the arena. Values
+ *       are 8 byte aligned so that any exif type can be stored
+ *
+ **/
+static void *mm_jpeg_exif_arena_alloc(mm_jpeg_exif_arena_t *p_arena,
+  uint32_t size)
+{
+  uint32_t aligned = (size + 7) & ~7U;
+  uint8_t *p_buf;
+
+  if (aligned < size ||
+    aligned > sizeof(p_arena->storage) - p_arena->used) {
+    return NULL;
+  }
+  p_buf = (uint8_t *)p_arena->storage + p_arena->used;
+  p_arena->used += aligned;
+  memset(p_buf, 0, size);
+  return p_buf;
+}
+
 /** addExifEntry:
  *
  *  Arguments:
- *   @exif_info : Exif info struct
- *   @p_session: job session
+ *   @p_arena : exif arena of the job
  *   @tagid   : exif tag ID
  *   @type    : data type
  *   @count   : number of data in uint of its type
@@ -56,233 +103,136 @@
  *              none-zero failure code
  *
  *  Description:
- *       Function to add an entry to exif data
+ *       Function to add an entry to exif data. Values which do not
+ *       fit in the entry itself are copied into the arena
  *
  **/
-int32_t addExifEntry(QOMX_EXIF_INFO *p_exif_info, exif_tag_id_t tagid,
+int32_t addExifEntry(mm_jpeg_exif_arena_t *p_arena, exif_tag_id_t tagid,
   exif_tag_type_t type, uint32_t count, void *data)
 {
-    int32_t rc = 0;
-    uint32_t numOfEntries = (uint32_t)p_exif_info->numOfEntries;
-    QEXIF_INFO_DATA *p_info_data = p_exif_info->exif_data;
+    uint32_t numOfEntries = (uint32_t)p_arena->info.numOfEntries;
+    QEXIF_INFO_DATA *p_info_data = &p_arena->entries[numOfEntries];
+    uint32_t elem_size = 0;
+    void *values = NULL;
+
     if(numOfEntries >= MAX_EXIF_TABLE_ENTRIES) {
         ALOGE("%s: Number of entries exceeded limit", __func__);
         return -1;
     }
 
-    p_info_data[numOfEntries].tag_id = tagid;
-    p_info_data[numOfEntries].tag_entry.type = type;
-    p_info_data[numOfEntries].tag_entry.count = count;
-    p_info_data[numOfEntries].tag_entry.copy = 1;
     switch (type) {
-    case EXIF_BYTE: {
-      if (count > 1) {
-        uint8_t *values = (uint8_t *)malloc(count);
-        if (values == NULL) {
-          ALOGE("%s: No memory for byte array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count);
-          p_info_data[numOfEntries].tag_entry.data._bytes = values;
-        }
-      } else {
-        p_info_data[numOfEntries].tag_entry.data._byte = *(uint8_t *)data;
+    case EXIF_BYTE:
+    case EXIF_UNDEFINED:
+      elem_size = sizeof(uint8_t);
+      break;
+    case EXIF_ASCII:
+      elem_size = sizeof(char);
+      break;
+    case EXIF_SHORT:
+      elem_size = sizeof(uint16_t);
+      break;
+    case EXIF_LONG:
+      elem_size = sizeof(uint32_t);
+      break;
+    case EXIF_RATIONAL:
+      elem_size = sizeof(rat_t);
+      break;
+    case EXIF_SLONG:
+      elem_size = sizeof(int32_t);
+      break;
+    case EXIF_SRATIONAL:
+      elem_size = sizeof(srat_t);
+      break;
+    default:
+      ALOGE("%s: Unsupported exif type %d", __func__, (int)type);
+      return -1;
+    }
+
+    /* ascii strings are always terminated, undefined data is always
+     * passed by pointer, other arrays only if there is more than one
+     * value */
+    if (type == EXIF_ASCII || type == EXIF_UNDEFINED || count > 1) {
+      uint32_t size;
+      if (count > (UINT32_MAX - 1) / elem_size) {
+        ALOGE("%s: Invalid count %u", __func__, count);
+        return -1;
       }
-    }
-    break;
-    case EXIF_ASCII: {
-      char *str = NULL;
-      str = (char *)malloc(count + 1);
-      if (str == NULL) {
-        ALOGE("%s: No memory for ascii string", __func__);
-        rc = -1;
-      } else {
-        memset(str, 0, count + 1);
-        memcpy(str, data, count);
-        p_info_data[numOfEntries].tag_entry.data._ascii = str;
+      size = count * elem_size + ((type == EXIF_ASCII) ? 1 : 0);
+      values = mm_jpeg_exif_arena_alloc(p_arena, size);
+      if (values == NULL) {
+        ALOGE("%s: No space in exif arena for tag 0x%x (%u bytes)",
+          __func__, (unsigned)tagid, size);
+        return -1;
       }
+      memcpy(values, data, count * elem_size);
     }
-    break;
-    case EXIF_SHORT: {
+
+    memset(p_info_data, 0, sizeof(*p_info_data));
+    p_info_data->tag_id = tagid;
+    p_info_data->tag_entry.type = type;
+    p_info_data->tag_entry.count = count;
+    p_info_data->tag_entry.copy = 1;
+    switch (type) {
+    case EXIF_BYTE:
       if (count > 1) {
-        uint16_t *values = (uint16_t *)malloc(count * sizeof(uint16_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for short array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(uint16_t));
-          p_info_data[numOfEntries].tag_entry.data._shorts = values;
-        }
+        p_info_data->tag_entry.data._bytes = (uint8_t *)values;
       } else {
-        p_info_data[numOfEntries].tag_entry.data._short = *(uint16_t *)data;
+        p_info_data->tag_entry.data._byte = *(uint8_t *)data;
       }
-    }
-    break;
-    case EXIF_LONG: {
+      break;
+    case EXIF_ASCII:
+      p_info_data->tag_entry.data._ascii = (char *)values;
+      break;
+    case EXIF_SHORT:
       if (count > 1) {
-        uint32_t *values = (uint32_t *)malloc(count * sizeof(uint32_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for long array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(uint32_t));
-          p_info_data[numOfEntries].tag_entry.data._longs = values;
-        }
+        p_info_data->tag_entry.data._shorts = (uint16_t *)values;
       } else {
-        p_info_data[numOfEntries].tag_entry.data._long = *(uint32_t *)data;
+        p_info_data->tag_entry.data._short = *(uint16_t *)data;
       }
-    }
-    break;
-    case EXIF_RATIONAL: {
+      break;
+    case EXIF_LONG:
       if (count > 1) {
-        rat_t *values = (rat_t *)malloc(count * sizeof(rat_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for rational array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(rat_t));
-          p_info_data[numOfEntries].tag_entry.data._rats = values;
-        }
+        p_info_data->tag_entry.data._longs = (uint32_t *)values;
       } else {
-        p_info_data[numOfEntries].tag_entry.data._rat = *(rat_t *)data;
+        p_info_data->tag_entry.data._long = *(uint32_t *)data;
       }
-    }
-    break;
-    case EXIF_UNDEFINED: {
-      uint8_t *values = (uint8_t *)malloc(count);
-      if (values == NULL) {
-        ALOGE("%s: No memory for undefined array", __func__);
-        rc = -1;
+      break;
+    case EXIF_RATIONAL:
+      if (count > 1) {
+        p_info_data->tag_entry.data._rats = (rat_t *)values;
       } else {
-        memcpy(values, data, count);
-        p_info_data[numOfEntries].tag_entry.data._undefined = values;
+        p_info_data->tag_entry.data._rat = *(rat_t *)data;
       }
-    }
-    break;
-    case EXIF_SLONG: {
+      break;
+    case EXIF_UNDEFINED:
+      p_info_data->tag_entry.data._undefined = (uint8_t *)values;
+      break;
+    case EXIF_SLONG:
       if (count > 1) {
-        int32_t *values = (int32_t *)malloc(count * sizeof(int32_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for signed long array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(int32_t));
-          p_info_data[numOfEntries].tag_entry.data._slongs = values;
-        }
+        p_info_data->tag_entry.data._slongs = (int32_t *)values;
       } else {
-        p_info_data[numOfEntries].tag_entry.data._slong = *(int32_t *)data;
+        p_info_data->tag_entry.data._slong = *(int32_t *)data;
       }
-    }
-    break;
-    case EXIF_SRATIONAL: {
+      break;
+    case EXIF_SRATIONAL:
       if (count > 1) {
-        srat_t *values = (srat_t *)malloc(count * sizeof(srat_t));
-        if (values == NULL) {
-          ALOGE("%s: No memory for signed rational array", __func__);
-          rc = -1;
-        } else {
-          memcpy(values, data, count * sizeof(srat_t));
-          p_info_data[numOfEntries].tag_entry.data._srats = values;
-        }
+        p_info_data->tag_entry.data._srats = (srat_t *)values;
       } else {
-        p_info_data[numOfEntries].tag_entry.data._srat = *(srat_t *)data;
+        p_info_data->tag_entry.data._srat = *(srat_t *)data;
       }
-    }
-    break;
+      break;
     }
 
     // Increase number of entries
-    p_exif_info->numOfEntries++;
-    return rc;
-}
-
-/** releaseExifEntry
- *
- *  Arguments:
- *   @p_exif_data : Exif info struct
- *
- *  Retrun     : int32_t type of status
- *               0  -- success
- *              none-zero failure code
- *
- *  Description:
- *       Function to release an entry from exif data
- *
- **/
-int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data)
-{
- switch (p_exif_data->tag_entry.type) {
-  case EXIF_BYTE: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._bytes != NULL) {
-      free(p_exif_data->tag_entry.data._bytes);
-      p_exif_data->tag_entry.data._bytes = NULL;
-    }
-  }
-  break;
-  case EXIF_ASCII: {
-    if (p_exif_data->tag_entry.data._ascii != NULL) {
-      free(p_exif_data->tag_entry.data._ascii);
-      p_exif_data->tag_entry.data._ascii = NULL;
-    }
-  }
-  break;
-  case EXIF_SHORT: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._shorts != NULL) {
-      free(p_exif_data->tag_entry.data._shorts);
-      p_exif_data->tag_entry.data._shorts = NULL;
-    }
-  }
-  break;
-  case EXIF_LONG: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._longs != NULL) {
-      free(p_exif_data->tag_entry.data._longs);
-      p_exif_data->tag_entry.data._longs = NULL;
-    }
-  }
-  break;
-  case EXIF_RATIONAL: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._rats != NULL) {
-      free(p_exif_data->tag_entry.data._rats);
-      p_exif_data->tag_entry.data._rats = NULL;
-    }
-  }
-  break;
-  case EXIF_UNDEFINED: {
-    if (p_exif_data->tag_entry.data._undefined != NULL) {
-      free(p_exif_data->tag_entry.data._undefined);
-      p_exif_data->tag_entry.data._undefined = NULL;
-    }
-  }
-  break;
-  case EXIF_SLONG: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._slongs != NULL) {
-      free(p_exif_data->tag_entry.data._slongs);
-      p_exif_data->tag_entry.data._slongs = NULL;
-    }
-  }
-  break;
-  case EXIF_SRATIONAL: {
-    if (p_exif_data->tag_entry.count > 1 &&
-      p_exif_data->tag_entry.data._srats != NULL) {
-      free(p_exif_data->tag_entry.data._srats);
-      p_exif_data->tag_entry.data._srats = NULL;
-    }
-  }
-  break;
-  } /*end of switch*/
-
-  return 0;
+    p_arena->info.numOfEntries++;
+    return 0;
 }
 
 /** process_sensor_data:
  *
  *  Arguments:
  *   @p_sensor_params : ptr to sensor data
+ *   @exif_info : exif arena of the job
  *
  *  Return     : int32_t type of status
  *               NO_ERROR  -- success
@@ -294,7 +244,7 @@ int32_t releaseExifEntry(QEXIF_INFO_DATA *p_exif_data)
  *  Notes: this needs to be filled for the metadata
  **/
 int process_sensor_data(cam_sensor_params_t *p_sensor_params,
-  QOMX_EXIF_INFO *exif_info)
+  mm_jpeg_exif_arena_t *exif_info)
 {
   int rc = 0;
   rat_t val_rat;
@@ -388,6 +338,7 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
  *
  *  Arguments:
  *   @p_3a_params : ptr to 3a data
+ *   @exif_info : exif arena of the job
  *
  *  Return     : int32_t type of status
  *               NO_ERROR  -- success
@@ -398,7 +349,8 @@ int process_sensor_data(cam_sensor_params_t *p_sensor_params,
  *
  *  Notes: this needs to be filled for the metadata
  **/
-int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
+int process_3a_data(cam_3a_params_t *p_3a_params,
+  mm_jpeg_exif_arena_t *exif_info)
 {
   int rc = 0;
   srat_t val_srat;
@@ -518,7 +470,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
  *
  *  Arguments:
  *   @p_meta : ptr to metadata
- *   @exif_info: Exif info struct
+ *   @exif_info: exif arena of the job
  *   @mm_jpeg_exif_params: exif params
  *
  *  Return     : int32_t type of status
@@ -528,7 +480,7 @@ int process_3a_data(cam_3a_params_t *p_3a_params, QOMX_EXIF_INFO *exif_info)
  *  Description:
  *       Extract exif data from the metadata
  **/
-int process_meta_data(metadata_buffer_t *p_meta, QOMX_EXIF_INFO *exif_info,
+int process_meta_data(metadata_buffer_t *p_meta, mm_jpeg_exif_arena_t *exif_info,
   mm_jpeg_exif_params_t *p_cam_exif_params, cam_hal_version_t hal_version)
 {
   int rc = 0;
@@ -199,6 +199,36 @@ static int32_t mm_jpeg_intf_destroy_session(uint32_t session_id)
   return rc;
 }
 
+/** mm_jpeg_intf_thumb_from_main:
+ *
+ *  Arguments:
+ *    none
+ *
+ *  Return:
+ *       1 if the thumbnail is taken from the main image, 0 if
+ *       not or on failure
+ *
+ *  Description:
+ *       Tell whether encode sessions ignore the thumbnail source
+ *
+ **/
+static int mm_jpeg_intf_thumb_from_main(void)
+{
+  int rc = 0;
+
+  pthread_mutex_lock(&g_intf_lock);
+  if (NULL == g_jpeg_obj) {
+    /* mm_jpeg obj not exists, return error */
+    CDBG_ERROR("%s:%d] mm_jpeg is not opened yet", __func__, __LINE__);
+    pthread_mutex_unlock(&g_intf_lock);
+    return rc;
+  }
+
+  rc = mm_jpeg_thumb_from_main(g_jpeg_obj);
+  pthread_mutex_unlock(&g_intf_lock);
+  return rc;
+}
+
 /** mm_jpeg_intf_abort_job:
  *
  *  Arguments:
@@ -355,6 +385,7 @@ uint32_t jpeg_open(mm_jpeg_ops_t *ops, mm_dimension picture_size)
       ops->create_session = mm_jpeg_intf_create_session;
       ops->destroy_session = mm_jpeg_intf_destroy_session;
       ops->close = mm_jpeg_intf_close;
+      ops->thumb_from_main = mm_jpeg_intf_thumb_from_main;
     }
   } else {
     /* failed new client */
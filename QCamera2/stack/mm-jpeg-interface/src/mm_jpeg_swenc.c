@@ -0,0 +1,1629 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include "mm_jpeg_swenc.h"
+#include "mm_jpeg_dbg.h"
+
+/* jfdctint constants, 13 bit fixed point */
+#define SWENC_CONST_BITS 13
+#define SWENC_PASS1_BITS 2
+#define FIX_0_298631336 2446
+#define FIX_0_390180644 3196
+#define FIX_0_541196100 4433
+#define FIX_0_765366865 6270
+#define FIX_0_899976223 7373
+#define FIX_1_175875602 9633
+#define FIX_1_501321110 12299
+#define FIX_1_847759065 15137
+#define FIX_1_961570560 16069
+#define FIX_2_053119869 16819
+#define FIX_2_562915447 20995
+#define FIX_3_072711026 25172
+
+/* worst case entropy coded size of one MCU, with byte stuffing */
+#define SWENC_MCU_MAX_BYTES 4096
+#define SWENC_HEADER_MAX_BYTES 1024
+
+#define SWENC_HUFF_DC_LUMA 0
+#define SWENC_HUFF_AC_LUMA 1
+#define SWENC_HUFF_DC_CHROMA 2
+#define SWENC_HUFF_AC_CHROMA 3
+
+/* 8 lane vectors, lowered to NEON/SSE by the compiler */
+typedef int32_t v8i32_t __attribute__((vector_size(32)));
+typedef float v8f32_t __attribute__((vector_size(32)));
+typedef uint8_t v8u8_t __attribute__((vector_size(8)));
+typedef uint8_t v16u8_t __attribute__((vector_size(16)));
+
+/** mm_jpeg_swenc_frame:
+ *  @p_y: luma of the top left pixel to encode
+ *  @y_stride: luma stride
+ *  @p_c: interleaved chroma of the top left pixel to encode
+ *  @c_stride: chroma stride
+ *  @width: encoded width
+ *  @height: encoded height
+ *  @h_samp: luma horizontal sampling factor
+ *  @v_samp: luma vertical sampling factor
+ *  @cb_idx: byte of the chroma pair holding Cb
+ *  @num_comps: 1 for monochrome, 3 otherwise
+ *  @mcus_per_row: MCUs per MCU row, also the restart interval
+ *  @mcu_rows: number of MCU rows
+ *  @qtable: luma and chroma quantization tables, natural order
+ *  @qscale: reciprocal of the DCT scaled quantizers, DCT output order
+ *  @huff: huffman tables
+ *  @p_src_y: source luma of a scaled or rotated job, NULL otherwise
+ *  @p_src_c: source chroma of a scaled or rotated job
+ *  @p_row_off: source luma offset of each output row
+ *  @p_col_off: source luma offset of each output column
+ *  @p_crow_off: source chroma offset of each output chroma row
+ *  @p_ccol_off: source chroma offset of each output chroma column
+ *  @transposed: set if output rows run down source columns
+ *
+ *  Everything the stripe workers need to encode a frame. For
+ *  scaled or rotated jobs p_y/p_c are unset, the stripes
+ *  resample each MCU row from the source through the offsets.
+ **/
+typedef struct mm_jpeg_swenc_frame {
+  const uint8_t *p_y;
+  uint32_t y_stride;
+  const uint8_t *p_c;
+  uint32_t c_stride;
+  uint32_t width;
+  uint32_t height;
+  uint32_t h_samp;
+  uint32_t v_samp;
+  uint32_t cb_idx;
+  uint32_t num_comps;
+  uint32_t mcus_per_row;
+  uint32_t mcu_rows;
+  uint8_t qtable[2][64];
+  float qscale[2][64] __attribute__((aligned(32)));
+  const mm_jpeg_swenc_huff_t *huff;
+  const uint8_t *p_src_y;
+  const uint8_t *p_src_c;
+  const uint32_t *p_row_off;
+  const uint32_t *p_col_off;
+  const uint32_t *p_crow_off;
+  const uint32_t *p_ccol_off;
+  int transposed;
+} mm_jpeg_swenc_frame_t;
+
+/** mm_jpeg_swenc_bs_t:
+ *  @p_stripe: stripe the bits go to
+ *  @acc: pending bits, low cnt bits are valid
+ *  @cnt: number of pending bits
+ *
+ *  Bit writer for the entropy coded segment
+ **/
+typedef struct {
+  mm_jpeg_swenc_stripe_t *p_stripe;
+  uint64_t acc;
+  uint32_t cnt;
+} mm_jpeg_swenc_bs_t;
+
+/* zigzag position -> natural position */
+static const uint8_t swenc_natural_order[64] = {
+  0,  1,  8, 16,  9,  2,  3, 10,
+  17, 24, 32, 25, 18, 11,  4,  5,
+  12, 19, 26, 33, 40, 48, 41, 34,
+  27, 20, 13,  6,  7, 14, 21, 28,
+  35, 42, 49, 56, 57, 50, 43, 36,
+  29, 22, 15, 23, 30, 37, 44, 51,
+  58, 59, 52, 45, 38, 31, 39, 46,
+  53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* Annex K.1 quantization tables, natural order */
+static const uint8_t swenc_std_qtable[2][64] = {
+  {
+    16, 11, 10, 16, 24, 40, 51, 61,
+    12, 12, 14, 19, 26, 58, 60, 55,
+    14, 13, 16, 24, 40, 57, 69, 56,
+    14, 17, 22, 29, 51, 87, 80, 62,
+    18, 22, 37, 56, 68, 109, 103, 77,
+    24, 35, 55, 64, 81, 104, 113, 92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103, 99
+  },
+  {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+  }
+};
+
+/* Annex K.3 huffman tables: code counts per length, then symbols */
+static const uint8_t swenc_dc_luma_bits[16] = {
+  0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0
+};
+static const uint8_t swenc_dc_chroma_bits[16] = {
+  0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0
+};
+static const uint8_t swenc_dc_vals[12] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11
+};
+static const uint8_t swenc_ac_luma_bits[16] = {
+  0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d
+};
+static const uint8_t swenc_ac_luma_vals[162] = {
+  0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+  0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+  0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+  0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+  0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+  0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+  0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+  0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+  0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+  0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+  0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+  0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+  0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+  0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+  0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+  0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+  0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+  0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+  0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+static const uint8_t swenc_ac_chroma_bits[16] = {
+  0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77
+};
+static const uint8_t swenc_ac_chroma_vals[162] = {
+  0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+  0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+  0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+  0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+  0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+  0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+  0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+  0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+  0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+  0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+  0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+  0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+  0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+  0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+  0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+  0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+  0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+  0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+  0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+  0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+  0xf9, 0xfa
+};
+
+static const uint8_t *swenc_huff_bits[MM_JPEG_SWENC_NUM_HUFF] = {
+  swenc_dc_luma_bits, swenc_ac_luma_bits,
+  swenc_dc_chroma_bits, swenc_ac_chroma_bits
+};
+static const uint8_t *swenc_huff_vals[MM_JPEG_SWENC_NUM_HUFF] = {
+  swenc_dc_vals, swenc_ac_luma_vals,
+  swenc_dc_vals, swenc_ac_chroma_vals
+};
+
+/* zigzag position -> position in the transposed DCT output */
+static uint8_t swenc_zz_to_dct[64];
+
+/** mm_jpeg_swenc_build_huff:
+ *
+ *  Arguments:
+ *    @p_bits: code counts per length
+ *    @p_vals: symbols in code order
+ *    @p_huff: table to fill
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Generates the canonical codes of a huffman table
+ *
+ **/
+static void mm_jpeg_swenc_build_huff(const uint8_t *p_bits,
+  const uint8_t *p_vals, mm_jpeg_swenc_huff_t *p_huff)
+{
+  uint32_t len, i, k = 0;
+  uint16_t code = 0;
+
+  memset(p_huff, 0, sizeof(*p_huff));
+  for (len = 1; len <= 16; len++) {
+    for (i = 0; i < p_bits[len - 1]; i++, k++) {
+      p_huff->code[p_vals[k]] = code++;
+      p_huff->size[p_vals[k]] = (uint8_t)len;
+    }
+    code = (uint16_t)(code << 1);
+  }
+}
+
+/** mm_jpeg_swenc_fdct:
+ *
+ *  Arguments:
+ *    @p_blk: 8 rows of level shifted samples, replaced by the
+ *            coefficients, transposed and scaled up by 8
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       jfdctint forward DCT on all 8 columns at once, then
+ *       on all 8 rows after a transpose
+ *
+ **/
+static inline void mm_jpeg_swenc_fdct_pass(v8i32_t *d, int pass)
+{
+  v8i32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;
+  v8i32_t tmp10, tmp11, tmp12, tmp13;
+  v8i32_t z1, z2, z3, z4, z5;
+  const int shift = pass ? (SWENC_CONST_BITS + SWENC_PASS1_BITS) :
+    (SWENC_CONST_BITS - SWENC_PASS1_BITS);
+  const int32_t round = 1 << (shift - 1);
+
+  tmp0 = d[0] + d[7];
+  tmp7 = d[0] - d[7];
+  tmp1 = d[1] + d[6];
+  tmp6 = d[1] - d[6];
+  tmp2 = d[2] + d[5];
+  tmp5 = d[2] - d[5];
+  tmp3 = d[3] + d[4];
+  tmp4 = d[3] - d[4];
+
+  tmp10 = tmp0 + tmp3;
+  tmp13 = tmp0 - tmp3;
+  tmp11 = tmp1 + tmp2;
+  tmp12 = tmp1 - tmp2;
+
+  if (pass) {
+    d[0] = (tmp10 + tmp11 + (1 << (SWENC_PASS1_BITS - 1))) >> SWENC_PASS1_BITS;
+    d[4] = (tmp10 - tmp11 + (1 << (SWENC_PASS1_BITS - 1))) >> SWENC_PASS1_BITS;
+  } else {
+    d[0] = (tmp10 + tmp11) << SWENC_PASS1_BITS;
+    d[4] = (tmp10 - tmp11) << SWENC_PASS1_BITS;
+  }
+
+  z1 = (tmp12 + tmp13) * FIX_0_541196100;
+  d[2] = (z1 + tmp13 * FIX_0_765366865 + round) >> shift;
+  d[6] = (z1 - tmp12 * FIX_1_847759065 + round) >> shift;
+
+  z1 = tmp4 + tmp7;
+  z2 = tmp5 + tmp6;
+  z3 = tmp4 + tmp6;
+  z4 = tmp5 + tmp7;
+  z5 = (z3 + z4) * FIX_1_175875602;
+
+  tmp4 = tmp4 * FIX_0_298631336;
+  tmp5 = tmp5 * FIX_2_053119869;
+  tmp6 = tmp6 * FIX_3_072711026;
+  tmp7 = tmp7 * FIX_1_501321110;
+  z1 = z1 * -FIX_0_899976223;
+  z2 = z2 * -FIX_2_562915447;
+  z3 = z3 * -FIX_1_961570560 + z5;
+  z4 = z4 * -FIX_0_390180644 + z5;
+
+  d[7] = (tmp4 + z1 + z3 + round) >> shift;
+  d[5] = (tmp5 + z2 + z4 + round) >> shift;
+  d[3] = (tmp6 + z2 + z3 + round) >> shift;
+  d[1] = (tmp7 + z1 + z4 + round) >> shift;
+}
+
+static inline void mm_jpeg_swenc_transpose(v8i32_t *r)
+{
+  v8i32_t t0, t1, t2, t3, t4, t5, t6, t7;
+  v8i32_t u0, u1, u2, u3, u4, u5, u6, u7;
+
+  t0 = __builtin_shufflevector(r[0], r[1], 0, 8, 2, 10, 4, 12, 6, 14);
+  t1 = __builtin_shufflevector(r[0], r[1], 1, 9, 3, 11, 5, 13, 7, 15);
+  t2 = __builtin_shufflevector(r[2], r[3], 0, 8, 2, 10, 4, 12, 6, 14);
+  t3 = __builtin_shufflevector(r[2], r[3], 1, 9, 3, 11, 5, 13, 7, 15);
+  t4 = __builtin_shufflevector(r[4], r[5], 0, 8, 2, 10, 4, 12, 6, 14);
+  t5 = __builtin_shufflevector(r[4], r[5], 1, 9, 3, 11, 5, 13, 7, 15);
+  t6 = __builtin_shufflevector(r[6], r[7], 0, 8, 2, 10, 4, 12, 6, 14);
+  t7 = __builtin_shufflevector(r[6], r[7], 1, 9, 3, 11, 5, 13, 7, 15);
+
+  u0 = __builtin_shufflevector(t0, t2, 0, 1, 8, 9, 4, 5, 12, 13);
+  u2 = __builtin_shufflevector(t0, t2, 2, 3, 10, 11, 6, 7, 14, 15);
+  u1 = __builtin_shufflevector(t1, t3, 0, 1, 8, 9, 4, 5, 12, 13);
+  u3 = __builtin_shufflevector(t1, t3, 2, 3, 10, 11, 6, 7, 14, 15);
+  u4 = __builtin_shufflevector(t4, t6, 0, 1, 8, 9, 4, 5, 12, 13);
+  u6 = __builtin_shufflevector(t4, t6, 2, 3, 10, 11, 6, 7, 14, 15);
+  u5 = __builtin_shufflevector(t5, t7, 0, 1, 8, 9, 4, 5, 12, 13);
+  u7 = __builtin_shufflevector(t5, t7, 2, 3, 10, 11, 6, 7, 14, 15);
+
+  r[0] = __builtin_shufflevector(u0, u4, 0, 1, 2, 3, 8, 9, 10, 11);
+  r[4] = __builtin_shufflevector(u0, u4, 4, 5, 6, 7, 12, 13, 14, 15);
+  r[1] = __builtin_shufflevector(u1, u5, 0, 1, 2, 3, 8, 9, 10, 11);
+  r[5] = __builtin_shufflevector(u1, u5, 4, 5, 6, 7, 12, 13, 14, 15);
+  r[2] = __builtin_shufflevector(u2, u6, 0, 1, 2, 3, 8, 9, 10, 11);
+  r[6] = __builtin_shufflevector(u2, u6, 4, 5, 6, 7, 12, 13, 14, 15);
+  r[3] = __builtin_shufflevector(u3, u7, 0, 1, 2, 3, 8, 9, 10, 11);
+  r[7] = __builtin_shufflevector(u3, u7, 4, 5, 6, 7, 12, 13, 14, 15);
+}
+
+static inline void mm_jpeg_swenc_fdct(v8i32_t *p_blk)
+{
+  mm_jpeg_swenc_fdct_pass(p_blk, 0);
+  mm_jpeg_swenc_transpose(p_blk);
+  mm_jpeg_swenc_fdct_pass(p_blk, 1);
+}
+
+/** mm_jpeg_swenc_quantize:
+ *
+ *  Arguments:
+ *    @p_blk: DCT output
+ *    @p_scale: reciprocal quantizers in DCT output order
+ *    @p_coef: quantized coefficients in DCT output order
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Divides by the quantizers, rounding half away from zero
+ *
+ **/
+static inline void mm_jpeg_swenc_quantize(const v8i32_t *p_blk,
+  const float *p_scale, int32_t *p_coef)
+{
+  int i;
+  v8f32_t scale, x, neg;
+  v8i32_t q;
+
+  for (i = 0; i < 8; i++) {
+    memcpy(&scale, p_scale + 8 * i, sizeof(scale));
+    x = __builtin_convertvector(p_blk[i], v8f32_t) * scale;
+    neg = __builtin_convertvector(x < 0, v8f32_t);
+    q = __builtin_convertvector(x + 0.5f + neg, v8i32_t);
+    memcpy(p_coef + 8 * i, &q, sizeof(q));
+  }
+}
+
+/** mm_jpeg_swenc_load_luma:
+ *
+ *  Arguments:
+ *    @p_frame: frame
+ *    @x0: left column of the block
+ *    @y0: top row of the block
+ *    @p_blk: level shifted samples
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Loads an 8x8 luma block, replicating the last row and
+ *       column past the image edge
+ *
+ **/
+static inline void mm_jpeg_swenc_load_luma(const mm_jpeg_swenc_frame_t *p_frame,
+  uint32_t x0, uint32_t y0, v8i32_t *p_blk)
+{
+  uint32_t r, c, y, x;
+  const uint8_t *p_row;
+  v8u8_t pix;
+  uint8_t edge[8];
+
+  for (r = 0; r < 8; r++) {
+    y = y0 + r;
+    if (y >= p_frame->height) {
+      y = p_frame->height - 1;
+    }
+    p_row = p_frame->p_y + (size_t)y * p_frame->y_stride;
+    if (x0 + 8 <= p_frame->width) {
+      memcpy(&pix, p_row + x0, sizeof(pix));
+    } else {
+      for (c = 0; c < 8; c++) {
+        x = x0 + c;
+        edge[c] = p_row[(x < p_frame->width) ? x : (p_frame->width - 1)];
+      }
+      memcpy(&pix, edge, sizeof(pix));
+    }
+    p_blk[r] = __builtin_convertvector(pix, v8i32_t) - 128;
+  }
+}
+
+/** mm_jpeg_swenc_load_chroma:
+ *
+ *  Arguments:
+ *    @p_frame: frame
+ *    @x0: left chroma column of the block
+ *    @y0: top chroma row of the block
+ *    @p_cb: level shifted Cb samples
+ *    @p_cr: level shifted Cr samples
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Loads and deinterleaves an 8x8 block of the CbCr/CrCb
+ *       plane, replicating the last row and column past the edge
+ *
+ **/
+static inline void mm_jpeg_swenc_load_chroma(
+  const mm_jpeg_swenc_frame_t *p_frame, uint32_t x0, uint32_t y0,
+  v8i32_t *p_cb, v8i32_t *p_cr)
+{
+  uint32_t r, c, y, x;
+  uint32_t cw = (p_frame->width + p_frame->h_samp - 1) / p_frame->h_samp;
+  uint32_t ch = (p_frame->height + p_frame->v_samp - 1) / p_frame->v_samp;
+  const uint8_t *p_row;
+  v16u8_t pix;
+  v8u8_t even, odd;
+  uint8_t edge[16];
+
+  for (r = 0; r < 8; r++) {
+    y = y0 + r;
+    if (y >= ch) {
+      y = ch - 1;
+    }
+    p_row = p_frame->p_c + (size_t)y * p_frame->c_stride;
+    if (x0 + 8 <= cw) {
+      memcpy(&pix, p_row + 2 * x0, sizeof(pix));
+    } else {
+      for (c = 0; c < 8; c++) {
+        x = x0 + c;
+        if (x >= cw) {
+          x = cw - 1;
+        }
+        edge[2 * c] = p_row[2 * x];
+        edge[2 * c + 1] = p_row[2 * x + 1];
+      }
+      memcpy(&pix, edge, sizeof(pix));
+    }
+    even = __builtin_shufflevector(pix, pix, 0, 2, 4, 6, 8, 10, 12, 14);
+    odd = __builtin_shufflevector(pix, pix, 1, 3, 5, 7, 9, 11, 13, 15);
+    if (p_frame->cb_idx) {
+      p_cb[r] = __builtin_convertvector(odd, v8i32_t) - 128;
+      p_cr[r] = __builtin_convertvector(even, v8i32_t) - 128;
+    } else {
+      p_cb[r] = __builtin_convertvector(even, v8i32_t) - 128;
+      p_cr[r] = __builtin_convertvector(odd, v8i32_t) - 128;
+    }
+  }
+}
+
+/** mm_jpeg_swenc_put_bits:
+ *
+ *  Arguments:
+ *    @p_bs: bit writer
+ *    @code: bits to write, right aligned
+ *    @size: number of bits, at most 32
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Appends bits to the stripe, stuffing a zero after 0xFF.
+ *       The caller reserves SWENC_MCU_MAX_BYTES per MCU.
+ *
+ **/
+static inline void mm_jpeg_swenc_put_bits(mm_jpeg_swenc_bs_t *p_bs,
+  uint32_t code, uint32_t size)
+{
+  mm_jpeg_swenc_stripe_t *p_stripe = p_bs->p_stripe;
+  uint8_t byte;
+
+  p_bs->acc = (p_bs->acc << size) | code;
+  p_bs->cnt += size;
+  while (p_bs->cnt >= 8) {
+    p_bs->cnt -= 8;
+    byte = (uint8_t)(p_bs->acc >> p_bs->cnt);
+    p_stripe->p_buf[p_stripe->len++] = byte;
+    if (0xFF == byte) {
+      p_stripe->p_buf[p_stripe->len++] = 0;
+    }
+  }
+}
+
+/** mm_jpeg_swenc_flush_bits:
+ *
+ *  Arguments:
+ *    @p_bs: bit writer
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Pads the pending bits with ones up to a byte boundary
+ *
+ **/
+static inline void mm_jpeg_swenc_flush_bits(mm_jpeg_swenc_bs_t *p_bs)
+{
+  if (p_bs->cnt) {
+    mm_jpeg_swenc_put_bits(p_bs, (1U << (8 - p_bs->cnt)) - 1,
+      8 - p_bs->cnt);
+  }
+  p_bs->acc = 0;
+}
+
+/** mm_jpeg_swenc_put_value:
+ *
+ *  Arguments:
+ *    @p_bs: bit writer
+ *    @p_huff: huffman table
+ *    @run: zero run before the value, 0 for DC
+ *    @val: value to code
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Writes the huffman code of (run, category) followed by
+ *       the extra bits of the value
+ *
+ **/
+static inline void mm_jpeg_swenc_put_value(mm_jpeg_swenc_bs_t *p_bs,
+  const mm_jpeg_swenc_huff_t *p_huff, uint32_t run, int32_t val)
+{
+  uint32_t mag = (uint32_t)((val < 0) ? -val : val);
+  uint32_t nbits = mag ? (32 - (uint32_t)__builtin_clz(mag)) : 0;
+  uint32_t sym = (run << 4) | nbits;
+
+  mm_jpeg_swenc_put_bits(p_bs, p_huff->code[sym], p_huff->size[sym]);
+  if (nbits) {
+    if (val < 0) {
+      val--;
+    }
+    mm_jpeg_swenc_put_bits(p_bs, (uint32_t)val & ((1U << nbits) - 1), nbits);
+  }
+}
+
+/** mm_jpeg_swenc_encode_block:
+ *
+ *  Arguments:
+ *    @p_bs: bit writer
+ *    @p_blk: level shifted samples, clobbered
+ *    @p_scale: reciprocal quantizers
+ *    @p_dc_pred: DC predictor of the component
+ *    @p_dc: DC huffman table
+ *    @p_ac: AC huffman table
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Transforms, quantizes and entropy codes one block
+ *
+ **/
+static void mm_jpeg_swenc_encode_block(mm_jpeg_swenc_bs_t *p_bs,
+  v8i32_t *p_blk, const float *p_scale, int32_t *p_dc_pred,
+  const mm_jpeg_swenc_huff_t *p_dc, const mm_jpeg_swenc_huff_t *p_ac)
+{
+  int32_t coef[64] __attribute__((aligned(32)));
+  uint32_t k, run = 0;
+  int32_t v;
+
+  mm_jpeg_swenc_fdct(p_blk);
+  mm_jpeg_swenc_quantize(p_blk, p_scale, coef);
+
+  mm_jpeg_swenc_put_value(p_bs, p_dc, 0, coef[0] - *p_dc_pred);
+  *p_dc_pred = coef[0];
+
+  for (k = 1; k < 64; k++) {
+    v = coef[swenc_zz_to_dct[k]];
+    if (0 == v) {
+      run++;
+      continue;
+    }
+    while (run > 15) {
+      /* ZRL */
+      mm_jpeg_swenc_put_bits(p_bs, p_ac->code[0xF0], p_ac->size[0xF0]);
+      run -= 16;
+    }
+    mm_jpeg_swenc_put_value(p_bs, p_ac, run, v);
+    run = 0;
+  }
+  if (run) {
+    /* EOB */
+    mm_jpeg_swenc_put_bits(p_bs, p_ac->code[0], p_ac->size[0]);
+  }
+}
+
+/** mm_jpeg_swenc_reserve:
+ *
+ *  Arguments:
+ *    @p_stripe: stripe
+ *    @bytes: free space needed
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Grows the stripe buffer if needed
+ *
+ **/
+static int mm_jpeg_swenc_reserve(mm_jpeg_swenc_stripe_t *p_stripe,
+  size_t bytes)
+{
+  size_t size;
+  uint8_t *p_buf;
+
+  if (p_stripe->len + bytes <= p_stripe->size) {
+    return 0;
+  }
+  size = p_stripe->size ? p_stripe->size : bytes;
+  while (p_stripe->len + bytes > size) {
+    size *= 2;
+  }
+  p_buf = (uint8_t *)realloc(p_stripe->p_buf, size);
+  if (NULL == p_buf) {
+    return -1;
+  }
+  p_stripe->p_buf = p_buf;
+  p_stripe->size = size;
+  return 0;
+}
+
+/** mm_jpeg_swenc_resample_band:
+ *
+ *  Arguments:
+ *    @p_frame: scaled or rotated frame
+ *    @y0: first output row of the band
+ *    @rows: output rows in the band
+ *    @p_y: band luma, p_frame->width bytes per row
+ *    @p_c: band chroma, two bytes per chroma column
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Nearest neighbour samples a band of output rows from
+ *       the source. Transposed bands walk the output columns
+ *       so that consecutive reads stay on one source row.
+ *
+ **/
+static void mm_jpeg_swenc_resample_band(const mm_jpeg_swenc_frame_t *p_frame,
+  uint32_t y0, uint32_t rows, uint8_t *p_y, uint8_t *p_c)
+{
+  uint32_t x, y;
+  uint32_t w = p_frame->width;
+  uint32_t cw = (w + 1) / 2;
+  uint32_t crows = (rows + 1) / 2;
+  const uint32_t *p_row = p_frame->p_row_off + y0;
+  const uint32_t *p_crow;
+  const uint8_t *p_src;
+
+  if (p_frame->transposed) {
+    for (x = 0; x < w; x++) {
+      p_src = p_frame->p_src_y + p_frame->p_col_off[x];
+      for (y = 0; y < rows; y++) {
+        p_y[(size_t)y * w + x] = p_src[p_row[y]];
+      }
+    }
+  } else {
+    for (y = 0; y < rows; y++) {
+      p_src = p_frame->p_src_y + p_row[y];
+      for (x = 0; x < w; x++) {
+        p_y[(size_t)y * w + x] = p_src[p_frame->p_col_off[x]];
+      }
+    }
+  }
+  if (3 != p_frame->num_comps) {
+    return;
+  }
+
+  p_crow = p_frame->p_crow_off + y0 / 2;
+  if (p_frame->transposed) {
+    for (x = 0; x < cw; x++) {
+      p_src = p_frame->p_src_c + p_frame->p_ccol_off[x];
+      for (y = 0; y < crows; y++) {
+        memcpy(p_c + (size_t)y * 2 * cw + 2 * x, p_src + p_crow[y], 2);
+      }
+    }
+  } else {
+    for (y = 0; y < crows; y++) {
+      p_src = p_frame->p_src_c + p_crow[y];
+      for (x = 0; x < cw; x++) {
+        memcpy(p_c + (size_t)y * 2 * cw + 2 * x,
+          p_src + p_frame->p_ccol_off[x], 2);
+      }
+    }
+  }
+}
+
+/** mm_jpeg_swenc_encode_stripe:
+ *
+ *  Arguments:
+ *    @p_frame: frame
+ *    @p_stripe: stripe to encode
+ *
+ *  Return:
+ *       none, p_stripe->error is set on failure
+ *
+ *  Description:
+ *       Entropy codes a band of MCU rows. Every MCU row but the
+ *       first of the image starts with a restart marker, so the
+ *       stripes are self contained and can simply be appended.
+ *       Scaled or rotated frames are resampled one MCU row at a
+ *       time into the stripe's band, which is then encoded as a
+ *       frame of its own.
+ *
+ **/
+static void mm_jpeg_swenc_encode_stripe(const mm_jpeg_swenc_frame_t *p_frame,
+  mm_jpeg_swenc_stripe_t *p_stripe)
+{
+  mm_jpeg_swenc_bs_t bs;
+  mm_jpeg_swenc_frame_t band;
+  const mm_jpeg_swenc_frame_t *p_src = p_frame;
+  v8i32_t blk[8], cr[8];
+  int32_t dc_pred[3];
+  uint32_t row, mcu, bh, bv, x0, y0;
+  const mm_jpeg_swenc_huff_t *p_huff = p_frame->huff;
+  uint32_t mcu_w = 8 * p_frame->h_samp;
+  uint32_t mcu_h = 8 * p_frame->v_samp;
+  uint32_t c_stride = 2 * ((p_frame->width + 1) / 2);
+  size_t band_size;
+  uint8_t *p_band;
+
+  memset(&bs, 0, sizeof(bs));
+  bs.p_stripe = p_stripe;
+  p_stripe->len = 0;
+  p_stripe->error = 0;
+
+  if (p_frame->p_src_y) {
+    band_size = (size_t)p_frame->width * mcu_h + (size_t)c_stride * 8;
+    if (band_size > p_stripe->band_size) {
+      p_band = (uint8_t *)realloc(p_stripe->p_band, band_size);
+      if (NULL == p_band) {
+        p_stripe->error = 1;
+        return;
+      }
+      p_stripe->p_band = p_band;
+      p_stripe->band_size = band_size;
+    }
+    band = *p_frame;
+    band.p_y = p_stripe->p_band;
+    band.y_stride = p_frame->width;
+    band.p_c = p_stripe->p_band + (size_t)p_frame->width * mcu_h;
+    band.c_stride = c_stride;
+    p_src = &band;
+  }
+
+  for (row = p_stripe->first_row;
+    row < p_stripe->first_row + p_stripe->num_rows; row++) {
+    if (mm_jpeg_swenc_reserve(p_stripe, 2 * SWENC_MCU_MAX_BYTES)) {
+      p_stripe->error = 1;
+      return;
+    }
+    if (row > 0) {
+      mm_jpeg_swenc_flush_bits(&bs);
+      p_stripe->p_buf[p_stripe->len++] = 0xFF;
+      p_stripe->p_buf[p_stripe->len++] = (uint8_t)(0xD0 + ((row - 1) & 7));
+    }
+    memset(dc_pred, 0, sizeof(dc_pred));
+
+    y0 = row * mcu_h;
+    if (p_frame->p_src_y) {
+      band.height = p_frame->height - y0;
+      if (band.height > mcu_h) {
+        band.height = mcu_h;
+      }
+      mm_jpeg_swenc_resample_band(p_frame, y0, band.height, p_stripe->p_band,
+        p_stripe->p_band + (size_t)p_frame->width * mcu_h);
+      y0 = 0;
+    }
+
+    for (mcu = 0; mcu < p_frame->mcus_per_row; mcu++) {
+      if (mm_jpeg_swenc_reserve(p_stripe, SWENC_MCU_MAX_BYTES)) {
+        p_stripe->error = 1;
+        return;
+      }
+      x0 = mcu * mcu_w;
+      for (bv = 0; bv < p_frame->v_samp; bv++) {
+        for (bh = 0; bh < p_frame->h_samp; bh++) {
+          mm_jpeg_swenc_load_luma(p_src, x0 + 8 * bh, y0 + 8 * bv, blk);
+          mm_jpeg_swenc_encode_block(&bs, blk, p_frame->qscale[0],
+            &dc_pred[0], &p_huff[SWENC_HUFF_DC_LUMA],
+            &p_huff[SWENC_HUFF_AC_LUMA]);
+        }
+      }
+      if (3 == p_frame->num_comps) {
+        mm_jpeg_swenc_load_chroma(p_src, 8 * mcu, y0 / p_frame->v_samp, blk,
+          cr);
+        mm_jpeg_swenc_encode_block(&bs, blk, p_frame->qscale[1],
+          &dc_pred[1], &p_huff[SWENC_HUFF_DC_CHROMA],
+          &p_huff[SWENC_HUFF_AC_CHROMA]);
+        mm_jpeg_swenc_encode_block(&bs, cr, p_frame->qscale[1],
+          &dc_pred[2], &p_huff[SWENC_HUFF_DC_CHROMA],
+          &p_huff[SWENC_HUFF_AC_CHROMA]);
+      }
+    }
+  }
+  mm_jpeg_swenc_flush_bits(&bs);
+}
+
+/** mm_jpeg_swenc_thread:
+ *
+ *  Arguments:
+ *    @data: software encoder
+ *
+ *  Return:
+ *       NULL
+ *
+ *  Description:
+ *       Worker main function, encodes stripes of the posted frame
+ *
+ **/
+static void *mm_jpeg_swenc_thread(void *data)
+{
+  mm_jpeg_swenc_t *p_enc = (mm_jpeg_swenc_t *)data;
+  const mm_jpeg_swenc_frame_t *p_frame;
+  uint32_t idx;
+
+  prctl(PR_SET_NAME, (unsigned long)"mm_jpeg_swenc", 0, 0, 0);
+
+  pthread_mutex_lock(&p_enc->work_lock);
+  while (p_enc->running) {
+    if ((NULL == p_enc->p_frame) ||
+      (p_enc->next_stripe >= p_enc->num_stripes)) {
+      pthread_cond_wait(&p_enc->work_cond, &p_enc->work_lock);
+      continue;
+    }
+    idx = p_enc->next_stripe++;
+    p_frame = p_enc->p_frame;
+    pthread_mutex_unlock(&p_enc->work_lock);
+
+    mm_jpeg_swenc_encode_stripe(p_frame, &p_enc->stripe[idx]);
+
+    pthread_mutex_lock(&p_enc->work_lock);
+    if (0 == --p_enc->stripes_left) {
+      pthread_cond_signal(&p_enc->done_cond);
+    }
+  }
+  pthread_mutex_unlock(&p_enc->work_lock);
+  return NULL;
+}
+
+/** mm_jpeg_swenc_run_frame:
+ *
+ *  Arguments:
+ *    @p_enc: software encoder
+ *    @p_frame: frame to encode
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Splits the frame into stripes and encodes them on the
+ *       workers, the calling thread takes stripes as well
+ *
+ **/
+static int32_t mm_jpeg_swenc_run_frame(mm_jpeg_swenc_t *p_enc,
+  const mm_jpeg_swenc_frame_t *p_frame)
+{
+  uint32_t num_stripes, rows, extra, row = 0, i, idx;
+
+  /* a few stripes per thread to even out busy and flat areas */
+  num_stripes = 4 * (p_enc->num_threads + 1);
+  if (num_stripes > MM_JPEG_SWENC_MAX_STRIPES) {
+    num_stripes = MM_JPEG_SWENC_MAX_STRIPES;
+  }
+  if (num_stripes > p_frame->mcu_rows) {
+    num_stripes = p_frame->mcu_rows;
+  }
+  rows = p_frame->mcu_rows / num_stripes;
+  extra = p_frame->mcu_rows % num_stripes;
+  for (i = 0; i < num_stripes; i++) {
+    p_enc->stripe[i].first_row = row;
+    p_enc->stripe[i].num_rows = rows + ((i < extra) ? 1 : 0);
+    row += p_enc->stripe[i].num_rows;
+  }
+
+  pthread_mutex_lock(&p_enc->work_lock);
+  p_enc->p_frame = p_frame;
+  p_enc->num_stripes = num_stripes;
+  p_enc->next_stripe = 0;
+  p_enc->stripes_left = num_stripes;
+  pthread_cond_broadcast(&p_enc->work_cond);
+
+  while (p_enc->next_stripe < p_enc->num_stripes) {
+    idx = p_enc->next_stripe++;
+    pthread_mutex_unlock(&p_enc->work_lock);
+
+    mm_jpeg_swenc_encode_stripe(p_frame, &p_enc->stripe[idx]);
+
+    pthread_mutex_lock(&p_enc->work_lock);
+    p_enc->stripes_left--;
+  }
+  while (p_enc->stripes_left) {
+    pthread_cond_wait(&p_enc->done_cond, &p_enc->work_lock);
+  }
+  p_enc->p_frame = NULL;
+  pthread_mutex_unlock(&p_enc->work_lock);
+
+  for (i = 0; i < num_stripes; i++) {
+    if (p_enc->stripe[i].error) {
+      CDBG_ERROR("%s:%d] stripe %d failed", __func__, __LINE__, i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/** mm_jpeg_swenc_put_marker:
+ *
+ *  Arguments:
+ *    @p: write position
+ *    @marker: marker code
+ *    @len: segment length, excluding the marker
+ *
+ *  Return:
+ *       next write position
+ *
+ *  Description:
+ *       Writes a marker segment header
+ *
+ **/
+static uint8_t *mm_jpeg_swenc_put_marker(uint8_t *p, uint8_t marker,
+  uint32_t len)
+{
+  *p++ = 0xFF;
+  *p++ = marker;
+  *p++ = (uint8_t)(len >> 8);
+  *p++ = (uint8_t)len;
+  return p;
+}
+
+/** mm_jpeg_swenc_write_header:
+ *
+ *  Arguments:
+ *    @p_frame: frame
+ *    @p_hdr: output, at least SWENC_HEADER_MAX_BYTES
+ *
+ *  Return:
+ *       header length
+ *
+ *  Description:
+ *       Writes SOI, JFIF, DQT, SOF0, DHT, DRI and SOS
+ *
+ **/
+static size_t mm_jpeg_swenc_write_header(const mm_jpeg_swenc_frame_t *p_frame,
+  uint8_t *p_hdr)
+{
+  static const uint8_t jfif[14] = {
+    'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0
+  };
+  uint8_t *p = p_hdr;
+  uint32_t t, k, n, len;
+  uint32_t num_tables = (3 == p_frame->num_comps) ? 2 : 1;
+
+  *p++ = 0xFF;
+  *p++ = 0xD8;
+
+  p = mm_jpeg_swenc_put_marker(p, 0xE0, 2 + sizeof(jfif));
+  memcpy(p, jfif, sizeof(jfif));
+  p += sizeof(jfif);
+
+  p = mm_jpeg_swenc_put_marker(p, 0xDB, 2 + 65 * num_tables);
+  for (t = 0; t < num_tables; t++) {
+    *p++ = (uint8_t)t;
+    for (k = 0; k < 64; k++) {
+      *p++ = p_frame->qtable[t][swenc_natural_order[k]];
+    }
+  }
+
+  p = mm_jpeg_swenc_put_marker(p, 0xC0, 8 + 3 * p_frame->num_comps);
+  *p++ = 8;
+  *p++ = (uint8_t)(p_frame->height >> 8);
+  *p++ = (uint8_t)p_frame->height;
+  *p++ = (uint8_t)(p_frame->width >> 8);
+  *p++ = (uint8_t)p_frame->width;
+  *p++ = (uint8_t)p_frame->num_comps;
+  *p++ = 1;
+  *p++ = (uint8_t)((p_frame->h_samp << 4) | p_frame->v_samp);
+  *p++ = 0;
+  if (3 == p_frame->num_comps) {
+    *p++ = 2;
+    *p++ = 0x11;
+    *p++ = 1;
+    *p++ = 3;
+    *p++ = 0x11;
+    *p++ = 1;
+  }
+
+  len = 2;
+  for (t = 0; t < 2 * num_tables; t++) {
+    for (k = 0, n = 0; k < 16; k++) {
+      n += swenc_huff_bits[t][k];
+    }
+    len += 17 + n;
+  }
+  p = mm_jpeg_swenc_put_marker(p, 0xC4, len);
+  for (t = 0; t < 2 * num_tables; t++) {
+    /* table class in the high nibble, chroma tables use id 1 */
+    *p++ = (uint8_t)(((t & 1) << 4) | (t >> 1));
+    for (k = 0, n = 0; k < 16; k++) {
+      n += swenc_huff_bits[t][k];
+    }
+    memcpy(p, swenc_huff_bits[t], 16);
+    p += 16;
+    memcpy(p, swenc_huff_vals[t], n);
+    p += n;
+  }
+
+  p = mm_jpeg_swenc_put_marker(p, 0xDD, 4);
+  *p++ = (uint8_t)(p_frame->mcus_per_row >> 8);
+  *p++ = (uint8_t)p_frame->mcus_per_row;
+
+  p = mm_jpeg_swenc_put_marker(p, 0xDA, 6 + 2 * p_frame->num_comps);
+  *p++ = (uint8_t)p_frame->num_comps;
+  *p++ = 1;
+  *p++ = 0x00;
+  if (3 == p_frame->num_comps) {
+    *p++ = 2;
+    *p++ = 0x11;
+    *p++ = 3;
+    *p++ = 0x11;
+  }
+  *p++ = 0;
+  *p++ = 63;
+  *p++ = 0;
+
+  return (size_t)(p - p_hdr);
+}
+
+/** mm_jpeg_swenc_set_qtables:
+ *
+ *  Arguments:
+ *    @p_frame: frame
+ *    @p_params: session parameters
+ *    @p_job: job parameters
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Uses the job quantization tables if given, otherwise
+ *       scales the Annex K tables by the session quality
+ *
+ **/
+static void mm_jpeg_swenc_set_qtables(mm_jpeg_swenc_frame_t *p_frame,
+  const mm_jpeg_encode_params_t *p_params,
+  const mm_jpeg_encode_job_t *p_job)
+{
+  uint32_t t, n, quality, scale, q;
+
+  quality = p_params->quality;
+  if (quality < 1) {
+    quality = 1;
+  } else if (quality > 100) {
+    quality = 100;
+  }
+  scale = (quality < 50) ? (5000 / quality) : (200 - 2 * quality);
+
+  for (t = 0; t < 2; t++) {
+    for (n = 0; n < 64; n++) {
+      if (p_job->qtable_set[t]) {
+        q = (uint32_t)p_job->qtable[t].nQuantizationMatrix[n];
+      } else {
+        q = (swenc_std_qtable[t][n] * scale + 50) / 100;
+      }
+      if (q < 1) {
+        q = 1;
+      } else if (q > 255) {
+        q = 255;
+      }
+      p_frame->qtable[t][n] = (uint8_t)q;
+      /* DCT output is transposed and scaled up by 8 */
+      p_frame->qscale[t][(n & 7) * 8 + (n >> 3)] = 1.0f / (float)(8 * q);
+    }
+  }
+}
+
+/** mm_jpeg_swenc_map:
+ *
+ *  Arguments:
+ *    @i: output index
+ *    @n: output size
+ *    @len: source size
+ *    @flip: set to count i from the far end
+ *
+ *  Return:
+ *       nearest neighbour source index
+ *
+ *  Description:
+ *       Maps an output row or column back to the source
+ *
+ **/
+static inline uint32_t mm_jpeg_swenc_map(uint32_t i, uint32_t n, uint32_t len,
+  int flip)
+{
+  if (flip) {
+    i = n - 1 - i;
+  }
+  return (uint32_t)(((uint64_t)i * len) / n);
+}
+
+/** mm_jpeg_swenc_resample:
+ *
+ *  Arguments:
+ *    @p_enc: software encoder
+ *    @p_frame: cropped source, switched to the resampled geometry
+ *    @dst_w: output width before rotation
+ *    @dst_h: output height before rotation
+ *    @rotation: clockwise rotation, 0, 90, 180 or 270
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Sets up a nearest neighbour scale and rotate to H2V2
+ *       semi-planar. Only the source offsets of the output rows
+ *       and columns are computed here, the stripes sample their
+ *       MCU rows through them while encoding. Only used when the
+ *       job asks for scaling or rotation.
+ *
+ **/
+static int32_t mm_jpeg_swenc_resample(mm_jpeg_swenc_t *p_enc,
+  mm_jpeg_swenc_frame_t *p_frame, uint32_t dst_w, uint32_t dst_h,
+  uint32_t rotation)
+{
+  uint32_t out_w = dst_w, out_h = dst_h;
+  uint32_t cw, ch, i, x, y;
+  uint32_t *p_map;
+  int transposed = (90 == rotation) || (270 == rotation);
+  int col_flip = (90 == rotation) || (180 == rotation);
+  int row_flip = (180 == rotation) || (270 == rotation);
+  size_t size;
+
+  if (transposed) {
+    out_w = dst_h;
+    out_h = dst_w;
+  }
+  cw = (out_w + 1) / 2;
+  ch = (out_h + 1) / 2;
+  size = sizeof(uint32_t) * ((size_t)out_w + out_h + cw + ch);
+  if (size > p_enc->scratch_size) {
+    p_map = (uint32_t *)realloc(p_enc->p_scratch, size);
+    if (NULL == p_map) {
+      CDBG_ERROR("%s:%d] no memory for %zu bytes", __func__, __LINE__, size);
+      return -1;
+    }
+    p_enc->p_scratch = p_map;
+    p_enc->scratch_size = size;
+  }
+  p_map = p_enc->p_scratch;
+  p_frame->p_col_off = p_map;
+  p_frame->p_row_off = p_map + out_w;
+  p_frame->p_ccol_off = p_map + out_w + out_h;
+  p_frame->p_crow_off = p_map + out_w + out_h + cw;
+
+  /* a transposed output column is a source row and vice versa */
+  for (i = 0; i < out_w; i++) {
+    if (transposed) {
+      y = mm_jpeg_swenc_map(i, dst_h, p_frame->height, col_flip);
+      p_map[i] = y * p_frame->y_stride;
+      if (!(i & 1)) {
+        p_map[out_w + out_h + i / 2] = (y / p_frame->v_samp) *
+          p_frame->c_stride;
+      }
+    } else {
+      x = mm_jpeg_swenc_map(i, dst_w, p_frame->width, col_flip);
+      p_map[i] = x;
+      if (!(i & 1)) {
+        p_map[out_w + out_h + i / 2] = 2 * (x / p_frame->h_samp);
+      }
+    }
+  }
+  for (i = 0; i < out_h; i++) {
+    if (transposed) {
+      x = mm_jpeg_swenc_map(i, dst_w, p_frame->width, row_flip);
+      p_map[out_w + i] = x;
+      if (!(i & 1)) {
+        p_map[out_w + out_h + cw + i / 2] = 2 * (x / p_frame->h_samp);
+      }
+    } else {
+      y = mm_jpeg_swenc_map(i, dst_h, p_frame->height, row_flip);
+      p_map[out_w + i] = y * p_frame->y_stride;
+      if (!(i & 1)) {
+        p_map[out_w + out_h + cw + i / 2] = (y / p_frame->v_samp) *
+          p_frame->c_stride;
+      }
+    }
+  }
+
+  p_frame->p_src_y = p_frame->p_y;
+  p_frame->p_src_c = p_frame->p_c;
+  p_frame->transposed = transposed;
+  p_frame->p_y = NULL;
+  p_frame->y_stride = out_w;
+  p_frame->p_c = NULL;
+  p_frame->c_stride = 2 * cw;
+  p_frame->width = out_w;
+  p_frame->height = out_h;
+  if (3 == p_frame->num_comps) {
+    p_frame->h_samp = 2;
+    p_frame->v_samp = 2;
+  }
+  return 0;
+}
+
+/** mm_jpeg_swenc_setup_frame:
+ *
+ *  Arguments:
+ *    @p_enc: software encoder
+ *    @p_frame: frame to fill
+ *    @p_params: session parameters
+ *    @p_job: job parameters
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Resolves the source planes, crop, sampling and tables
+ *       of a job
+ *
+ **/
+static int32_t mm_jpeg_swenc_setup_frame(mm_jpeg_swenc_t *p_enc,
+  mm_jpeg_swenc_frame_t *p_frame, const mm_jpeg_encode_params_t *p_params,
+  const mm_jpeg_encode_job_t *p_job)
+{
+  const mm_jpeg_buf_t *p_src;
+  const cam_frame_len_offset_t *p_off;
+  const mm_jpeg_dim_t *p_dim = &p_job->main_dim;
+  uint32_t src_w, src_h, left, top, crop_w, crop_h, dst_w, dst_h;
+  uint32_t rotation = p_job->rotation % 360;
+
+  memset(p_frame, 0, sizeof(*p_frame));
+  if ((p_job->src_index < 0) ||
+    ((uint32_t)p_job->src_index >= p_params->num_src_bufs)) {
+    CDBG_ERROR("%s:%d] invalid src index %d", __func__, __LINE__,
+      p_job->src_index);
+    return -1;
+  }
+  p_src = &p_params->src_main_buf[p_job->src_index];
+  p_off = &p_src->offset;
+
+  p_frame->num_comps = 3;
+  p_frame->cb_idx = 1;
+  switch (p_params->color_format) {
+  case MM_JPEG_COLOR_FORMAT_YCBCRLP_H2V2:
+    p_frame->cb_idx = 0;
+    /* fall through */
+  case MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2:
+    p_frame->h_samp = 2;
+    p_frame->v_samp = 2;
+    break;
+  case MM_JPEG_COLOR_FORMAT_YCBCRLP_H2V1:
+    p_frame->cb_idx = 0;
+    /* fall through */
+  case MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V1:
+    p_frame->h_samp = 2;
+    p_frame->v_samp = 1;
+    break;
+  case MM_JPEG_COLOR_FORMAT_YCBCRLP_H1V2:
+    p_frame->cb_idx = 0;
+    /* fall through */
+  case MM_JPEG_COLOR_FORMAT_YCRCBLP_H1V2:
+    p_frame->h_samp = 1;
+    p_frame->v_samp = 2;
+    break;
+  case MM_JPEG_COLOR_FORMAT_YCBCRLP_H1V1:
+    p_frame->cb_idx = 0;
+    /* fall through */
+  case MM_JPEG_COLOR_FORMAT_YCRCBLP_H1V1:
+    p_frame->h_samp = 1;
+    p_frame->v_samp = 1;
+    break;
+  case MM_JPEG_COLOR_FORMAT_MONOCHROME:
+    p_frame->num_comps = 1;
+    p_frame->h_samp = 1;
+    p_frame->v_samp = 1;
+    break;
+  default:
+    CDBG_ERROR("%s:%d] unsupported color format %d", __func__, __LINE__,
+      p_params->color_format);
+    return -1;
+  }
+
+  src_w = (uint32_t)p_dim->src_dim.width;
+  src_h = (uint32_t)p_dim->src_dim.height;
+  left = (uint32_t)p_dim->crop.left;
+  top = (uint32_t)p_dim->crop.top;
+  crop_w = (uint32_t)p_dim->crop.width;
+  crop_h = (uint32_t)p_dim->crop.height;
+  if (!crop_w || !crop_h) {
+    left = top = 0;
+    crop_w = src_w;
+    crop_h = src_h;
+  }
+  /* keep the crop origin on a chroma sample */
+  left -= left % p_frame->h_samp;
+  top -= top % p_frame->v_samp;
+  if (!crop_w || !crop_h || (left + crop_w > src_w) || (top + crop_h > src_h)) {
+    CDBG_ERROR("%s:%d] invalid crop %dx%d+%d+%d of %dx%d", __func__, __LINE__,
+      crop_w, crop_h, left, top, src_w, src_h);
+    return -1;
+  }
+  dst_w = (uint32_t)p_dim->dst_dim.width;
+  dst_h = (uint32_t)p_dim->dst_dim.height;
+  if (!dst_w || !dst_h) {
+    dst_w = crop_w;
+    dst_h = crop_h;
+  }
+
+  p_frame->y_stride = p_off->mp[0].stride ? (uint32_t)p_off->mp[0].stride :
+    src_w;
+  p_frame->c_stride = p_off->mp[1].stride ? (uint32_t)p_off->mp[1].stride :
+    p_frame->y_stride * 2 / p_frame->h_samp;
+  p_frame->p_y = p_src->buf_vaddr + p_off->mp[0].offset +
+    (size_t)top * p_frame->y_stride + left;
+  p_frame->p_c = p_src->buf_vaddr + p_off->mp[0].len + p_off->mp[1].offset +
+    (size_t)(top / p_frame->v_samp) * p_frame->c_stride +
+    2 * (left / p_frame->h_samp);
+  p_frame->width = crop_w;
+  p_frame->height = crop_h;
+
+  if ((dst_w != crop_w) || (dst_h != crop_h) || rotation) {
+    if (mm_jpeg_swenc_resample(p_enc, p_frame, dst_w, dst_h, rotation)) {
+      return -1;
+    }
+  }
+
+  p_frame->mcus_per_row = (p_frame->width + 8 * p_frame->h_samp - 1) /
+    (8 * p_frame->h_samp);
+  p_frame->mcu_rows = (p_frame->height + 8 * p_frame->v_samp - 1) /
+    (8 * p_frame->v_samp);
+  if ((p_frame->width > 0xFFFF) || (p_frame->height > 0xFFFF)) {
+    CDBG_ERROR("%s:%d] image too large %dx%d", __func__, __LINE__,
+      p_frame->width, p_frame->height);
+    return -1;
+  }
+
+  mm_jpeg_swenc_set_qtables(p_frame, p_params, p_job);
+  p_frame->huff = p_enc->huff;
+  return 0;
+}
+
+/** mm_jpeg_swenc_time_us:
+ *
+ *  Arguments:
+ *    none
+ *
+ *  Return:
+ *       monotonic time in microseconds
+ *
+ *  Description:
+ *       Timestamp for the encode time log
+ *
+ **/
+static uint64_t mm_jpeg_swenc_time_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/** mm_jpeg_swenc_encode:
+ *
+ *  Arguments:
+ *    @p_enc: software encoder
+ *    @p_params: session parameters
+ *    @p_job: job to encode
+ *    @p_out: filled with the output buffer and length
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Encodes the main image of a job
+ *
+ **/
+int32_t mm_jpeg_swenc_encode(mm_jpeg_swenc_t *p_enc,
+  const mm_jpeg_encode_params_t *p_params,
+  const mm_jpeg_encode_job_t *p_job,
+  mm_jpeg_output_t *p_out)
+{
+  mm_jpeg_swenc_frame_t frame;
+  const mm_jpeg_buf_t *p_dst;
+  omx_jpeg_ouput_buf_t *p_mem;
+  uint8_t hdr[SWENC_HEADER_MAX_BYTES];
+  uint8_t *p;
+  size_t hdr_len, total, avail;
+  uint32_t i;
+  int32_t rc = -1;
+  uint64_t start_us = mm_jpeg_swenc_time_us();
+
+  if ((p_job->dst_index < 0) ||
+    ((uint32_t)p_job->dst_index >= p_params->num_dst_bufs)) {
+    CDBG_ERROR("%s:%d] invalid dst index %d", __func__, __LINE__,
+      p_job->dst_index);
+    return -1;
+  }
+  p_dst = &p_params->dest_buf[p_job->dst_index];
+
+  pthread_mutex_lock(&p_enc->lock);
+
+  if (mm_jpeg_swenc_setup_frame(p_enc, &frame, p_params, p_job)) {
+    goto end;
+  }
+  if (mm_jpeg_swenc_run_frame(p_enc, &frame)) {
+    goto end;
+  }
+
+  hdr_len = mm_jpeg_swenc_write_header(&frame, hdr);
+  total = hdr_len + 2;
+  for (i = 0; i < p_enc->num_stripes; i++) {
+    total += p_enc->stripe[i].len;
+  }
+
+  if (NULL != p_params->get_memory) {
+    /* the client allocates the output once the size is known */
+    p_mem = (omx_jpeg_ouput_buf_t *)(void *)p_dst->buf_vaddr;
+    p_mem->size = total;
+    p_mem->fd = -1;
+    if (p_params->get_memory(p_mem) || (NULL == p_mem->vaddr)) {
+      CDBG_ERROR("%s:%d] get_memory failed", __func__, __LINE__);
+      goto end;
+    }
+    p = (uint8_t *)p_mem->vaddr;
+    avail = total;
+  } else {
+    p = p_dst->buf_vaddr;
+    avail = p_dst->buf_size;
+  }
+  if (total > avail) {
+    CDBG_ERROR("%s:%d] output %zu bytes does not fit in %zu", __func__,
+      __LINE__, total, avail);
+    goto end;
+  }
+
+  memcpy(p, hdr, hdr_len);
+  p += hdr_len;
+  for (i = 0; i < p_enc->num_stripes; i++) {
+    memcpy(p, p_enc->stripe[i].p_buf, p_enc->stripe[i].len);
+    p += p_enc->stripe[i].len;
+  }
+  *p++ = 0xFF;
+  *p++ = 0xD9;
+
+  p_out->buf_vaddr = p_dst->buf_vaddr;
+  p_out->buf_filled_len = total;
+  p_out->fd = -1;
+  rc = 0;
+
+  CDBG_HIGH("%s:%d] %dx%d in %d stripes, %zu bytes, %llu us", __func__,
+    __LINE__, frame.width, frame.height, p_enc->num_stripes, total,
+    (unsigned long long)(mm_jpeg_swenc_time_us() - start_us));
+
+end:
+  pthread_mutex_unlock(&p_enc->lock);
+  return rc;
+}
+
+/** mm_jpeg_swenc_init:
+ *
+ *  Arguments:
+ *    @p_enc: software encoder
+ *    @num_threads: threads encoding a frame, including the
+ *                  caller, 0 for one per online CPU
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Builds the tables and starts the workers. The thread
+ *       submitting a frame encodes stripes too, so one worker
+ *       less than num_threads is started.
+ *
+ **/
+int32_t mm_jpeg_swenc_init(mm_jpeg_swenc_t *p_enc, uint32_t num_threads)
+{
+  uint32_t i, n, num_workers;
+  long cpus;
+
+  memset(p_enc, 0, sizeof(*p_enc));
+  for (i = 0; i < MM_JPEG_SWENC_NUM_HUFF; i++) {
+    mm_jpeg_swenc_build_huff(swenc_huff_bits[i], swenc_huff_vals[i],
+      &p_enc->huff[i]);
+  }
+  for (i = 0; i < 64; i++) {
+    n = swenc_natural_order[i];
+    swenc_zz_to_dct[i] = (uint8_t)((n & 7) * 8 + (n >> 3));
+  }
+
+  if (0 == num_threads) {
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = (cpus > 1) ? (uint32_t)cpus : 1;
+  }
+  if (num_threads > MM_JPEG_SWENC_MAX_THREADS) {
+    num_threads = MM_JPEG_SWENC_MAX_THREADS;
+  }
+  num_workers = num_threads - 1;
+
+  pthread_mutex_init(&p_enc->lock, NULL);
+  pthread_mutex_init(&p_enc->work_lock, NULL);
+  pthread_cond_init(&p_enc->work_cond, NULL);
+  pthread_cond_init(&p_enc->done_cond, NULL);
+  p_enc->running = 1;
+
+  for (i = 0; i < num_workers; i++) {
+    if (pthread_create(&p_enc->pid[i], NULL, mm_jpeg_swenc_thread, p_enc)) {
+      CDBG_ERROR("%s:%d] cannot start worker %d", __func__, __LINE__, i);
+      break;
+    }
+  }
+  p_enc->num_threads = i;
+  CDBG_HIGH("%s:%d] %d workers", __func__, __LINE__, p_enc->num_threads);
+  return 0;
+}
+
+/** mm_jpeg_swenc_deinit:
+ *
+ *  Arguments:
+ *    @p_enc: software encoder
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Stops the workers and frees the buffers
+ *
+ **/
+void mm_jpeg_swenc_deinit(mm_jpeg_swenc_t *p_enc)
+{
+  uint32_t i;
+
+  pthread_mutex_lock(&p_enc->work_lock);
+  p_enc->running = 0;
+  pthread_cond_broadcast(&p_enc->work_cond);
+  pthread_mutex_unlock(&p_enc->work_lock);
+
+  for (i = 0; i < p_enc->num_threads; i++) {
+    pthread_join(p_enc->pid[i], NULL);
+  }
+  p_enc->num_threads = 0;
+
+  for (i = 0; i < MM_JPEG_SWENC_MAX_STRIPES; i++) {
+    free(p_enc->stripe[i].p_buf);
+    p_enc->stripe[i].p_buf = NULL;
+    p_enc->stripe[i].size = 0;
+    free(p_enc->stripe[i].p_band);
+    p_enc->stripe[i].p_band = NULL;
+    p_enc->stripe[i].band_size = 0;
+  }
+  free(p_enc->p_scratch);
+  p_enc->p_scratch = NULL;
+  p_enc->scratch_size = 0;
+
+  pthread_cond_destroy(&p_enc->done_cond);
+  pthread_cond_destroy(&p_enc->work_cond);
+  pthread_mutex_destroy(&p_enc->work_lock);
+  pthread_mutex_destroy(&p_enc->lock);
+}
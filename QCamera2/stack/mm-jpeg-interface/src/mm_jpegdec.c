@@ -101,8 +101,8 @@ static void mm_jpegdec_job_done(mm_jpeg_job_session_t *p_session)
   }
   p_session->encoding = OMX_FALSE;
 
-  /* wake up jobMgr thread to work on new job if there is any */
-  cam_sem_post(&my_obj->job_mgr.job_sem);
+  /* a job slot is free again */
+  mm_jpeg_jobmgr_kick(my_obj);
 }
 
 
@@ -213,7 +213,7 @@ OMX_ERRORTYPE mm_jpegdec_session_create(mm_jpeg_job_session_t* p_session)
   p_session->omx_callbacks.EmptyBufferDone = mm_jpegdec_ebd;
   p_session->omx_callbacks.FillBufferDone = mm_jpegdec_fbd;
   p_session->omx_callbacks.EventHandler = mm_jpegdec_event_handler;
-  p_session->exif_count_local = 0;
+  mm_jpeg_exif_arena_reset(&p_session->exif_arena);
 
   rc = OMX_GetHandle(&p_session->omx_handle,
     "OMX.qcom.image.jpeg.decoder",
@@ -736,7 +736,6 @@ int32_t mm_jpegdec_start_decode_job(mm_jpeg_obj *my_obj,
   mm_jpeg_job_t *job,
   uint32_t *job_id)
 {
-  mm_jpeg_q_data_t qdata;
   int32_t rc = -1;
   uint8_t session_idx = 0;
   uint8_t client_idx = 0;
@@ -788,10 +787,9 @@ int32_t mm_jpegdec_start_decode_job(mm_jpeg_obj *my_obj,
   node->dec_info.client_handle = p_session->client_hdl;
   node->type = MM_JPEG_CMD_TYPE_DECODE_JOB;
 
-  qdata.p = node;
-  rc = mm_jpeg_queue_enq(&my_obj->job_mgr.job_queue, qdata);
-  if (0 == rc) {
-    cam_sem_post(&my_obj->job_mgr.job_sem);
+  rc = mm_jpeg_jobmgr_enqueue(my_obj, node, MM_JPEG_LANE_NORMAL);
+  if (0 != rc) {
+    free(node);
   }
 
   return rc;
@@ -889,6 +887,7 @@ int32_t mm_jpegdec_destroy_session(mm_jpeg_obj *my_obj,
   }
   uint32_t session_id = p_session->sessionId;
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_jobmgr_pause(my_obj);
 
   /* abort job if in todo queue */
   CDBG("%s:%d] abort todo jobs", __func__, __LINE__);
@@ -910,10 +909,8 @@ int32_t mm_jpegdec_destroy_session(mm_jpeg_obj *my_obj,
   mm_jpeg_session_abort(p_session);
   mm_jpegdec_session_destroy(p_session);
   mm_jpeg_remove_session_idx(my_obj, session_id);
+  mm_jpeg_jobmgr_resume(my_obj);
   pthread_mutex_unlock(&my_obj->job_lock);
-
-  /* wake up jobMgr thread to work on new job if there is any */
-  cam_sem_post(&my_obj->job_mgr.job_sem);
   CDBG("%s:%d] X", __func__, __LINE__);
 
   return rc;
@@ -1080,6 +1077,7 @@ int32_t mm_jpegdec_abort_job(mm_jpeg_obj *my_obj,
 
   CDBG("%s:%d] ", __func__, __LINE__);
   pthread_mutex_lock(&my_obj->job_lock);
+  mm_jpeg_jobmgr_pause(my_obj);
 
   /* abort job if in todo queue */
   node = mm_jpeg_queue_remove_job_by_job_id(&my_obj->job_mgr.job_queue, jobId);
@@ -1104,6 +1102,7 @@ int32_t mm_jpegdec_abort_job(mm_jpeg_obj *my_obj,
   }
 
 abort_done:
+  mm_jpeg_jobmgr_resume(my_obj);
   pthread_mutex_unlock(&my_obj->job_lock);
 
   return rc;
@@ -0,0 +1,347 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "mm_jpeg_swenc.h"
+#include "mm_jpeg_dbg.h"
+
+#define MAX_BENCH_SIZES 4
+#define DEFAULT_ITERATIONS 10
+
+/** mm_jpeg_swenc_bench_t:
+ *  @filename: NV21 input, synthetic image if NULL
+ *  @out_filename: where to write the last encoded image
+ *  @width: image widths
+ *  @height: image heights
+ *  @num_sizes: number of sizes to run
+ *  @iterations: encodes per size and thread count
+ *  @max_threads: highest thread count of the sweep
+ *  @quality: jpeg quality
+ *
+ *  Benchmark options
+ **/
+typedef struct {
+  const char *filename;
+  const char *out_filename;
+  uint32_t width[MAX_BENCH_SIZES];
+  uint32_t height[MAX_BENCH_SIZES];
+  uint32_t num_sizes;
+  uint32_t iterations;
+  uint32_t max_threads;
+  uint32_t quality;
+} mm_jpeg_swenc_bench_t;
+
+static uint64_t bench_time_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/** bench_fill_image:
+ *
+ *  Arguments:
+ *    @p_buf: NV21 buffer
+ *    @width: image width
+ *    @height: image height
+ *
+ *  Return:
+ *       none
+ *
+ *  Description:
+ *       Deterministic test image with gradients, edges and some
+ *       noise, so the entropy coder sees camera like statistics
+ *
+ **/
+static void bench_fill_image(uint8_t *p_buf, uint32_t width, uint32_t height)
+{
+  uint32_t x, y, seed = 0x12345678;
+  uint8_t *p_c = p_buf + width * height;
+
+  for (y = 0; y < height; y++) {
+    for (x = 0; x < width; x++) {
+      seed = seed * 1103515245 + 12345;
+      p_buf[y * width + x] = (uint8_t)(((x * 255) / width + (y & 0x40) +
+        ((seed >> 16) & 0xF)) & 0xFF);
+    }
+  }
+  for (y = 0; y < height / 2; y++) {
+    for (x = 0; x < width / 2; x++) {
+      p_c[y * width + 2 * x] = (uint8_t)(64 + (x * 128) / (width / 2));
+      p_c[y * width + 2 * x + 1] = (uint8_t)(64 + (y * 128) / (height / 2));
+    }
+  }
+}
+
+/** bench_load_image:
+ *
+ *  Arguments:
+ *    @filename: NV21 file
+ *    @p_buf: buffer of size bytes
+ *    @size: expected file size
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Reads a raw NV21 image
+ *
+ **/
+static int bench_load_image(const char *filename, uint8_t *p_buf, size_t size)
+{
+  FILE *fp = fopen(filename, "rb");
+  size_t len;
+
+  if (NULL == fp) {
+    fprintf(stderr, "cannot open %s\n", filename);
+    return -1;
+  }
+  len = fread(p_buf, 1, size, fp);
+  fclose(fp);
+  if (len != size) {
+    fprintf(stderr, "%s: read %zu of %zu bytes\n", filename, len, size);
+    return -1;
+  }
+  return 0;
+}
+
+/** bench_run_size:
+ *
+ *  Arguments:
+ *    @p_bench: options
+ *    @width: image width
+ *    @height: image height
+ *
+ *  Return:
+ *       0 for success else failure
+ *
+ *  Description:
+ *       Encodes one image size for 1, 2, 4 .. max_threads
+ *       threads and prints the best and average times
+ *
+ **/
+static int bench_run_size(mm_jpeg_swenc_bench_t *p_bench, uint32_t width,
+  uint32_t height)
+{
+  mm_jpeg_swenc_t enc;
+  mm_jpeg_encode_params_t params;
+  mm_jpeg_encode_job_t job;
+  mm_jpeg_output_t out;
+  size_t frame_len = (size_t)width * height * 3 / 2;
+  uint8_t *p_src, *p_dst;
+  uint64_t start, elapsed, best, total;
+  uint32_t threads, i;
+  FILE *fp;
+  int rc = 0;
+
+  p_src = (uint8_t *)malloc(frame_len);
+  p_dst = (uint8_t *)malloc(frame_len);
+  if ((NULL == p_src) || (NULL == p_dst)) {
+    fprintf(stderr, "no memory for %ux%u\n", width, height);
+    free(p_src);
+    free(p_dst);
+    return -1;
+  }
+  if (p_bench->filename) {
+    if (bench_load_image(p_bench->filename, p_src, frame_len)) {
+      free(p_src);
+      free(p_dst);
+      return -1;
+    }
+  } else {
+    bench_fill_image(p_src, width, height);
+  }
+
+  memset(&params, 0, sizeof(params));
+  params.num_src_bufs = 1;
+  params.num_dst_bufs = 1;
+  params.src_main_buf[0].buf_vaddr = p_src;
+  params.src_main_buf[0].buf_size = frame_len;
+  params.src_main_buf[0].fd = -1;
+  params.src_main_buf[0].offset.mp[0].len = width * height;
+  params.src_main_buf[0].offset.mp[0].stride = (int32_t)width;
+  params.src_main_buf[0].offset.mp[1].len = width * height / 2;
+  params.src_main_buf[0].offset.mp[1].stride = (int32_t)width;
+  params.dest_buf[0].buf_vaddr = p_dst;
+  params.dest_buf[0].buf_size = frame_len;
+  params.dest_buf[0].fd = -1;
+  params.color_format = MM_JPEG_COLOR_FORMAT_YCRCBLP_H2V2;
+  params.quality = p_bench->quality;
+  params.sw_encode = 1;
+
+  memset(&job, 0, sizeof(job));
+  job.main_dim.src_dim.width = (int32_t)width;
+  job.main_dim.src_dim.height = (int32_t)height;
+  job.main_dim.dst_dim = job.main_dim.src_dim;
+
+  fprintf(stderr, "%ux%u, quality %u\n", width, height, p_bench->quality);
+  fprintf(stderr, "%-10s%-12s%-12s%-10s%-12s\n", "threads", "best ms",
+    "avg ms", "MP/s", "bytes");
+  for (threads = 1; threads <= p_bench->max_threads; threads *= 2) {
+    if (mm_jpeg_swenc_init(&enc, threads)) {
+      rc = -1;
+      break;
+    }
+    best = (uint64_t)-1;
+    total = 0;
+    /* first encode warms the stripe buffers */
+    for (i = 0; i <= p_bench->iterations; i++) {
+      start = bench_time_us();
+      if (mm_jpeg_swenc_encode(&enc, &params, &job, &out)) {
+        fprintf(stderr, "encode failed\n");
+        rc = -1;
+        break;
+      }
+      elapsed = bench_time_us() - start;
+      if (0 == i) {
+        continue;
+      }
+      total += elapsed;
+      if (elapsed < best) {
+        best = elapsed;
+      }
+    }
+    mm_jpeg_swenc_deinit(&enc);
+    if (rc) {
+      break;
+    }
+    fprintf(stderr, "%-10u%-12.2f%-12.2f%-10.1f%-12zu\n", threads,
+      (double)best / 1000.0,
+      (double)total / 1000.0 / p_bench->iterations,
+      (double)width * height / (double)best,
+      out.buf_filled_len);
+  }
+
+  if (!rc && p_bench->out_filename) {
+    fp = fopen(p_bench->out_filename, "wb");
+    if (fp) {
+      fwrite(out.buf_vaddr, 1, out.buf_filled_len, fp);
+      fclose(fp);
+    } else {
+      fprintf(stderr, "cannot write %s\n", p_bench->out_filename);
+    }
+  }
+
+  free(p_src);
+  free(p_dst);
+  return rc;
+}
+
+static void bench_print_usage(void)
+{
+  fprintf(stderr, "Usage: mm-jpeg-swenc-bench [options]\n");
+  fprintf(stderr, "  -I FILE\t\tNV21 input, needs -W and -H\n");
+  fprintf(stderr, "  -O FILE\t\tWrite the encoded image\n");
+  fprintf(stderr, "  -W WIDTH\t\tImage width\n");
+  fprintf(stderr, "  -H HEIGHT\t\tImage height\n");
+  fprintf(stderr, "  -n COUNT\t\tEncodes per run (default %d)\n",
+    DEFAULT_ITERATIONS);
+  fprintf(stderr, "  -t THREADS\t\tHighest thread count (default: CPUs)\n");
+  fprintf(stderr, "  -Q QUALITY\t\tJpeg quality (default 95)\n");
+  fprintf(stderr, "Without -W/-H 8MP and 13MP synthetic images are used\n");
+}
+
+int main(int argc, char *argv[])
+{
+  mm_jpeg_swenc_bench_t bench;
+  uint32_t i;
+  long cpus;
+  int c;
+
+  memset(&bench, 0, sizeof(bench));
+  bench.iterations = DEFAULT_ITERATIONS;
+  bench.quality = 95;
+  cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  bench.max_threads = (cpus > 0) ? (uint32_t)cpus : 1;
+
+  while ((c = getopt(argc, argv, "I:O:W:H:n:t:Q:h")) != -1) {
+    switch (c) {
+    case 'I':
+      bench.filename = optarg;
+      break;
+    case 'O':
+      bench.out_filename = optarg;
+      break;
+    case 'W':
+      bench.width[0] = (uint32_t)atoi(optarg);
+      break;
+    case 'H':
+      bench.height[0] = (uint32_t)atoi(optarg);
+      break;
+    case 'n':
+      bench.iterations = (uint32_t)atoi(optarg);
+      break;
+    case 't':
+      bench.max_threads = (uint32_t)atoi(optarg);
+      break;
+    case 'Q':
+      bench.quality = (uint32_t)atoi(optarg);
+      break;
+    default:
+      bench_print_usage();
+      return 1;
+    }
+  }
+
+  if (bench.width[0] && bench.height[0]) {
+    bench.num_sizes = 1;
+  } else if (bench.filename) {
+    bench_print_usage();
+    return 1;
+  } else {
+    bench.width[0] = 3264;
+    bench.height[0] = 2448;
+    bench.width[1] = 4160;
+    bench.height[1] = 3120;
+    bench.num_sizes = 2;
+  }
+  if (!bench.iterations) {
+    bench.iterations = 1;
+  }
+  if (!bench.max_threads) {
+    bench.max_threads = 1;
+  }
+  if (bench.max_threads > MM_JPEG_SWENC_MAX_THREADS) {
+    bench.max_threads = MM_JPEG_SWENC_MAX_THREADS;
+  }
+
+  for (i = 0; i < bench.num_sizes; i++) {
+    if (bench_run_size(&bench, bench.width[i], bench.height[i])) {
+      fprintf(stderr, "%-25s\n", "Fail!");
+      return 1;
+    }
+  }
+  fprintf(stderr, "%-25s\n", "Success!");
+  return 0;
+}
@@ -0,0 +1,200 @@
+/* Copyright (c) 2012, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#include <utils/Log.h>
+#include "QCameraBufIndexMap.h"
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCameraBufIndexMap
+ *
+ * DESCRIPTION: constructor of QCameraBufIndexMap
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraBufIndexMap::QCameraBufIndexMap()
+{
+    clear();
+}
+
+/*===========================================================================
+ * FUNCTION   : hash
+ *
+ * DESCRIPTION: map a key ptr to its home slot. Low bits are dropped since
+ *              buffer ptrs are at least word aligned, the rest is spread
+ *              by a multiplicative (Fibonacci) hash.
+ *
+ * PARAMETERS :
+ *   @key     : key ptr
+ *
+ * RETURN     : home slot of the key
+ *==========================================================================*/
+uint32_t QCameraBufIndexMap::hash(const void *key)
+{
+    uint64_t k = (uint64_t)(uintptr_t)key >> 3;
+    k *= 0x9E3779B97F4A7C15ULL;
+    return (uint32_t)(k >> (64 - NUM_SLOTS_SHIFT));
+}
+
+/*===========================================================================
+ * FUNCTION   : add
+ *
+ * DESCRIPTION: insert a key, or update its index if already present
+ *
+ * PARAMETERS :
+ *   @key     : key ptr, must not be NULL
+ *   @index   : buffer index of the key
+ *
+ * RETURN     : 0  -- success
+ *              -1 -- invalid key or map full
+ *==========================================================================*/
+int32_t QCameraBufIndexMap::add(const void *key, int32_t index)
+{
+    if (key == NULL) {
+        return -1;
+    }
+
+    uint32_t slot = hash(key);
+    for (uint32_t i = 0; i < NUM_SLOTS; i++) {
+        if (mSlots[slot].key == key) {
+            mSlots[slot].index = index;
+            return 0;
+        }
+        if (mSlots[slot].key == NULL) {
+            // keep at least one empty slot so lookups always terminate
+            if (mCount >= NUM_SLOTS - 1) {
+                break;
+            }
+            mSlots[slot].key = key;
+            mSlots[slot].index = index;
+            mCount++;
+            return 0;
+        }
+        slot = (slot + 1) & (NUM_SLOTS - 1);
+    }
+
+    ALOGE("%s: buffer index map full (%u entries)", __func__, mCount);
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : remove
+ *
+ * DESCRIPTION: remove a key. Entries following it in the same probe chain
+ *              are shifted back so no tombstones are needed.
+ *
+ * PARAMETERS :
+ *   @key     : key ptr
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufIndexMap::remove(const void *key)
+{
+    if (key == NULL) {
+        return;
+    }
+
+    uint32_t hole = hash(key);
+    while (mSlots[hole].key != key) {
+        if (mSlots[hole].key == NULL) {
+            return;
+        }
+        hole = (hole + 1) & (NUM_SLOTS - 1);
+    }
+
+    uint32_t next = hole;
+    for (;;) {
+        next = (next + 1) & (NUM_SLOTS - 1);
+        if (mSlots[next].key == NULL) {
+            break;
+        }
+        // an entry may only move back if its home slot is not
+        // cyclically inside (hole, next]
+        uint32_t home = hash(mSlots[next].key);
+        if (((next - home) & (NUM_SLOTS - 1)) >=
+                ((next - hole) & (NUM_SLOTS - 1))) {
+            mSlots[hole] = mSlots[next];
+            hole = next;
+        }
+    }
+    mSlots[hole].key = NULL;
+    mSlots[hole].index = -1;
+    mCount--;
+}
+
+/*===========================================================================
+ * FUNCTION   : find
+ *
+ * DESCRIPTION: look up the buffer index of a key
+ *
+ * PARAMETERS :
+ *   @key     : key ptr
+ *
+ * RETURN     : buffer index if found,
+ *              -1 if not found
+ *==========================================================================*/
+int32_t QCameraBufIndexMap::find(const void *key) const
+{
+    if (key == NULL) {
+        return -1;
+    }
+
+    uint32_t slot = hash(key);
+    while (mSlots[slot].key != NULL) {
+        if (mSlots[slot].key == key) {
+            return mSlots[slot].index;
+        }
+        slot = (slot + 1) & (NUM_SLOTS - 1);
+    }
+    return -1;
+}
+
+/*===========================================================================
+ * FUNCTION   : clear
+ *
+ * DESCRIPTION: remove all keys
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraBufIndexMap::clear()
+{
+    for (uint32_t i = 0; i < NUM_SLOTS; i++) {
+        mSlots[i].key = NULL;
+        mSlots[i].index = -1;
+    }
+    mCount = 0;
+}
+
+}; // namespace qcamera
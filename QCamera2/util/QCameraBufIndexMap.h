@@ -0,0 +1,67 @@
+/* Copyright (c) 2012, The Linux Foundataion. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_BUF_INDEX_MAP_H__
+#define __QCAMERA_BUF_INDEX_MAP_H__
+
+#include <stdint.h>
+
+namespace qcamera {
+
+// Fixed size open addressing map from a buffer key (opaque data ptr,
+// buffer_handle_t ptr, ...) to its buffer index. Sized for twice the max
+// number of buffers per stream so probe chains stay short. Not thread
+// safe; callers serialize against register/unregister themselves.
+class QCameraBufIndexMap {
+public:
+    QCameraBufIndexMap();
+    int32_t add(const void *key, int32_t index);
+    void remove(const void *key);
+    int32_t find(const void *key) const;
+    void clear();
+    uint32_t getCount() const {return mCount;}
+private:
+    enum {
+        NUM_SLOTS_SHIFT = 7,
+        NUM_SLOTS = 1 << NUM_SLOTS_SHIFT
+    };
+    typedef struct {
+        const void *key;
+        int32_t index;
+    } slot_t;
+
+    static uint32_t hash(const void *key);
+
+    slot_t mSlots[NUM_SLOTS];
+    uint32_t mCount;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_BUF_INDEX_MAP_H__ */
@@ -49,6 +49,8 @@ QCameraCmdThread::QCameraCmdThread() :
     cmd_queue()
 {
     cmd_pid = 0;
+    mDrainMode = false;
+    mJobPending = 0;
     cam_sem_init(&sync_sem, 0);
     cam_sem_init(&cmd_sem, 0);
 }
@@ -129,9 +131,20 @@ int32_t QCameraCmdThread::setName(const char* name)
  *==========================================================================*/
 int32_t QCameraCmdThread::sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority)
 {
+    if (mDrainMode && (CAMERA_CMD_TYPE_DO_NEXT_JOB == cmd) && !sync_cmd) {
+        /* job data is queued before this call; if a DO_NEXT_JOB is still
+         * pending, the thread will pick this job up in the same drain */
+        if (__atomic_exchange_n(&mJobPending, 1, __ATOMIC_SEQ_CST)) {
+            return NO_ERROR;
+        }
+    }
+
     camera_cmd_t *node = (camera_cmd_t *)malloc(sizeof(camera_cmd_t));
     if (NULL == node) {
         ALOGE("%s: No memory for camera_cmd_t", __func__);
+        if (mDrainMode && (CAMERA_CMD_TYPE_DO_NEXT_JOB == cmd)) {
+            __atomic_store_n(&mJobPending, 0, __ATOMIC_SEQ_CST);
+        }
         return NO_MEMORY;
     }
     memset(node, 0, sizeof(camera_cmd_t));
@@ -177,6 +190,12 @@ camera_cmd_type_t QCameraCmdThread::getCmd()
         cmd = node->cmd;
         free(node);
     }
+    if (mDrainMode && (CAMERA_CMD_TYPE_DO_NEXT_JOB == cmd)) {
+        /* clear before the caller drains, so jobs queued from now on
+         * trigger a new wakeup */
+        __atomic_store_n(&mJobPending, 0, __ATOMIC_SEQ_CST);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
     return cmd;
 }
 
@@ -62,11 +62,20 @@ public:
     int32_t exit();
     int32_t sendCmd(camera_cmd_type_t cmd, uint8_t sync_cmd, uint8_t priority);
     camera_cmd_type_t getCmd();
+    /* In drain mode the thread routine processes every pending job of its
+     * data queues on each CAMERA_CMD_TYPE_DO_NEXT_JOB, so back to back
+     * DO_NEXT_JOB cmds are coalesced into a single wakeup. */
+    void setDrainMode(bool drain) { mDrainMode = drain; }
+    bool isDrainMode() { return mDrainMode; }
 
     QCameraQueue cmd_queue;      /* cmd queue */
     pthread_t cmd_pid;           /* cmd thread ID */
     cam_semaphore_t cmd_sem;               /* semaphore for cmd thread */
     cam_semaphore_t sync_sem;              /* semaphore for synchronized call signal */
+
+private:
+    bool mDrainMode;
+    int32_t mJobPending;         /* a DO_NEXT_JOB is queued, drain mode only */
 };
 
 }; // namespace qcamera
@@ -31,6 +31,10 @@
 #include <utils/Log.h>
 #include "QCameraQueue.h"
 
+/* nodes preallocated at init, and max number of nodes kept for reuse */
+#define QCAMERA_QUEUE_NODE_POOL_SIZE 16
+#define QCAMERA_QUEUE_NODE_POOL_MAX  64
+
 namespace qcamera {
 
 /*===========================================================================
@@ -50,6 +54,7 @@ QCameraQueue::QCameraQueue()
     m_dataFn = NULL;
     m_userData = NULL;
     m_active = true;
+    initNodePool();
 }
 
 /*===========================================================================
@@ -71,6 +76,7 @@ QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
     m_dataFn = data_rel_fn;
     m_userData = user_data;
     m_active = true;
+    initNodePool();
 }
 
 /*===========================================================================
@@ -85,9 +91,104 @@ QCameraQueue::QCameraQueue(release_data_fn data_rel_fn, void *user_data)
 QCameraQueue::~QCameraQueue()
 {
     flush();
+    releaseNodePool();
     pthread_mutex_destroy(&m_lock);
 }
 
+/*===========================================================================
+ * FUNCTION   : initNodePool
+ *
+ * DESCRIPTION: preallocate queue nodes so that steady state enqueue/dequeue
+ *              does not hit the heap
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::initNodePool()
+{
+    m_freeNodes = NULL;
+    m_freeCnt = 0;
+    for (int i = 0; i < QCAMERA_QUEUE_NODE_POOL_SIZE; i++) {
+        camera_q_node *node = (camera_q_node *)malloc(sizeof(camera_q_node));
+        if (NULL == node) {
+            break;
+        }
+        releaseNode_l(node);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseNodePool
+ *
+ * DESCRIPTION: free all nodes kept for reuse
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::releaseNodePool()
+{
+    pthread_mutex_lock(&m_lock);
+    while (NULL != m_freeNodes) {
+        camera_q_node *node = m_freeNodes;
+        m_freeNodes = (camera_q_node *)node->list.next;
+        free(node);
+    }
+    m_freeCnt = 0;
+    pthread_mutex_unlock(&m_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : allocNode_l
+ *
+ * DESCRIPTION: get a node from free list, falling back to heap when the list
+ *              is exhausted. Must be called with m_lock held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : node ptr. NULL if no memory.
+ *==========================================================================*/
+QCameraQueue::camera_q_node *QCameraQueue::allocNode_l()
+{
+    camera_q_node *node = m_freeNodes;
+    if (NULL != node) {
+        m_freeNodes = (camera_q_node *)node->list.next;
+        m_freeCnt--;
+    } else {
+        node = (camera_q_node *)malloc(sizeof(camera_q_node));
+        if (NULL == node) {
+            ALOGE("%s: No memory for camera_q_node", __func__);
+            return NULL;
+        }
+    }
+    memset(node, 0, sizeof(camera_q_node));
+    return node;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseNode_l
+ *
+ * DESCRIPTION: return a node to free list, or to heap once the list holds
+ *              QCAMERA_QUEUE_NODE_POOL_MAX nodes. Must be called with m_lock
+ *              held.
+ *
+ * PARAMETERS :
+ *   @node    : node to be released
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraQueue::releaseNode_l(camera_q_node *node)
+{
+    if (m_freeCnt >= QCAMERA_QUEUE_NODE_POOL_MAX) {
+        free(node);
+        return;
+    }
+    node->list.next = (struct cam_list *)m_freeNodes;
+    m_freeNodes = node;
+    m_freeCnt++;
+}
+
 /*===========================================================================
  * FUNCTION   : init
  *
@@ -137,23 +238,18 @@ bool QCameraQueue::isEmpty()
 bool QCameraQueue::enqueue(void *data)
 {
     bool rc;
-    camera_q_node *node =
-        (camera_q_node *)malloc(sizeof(camera_q_node));
-    if (NULL == node) {
-        ALOGE("%s: No memory for camera_q_node", __func__);
-        return false;
-    }
-
-    memset(node, 0, sizeof(camera_q_node));
-    node->data = data;
+    camera_q_node *node = NULL;
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
+        node = allocNode_l();
+    }
+    if (NULL != node) {
+        node->data = data;
         cam_list_add_tail_node(&node->list, &m_head.list);
         m_size++;
         rc = true;
     } else {
-        free(node);
         rc = false;
     }
     pthread_mutex_unlock(&m_lock);
@@ -174,18 +270,14 @@ bool QCameraQueue::enqueue(void *data)
 bool QCameraQueue::enqueueWithPriority(void *data)
 {
     bool rc;
-    camera_q_node *node =
-        (camera_q_node *)malloc(sizeof(camera_q_node));
-    if (NULL == node) {
-        ALOGE("%s: No memory for camera_q_node", __func__);
-        return false;
-    }
-
-    memset(node, 0, sizeof(camera_q_node));
-    node->data = data;
+    camera_q_node *node = NULL;
 
     pthread_mutex_lock(&m_lock);
     if (m_active) {
+        node = allocNode_l();
+    }
+    if (NULL != node) {
+        node->data = data;
         struct cam_list *p_next = m_head.list.next;
 
         m_head.list.next = &node->list;
@@ -196,7 +288,6 @@ bool QCameraQueue::enqueueWithPriority(void *data)
         m_size++;
         rc = true;
     } else {
-        free(node);
         rc = false;
     }
     pthread_mutex_unlock(&m_lock);
@@ -266,15 +357,12 @@ void* QCameraQueue::dequeue(bool bFromHead)
             node = member_of(pos, camera_q_node, list);
             cam_list_del_node(&node->list);
             m_size--;
+            data = node->data;
+            releaseNode_l(node);
         }
     }
     pthread_mutex_unlock(&m_lock);
 
-    if (NULL != node) {
-        data = node->data;
-        free(node);
-    }
-
     return data;
 }
 
@@ -310,7 +398,7 @@ void QCameraQueue::flush(){
                 }
                 free(node->data);
             }
-            free(node);
+            releaseNode_l(node);
 
         }
         m_size = 0;
@@ -357,7 +445,7 @@ void QCameraQueue::flushNodes(match_fn match){
                     }
                     free(node->data);
                 }
-                free(node);
+                releaseNode_l(node);
             }
         }
     }
@@ -402,7 +490,7 @@ void QCameraQueue::flushNodes(match_fn_data match, void *match_data){
                     }
                     free(node->data);
                 }
-                free(node);
+                releaseNode_l(node);
             }
         }
     }
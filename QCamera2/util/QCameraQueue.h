@@ -62,8 +62,15 @@ private:
         void* data;
     } camera_q_node;
 
+    void initNodePool();
+    void releaseNodePool();
+    camera_q_node *allocNode_l();
+    void releaseNode_l(camera_q_node *node);
+
     camera_q_node m_head; // dummy head
     int m_size;
+    camera_q_node *m_freeNodes; // free list of nodes, linked by list.next
+    int m_freeCnt;
     bool m_active;
     pthread_mutex_t m_lock;
     release_data_fn m_dataFn;
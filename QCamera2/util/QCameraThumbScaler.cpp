@@ -0,0 +1,766 @@
+/* Copyright (c) 2015, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#define ATRACE_TAG ATRACE_TAG_CAMERA
+#define LOG_TAG "QCameraThumbScaler"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+#include "QCameraThumbScaler.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : padTo
+ *
+ * DESCRIPTION: round up to a power of two padding
+ *
+ * PARAMETERS :
+ *   @value   : value to pad
+ *   @padding : padding, power of two
+ *
+ * RETURN     : padded value
+ *==========================================================================*/
+static inline uint32_t padTo(uint32_t value, uint32_t padding)
+{
+    return (value + padding - 1) & ~(padding - 1);
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraThumbScaler
+ *
+ * DESCRIPTION: Constructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraThumbScaler::QCameraThumbScaler()
+        : mRotation(0),
+          mNumWorkers(0),
+          mScratch(NULL),
+          mScratchSize(0)
+{
+    memset(mPlanes, 0, sizeof(mPlanes));
+    memset(&mCaller, 0, sizeof(mCaller));
+    mCaller.owner = this;
+    for (uint32_t i = 0; i < MAX_SCALE_WORKERS; i++) {
+        memset(&mWorkers[i].stripe, 0, sizeof(mWorkers[i].stripe));
+        mWorkers[i].stripe.owner = this;
+    }
+    cam_sem_init(&mDoneSem, 0);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraThumbScaler
+ *
+ * DESCRIPTION: destructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraThumbScaler::~QCameraThumbScaler()
+{
+    deinit();
+    cam_sem_destroy(&mDoneSem);
+}
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: launch the worker threads. The calling thread always takes
+ *              a stripe of its own, so numThreads - 1 workers are started,
+ *              bounded by the online cpus.
+ *
+ * PARAMETERS :
+ *   @numThreads : threads to scale a frame with, 1 for no workers
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraThumbScaler::init(uint32_t numThreads)
+{
+    deinit();
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((cpus > 0) && (numThreads > (uint32_t)cpus)) {
+        numThreads = (uint32_t)cpus;
+    }
+    uint32_t numWorkers = (numThreads > 1) ? numThreads - 1 : 0;
+    if (numWorkers > MAX_SCALE_WORKERS) {
+        numWorkers = MAX_SCALE_WORKERS;
+    }
+
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        int32_t rc = mWorkers[i].thread.launch(workerRoutine, &mWorkers[i]);
+        if (rc != NO_ERROR) {
+            ALOGE("%s: Failed to launch worker %d", __func__, i);
+            break;
+        }
+        mNumWorkers++;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : deinit
+ *
+ * DESCRIPTION: stop the worker threads and drop the scratch memory
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::deinit()
+{
+    for (uint32_t i = 0; i < mNumWorkers; i++) {
+        mWorkers[i].thread.exit();
+    }
+    mNumWorkers = 0;
+
+    free(mScratch);
+    mScratch = NULL;
+    mScratchSize = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : getFrameOffset
+ *
+ * DESCRIPTION: plane layout of a thumbnail buffer, padded like a regular
+ *              NV21 stream buffer
+ *
+ * PARAMETERS :
+ *   @dim     : thumbnail dimension
+ *   @offset  : filled with the plane layout
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::getFrameOffset(const cam_dimension_t &dim,
+        cam_frame_len_offset_t &offset)
+{
+    uint32_t stride = padTo((uint32_t)dim.width, CAM_PAD_TO_32);
+    uint32_t scanline = padTo((uint32_t)dim.height, CAM_PAD_TO_2);
+
+    memset(&offset, 0, sizeof(offset));
+    offset.num_planes = 2;
+    offset.mp[0].len = stride * scanline;
+    offset.mp[0].stride = (int32_t)stride;
+    offset.mp[0].scanline = (int32_t)scanline;
+    offset.mp[0].width = dim.width;
+    offset.mp[0].height = dim.height;
+    offset.mp[1].len = stride * scanline / 2;
+    offset.mp[1].stride = (int32_t)stride;
+    offset.mp[1].scanline = (int32_t)(scanline / 2);
+    offset.mp[1].width = dim.width;
+    offset.mp[1].height = dim.height / 2;
+    offset.frame_len = padTo(offset.mp[0].len + offset.mp[1].len,
+            CAM_PAD_TO_4K);
+}
+
+/*===========================================================================
+ * FUNCTION   : mapImage
+ *
+ * DESCRIPTION: describe a frame buffer the way the jpeg encoder reads it,
+ *              chroma at the end of the luma plane with the luma stride
+ *
+ * PARAMETERS :
+ *   @base    : buffer address
+ *   @dim     : frame dimension
+ *   @offset  : plane layout of the buffer
+ *   @image   : filled with the image description
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::mapImage(uint8_t *base, const cam_dimension_t &dim,
+        const cam_frame_len_offset_t &offset, thumb_scale_image_t &image)
+{
+    image.y = base + offset.mp[0].offset;
+    image.uv = base + offset.mp[0].len + offset.mp[1].offset;
+    image.width = (uint32_t)dim.width;
+    image.height = (uint32_t)dim.height;
+    image.yStride = (uint32_t)offset.mp[0].stride;
+    image.uvStride = (uint32_t)offset.mp[0].stride;
+}
+
+/*===========================================================================
+ * FUNCTION   : scale
+ *
+ * DESCRIPTION: scale a crop of the source into the destination image
+ *
+ * PARAMETERS :
+ *   @src      : source frame
+ *   @crop     : region of the source to use, NULL for all of it
+ *   @dst      : thumbnail, its size is the size after rotation
+ *   @rotation : clockwise rotation, 0/90/180/270
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraThumbScaler::scale(const thumb_scale_image_t &src,
+        const cam_rect_t *crop, const thumb_scale_image_t &dst,
+        uint32_t rotation)
+{
+    ATRACE_CALL();
+    if ((src.y == NULL) || (src.uv == NULL) || (dst.y == NULL) ||
+            (dst.uv == NULL) || (src.width < 2) || (src.height < 2) ||
+            (dst.width == 0) || (dst.height == 0) ||
+            (src.yStride < src.width) || (src.uvStride < src.width) ||
+            (dst.yStride < dst.width) || (dst.uvStride < dst.width)) {
+        ALOGE("%s: Invalid image %ux%u -> %ux%u", __func__,
+                src.width, src.height, dst.width, dst.height);
+        return BAD_VALUE;
+    }
+    if ((rotation != 0) && (rotation != 90) && (rotation != 180) &&
+            (rotation != 270)) {
+        ALOGE("%s: Invalid rotation %u", __func__, rotation);
+        return BAD_VALUE;
+    }
+
+    uint32_t left = 0;
+    uint32_t top = 0;
+    uint32_t width = src.width;
+    uint32_t height = src.height;
+    if ((crop != NULL) && (crop->width > 0) && (crop->height > 0)) {
+        if ((crop->left < 0) || (crop->top < 0) ||
+                ((uint32_t)(crop->left + crop->width) > src.width) ||
+                ((uint32_t)(crop->top + crop->height) > src.height)) {
+            ALOGE("%s: Crop %d,%d %dx%d out of %ux%u", __func__, crop->left,
+                    crop->top, crop->width, crop->height, src.width,
+                    src.height);
+            return BAD_VALUE;
+        }
+        left = (uint32_t)crop->left;
+        top = (uint32_t)crop->top;
+        width = (uint32_t)crop->width;
+        height = (uint32_t)crop->height;
+    }
+
+    bool swap = (rotation == 90) || (rotation == 270);
+    uint32_t outWidth = swap ? dst.height : dst.width;
+    uint32_t outHeight = swap ? dst.width : dst.height;
+
+    // trim the crop to the thumbnail aspect ratio around its center
+    if ((uint64_t)width * outHeight > (uint64_t)height * outWidth) {
+        uint32_t trimmed = (uint32_t)((uint64_t)height * outWidth / outHeight);
+        left += (width - trimmed) / 2;
+        width = trimmed;
+    } else {
+        uint32_t trimmed = (uint32_t)((uint64_t)width * outHeight / outWidth);
+        top += (height - trimmed) / 2;
+        height = trimmed;
+    }
+    // chroma sites are shared by 2x2 pixels, start the crop on one
+    width += left & 1;
+    height += top & 1;
+    left &= ~1U;
+    top &= ~1U;
+    if ((width < 2) || (height < 2)) {
+        ALOGE("%s: Crop too small for %ux%u", __func__, dst.width,
+                dst.height);
+        return BAD_VALUE;
+    }
+
+    plane_job_t &luma = mPlanes[0];
+    luma.src = src.y + top * src.yStride + left;
+    luma.srcStride = src.yStride;
+    luma.cropWidth = width;
+    luma.cropHeight = height;
+    luma.channels = 1;
+    luma.outWidth = outWidth;
+    luma.outHeight = outHeight;
+    luma.dst = dst.y;
+    luma.dstStride = dst.yStride;
+
+    plane_job_t &chroma = mPlanes[1];
+    chroma.src = src.uv + (top / 2) * src.uvStride + left;
+    chroma.srcStride = src.uvStride;
+    chroma.cropWidth = width / 2;
+    chroma.cropHeight = height / 2;
+    chroma.channels = 2;
+    chroma.outWidth = (outWidth + 1) / 2;
+    chroma.outHeight = (outHeight + 1) / 2;
+    chroma.dst = dst.uv;
+    chroma.dstStride = dst.uvStride;
+    mRotation = rotation;
+
+    uint32_t stripes = outHeight / MIN_ROWS_PER_STRIPE;
+    if (stripes > mNumWorkers + 1) {
+        stripes = mNumWorkers + 1;
+    }
+    if (stripes < 1) {
+        stripes = 1;
+    }
+    if (prepareScratch(stripes) != NO_ERROR) {
+        return NO_MEMORY;
+    }
+
+    // stripes start on even rows so chroma rows aren't shared
+    uint32_t rowsPerStripe = padTo((outHeight + stripes - 1) / stripes, 2);
+    uint32_t row = 0;
+    uint32_t dispatched = 0;
+    for (uint32_t i = 0; (i < stripes - 1) && (row < outHeight); i++) {
+        stripe_t &stripe = mWorkers[i].stripe;
+        stripe.firstRow = row;
+        stripe.lastRow = row + rowsPerStripe;
+        if (stripe.lastRow > outHeight) {
+            stripe.lastRow = outHeight;
+        }
+        row = stripe.lastRow;
+        if (mWorkers[i].thread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB,
+                0, 0) == NO_ERROR) {
+            dispatched++;
+        } else {
+            scaleStripe(stripe);
+        }
+    }
+    mCaller.firstRow = row;
+    mCaller.lastRow = outHeight;
+    scaleStripe(mCaller);
+
+    for (uint32_t i = 0; i < dispatched; i++) {
+        cam_sem_wait(&mDoneSem);
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : prepareScratch
+ *
+ * DESCRIPTION: carve the column tables of both planes and the row buffers
+ *              of every stripe out of one scratch block, grown on demand
+ *              and kept across frames
+ *
+ * PARAMETERS :
+ *   @stripes : number of stripes of the job
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraThumbScaler::prepareScratch(uint32_t stripes)
+{
+    const plane_job_t &luma = mPlanes[0];
+    const plane_job_t &chroma = mPlanes[1];
+    size_t cols = luma.outWidth + chroma.outWidth;
+    size_t accBytes = padTo(luma.cropWidth * (uint32_t)sizeof(uint16_t), 16);
+    size_t rowBytes = padTo(2 * chroma.outWidth, 16);
+    size_t tableBytes = padTo((uint32_t)(cols * sizeof(uint32_t)), 16) +
+            padTo((uint32_t)cols, 16);
+    size_t size = tableBytes + stripes * (accBytes + rowBytes);
+
+    if (size > mScratchSize) {
+        void *scratch = NULL;
+        if (posix_memalign(&scratch, 16, size) != 0) {
+            ALOGE("%s: No memory for %zu bytes of scratch", __func__, size);
+            return NO_MEMORY;
+        }
+        free(mScratch);
+        mScratch = (uint8_t *)scratch;
+        mScratchSize = size;
+    }
+
+    uint8_t *p = mScratch;
+    uint32_t *xPos = (uint32_t *)p;
+    p += padTo((uint32_t)(cols * sizeof(uint32_t)), 16);
+    uint8_t *xFrac = p;
+    p += padTo((uint32_t)cols, 16);
+    setupPlane(mPlanes[0], xPos, xFrac);
+    setupPlane(mPlanes[1], xPos + luma.outWidth, xFrac + luma.outWidth);
+
+    for (uint32_t i = 0; i < stripes; i++) {
+        stripe_t &stripe = (i < stripes - 1) ? mWorkers[i].stripe : mCaller;
+        stripe.acc = (uint16_t *)p;
+        p += accBytes;
+        stripe.row = p;
+        p += rowBytes;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : setupPlane
+ *
+ * DESCRIPTION: pick the filter of each direction and precompute where
+ *              every output column samples the source
+ *
+ * PARAMETERS :
+ *   @plane   : plane of the job
+ *   @xPos    : table of outWidth first source pixels
+ *   @xFrac   : table of outWidth bilinear weights
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::setupPlane(plane_job_t &plane, uint32_t *xPos,
+        uint8_t *xFrac)
+{
+    plane.boxX = (plane.cropWidth >= 2 * plane.outWidth);
+    plane.boxY = (plane.cropHeight >= 2 * plane.outHeight);
+    plane.tapsX = BILINEAR_ONE;
+    plane.tapsY = BILINEAR_ONE;
+    if (plane.boxX) {
+        plane.tapsX = plane.cropWidth / plane.outWidth;
+        if (plane.tapsX > MAX_BOX_TAPS) {
+            plane.tapsX = MAX_BOX_TAPS;
+        }
+    }
+    if (plane.boxY) {
+        plane.tapsY = plane.cropHeight / plane.outHeight;
+        if (plane.tapsY > MAX_BOX_TAPS) {
+            plane.tapsY = MAX_BOX_TAPS;
+        }
+    }
+    uint64_t taps = (uint64_t)plane.tapsX * plane.tapsY;
+    plane.recip = ((1ULL << 31) + taps / 2) / taps;
+
+    plane.xPos = xPos;
+    plane.xFrac = xFrac;
+    for (uint32_t i = 0; i < plane.outWidth; i++) {
+        // center of output column i in the source
+        uint64_t center2 = (2ULL * i + 1) * plane.cropWidth;
+        if (plane.boxX) {
+            // window centered on the output pixel, rounded to nearest
+            int64_t first = ((int64_t)center2 -
+                    (int64_t)(plane.tapsX - 1) * plane.outWidth) /
+                    (2 * (int64_t)plane.outWidth);
+            if (first < 0) {
+                first = 0;
+            } else if (first > (int64_t)(plane.cropWidth - plane.tapsX)) {
+                first = plane.cropWidth - plane.tapsX;
+            }
+            xPos[i] = (uint32_t)first;
+            xFrac[i] = 0;
+        } else {
+            int64_t pos = (int64_t)(center2 * BILINEAR_ONE /
+                    (2 * plane.outWidth)) - BILINEAR_ONE / 2;
+            if (pos < 0) {
+                pos = 0;
+            }
+            uint32_t x = (uint32_t)(pos / BILINEAR_ONE);
+            uint32_t frac = (uint32_t)(pos % BILINEAR_ONE);
+            if (x >= plane.cropWidth - 1) {
+                x = plane.cropWidth - 1;
+                frac = 0;
+            }
+            xPos[i] = x;
+            xFrac[i] = (uint8_t)frac;
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : scaleStripe
+ *
+ * DESCRIPTION: scale the luma rows of a stripe and the chroma rows under
+ *              them
+ *
+ * PARAMETERS :
+ *   @stripe  : stripe to scale
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::scaleStripe(stripe_t &stripe)
+{
+    scaleRows(mPlanes[0], stripe.firstRow, stripe.lastRow, stripe.acc,
+            stripe.row);
+    scaleRows(mPlanes[1], stripe.firstRow / 2, (stripe.lastRow + 1) / 2,
+            stripe.acc, stripe.row);
+}
+
+/*===========================================================================
+ * FUNCTION   : scaleRows
+ *
+ * DESCRIPTION: produce output rows [firstRow, lastRow) of a plane: filter
+ *              the source rows under each of them into a 16 bit row, then
+ *              filter that horizontally and normalize
+ *
+ * PARAMETERS :
+ *   @plane    : plane of the job
+ *   @firstRow : first output row, before rotation
+ *   @lastRow  : row past the last one
+ *   @acc      : scratch for cropWidth * channels sums
+ *   @row      : scratch for one output row
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::scaleRows(const plane_job_t &plane,
+        uint32_t firstRow, uint32_t lastRow, uint16_t *acc, uint8_t *row)
+{
+    const uint32_t ch = plane.channels;
+    const uint32_t bytes = plane.cropWidth * ch;
+    const uint64_t half = 1ULL << 30;
+
+    for (uint32_t j = firstRow; j < lastRow; j++) {
+        uint64_t center2 = (2ULL * j + 1) * plane.cropHeight;
+        if (plane.boxY) {
+            // window centered on the output pixel, rounded to nearest
+            int64_t first = ((int64_t)center2 -
+                    (int64_t)(plane.tapsY - 1) * plane.outHeight) /
+                    (2 * (int64_t)plane.outHeight);
+            if (first < 0) {
+                first = 0;
+            } else if (first > (int64_t)(plane.cropHeight - plane.tapsY)) {
+                first = plane.cropHeight - plane.tapsY;
+            }
+            sumRows(plane.src + (uint32_t)first * plane.srcStride,
+                    plane.srcStride, plane.tapsY, bytes, acc);
+        } else {
+            int64_t pos = (int64_t)(center2 * BILINEAR_ONE /
+                    (2 * plane.outHeight)) - BILINEAR_ONE / 2;
+            if (pos < 0) {
+                pos = 0;
+            }
+            uint32_t y = (uint32_t)(pos / BILINEAR_ONE);
+            uint32_t frac = (uint32_t)(pos % BILINEAR_ONE);
+            if (y >= plane.cropHeight - 1) {
+                y = plane.cropHeight - 1;
+                frac = 0;
+            }
+            const uint8_t *top = plane.src + y * plane.srcStride;
+            blendRows(top, (frac != 0) ? top + plane.srcStride : top, frac,
+                    bytes, acc);
+        }
+
+        uint8_t *out = row;
+        for (uint32_t i = 0; i < plane.outWidth; i++) {
+            const uint16_t *p = acc + plane.xPos[i] * ch;
+            for (uint32_t c = 0; c < ch; c++) {
+                uint32_t sum;
+                if (plane.boxX) {
+                    sum = 0;
+                    for (uint32_t k = 0; k < plane.tapsX; k++) {
+                        sum += p[k * ch + c];
+                    }
+                } else {
+                    uint32_t frac = plane.xFrac[i];
+                    sum = p[c] * (BILINEAR_ONE - frac);
+                    if (frac != 0) {
+                        sum += p[ch + c] * frac;
+                    }
+                }
+                *out++ = (uint8_t)((sum * plane.recip + half) >> 31);
+            }
+        }
+        emitRow(plane, j, row);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : emitRow
+ *
+ * DESCRIPTION: store an output row at its rotated place. Rotated rows
+ *              become columns of the thumbnail, which is small enough for
+ *              the strided stores not to matter.
+ *
+ * PARAMETERS :
+ *   @plane   : plane of the job
+ *   @j       : output row, before rotation
+ *   @row     : pixels of the row
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::emitRow(const plane_job_t &plane, uint32_t j,
+        const uint8_t *row)
+{
+    const uint32_t ch = plane.channels;
+    const uint32_t w = plane.outWidth;
+    const uint32_t h = plane.outHeight;
+    uint8_t *out = NULL;
+    ssize_t step = 0;
+
+    switch (mRotation) {
+    case 90:
+        out = plane.dst + (h - 1 - j) * ch;
+        step = (ssize_t)plane.dstStride;
+        break;
+    case 180:
+        out = plane.dst + (h - 1 - j) * plane.dstStride + (w - 1) * ch;
+        step = -(ssize_t)ch;
+        break;
+    case 270:
+        out = plane.dst + (w - 1) * plane.dstStride + j * ch;
+        step = -(ssize_t)plane.dstStride;
+        break;
+    default:
+        memcpy(plane.dst + j * plane.dstStride, row, w * ch);
+        return;
+    }
+
+    for (uint32_t i = 0; i < w; i++, out += step, row += ch) {
+        out[0] = row[0];
+        if (ch > 1) {
+            out[1] = row[1];
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : sumRows
+ *
+ * DESCRIPTION: add up a run of source rows. With NEON 16 columns at a
+ *              time are summed in registers down all the rows.
+ *
+ * PARAMETERS :
+ *   @src     : first row
+ *   @stride  : row stride in bytes
+ *   @rows    : rows to add, at most MAX_BOX_TAPS
+ *   @bytes   : bytes per row
+ *   @acc     : filled with the sums
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::sumRows(const uint8_t *src, uint32_t stride,
+        uint32_t rows, uint32_t bytes, uint16_t *acc)
+{
+    uint32_t x = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; x + 16 <= bytes; x += 16) {
+        const uint8_t *p = src + x;
+        uint8x16_t in = vld1q_u8(p);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(in));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(in));
+        for (uint32_t r = 1; r < rows; r++) {
+            p += stride;
+            in = vld1q_u8(p);
+            lo = vaddw_u8(lo, vget_low_u8(in));
+            hi = vaddw_u8(hi, vget_high_u8(in));
+        }
+        vst1q_u16(acc + x, lo);
+        vst1q_u16(acc + x + 8, hi);
+    }
+#endif
+    // row by row, which compilers vectorize
+    for (uint32_t i = x; i < bytes; i++) {
+        acc[i] = src[i];
+    }
+    for (uint32_t r = 1; r < rows; r++) {
+        const uint8_t *p = src + r * stride;
+        for (uint32_t i = x; i < bytes; i++) {
+            acc[i] = (uint16_t)(acc[i] + p[i]);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : blendRows
+ *
+ * DESCRIPTION: weigh two neighbouring source rows, the sum of the weights
+ *              being BILINEAR_ONE. With NEON 16 columns are done per step.
+ *
+ * PARAMETERS :
+ *   @top     : upper row
+ *   @bottom  : lower row
+ *   @frac    : weight of the lower row, below BILINEAR_ONE
+ *   @bytes   : bytes per row
+ *   @acc     : filled with the weighted sums
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThumbScaler::blendRows(const uint8_t *top, const uint8_t *bottom,
+        uint32_t frac, uint32_t bytes, uint16_t *acc)
+{
+    uint32_t x = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const uint8x8_t wTop = vdup_n_u8((uint8_t)(BILINEAR_ONE - frac));
+    const uint8x8_t wBottom = vdup_n_u8((uint8_t)frac);
+    for (; x + 16 <= bytes; x += 16) {
+        uint8x16_t a = vld1q_u8(top + x);
+        uint8x16_t b = vld1q_u8(bottom + x);
+        uint16x8_t lo = vmull_u8(vget_low_u8(a), wTop);
+        uint16x8_t hi = vmull_u8(vget_high_u8(a), wTop);
+        lo = vmlal_u8(lo, vget_low_u8(b), wBottom);
+        hi = vmlal_u8(hi, vget_high_u8(b), wBottom);
+        vst1q_u16(acc + x, lo);
+        vst1q_u16(acc + x + 8, hi);
+    }
+#endif
+    for (; x < bytes; x++) {
+        acc[x] = (uint16_t)(top[x] * (BILINEAR_ONE - frac) + bottom[x] * frac);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : workerRoutine
+ *
+ * DESCRIPTION: worker thread, scales the stripe it is handed on every
+ *              CAMERA_CMD_TYPE_DO_NEXT_JOB
+ *
+ * PARAMETERS :
+ *   @data    : worker descriptor
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void *QCameraThumbScaler::workerRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    scale_worker_t *worker = (scale_worker_t *)data;
+    QCameraCmdThread *cmdThread = &worker->thread;
+    cmdThread->setName("cam_thumb_scale");
+
+    do {
+        do {
+            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            if (ret != 0 && errno != EINVAL) {
+                ALOGE("%s: cam_sem_wait error (%s)",
+                      __func__, strerror(errno));
+                return NULL;
+            }
+        } while (ret != 0);
+
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            worker->stripe.owner->scaleStripe(worker->stripe);
+            cam_sem_post(&worker->stripe.owner->mDoneSem);
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            running = 0;
+            break;
+        default:
+            break;
+        }
+    } while (running);
+    return NULL;
+}
+
+}; // namespace qcamera
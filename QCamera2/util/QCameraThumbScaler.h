@@ -0,0 +1,143 @@
+/* Copyright (c) 2015, The Linux Foundataion. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA_THUMB_SCALER_H__
+#define __QCAMERA_THUMB_SCALER_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <cam_semaphore.h>
+#include "cam_types.h"
+#include "QCameraCmdThread.h"
+
+namespace qcamera {
+
+/* Semi-planar YUV 4:2:0 image (NV21 or NV12). The chroma plane holds
+ * interleaved pairs at half resolution; their order is kept as is. */
+typedef struct {
+    uint8_t *y;
+    uint8_t *uv;
+    uint32_t width;
+    uint32_t height;
+    uint32_t yStride;   /* bytes */
+    uint32_t uvStride;  /* bytes */
+} thumb_scale_image_t;
+
+/* Shrinks a crop of a semi-planar frame into a thumbnail and rotates it
+ * clockwise by 0, 90, 180 or 270 degrees on the way out. The crop is
+ * trimmed around its center to the aspect ratio of the thumbnail. Each
+ * direction is box filtered when it shrinks by 2 or more and bilinear
+ * otherwise. Output rows are split in stripes across a worker pool, the
+ * calling thread takes one of them. One frame is scaled at a time. */
+class QCameraThumbScaler {
+public:
+    QCameraThumbScaler();
+    virtual ~QCameraThumbScaler();
+
+    int32_t init(uint32_t numThreads);
+    void deinit();
+    int32_t scale(const thumb_scale_image_t &src, const cam_rect_t *crop,
+            const thumb_scale_image_t &dst, uint32_t rotation);
+
+    static void getFrameOffset(const cam_dimension_t &dim,
+            cam_frame_len_offset_t &offset);
+    static void mapImage(uint8_t *base, const cam_dimension_t &dim,
+            const cam_frame_len_offset_t &offset, thumb_scale_image_t &image);
+
+private:
+    enum {
+        MAX_SCALE_WORKERS = 3,
+        // fewer output rows are not worth waking up the workers
+        MIN_ROWS_PER_STRIPE = 16,
+        // widest box summed per output pixel, keeps sums in 16 bits
+        MAX_BOX_TAPS = 64,
+        // bilinear weights are 7 bit so that they fit a u8 multiply
+        BILINEAR_ONE = 128
+    };
+
+    /* one plane of the job, in the orientation of the source */
+    typedef struct {
+        const uint8_t *src;   /* first byte of the crop */
+        uint32_t srcStride;
+        uint32_t cropWidth;   /* pixels */
+        uint32_t cropHeight;
+        uint32_t channels;    /* 1 for luma, 2 for chroma */
+        uint32_t outWidth;    /* pixels, before rotation */
+        uint32_t outHeight;
+        uint8_t *dst;
+        uint32_t dstStride;
+        bool boxX;
+        bool boxY;
+        uint32_t tapsX;       /* box width or bilinear one */
+        uint32_t tapsY;
+        uint64_t recip;       /* 2^31 / (tapsX * tapsY) */
+        uint32_t *xPos;       /* first source pixel per output column */
+        uint8_t *xFrac;       /* bilinear weight of the next pixel */
+    } plane_job_t;
+
+    typedef struct {
+        QCameraThumbScaler *owner;
+        uint16_t *acc;        /* vertically filtered row */
+        uint8_t *row;         /* output row before rotation */
+        uint32_t firstRow;    /* luma output rows */
+        uint32_t lastRow;
+    } stripe_t;
+
+    typedef struct {
+        QCameraCmdThread thread;
+        stripe_t stripe;
+    } scale_worker_t;
+
+    static void *workerRoutine(void *data);
+    int32_t prepareScratch(uint32_t stripes);
+    void setupPlane(plane_job_t &plane, uint32_t *xPos, uint8_t *xFrac);
+    void scaleStripe(stripe_t &stripe);
+    void scaleRows(const plane_job_t &plane, uint32_t firstRow,
+            uint32_t lastRow, uint16_t *acc, uint8_t *row);
+    void emitRow(const plane_job_t &plane, uint32_t j, const uint8_t *row);
+
+    static void sumRows(const uint8_t *src, uint32_t stride, uint32_t rows,
+            uint32_t bytes, uint16_t *acc);
+    static void blendRows(const uint8_t *top, const uint8_t *bottom,
+            uint32_t frac, uint32_t bytes, uint16_t *acc);
+
+    plane_job_t mPlanes[2];
+    uint32_t mRotation;
+    stripe_t mCaller;
+    scale_worker_t mWorkers[MAX_SCALE_WORKERS];
+    uint32_t mNumWorkers;
+    cam_semaphore_t mDoneSem;
+
+    uint8_t *mScratch;
+    size_t mScratchSize;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_THUMB_SCALER_H__ */
@@ -0,0 +1,29 @@
+#thumbnail scaler benchmark
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_C_INCLUDES := \
+        $(LOCAL_PATH)/.. \
+        $(LOCAL_PATH)/../../stack/common
+
+ifeq ($(TARGET_COMPILE_WITH_MSM_KERNEL),true)
+LOCAL_C_INCLUDES += $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include
+LOCAL_C_INCLUDES += $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr/include/media
+LOCAL_ADDITIONAL_DEPENDENCIES := $(TARGET_OUT_INTERMEDIATES)/KERNEL_OBJ/usr
+endif
+
+LOCAL_SRC_FILES := \
+        qcamera_thumb_scaler_bench.cpp \
+        ../QCameraThumbScaler.cpp \
+        ../QCameraCmdThread.cpp \
+        ../QCameraQueue.cpp
+
+LOCAL_32_BIT_ONLY := $(BOARD_QTI_CAMERA_32BIT_ONLY)
+LOCAL_MODULE           := qcamera-thumb-scaler-bench
+LOCAL_SHARED_LIBRARIES := liblog libutils libcutils
+
+include $(BUILD_EXECUTABLE)
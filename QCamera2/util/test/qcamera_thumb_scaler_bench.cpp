@@ -0,0 +1,549 @@
+/* Copyright (c) 2015, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "QCameraThumbScaler.h"
+
+using namespace qcamera;
+
+#define MAX_BENCH_SIZES 4
+#define MAX_BENCH_THREADS 4
+#define DEFAULT_ITERATIONS 20
+// area averaged reference vs fixed point box/bilinear filter
+#define MIN_PSNR_DB 40.0
+
+/* Benchmark options */
+typedef struct {
+    const char *filename;       // NV21 input, synthetic image if NULL
+    const char *outFilename;    // where to write the last thumbnail
+    uint32_t width[MAX_BENCH_SIZES];
+    uint32_t height[MAX_BENCH_SIZES];
+    uint32_t numSizes;
+    uint32_t thumbWidth;
+    uint32_t thumbHeight;
+    uint32_t iterations;        // scales per size and thread count
+    uint32_t maxThreads;        // highest thread count of the sweep
+} thumb_bench_t;
+
+/* frame buffer with its layout */
+typedef struct {
+    uint8_t *buf;
+    cam_dimension_t dim;
+    cam_frame_len_offset_t offset;
+    thumb_scale_image_t image;
+} bench_frame_t;
+
+static uint64_t benchTimeUs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : allocFrame
+ *
+ * DESCRIPTION: allocate a frame padded like a stream buffer
+ *
+ * PARAMETERS :
+ *   @frame   : frame to fill in
+ *   @width   : frame width
+ *   @height  : frame height
+ *
+ * RETURN     : 0 for success else failure
+ *==========================================================================*/
+static int allocFrame(bench_frame_t &frame, uint32_t width, uint32_t height)
+{
+    memset(&frame, 0, sizeof(frame));
+    frame.dim.width = (int32_t)width;
+    frame.dim.height = (int32_t)height;
+    QCameraThumbScaler::getFrameOffset(frame.dim, frame.offset);
+    frame.buf = (uint8_t *)malloc(frame.offset.frame_len);
+    if (frame.buf == NULL) {
+        fprintf(stderr, "no memory for %ux%u\n", width, height);
+        return -1;
+    }
+    memset(frame.buf, 0, frame.offset.frame_len);
+    QCameraThumbScaler::mapImage(frame.buf, frame.dim, frame.offset,
+            frame.image);
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : fillFrame
+ *
+ * DESCRIPTION: deterministic test image with gradients, edges and some
+ *              noise
+ *
+ * PARAMETERS :
+ *   @frame   : frame to fill
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static void fillFrame(bench_frame_t &frame)
+{
+    const thumb_scale_image_t &img = frame.image;
+    uint32_t seed = 0x12345678;
+
+    for (uint32_t y = 0; y < img.height; y++) {
+        for (uint32_t x = 0; x < img.width; x++) {
+            seed = seed * 1103515245 + 12345;
+            img.y[y * img.yStride + x] = (uint8_t)(((x * 191) / img.width +
+                    (y & 0x40) + ((seed >> 16) & 0xF)) & 0xFF);
+        }
+    }
+    for (uint32_t y = 0; y < img.height / 2; y++) {
+        for (uint32_t x = 0; x < img.width / 2; x++) {
+            img.uv[y * img.uvStride + 2 * x] =
+                    (uint8_t)(64 + (x * 128) / (img.width / 2));
+            img.uv[y * img.uvStride + 2 * x + 1] =
+                    (uint8_t)(64 + (y * 128) / (img.height / 2));
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : loadFrame
+ *
+ * DESCRIPTION: read a packed NV21 image into a padded frame
+ *
+ * PARAMETERS :
+ *   @filename: NV21 file without padding
+ *   @frame   : frame to fill
+ *
+ * RETURN     : 0 for success else failure
+ *==========================================================================*/
+static int loadFrame(const char *filename, bench_frame_t &frame)
+{
+    const thumb_scale_image_t &img = frame.image;
+    FILE *fp = fopen(filename, "rb");
+    size_t len = 0;
+
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open %s\n", filename);
+        return -1;
+    }
+    for (uint32_t y = 0; y < img.height; y++) {
+        len += fread(img.y + y * img.yStride, 1, img.width, fp);
+    }
+    for (uint32_t y = 0; y < img.height / 2; y++) {
+        len += fread(img.uv + y * img.uvStride, 1, img.width, fp);
+    }
+    fclose(fp);
+    if (len != (size_t)img.width * img.height * 3 / 2) {
+        fprintf(stderr, "%s: short read of %zu bytes\n", filename, len);
+        return -1;
+    }
+    return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : areaAverage
+ *
+ * DESCRIPTION: mean of a channel over a fractional source window, windows
+ *              narrower than a pixel are widened to one
+ *
+ * PARAMETERS :
+ *   @src, @stride, @channels, @c : plane, byte stride, interleave, channel
+ *   @width, @height : plane size in pixels
+ *   @x0, @x1, @y0, @y1 : window
+ *
+ * RETURN     : mean value
+ *==========================================================================*/
+static double areaAverage(const uint8_t *src, uint32_t stride,
+        uint32_t channels, uint32_t c, uint32_t width, uint32_t height,
+        double x0, double x1, double y0, double y1)
+{
+    if (x1 - x0 < 1.0) {
+        x0 = fmax(0.0, fmin((x0 + x1 - 1.0) / 2, width - 1.0));
+        x1 = x0 + 1.0;
+    }
+    if (y1 - y0 < 1.0) {
+        y0 = fmax(0.0, fmin((y0 + y1 - 1.0) / 2, height - 1.0));
+        y1 = y0 + 1.0;
+    }
+    double sum = 0.0;
+    double area = 0.0;
+    for (uint32_t y = (uint32_t)y0; (y < height) && (y < y1); y++) {
+        double wy = fmin(y + 1.0, y1) - fmax((double)y, y0);
+        for (uint32_t x = (uint32_t)x0; (x < width) && (x < x1); x++) {
+            double w = wy * (fmin(x + 1.0, x1) - fmax((double)x, x0));
+            sum += w * src[y * stride + x * channels + c];
+            area += w;
+        }
+    }
+    return sum / area;
+}
+
+/*===========================================================================
+ * FUNCTION   : checkQuality
+ *
+ * DESCRIPTION: compare an unrotated thumbnail of the whole frame against
+ *              an area averaged reference of the same crop
+ *
+ * PARAMETERS :
+ *   @src     : source frame
+ *   @dst     : thumbnail
+ *   @psnr    : PSNR of luma and chroma in dB
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static void checkQuality(const bench_frame_t &src, const bench_frame_t &dst,
+        double psnr[2])
+{
+    const thumb_scale_image_t &s = src.image;
+    const thumb_scale_image_t &d = dst.image;
+
+    // same crop as the scaler: centered to the thumbnail aspect ratio,
+    // starting on an even pixel
+    uint32_t left = 0, top = 0, width = s.width, height = s.height;
+    if ((uint64_t)width * d.height > (uint64_t)height * d.width) {
+        width = (uint32_t)((uint64_t)height * d.width / d.height);
+        left = (s.width - width) / 2;
+    } else {
+        height = (uint32_t)((uint64_t)width * d.height / d.width);
+        top = (s.height - height) / 2;
+    }
+    width += left & 1;
+    height += top & 1;
+    left &= ~1U;
+    top &= ~1U;
+
+    for (uint32_t plane = 0; plane < 2; plane++) {
+        uint32_t ch = plane + 1;
+        uint32_t cw = plane ? width / 2 : width;
+        uint32_t chh = plane ? height / 2 : height;
+        uint32_t ow = plane ? (d.width + 1) / 2 : d.width;
+        uint32_t oh = plane ? (d.height + 1) / 2 : d.height;
+        const uint8_t *in = plane ? s.uv + (top / 2) * s.uvStride + left :
+                s.y + top * s.yStride + left;
+        const uint8_t *out = plane ? d.uv : d.y;
+        uint32_t inStride = plane ? s.uvStride : s.yStride;
+        uint32_t outStride = plane ? d.uvStride : d.yStride;
+        double se = 0.0;
+
+        for (uint32_t j = 0; j < oh; j++) {
+            for (uint32_t i = 0; i < ow; i++) {
+                for (uint32_t c = 0; c < ch; c++) {
+                    double ref = areaAverage(in, inStride, ch, c, cw, chh,
+                            (double)i * cw / ow, (double)(i + 1) * cw / ow,
+                            (double)j * chh / oh, (double)(j + 1) * chh / oh);
+                    double e = ref - out[j * outStride + i * ch + c];
+                    se += e * e;
+                }
+            }
+        }
+        double mse = se / ((double)ow * oh * ch);
+        psnr[plane] = (mse > 0.0) ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : checkRotation
+ *
+ * DESCRIPTION: a rotated thumbnail must hold exactly the pixels of the
+ *              unrotated one, moved
+ *
+ * PARAMETERS :
+ *   @ref     : unrotated thumbnail
+ *   @rot     : rotated thumbnail
+ *   @rotation: clockwise rotation of rot
+ *
+ * RETURN     : number of mismatching pixels
+ *==========================================================================*/
+static uint32_t checkRotation(const bench_frame_t &ref,
+        const bench_frame_t &rot, uint32_t rotation)
+{
+    const thumb_scale_image_t &a = ref.image;
+    const thumb_scale_image_t &b = rot.image;
+    uint32_t errors = 0;
+
+    for (uint32_t plane = 0; plane < 2; plane++) {
+        uint32_t ch = plane + 1;
+        uint32_t w = plane ? (a.width + 1) / 2 : a.width;
+        uint32_t h = plane ? (a.height + 1) / 2 : a.height;
+        const uint8_t *pa = plane ? a.uv : a.y;
+        const uint8_t *pb = plane ? b.uv : b.y;
+        uint32_t sa = plane ? a.uvStride : a.yStride;
+        uint32_t sb = plane ? b.uvStride : b.yStride;
+
+        for (uint32_t j = 0; j < h; j++) {
+            for (uint32_t i = 0; i < w; i++) {
+                uint32_t x, y;
+                switch (rotation) {
+                case 90:
+                    x = h - 1 - j;
+                    y = i;
+                    break;
+                case 180:
+                    x = w - 1 - i;
+                    y = h - 1 - j;
+                    break;
+                case 270:
+                    x = j;
+                    y = w - 1 - i;
+                    break;
+                default:
+                    x = i;
+                    y = j;
+                    break;
+                }
+                for (uint32_t c = 0; c < ch; c++) {
+                    if (pa[j * sa + i * ch + c] != pb[y * sb + x * ch + c]) {
+                        errors++;
+                    }
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+/*===========================================================================
+ * FUNCTION   : runSize
+ *
+ * DESCRIPTION: check one frame size for quality and rotation, then time
+ *              it for 1, 2, 4 .. maxThreads threads
+ *
+ * PARAMETERS :
+ *   @bench   : options
+ *   @width   : frame width
+ *   @height  : frame height
+ *
+ * RETURN     : 0 for success else failure
+ *==========================================================================*/
+static int runSize(const thumb_bench_t &bench, uint32_t width,
+        uint32_t height)
+{
+    bench_frame_t src, thumb;
+    QCameraThumbScaler scaler;
+    int rc = 0;
+
+    memset(&src, 0, sizeof(src));
+    memset(&thumb, 0, sizeof(thumb));
+    if (allocFrame(src, width, height) ||
+            allocFrame(thumb, bench.thumbWidth, bench.thumbHeight)) {
+        rc = -1;
+        goto done;
+    }
+    if (bench.filename != NULL) {
+        if (loadFrame(bench.filename, src)) {
+            rc = -1;
+            goto done;
+        }
+    } else {
+        fillFrame(src);
+    }
+
+    fprintf(stderr, "%ux%u -> %ux%u\n", width, height, bench.thumbWidth,
+            bench.thumbHeight);
+    scaler.init(1);
+    if (scaler.scale(src.image, NULL, thumb.image, 0) != 0) {
+        fprintf(stderr, "scale failed\n");
+        rc = -1;
+        goto done;
+    }
+    {
+        double psnr[2];
+        checkQuality(src, thumb, psnr);
+        fprintf(stderr, "PSNR vs area average: Y %.1f dB, CbCr %.1f dB\n",
+                psnr[0], psnr[1]);
+        if ((psnr[0] < MIN_PSNR_DB) || (psnr[1] < MIN_PSNR_DB)) {
+            fprintf(stderr, "PSNR below %.1f dB\n", MIN_PSNR_DB);
+            rc = -1;
+        }
+    }
+    for (uint32_t rotation = 90; rotation < 360; rotation += 90) {
+        bool swap = (rotation != 180);
+        bench_frame_t rotated;
+        if (allocFrame(rotated, swap ? bench.thumbHeight : bench.thumbWidth,
+                swap ? bench.thumbWidth : bench.thumbHeight)) {
+            rc = -1;
+            break;
+        }
+        uint32_t errors = (uint32_t)-1;
+        if (scaler.scale(src.image, NULL, rotated.image, rotation) == 0) {
+            errors = checkRotation(thumb, rotated, rotation);
+        }
+        fprintf(stderr, "rotation %u: %u mismatches\n", rotation, errors);
+        if (errors != 0) {
+            rc = -1;
+        }
+        free(rotated.buf);
+    }
+
+    fprintf(stderr, "%-10s%-12s%-12s%-10s\n", "threads", "best ms",
+            "avg ms", "MP/s");
+    for (uint32_t threads = 1; threads <= bench.maxThreads; threads *= 2) {
+        uint64_t best = (uint64_t)-1, total = 0;
+        scaler.init(threads);
+        // first scale grows the scratch buffers
+        for (uint32_t i = 0; i <= bench.iterations; i++) {
+            uint64_t start = benchTimeUs();
+            scaler.scale(src.image, NULL, thumb.image, 0);
+            uint64_t elapsed = benchTimeUs() - start;
+            if (i == 0) {
+                continue;
+            }
+            total += elapsed;
+            if (elapsed < best) {
+                best = elapsed;
+            }
+        }
+        fprintf(stderr, "%-10u%-12.2f%-12.2f%-10.1f\n", threads,
+                (double)best / 1000.0,
+                (double)total / 1000.0 / bench.iterations,
+                (double)width * height / (double)(best ? best : 1));
+    }
+    scaler.deinit();
+
+    if ((rc == 0) && (bench.outFilename != NULL)) {
+        FILE *fp = fopen(bench.outFilename, "wb");
+        if (fp != NULL) {
+            const thumb_scale_image_t &img = thumb.image;
+            for (uint32_t y = 0; y < img.height; y++) {
+                fwrite(img.y + y * img.yStride, 1, img.width, fp);
+            }
+            for (uint32_t y = 0; y < (img.height + 1) / 2; y++) {
+                fwrite(img.uv + y * img.uvStride, 1, img.width, fp);
+            }
+            fclose(fp);
+        } else {
+            fprintf(stderr, "cannot write %s\n", bench.outFilename);
+        }
+    }
+
+done:
+    free(src.buf);
+    free(thumb.buf);
+    return rc;
+}
+
+static void printUsage()
+{
+    fprintf(stderr, "Usage: qcamera-thumb-scaler-bench [options]\n");
+    fprintf(stderr, "  -I FILE\t\tNV21 input, needs -W and -H\n");
+    fprintf(stderr, "  -O FILE\t\tWrite the NV21 thumbnail\n");
+    fprintf(stderr, "  -W WIDTH\t\tImage width\n");
+    fprintf(stderr, "  -H HEIGHT\t\tImage height\n");
+    fprintf(stderr, "  -w WIDTH\t\tThumbnail width (default 512)\n");
+    fprintf(stderr, "  -h HEIGHT\t\tThumbnail height (default 384)\n");
+    fprintf(stderr, "  -n COUNT\t\tScales per run (default %d)\n",
+            DEFAULT_ITERATIONS);
+    fprintf(stderr, "  -t THREADS\t\tHighest thread count (default: CPUs)\n");
+    fprintf(stderr, "Without -W/-H 8MP and 13MP synthetic images are used\n");
+}
+
+int main(int argc, char *argv[])
+{
+    thumb_bench_t bench;
+    long cpus;
+    int c;
+
+    memset(&bench, 0, sizeof(bench));
+    bench.thumbWidth = 512;
+    bench.thumbHeight = 384;
+    bench.iterations = DEFAULT_ITERATIONS;
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    bench.maxThreads = (cpus > 0) ? (uint32_t)cpus : 1;
+
+    while ((c = getopt(argc, argv, "I:O:W:H:w:h:n:t:")) != -1) {
+        switch (c) {
+        case 'I':
+            bench.filename = optarg;
+            break;
+        case 'O':
+            bench.outFilename = optarg;
+            break;
+        case 'W':
+            bench.width[0] = (uint32_t)atoi(optarg);
+            break;
+        case 'H':
+            bench.height[0] = (uint32_t)atoi(optarg);
+            break;
+        case 'w':
+            bench.thumbWidth = (uint32_t)atoi(optarg);
+            break;
+        case 'h':
+            bench.thumbHeight = (uint32_t)atoi(optarg);
+            break;
+        case 'n':
+            bench.iterations = (uint32_t)atoi(optarg);
+            break;
+        case 't':
+            bench.maxThreads = (uint32_t)atoi(optarg);
+            break;
+        default:
+            printUsage();
+            return 1;
+        }
+    }
+
+    if (bench.width[0] && bench.height[0]) {
+        bench.numSizes = 1;
+    } else if (bench.filename != NULL) {
+        printUsage();
+        return 1;
+    } else {
+        bench.width[0] = 3264;
+        bench.height[0] = 2448;
+        bench.width[1] = 4160;
+        bench.height[1] = 3120;
+        bench.numSizes = 2;
+    }
+    if ((bench.thumbWidth == 0) || (bench.thumbHeight == 0)) {
+        printUsage();
+        return 1;
+    }
+    if (bench.iterations == 0) {
+        bench.iterations = 1;
+    }
+    if (bench.maxThreads == 0) {
+        bench.maxThreads = 1;
+    }
+    if (bench.maxThreads > MAX_BENCH_THREADS) {
+        bench.maxThreads = MAX_BENCH_THREADS;
+    }
+
+    for (uint32_t i = 0; i < bench.numSizes; i++) {
+        if (runSize(bench, bench.width[i], bench.height[i])) {
+            fprintf(stderr, "%-25s\n", "Fail!");
+            return 1;
+        }
+    }
+    fprintf(stderr, "%-25s\n", "Success!");
+    return 0;
+}